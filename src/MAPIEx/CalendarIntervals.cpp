@@ -0,0 +1,268 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: CalendarIntervals.cpp
+// Description: Interval tree over appointment times for conflict detection without MFC or MAPI
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// not built with the precompiled header, nothing from Windows may be used here
+#include "CalendarIntervals.h"
+#include <stdlib.h>
+#include <algorithm>
+
+/////////////////////////////////////////////////////////////
+// CCalendarIntervals
+
+CCalendarIntervals::CCalendarIntervals()
+{
+	m_nIndexed=0;
+	m_nDeleted=0;
+}
+
+void CCalendarIntervals::RemoveAll()
+{
+	m_arIntervals.clear();
+	m_arMaxEnd.clear();
+	m_arItemIntervals.clear();
+	m_arItemDeleted.clear();
+	m_nIndexed=0;
+	m_nDeleted=0;
+}
+
+// returns the new item's number
+int CCalendarIntervals::AddItem()
+{
+	m_arItemIntervals.push_back(0);
+	m_arItemDeleted.push_back(false);
+	return (int)m_arItemIntervals.size()-1;
+}
+
+// leaves nItem's intervals in place as tombstones until Compact, false if it was already removed
+bool CCalendarIntervals::RemoveItem(int nItem)
+{
+	if(nItem<0 || nItem>=GetItemCount() || m_arItemDeleted[nItem]) return false;
+	m_arItemDeleted[nItem]=true;
+	m_nDeleted+=m_arItemIntervals[nItem];
+	return true;
+}
+
+// appended to the delta, an end before the start is taken as the start
+void CCalendarIntervals::AddInterval(int nItem, uint64_t ullStart, uint64_t ullEnd, int nBusyStatus)
+{
+	CCalendarInterval interval;
+	interval.m_ullStart=ullStart;
+	interval.m_ullEnd=std::max(ullStart, ullEnd);
+	interval.m_nItem=nItem;
+	interval.m_nBusyStatus=nBusyStatus;
+	m_arIntervals.push_back(interval);
+	m_arItemIntervals[nItem]++;
+}
+
+// true once the delta and the tombstones get past an eighth of the index
+bool CCalendarIntervals::IsDeltaFull() const
+{
+	int nDelta=(int)m_arIntervals.size()-m_nIndexed+m_nDeleted;
+	return (nDelta>std::max((int)MIN_DELTA, m_nIndexed/8));
+}
+
+// drops removed items and their intervals, renumbering the rest.  arNewItems[i] is item i's new number or -1
+void CCalendarIntervals::Compact(std::vector<int>& arNewItems)
+{
+	int i, nItems=0, nIntervals=0;
+	arNewItems.resize(m_arItemIntervals.size());
+	for(i=0;i<(int)m_arItemIntervals.size();i++)
+	{
+		if(m_arItemDeleted[i])
+		{
+			arNewItems[i]=-1;
+			continue;
+		}
+		m_arItemIntervals[nItems]=m_arItemIntervals[i];
+		arNewItems[i]=nItems++;
+	}
+	m_arItemIntervals.resize(nItems);
+	m_arItemDeleted.assign(nItems, false);
+
+	for(i=0;i<(int)m_arIntervals.size();i++)
+	{
+		int nItem=arNewItems[m_arIntervals[i].m_nItem];
+		if(nItem<0) continue;
+		m_arIntervals[nIntervals]=m_arIntervals[i];
+		m_arIntervals[nIntervals++].m_nItem=nItem;
+	}
+	m_arIntervals.resize(nIntervals);
+	m_nIndexed=0;
+	m_nDeleted=0;
+}
+
+// sorts every interval into the tree and sets the subtree ends, compacting first if items were removed.  Call
+// Compact first to renumber anything kept per item
+void CCalendarIntervals::Build()
+{
+	if(m_nDeleted)
+	{
+		std::vector<int> arNewItems;
+		Compact(arNewItems);
+	}
+
+	int nIntervals=(int)m_arIntervals.size();
+	if(nIntervals) qsort(&m_arIntervals[0], nIntervals, sizeof(CCalendarInterval), CompareIntervals);
+	m_arMaxEnd.resize(nIntervals);
+	BuildMaxEnd(0, nIntervals);
+	m_nIndexed=nIntervals;
+}
+
+// m_arMaxEnd[middle of nLow..nHigh] is the largest end in nLow..nHigh, for the same split FindInTree uses
+uint64_t CCalendarIntervals::BuildMaxEnd(int nLow, int nHigh)
+{
+	if(nLow>=nHigh) return 0;
+	int nMid=(nLow+nHigh)/2;
+	uint64_t ullMax=GetEnd(m_arIntervals[nMid]);
+	ullMax=std::max(ullMax, BuildMaxEnd(nLow, nMid));
+	ullMax=std::max(ullMax, BuildMaxEnd(nMid+1, nHigh));
+	m_arMaxEnd[nMid]=ullMax;
+	return ullMax;
+}
+
+// Indexes of the intervals overlapping ullStart..ullEnd (end exclusive), the tree in start order then the
+// delta.  An empty range is treated as the point ullStart, nMaxMatches of 0 finds all.  Free time is left
+// out with bIgnoreFree and nIgnoreItem's intervals always are
+int CCalendarIntervals::Find(uint64_t ullStart, uint64_t ullEnd, std::vector<int>& arMatches, int nMaxMatches, bool bIgnoreFree, int nIgnoreItem) const
+{
+	arMatches.clear();
+	if(ullEnd<=ullStart) ullEnd=ullStart+1;
+	if(!FindInTree(0, m_nIndexed, ullStart, ullEnd, arMatches, nMaxMatches, bIgnoreFree, nIgnoreItem))
+	{
+		for(int i=m_nIndexed;i<(int)m_arIntervals.size();i++)
+		{
+			if(!Matches(i, ullStart, ullEnd, bIgnoreFree, nIgnoreItem)) continue;
+			arMatches.push_back(i);
+			if(nMaxMatches && (int)arMatches.size()>=nMaxMatches) break;
+		}
+	}
+	return (int)arMatches.size();
+}
+
+// In order walk of nLow..nHigh that skips subtrees ending before ullStart and stops at the first interval
+// starting after ullEnd.  Returns true once nMaxMatches are found
+bool CCalendarIntervals::FindInTree(int nLow, int nHigh, uint64_t ullStart, uint64_t ullEnd, std::vector<int>& arMatches, int nMaxMatches, bool bIgnoreFree, int nIgnoreItem) const
+{
+	while(nLow<nHigh)
+	{
+		int nMid=(nLow+nHigh)/2;
+		if(m_arMaxEnd[nMid]<=ullStart) return false;
+		if(FindInTree(nLow, nMid, ullStart, ullEnd, arMatches, nMaxMatches, bIgnoreFree, nIgnoreItem)) return true;
+		if(m_arIntervals[nMid].m_ullStart>=ullEnd) return false;
+
+		if(Matches(nMid, ullStart, ullEnd, bIgnoreFree, nIgnoreItem))
+		{
+			arMatches.push_back(nMid);
+			if(nMaxMatches && (int)arMatches.size()>=nMaxMatches) return true;
+		}
+		nLow=nMid+1;
+	}
+	return false;
+}
+
+// zero length intervals match at their start
+bool CCalendarIntervals::Matches(int nInterval, uint64_t ullStart, uint64_t ullEnd, bool bIgnoreFree, int nIgnoreItem) const
+{
+	const CCalendarInterval& interval=m_arIntervals[nInterval];
+	if(m_arItemDeleted[interval.m_nItem] || interval.m_nItem==nIgnoreItem) return false;
+	if(bIgnoreFree && interval.m_nBusyStatus==BUSY_FREE) return false;
+	return (interval.m_ullStart<ullEnd && GetEnd(interval)>ullStart);
+}
+
+// the intervals Find matched in start order, the delta isn't sorted so matches from it are sorted in
+void CCalendarIntervals::GetSorted(const std::vector<int>& arMatches, std::vector<CCalendarInterval>& arSorted) const
+{
+	int nMatches=(int)arMatches.size();
+	arSorted.resize(nMatches);
+	for(int i=0;i<nMatches;i++) arSorted[i]=m_arIntervals[arMatches[i]];
+	if(nMatches && arMatches[nMatches-1]>=m_nIndexed) qsort(&arSorted[0], nMatches, sizeof(CCalendarInterval), CompareIntervals);
+}
+
+// appends the count and INTERVAL_SIZE bytes per interval (start, end, item, busy status, little endian)
+void CCalendarIntervals::Write(std::vector<uint8_t>& arData) const
+{
+	arData.reserve(arData.size()+4+m_arIntervals.size()*INTERVAL_SIZE);
+	PutDWord(arData, (uint32_t)m_arIntervals.size());
+	for(size_t i=0;i<m_arIntervals.size();i++)
+	{
+		const CCalendarInterval& interval=m_arIntervals[i];
+		PutQWord(arData, interval.m_ullStart);
+		PutQWord(arData, interval.m_ullEnd);
+		PutDWord(arData, (uint32_t)interval.m_nItem);
+		PutDWord(arData, (uint32_t)interval.m_nBusyStatus);
+	}
+}
+
+// Reads what Write wrote up to pEnd, which must be the end of it, for the items already added.  The intervals
+// are built, false (and no intervals) if the data is cut short or refers to an unknown item
+bool CCalendarIntervals::Read(const uint8_t*& pData, const uint8_t* pEnd)
+{
+	m_arIntervals.clear();
+	m_arMaxEnd.clear();
+	m_nIndexed=0;
+	if(pEnd-pData<4) return false;
+	uint32_t dwCount=GetDWord(pData);
+	pData+=4;
+	if((uint64_t)(pEnd-pData)!=(uint64_t)dwCount*INTERVAL_SIZE) return false;
+
+	m_arIntervals.resize(dwCount);
+	for(uint32_t i=0;i<dwCount;i++,pData+=INTERVAL_SIZE)
+	{
+		CCalendarInterval& interval=m_arIntervals[i];
+		interval.m_ullStart=GetQWord(pData);
+		interval.m_ullEnd=GetQWord(pData+8);
+		interval.m_nItem=(int)GetDWord(pData+16);
+		interval.m_nBusyStatus=(int)GetDWord(pData+20);
+		if(interval.m_nItem<0 || interval.m_nItem>=GetItemCount() || interval.m_ullEnd<interval.m_ullStart)
+		{
+			m_arIntervals.clear();
+			return false;
+		}
+	}
+
+	for(uint32_t i=0;i<dwCount;i++) m_arItemIntervals[m_arIntervals[i].m_nItem]++;
+	Build();
+	return true;
+}
+
+// by start, then end
+int CCalendarIntervals::CompareIntervals(const void* p1, const void* p2)
+{
+	const CCalendarInterval* pInterval1=(const CCalendarInterval*)p1;
+	const CCalendarInterval* pInterval2=(const CCalendarInterval*)p2;
+	if(pInterval1->m_ullStart!=pInterval2->m_ullStart) return (pInterval1->m_ullStart<pInterval2->m_ullStart) ? -1 : 1;
+	if(pInterval1->m_ullEnd!=pInterval2->m_ullEnd) return (pInterval1->m_ullEnd<pInterval2->m_ullEnd) ? -1 : 1;
+	return 0;
+}
+
+void CCalendarIntervals::PutDWord(std::vector<uint8_t>& arData, uint32_t dwValue)
+{
+	for(int i=0;i<4;i++) arData.push_back((uint8_t)(dwValue>>(i*8)));
+}
+
+void CCalendarIntervals::PutQWord(std::vector<uint8_t>& arData, uint64_t ullValue)
+{
+	PutDWord(arData, (uint32_t)ullValue);
+	PutDWord(arData, (uint32_t)(ullValue>>32));
+}
+
+uint32_t CCalendarIntervals::GetDWord(const uint8_t* pData)
+{
+	return (uint32_t)pData[0]|((uint32_t)pData[1]<<8)|((uint32_t)pData[2]<<16)|((uint32_t)pData[3]<<24);
+}
+
+uint64_t CCalendarIntervals::GetQWord(const uint8_t* pData)
+{
+	return (uint64_t)GetDWord(pData)|((uint64_t)GetDWord(pData+4)<<32);
+}
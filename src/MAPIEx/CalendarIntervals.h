@@ -0,0 +1,88 @@
+#ifndef __CALENDARINTERVALS_H__
+#define __CALENDARINTERVALS_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: CalendarIntervals.h
+// Description: Interval tree over appointment times for conflict detection without MFC or MAPI
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Only the standard library is used here so the tree can be built and tested on any platform (see
+// src/TestCalendarIndex), CMAPICalendarIndex keeps the entry IDs, the lock and the folder around it
+
+#include <stdint.h>
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// CCalendarInterval
+
+// One appointment or occurrence in UTC ticks, m_nItem is the appointment it belongs to
+struct CCalendarInterval
+{
+	uint64_t m_ullStart;
+	uint64_t m_ullEnd;
+	int m_nItem;
+	int m_nBusyStatus;
+};
+
+/////////////////////////////////////////////////////////////
+// CCalendarIntervals
+
+// The intervals of numbered items.  Intervals below m_nIndexed are sorted by start and the array is used as
+// an implicit balanced tree (the middle of each range is its root) with the largest end of every subtree in
+// m_arMaxEnd, so overlap and point queries visit O(log n + k) intervals.  Intervals added after Build are a
+// delta searched linearly, removed items are tombstones until Compact.  Not thread safe
+class CCalendarIntervals
+{
+public:
+	CCalendarIntervals();
+
+	enum { MIN_DELTA=256, BUSY_FREE=0, INTERVAL_SIZE=24 };
+
+// Attributes
+public:
+	std::vector<CCalendarInterval> m_arIntervals;
+	std::vector<uint64_t> m_arMaxEnd;
+	std::vector<int> m_arItemIntervals;		// intervals per item
+	std::vector<bool> m_arItemDeleted;
+	int m_nIndexed;
+	int m_nDeleted;
+
+// Operations
+public:
+	void RemoveAll();
+	int AddItem();
+	bool RemoveItem(int nItem);
+	int GetItemCount() const { return (int)m_arItemIntervals.size(); }
+	bool IsDeleted(int nItem) const { return m_arItemDeleted[nItem]; }
+	void AddInterval(int nItem, uint64_t ullStart, uint64_t ullEnd, int nBusyStatus);
+	bool IsDeltaFull() const;
+	void Compact(std::vector<int>& arNewItems);
+	void Build();
+	int Find(uint64_t ullStart, uint64_t ullEnd, std::vector<int>& arMatches, int nMaxMatches=0, bool bIgnoreFree=false, int nIgnoreItem=-1) const;
+	bool Matches(int nInterval, uint64_t ullStart, uint64_t ullEnd, bool bIgnoreFree, int nIgnoreItem) const;
+	void GetSorted(const std::vector<int>& arMatches, std::vector<CCalendarInterval>& arSorted) const;
+	void Write(std::vector<uint8_t>& arData) const;
+	bool Read(const uint8_t*& pData, const uint8_t* pEnd);
+
+	static uint64_t GetEnd(const CCalendarInterval& interval) { return (interval.m_ullEnd>interval.m_ullStart) ? interval.m_ullEnd : interval.m_ullStart+1; }
+	static int CompareIntervals(const void* p1, const void* p2);
+
+protected:
+	uint64_t BuildMaxEnd(int nLow, int nHigh);
+	bool FindInTree(int nLow, int nHigh, uint64_t ullStart, uint64_t ullEnd, std::vector<int>& arMatches, int nMaxMatches, bool bIgnoreFree, int nIgnoreItem) const;
+	static void PutDWord(std::vector<uint8_t>& arData, uint32_t dwValue);
+	static void PutQWord(std::vector<uint8_t>& arData, uint64_t ullValue);
+	static uint32_t GetDWord(const uint8_t* pData);
+	static uint64_t GetQWord(const uint8_t* pData);
+};
+
+#endif
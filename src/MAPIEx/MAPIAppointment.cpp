@@ -57,6 +57,28 @@ BOOL CMAPIAppointment::SetPropertyString(ULONG ulProperty, LPCTSTR szProperty, B
 
 #else
 
+// Creates an appointment in pFolder, or the calendar if there's no current folder.  Without bDefaults the
+// message class, importance and sensitivity are left to the caller's own SetProps (see
+// CMAPIAppointmentLoader::Write)
+BOOL CMAPIAppointment::Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder, BOOL bDefaults)
+{
+	if(!pMAPI) return FALSE;
+	if(!pFolder) pFolder=pMAPI->GetFolder();
+	if(!pFolder) pFolder=pMAPI->OpenCalendar();
+	if(!CMAPIObject::Create(pMAPI, pFolder)) return FALSE;
+	if(!bDefaults) return TRUE;
+
+	SPropValue props[3];
+	props[0].ulPropTag=PR_MESSAGE_CLASS;
+	props[0].Value.LPSZ=_T("IPM.Appointment");
+	props[1].ulPropTag=PR_IMPORTANCE;
+	props[1].Value.l=1;
+	props[2].ulPropTag=PR_SENSITIVITY;
+	props[2].Value.l=0;
+	Message()->SetProps(3, props, NULL);
+	return TRUE;
+}
+
 BOOL CMAPIAppointment::GetSubject(CString& strSubject)
 {
 	if(GetPropertyString(PR_SUBJECT, strSubject)) return TRUE;
@@ -127,6 +149,46 @@ BOOL CMAPIAppointment::GetEndTime(CString& strEndTime, LPCTSTR szFormat)
 	return FALSE;
 }
 
+// reads the AppointmentRecur blob and the time zone it was created in with one GetProps, blobs too large for
+// GetProps are read through a stream
+BOOL CMAPIAppointment::GetRecurrence(CMAPIRecurrence& recurrence)
+{
+	recurrence.Empty();
+	const ULONG RecurrenceIDs[]={ CMAPIRecurrence::OUTLOOK_APPOINTMENT_RECUR, CMAPIRecurrence::OUTLOOK_TIMEZONE_STRUCT };
+	CMAPIProperties props;
+	if(!GetOutlookProperties(OUTLOOK_DATA2, RecurrenceIDs, 2, props) || props.GetCount()<2) return FALSE;
+
+	// the ANSI exception strings are in the message's code page
+	recurrence.m_nCodePage=(UINT)GetPropertyValue(PR_MESSAGE_CODEPAGE, CP_ACP);
+
+	SBinary* pTimeZone=props.GetBinary(1);
+	if(pTimeZone) recurrence.SetTimeZone(pTimeZone->lpb, pTimeZone->cb);
+
+	SBinary* pRecur=props.GetBinary(0);
+	if(pRecur) return recurrence.Parse(pRecur->lpb, pRecur->cb);
+
+	LPSPropValue pProp=props.GetProps();
+	if(PROP_TYPE(pProp->ulPropTag)!=PT_ERROR || pProp->Value.err!=MAPI_E_NOT_ENOUGH_MEMORY) return FALSE;
+
+	IStream* pStream;
+	ULONG ulPropTag=PROP_TAG(PT_BINARY, PROP_ID(pProp->ulPropTag));
+	if(Message()->OpenProperty(ulPropTag, &IID_IStream, STGM_READ, NULL, (LPUNKNOWN*)&pStream)!=S_OK) return FALSE;
+
+	const int BUF_SIZE=16384;
+	CArray<BYTE, BYTE> arData;
+	ULONG ulRead;
+	do 
+	{
+		int nSize=(int)arData.GetSize();
+		arData.SetSize(nSize+BUF_SIZE);
+		if(pStream->Read(arData.GetData()+nSize, BUF_SIZE, &ulRead)!=S_OK) ulRead=0;
+		arData.SetSize(nSize+ulRead);
+	} while(ulRead>=BUF_SIZE);
+	RELEASE(pStream);
+
+	return recurrence.Parse(arData.GetData(), (ULONG)arData.GetSize());
+}
+
 BOOL CMAPIAppointment::SetSubject(LPCTSTR szSubject)
 {
 	return SetPropertyString(PR_SUBJECT, szSubject);
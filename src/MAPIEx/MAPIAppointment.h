@@ -17,6 +17,7 @@
 
 class CMAPIEx;
 class CMAPIAppointment;
+class CMAPIRecurrence;
 
 #ifdef _WIN32_WCE
 #include "POOM.h"
@@ -50,12 +51,15 @@ public:
 	virtual BOOL GetPropertyString(ULONG ulProperty, CString& strProperty, BOOL bStream=FALSE);
 	virtual BOOL SetPropertyString(ULONG ulProperty, LPCTSTR szProperty, BOOL bStream=FALSE);
 #else
+	BOOL Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder=NULL, BOOL bDefaults=TRUE);
+
 	BOOL GetSubject(CString& strSubject);
 	BOOL GetLocation(CString& strLocation);
 	BOOL GetStartTime(SYSTEMTIME& tmStart);
 	BOOL GetStartTime(CString& strStartTime, LPCTSTR szFormat=NULL); // NULL defaults to "MM/dd/yyyy hh:mm:ss tt"
 	BOOL GetEndTime(SYSTEMTIME& tmEnd);
 	BOOL GetEndTime(CString& strEndTime, LPCTSTR szFormat=NULL); // NULL defaults to "MM/dd/yyyy hh:mm:ss tt"
+	BOOL GetRecurrence(CMAPIRecurrence& recurrence);
 
 	BOOL SetSubject(LPCTSTR szSubject);
 	BOOL SetLocation(LPCTSTR szLocation);
@@ -0,0 +1,406 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIAppointmentLoader.cpp
+// Description: Reads appointments into plain records and queries a calendar by date range
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+const ULONG AppointmentTags[]={ PR_MESSAGE_FLAGS, PR_ENTRYID, PR_LAST_MODIFICATION_TIME, PR_SUBJECT };
+
+/////////////////////////////////////////////////////////////
+// CAppointmentRecord
+
+CAppointmentRecord::CAppointmentRecord()
+{
+	Empty();
+}
+
+void CAppointmentRecord::Empty()
+{
+	m_entryID.Empty();
+	m_ftLastModified.dwLowDateTime=m_ftLastModified.dwHighDateTime=0;
+	m_strSubject.Empty();
+	m_strLocation.Empty();
+	m_ftStart.dwLowDateTime=m_ftStart.dwHighDateTime=0;
+	m_ftEnd.dwLowDateTime=m_ftEnd.dwHighDateTime=0;
+	m_bRecurring=FALSE;
+	m_nBusyStatus=-1;
+	m_bAllDay=FALSE;
+}
+
+BOOL CAppointmentRecord::GetStartTime(SYSTEMTIME& tmStart)
+{
+	if(!m_ftStart.dwLowDateTime && !m_ftStart.dwHighDateTime) return FALSE;
+
+	SYSTEMTIME tmUTC;
+	FileTimeToSystemTime(&m_ftStart, &tmUTC);
+	return SystemTimeToTzSpecificLocalTime(NULL, &tmUTC, &tmStart);
+}
+
+BOOL CAppointmentRecord::GetEndTime(SYSTEMTIME& tmEnd)
+{
+	if(!m_ftEnd.dwLowDateTime && !m_ftEnd.dwHighDateTime) return FALSE;
+
+	SYSTEMTIME tmUTC;
+	FileTimeToSystemTime(&m_ftEnd, &tmUTC);
+	return SystemTimeToTzSpecificLocalTime(NULL, &tmUTC, &tmEnd);
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIAppointmentLoader
+
+CMAPIAppointmentLoader::CMAPIAppointmentLoader()
+{
+	m_pTags=NULL;
+	for(int i=0;i<WRITE_TAGS;i++) m_ulWriteTags[i]=PR_NULL;
+}
+
+CMAPIAppointmentLoader::~CMAPIAppointmentLoader()
+{
+	Release();
+}
+
+// pProp is anything in the store the appointments live in, named property IDs are per store so Init again
+// before loading appointments from another store.  Use bCreate before writing to a store that may not have
+// seen an appointment yet
+BOOL CMAPIAppointmentLoader::Init(IMAPIProp* pProp, BOOL bCreate)
+{
+	Release();
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	if(!pProp) return FALSE;
+
+	const GUID guidOutlookData2={CMAPIAppointment::OUTLOOK_DATA2, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+
+	// named properties in PROP_START..APPOINTMENT_COLS order followed by the WRITE_ ones
+	const int nColumns=APPOINTMENT_COLS-PROP_START, nNamed=nColumns+WRITE_TAGS;
+	const ULONG NamedIDs[nNamed]={ CMAPIAppointment::OUTLOOK_APPOINTMENT_START, CMAPIAppointment::OUTLOOK_APPOINTMENT_END,
+		CMAPIAppointment::OUTLOOK_APPOINTMENT_LOCATION, OUTLOOK_RECURRING, OUTLOOK_CLIP_START, OUTLOOK_CLIP_END, OUTLOOK_BUSY_STATUS,
+		OUTLOOK_ALL_DAY,		CMAPIRecurrence::OUTLOOK_APPOINTMENT_RECUR, CMAPIRecurrence::OUTLOOK_TIMEZONE_STRUCT, OUTLOOK_RECURRENCE_TYPE
+	};
+	const ULONG NamedTypes[nNamed]={ PT_SYSTIME, PT_SYSTIME, PT_TSTRING, PT_BOOLEAN, PT_SYSTIME, PT_SYSTIME, PT_LONG, PT_BOOLEAN, PT_BINARY, PT_BINARY, PT_LONG };
+
+	MAPINAMEID nameIDs[nNamed];
+	LPMAPINAMEID lpNameIDs[nNamed];
+	int i;
+	for(i=0;i<nNamed;i++)
+	{
+		nameIDs[i].lpguid=(GUID*)&guidOutlookData2;
+		nameIDs[i].ulKind=MNID_ID;
+		nameIDs[i].Kind.lID=NamedIDs[i];
+		lpNameIDs[i]=&nameIDs[i];
+	}
+
+	LPSPropTagArray pNamedTags=NULL;
+	if(FAILED(pProp->GetIDsFromNames(nNamed, lpNameIDs, bCreate ? MAPI_CREATE : 0, &pNamedTags))) return FALSE;
+
+	if(MAPIAllocateBuffer(CbNewSPropTagArray(APPOINTMENT_COLS), (LPVOID*)&m_pTags)!=S_OK)
+	{
+		MAPIFreeBuffer(pNamedTags);
+		return FALSE;
+	}
+
+	m_pTags->cValues=APPOINTMENT_COLS;
+	for(i=0;i<PROP_START;i++) m_pTags->aulPropTag[i]=AppointmentTags[i];
+
+	// see CMAPIContactLoader::Init, missing named properties become empty columns
+	for(i=0;i<nNamed;i++)
+	{
+		ULONG ulTag=pNamedTags->aulPropTag[i];
+		ulTag=(PROP_TYPE(ulTag)==PT_ERROR) ? PR_NULL : PROP_TAG(NamedTypes[i], PROP_ID(ulTag));
+		if(i<nColumns) m_pTags->aulPropTag[PROP_START+i]=ulTag;
+		else m_ulWriteTags[i-nColumns]=ulTag;
+	}
+	MAPIFreeBuffer(pNamedTags);
+	return TRUE;
+#endif
+}
+
+void CMAPIAppointmentLoader::Release()
+{
+	if(m_pTags) MAPIFreeBuffer(m_pTags);
+	m_pTags=NULL;
+	for(int i=0;i<WRITE_TAGS;i++) m_ulWriteTags[i]=PR_NULL;
+}
+
+BOOL CMAPIAppointmentLoader::Load(CMAPIAppointment& appointment, CAppointmentRecord& record)
+{
+	return Load(appointment.Message(), record);
+}
+
+BOOL CMAPIAppointmentLoader::Load(IMAPIProp* pAppointment, CAppointmentRecord& record)
+{
+	if(!m_pTags || !pAppointment)
+	{
+		record.Empty();
+		return FALSE;
+	}
+
+	CMAPIProperties props;
+	ULONG ulCount=0;
+	LPSPropValue pProps=NULL;
+	if(FAILED(pAppointment->GetProps(m_pTags, CMAPIEx::cm_nMAPICode, &ulCount, &pProps))) return FALSE;
+	props.Attach(pProps, ulCount);
+
+	Fill(props.GetProps(), props.GetCount(), record);
+	return TRUE;
+}
+
+// pProps is laid out like GetTags(), either from GetProps or a contents table row
+void CMAPIAppointmentLoader::Fill(LPSPropValue pProps, ULONG ulCount, CAppointmentRecord& record)
+{
+	record.Empty();
+	if(!pProps || ulCount<APPOINTMENT_COLS) return;
+
+	if(PROP_TYPE(pProps[PROP_ENTRYID].ulPropTag)==PT_BINARY) record.m_entryID=pProps[PROP_ENTRYID].Value.bin;
+	if(PROP_TYPE(pProps[PROP_LAST_MODIFIED].ulPropTag)==PT_SYSTIME) record.m_ftLastModified=pProps[PROP_LAST_MODIFIED].Value.ft;
+	record.m_strSubject=GetString(pProps, ulCount, PROP_SUBJECT);
+	record.m_strLocation=GetString(pProps, ulCount, PROP_LOCATION);
+	if(PROP_TYPE(pProps[PROP_START].ulPropTag)==PT_SYSTIME) record.m_ftStart=pProps[PROP_START].Value.ft;
+	if(PROP_TYPE(pProps[PROP_END].ulPropTag)==PT_SYSTIME) record.m_ftEnd=pProps[PROP_END].Value.ft;
+	if(PROP_TYPE(pProps[PROP_RECURRING].ulPropTag)==PT_BOOLEAN) record.m_bRecurring=(pProps[PROP_RECURRING].Value.b!=0);
+	if(PROP_TYPE(pProps[PROP_BUSY_STATUS].ulPropTag)==PT_LONG) record.m_nBusyStatus=pProps[PROP_BUSY_STATUS].Value.l;
+	if(PROP_TYPE(pProps[PROP_ALL_DAY].ulPropTag)==PT_BOOLEAN) record.m_bAllDay=(pProps[PROP_ALL_DAY].Value.b!=0);
+}
+
+// Writes record to a new or open appointment with a single SetProps, call Save afterwards.  bNew adds the
+// defaults CMAPIAppointment::Create sets, for appointments created without them.  A single appointment gets
+// its start and end as the clip range like Outlook does.  With pRecurrence the appointment is recurring:
+// record holds its first occurrence, the pattern and its time zone are written as the AppointmentRecur and
+// TimeZoneStruct blobs and the clip range runs from the day of the first occurrence to the end of the last
+BOOL CMAPIAppointmentLoader::Write(CMAPIAppointment& appointment, CAppointmentRecord& record, BOOL bNew, CMAPIRecurrence* pRecurrence)
+{
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	if(!m_pTags || !appointment.Message()) return FALSE;
+	if(pRecurrence && (GetTag(PROP_RECURRING)==PR_NULL || m_ulWriteTags[WRITE_RECURRENCE]==PR_NULL)) return FALSE;
+
+	SPropValue props[APPOINTMENT_COLS+5+WRITE_TAGS];
+	ULONG ulCount=0;
+	if(record.m_strSubject.GetLength())
+	{
+		props[ulCount].ulPropTag=PR_SUBJECT;
+		props[ulCount++].Value.LPSZ=(LPTSTR)(LPCTSTR)record.m_strSubject;
+	}
+	if(record.m_strLocation.GetLength() && GetTag(PROP_LOCATION)!=PR_NULL)
+	{
+		props[ulCount].ulPropTag=GetTag(PROP_LOCATION);
+		props[ulCount++].Value.LPSZ=(LPTSTR)(LPCTSTR)record.m_strLocation;
+	}
+
+	BOOL bStart=(record.m_ftStart.dwLowDateTime || record.m_ftStart.dwHighDateTime);
+	BOOL bEnd=(record.m_ftEnd.dwLowDateTime || record.m_ftEnd.dwHighDateTime);
+	FILETIME ftClipStart=record.m_ftStart, ftClipEnd=record.m_ftEnd;
+	CByteArray arRecurrence, arTimeZone;
+	if(pRecurrence)
+	{
+		// the end of the last occurrence rather than Outlook's midnight before it, so Restrict still finds it
+		CRecurrenceIterator it;
+		FILETIME ftNone={ 0, 0 };
+		it.Begin(*pRecurrence, ftNone, ftNone);
+		CMAPIRecurrence::MinutesToFileTime(it.LocalToUTC(pRecurrence->m_dwStartDate), ftClipStart);
+		DWORD dwClipEnd=CMAPIRecurrence::END_DATE_NEVER+CMAPIRecurrence::MINUTES_PER_DAY-1;
+		if(pRecurrence->HasEndDate()) dwClipEnd=it.LocalToUTC(pRecurrence->m_dwEndDate+pRecurrence->m_dwEndTimeOffset);
+		CMAPIRecurrence::MinutesToFileTime(dwClipEnd, ftClipEnd);
+		bStart=bEnd=TRUE;
+
+		pRecurrence->Write(arRecurrence);
+		props[ulCount].ulPropTag=m_ulWriteTags[WRITE_RECURRENCE];
+		props[ulCount].Value.bin.cb=(ULONG)arRecurrence.GetSize();
+		props[ulCount++].Value.bin.lpb=arRecurrence.GetData();
+		if(pRecurrence->WriteTimeZone(arTimeZone) && m_ulWriteTags[WRITE_TIMEZONE]!=PR_NULL)
+		{
+			props[ulCount].ulPropTag=m_ulWriteTags[WRITE_TIMEZONE];
+			props[ulCount].Value.bin.cb=(ULONG)arTimeZone.GetSize();
+			props[ulCount++].Value.bin.lpb=arTimeZone.GetData();
+		}
+		if(m_ulWriteTags[WRITE_RECURRENCE_TYPE]!=PR_NULL)
+		{
+			props[ulCount].ulPropTag=m_ulWriteTags[WRITE_RECURRENCE_TYPE];
+			props[ulCount++].Value.l=RECURRENCE_TYPE_DAILY+(pRecurrence->m_wFrequency-CMAPIRecurrence::FREQUENCY_DAILY);
+		}
+	}
+
+	const int TimeColumns[]={ PROP_START, PROP_CLIP_START, PROP_END, PROP_CLIP_END };
+	const FILETIME* pTimes[]={ &record.m_ftStart, &ftClipStart, &record.m_ftEnd, &ftClipEnd };
+	for(int i=0;i<4;i++)
+	{
+		BOOL bStartColumn=(i<2);
+		if(GetTag(TimeColumns[i])==PR_NULL || !(bStartColumn ? bStart : bEnd)) continue;
+		props[ulCount].ulPropTag=GetTag(TimeColumns[i]);
+		props[ulCount++].Value.ft=*pTimes[i];
+	}
+	if(bStart)
+	{
+		props[ulCount].ulPropTag=PR_START_DATE;
+		props[ulCount++].Value.ft=record.m_ftStart;
+	}
+	if(bEnd)
+	{
+		props[ulCount].ulPropTag=PR_END_DATE;
+		props[ulCount++].Value.ft=record.m_ftEnd;
+	}
+	if(GetTag(PROP_RECURRING)!=PR_NULL)
+	{
+		props[ulCount].ulPropTag=GetTag(PROP_RECURRING);
+		props[ulCount++].Value.b=(pRecurrence!=NULL);
+	}
+	if(record.m_nBusyStatus>=0 && GetTag(PROP_BUSY_STATUS)!=PR_NULL)
+	{
+		props[ulCount].ulPropTag=GetTag(PROP_BUSY_STATUS);
+		props[ulCount++].Value.l=record.m_nBusyStatus;
+	}
+	if(record.m_bAllDay && GetTag(PROP_ALL_DAY)!=PR_NULL)
+	{
+		props[ulCount].ulPropTag=GetTag(PROP_ALL_DAY);
+		props[ulCount++].Value.b=TRUE;
+	}
+	if(bNew)
+	{
+		props[ulCount].ulPropTag=PR_MESSAGE_CLASS;
+		props[ulCount++].Value.LPSZ=(LPTSTR)_T("IPM.Appointment");
+		props[ulCount].ulPropTag=PR_IMPORTANCE;
+		props[ulCount++].Value.l=IMPORTANCE_NORMAL;
+		props[ulCount].ulPropTag=PR_SENSITIVITY;
+		props[ulCount++].Value.l=SENSITIVITY_NONE;
+	}
+	return (appointment.Message()->SetProps(ulCount, props, NULL)==S_OK);
+#endif
+}
+
+// Restricts pTable to the appointments (IPM.Appointment and custom forms derived from it) overlapping
+// ftStart..ftEnd (UTC) and sorts them by start time, the store does the filtering so only those rows are returned.  A recurring appointment's start and end are its
+// first occurrence's so it is matched on its clip range (first occurrence to end of the series) instead.
+// TBL_BATCH lets the provider apply the columns, restriction and sort together on the first QueryRows
+BOOL CMAPIAppointmentLoader::Restrict(LPMAPITABLE pTable, FILETIME& ftStart, FILETIME& ftEnd)
+{
+	if(!m_pTags || !pTable) return FALSE;
+
+	ULONG ulStart=GetTag(PROP_START), ulEnd=GetTag(PROP_END), ulRecurring=GetTag(PROP_RECURRING);
+	ULONG ulClipStart=GetTag(PROP_CLIP_START), ulClipEnd=GetTag(PROP_CLIP_END);
+
+	SRestriction resAll, resTerms[2], resOr[2], resSingle[4], resRecurring[6], resNone;
+	SRestriction& res=resTerms[1];
+	SPropValue values[5], propClass;
+	if(ulStart==PR_NULL || ulEnd==PR_NULL)
+	{
+		// the store has never seen an appointment, nothing can match
+		res.rt=RES_NOT;
+		res.res.resNot.lpRes=&resNone;
+		resNone.rt=RES_EXIST;
+		resNone.res.resExist.ulPropTag=PR_ENTRYID;
+		resNone.res.resExist.ulReserved1=resNone.res.resExist.ulReserved2=0;
+	}
+	else
+	{
+		resOr[0].rt=RES_AND;
+		resOr[0].res.resAnd.cRes=SetOverlap(resSingle, values, ulStart, ulEnd, ftStart, ftEnd);
+		resOr[0].res.resAnd.lpRes=resSingle;
+
+		res.rt=RES_OR;
+		res.res.resOr.cRes=1;
+		res.res.resOr.lpRes=resOr;
+		if(ulRecurring!=PR_NULL && ulClipStart!=PR_NULL && ulClipEnd!=PR_NULL)
+		{
+			resRecurring[0].rt=RES_EXIST;
+			resRecurring[0].res.resExist.ulPropTag=ulRecurring;
+			resRecurring[0].res.resExist.ulReserved1=resRecurring[0].res.resExist.ulReserved2=0;
+			values[4].ulPropTag=ulRecurring;
+			values[4].Value.b=TRUE;
+			resRecurring[1].rt=RES_PROPERTY;
+			resRecurring[1].res.resProperty.relop=RELOP_EQ;
+			resRecurring[1].res.resProperty.ulPropTag=ulRecurring;
+			resRecurring[1].res.resProperty.lpProp=&values[4];
+
+			resOr[1].rt=RES_AND;
+			resOr[1].res.resAnd.cRes=2+SetOverlap(resRecurring+2, values+2, ulClipStart, ulClipEnd, ftStart, ftEnd);
+			resOr[1].res.resAnd.lpRes=resRecurring;
+			res.res.resOr.cRes=2;
+		}
+	}
+
+	propClass.ulPropTag=PR_MESSAGE_CLASS;
+	propClass.Value.LPSZ=(LPTSTR)_T("IPM.Appointment");
+	resTerms[0].rt=RES_CONTENT;
+	resTerms[0].res.resContent.ulFuzzyLevel=FL_PREFIX | FL_IGNORECASE;
+	resTerms[0].res.resContent.ulPropTag=PR_MESSAGE_CLASS;
+	resTerms[0].res.resContent.lpProp=&propClass;
+	resAll.rt=RES_AND;
+	resAll.res.resAnd.cRes=2;
+	resAll.res.resAnd.lpRes=resTerms;
+	if(pTable->Restrict(&resAll, TBL_BATCH)!=S_OK) return FALSE;
+
+	SizedSSortOrderSet(1, SortColums)={1, 0, 0, {{ulStart, TABLE_SORT_ASCEND}}};
+	return (ulStart==PR_NULL || pTable->SortTable((LPSSortOrderSet)&SortColums, TBL_BATCH)==S_OK);
+}
+
+// the class test of Restrict for a single item, for notifications
+BOOL CMAPIAppointmentLoader::IsAppointment(IMAPIProp* pProp)
+{
+	if(!pProp) return FALSE;
+
+	SizedSPropTagArray(1, Tags)={1,{PR_MESSAGE_CLASS}};
+	ULONG ulCount=0;
+	LPSPropValue pProps=NULL;
+	if(FAILED(pProp->GetProps((LPSPropTagArray)&Tags, CMAPIEx::cm_nMAPICode, &ulCount, &pProps))) return FALSE;
+
+	LPCTSTR szClass=CMAPIEx::GetValidString(pProps[0]);
+	BOOL bAppointment=(szClass && !_tcsnicmp(szClass, _T("IPM.Appointment"), 15));
+	MAPIFreeBuffer(pProps);
+	return bAppointment;
+}
+
+#ifndef _WIN32_WCE
+// tm is local time like the CMAPIAppointment getters and setters
+BOOL CMAPIAppointmentLoader::LocalToFileTime(SYSTEMTIME& tm, FILETIME& ft)
+{
+	SYSTEMTIME tmUTC;
+	if(!TzSpecificLocalTimeToSystemTime(NULL, &tm, &tmUTC)) return FALSE;
+	return SystemTimeToFileTime(&tmUTC, &ft);
+}
+#endif
+
+LPCTSTR CMAPIAppointmentLoader::GetString(LPSPropValue pProps, ULONG ulCount, int nIndex)
+{
+	if((ULONG)nIndex>=ulCount || PROP_TYPE(pProps[nIndex].ulPropTag)!=PT_TSTRING) return NULL;
+	return pProps[nIndex].Value.LPSZ;
+}
+
+// fills 4 terms (both properties exist, starts before ftEnd and ends after ftStart) for a RES_AND, an
+// appointment ending exactly at ftStart or starting exactly at ftEnd doesn't overlap
+int CMAPIAppointmentLoader::SetOverlap(SRestriction* pTerms, SPropValue* pValues, ULONG ulStartTag, ULONG ulEndTag, FILETIME& ftStart, FILETIME& ftEnd)
+{
+	pTerms[0].rt=RES_EXIST;
+	pTerms[0].res.resExist.ulPropTag=ulStartTag;
+	pTerms[0].res.resExist.ulReserved1=pTerms[0].res.resExist.ulReserved2=0;
+	pTerms[1].rt=RES_EXIST;
+	pTerms[1].res.resExist.ulPropTag=ulEndTag;
+	pTerms[1].res.resExist.ulReserved1=pTerms[1].res.resExist.ulReserved2=0;
+
+	pValues[0].ulPropTag=ulStartTag;
+	pValues[0].Value.ft=ftEnd;
+	pTerms[2].rt=RES_PROPERTY;
+	pTerms[2].res.resProperty.relop=RELOP_LT;
+	pTerms[2].res.resProperty.ulPropTag=ulStartTag;
+	pTerms[2].res.resProperty.lpProp=&pValues[0];
+
+	pValues[1].ulPropTag=ulEndTag;
+	pValues[1].Value.ft=ftStart;
+	pTerms[3].rt=RES_PROPERTY;
+	pTerms[3].res.resProperty.relop=RELOP_GT;
+	pTerms[3].res.resProperty.ulPropTag=ulEndTag;
+	pTerms[3].res.resProperty.lpProp=&pValues[1];
+	return 4;
+}
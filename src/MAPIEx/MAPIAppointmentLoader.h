@@ -0,0 +1,109 @@
+#ifndef __MAPIAPPOINTMENTLOADER_H__
+#define __MAPIAPPOINTMENTLOADER_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIAppointmentLoader.h
+// Description: Reads appointments into plain records and queries a calendar by date range
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CAppointmentRecord
+
+// Snapshot of an appointment, times are UTC like they are stored, use GetStartTime etc for local time.
+// m_nBusyStatus is -1 when the appointment doesn't have one
+class AFX_EXT_CLASS CAppointmentRecord
+{
+public:
+	CAppointmentRecord();
+
+// Attributes
+public:
+	CMAPIEntryID m_entryID;
+	FILETIME m_ftLastModified;
+	CString m_strSubject;
+	CString m_strLocation;
+	FILETIME m_ftStart;
+	FILETIME m_ftEnd;
+	BOOL m_bRecurring;
+	int m_nBusyStatus;
+	BOOL m_bAllDay;	// m_ftStart and m_ftEnd are local midnights
+
+// Operations
+public:
+	void Empty();
+	BOOL GetStartTime(SYSTEMTIME& tmStart);
+	BOOL GetEndTime(SYSTEMTIME& tmEnd);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIAppointmentLoader
+
+// Resolves the Outlook named properties of an appointment once (per store) and fills a CAppointmentRecord
+// from one GetProps or a contents table row.  CMAPIFolder::GetAppointmentContents uses it to list only the
+// appointments in a date range:
+//
+//		CMAPIAppointmentLoader loader;
+//		if(pFolder->GetAppointmentContents(loader, tmStart, tmEnd))
+//		{
+//			while(pFolder->GetNextAppointment(record)) ...
+//		}
+class AFX_EXT_CLASS CMAPIAppointmentLoader
+{
+public:
+	CMAPIAppointmentLoader();
+	~CMAPIAppointmentLoader();
+
+	enum { OUTLOOK_BUSY_STATUS=0x8205, OUTLOOK_ALL_DAY=0x8215, OUTLOOK_RECURRING=0x8223, OUTLOOK_RECURRENCE_TYPE=0x8231, OUTLOOK_CLIP_START=0x8235, OUTLOOK_CLIP_END=0x8236 };
+	enum { RECURRENCE_TYPE_DAILY=1, RECURRENCE_TYPE_WEEKLY, RECURRENCE_TYPE_MONTHLY, RECURRENCE_TYPE_YEARLY };
+
+	// column layout of GetTags(), the first two columns match CMAPIFolder::GetContents
+	enum { PROP_MESSAGE_FLAGS, PROP_ENTRYID, PROP_LAST_MODIFIED, PROP_SUBJECT, PROP_START, PROP_END, PROP_LOCATION,
+		PROP_RECURRING, PROP_CLIP_START, PROP_CLIP_END, PROP_BUSY_STATUS, PROP_ALL_DAY, APPOINTMENT_COLS
+	};
+
+	// properties only Write sets, too big or not needed for a table
+	enum { WRITE_RECURRENCE, WRITE_TIMEZONE, WRITE_RECURRENCE_TYPE, WRITE_TAGS };
+
+// Attributes
+protected:
+	LPSPropTagArray m_pTags;
+	ULONG m_ulWriteTags[WRITE_TAGS];
+
+// Operations
+public:
+	BOOL Init(IMAPIProp* pProp, BOOL bCreate=FALSE);
+	void Release();
+	BOOL IsInitialized() { return (m_pTags!=NULL); }
+	LPSPropTagArray GetTags() { return m_pTags; }
+	ULONG GetTag(int nIndex) { return (m_pTags && nIndex>=0 && nIndex<APPOINTMENT_COLS) ? m_pTags->aulPropTag[nIndex] : PR_NULL; }
+
+	BOOL Load(CMAPIAppointment& appointment, CAppointmentRecord& record);
+	BOOL Load(IMAPIProp* pAppointment, CAppointmentRecord& record);
+	static void Fill(LPSPropValue pProps, ULONG ulCount, CAppointmentRecord& record);
+	BOOL Write(CMAPIAppointment& appointment, CAppointmentRecord& record, BOOL bNew=FALSE, CMAPIRecurrence* pRecurrence=NULL);
+	BOOL Restrict(LPMAPITABLE pTable, FILETIME& ftStart, FILETIME& ftEnd);
+	static BOOL IsAppointment(IMAPIProp* pProp);
+
+#ifndef _WIN32_WCE
+	static BOOL LocalToFileTime(SYSTEMTIME& tm, FILETIME& ft);
+#endif
+
+protected:
+	static LPCTSTR GetString(LPSPropValue pProps, ULONG ulCount, int nIndex);
+	static int SetOverlap(SRestriction* pTerms, SPropValue* pValues, ULONG ulStartTag, ULONG ulEndTag, FILETIME& ftStart, FILETIME& ftEnd);
+
+private:
+	CMAPIAppointmentLoader(const CMAPIAppointmentLoader&);
+	CMAPIAppointmentLoader& operator=(const CMAPIAppointmentLoader&);
+};
+
+#endif
@@ -0,0 +1,581 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPICalendarIndex.cpp
+// Description: In memory interval index over a calendar for conflict detection
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+#define INDEX_FILE_MAGIC 0x5849434D // "MCIX"
+#define INDEX_FILE_GROW_BY 65536
+
+/////////////////////////////////////////////////////////////
+// CCalendarIndexResult
+
+CCalendarIndexResult::CCalendarIndexResult()
+{
+	memset(&m_ftStart, 0, sizeof(FILETIME));
+	memset(&m_ftEnd, 0, sizeof(FILETIME));
+	m_nBusyStatus=-1;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPICalendarIndex
+
+CMAPICalendarIndex::CMAPICalendarIndex()
+{
+	InitializeCriticalSection(&m_cs);
+	m_pIntervals=new CCalendarIntervals;
+	memset(&m_ftWindowStart, 0, sizeof(FILETIME));
+	memset(&m_ftWindowEnd, 0, sizeof(FILETIME));
+	m_bBuilding=FALSE;
+}
+
+CMAPICalendarIndex::~CMAPICalendarIndex()
+{
+	RemoveAll();
+	delete m_pIntervals;
+	DeleteCriticalSection(&m_cs);
+}
+
+// Loads every appointment in folder from its contents table (see CMAPIFolder::GetAppointmentContents) and builds
+// the index.  Recurring appointments are opened for their pattern and indexed for their occurrences between
+// ftWindowStart and ftWindowEnd.  The folder is read without the lock, changes merged meanwhile (by OnNotify)
+// are replayed over what was read.  Fails if another Build is reading
+BOOL CMAPICalendarIndex::Build(CMAPIFolder& folder, CMAPIAppointmentLoader& loader, const FILETIME& ftWindowStart, const FILETIME& ftWindowEnd)
+{
+	CMAPIEntryID folderID=folder.EntryID();
+	EnterCriticalSection(&m_cs);
+	if(m_bBuilding)
+	{
+		LeaveCriticalSection(&m_cs);
+		return FALSE;
+	}
+	SetWindow(ftWindowStart, ftWindowEnd);
+	m_folderID=folderID;
+	m_bBuilding=TRUE;
+	LeaveCriticalSection(&m_cs);
+
+	CArray<CMAPIEntryID, CMAPIEntryID&> arEntryIDs;
+	CArray<Interval, Interval&> arIntervals;
+	BOOL bResult=(folder.GetAppointmentContents(loader)!=NULL);
+	if(bResult)
+	{
+		CAppointmentRecord record;
+		CMAPIRecurrence recurrence;
+		while(folder.GetNextAppointment(record))
+		{
+			BOOL bRecurrence=GetRecurrence(folder.GetMAPI(), record, recurrence);
+			Expand(record, bRecurrence ? &recurrence : NULL, ftWindowStart, ftWindowEnd, (int)arEntryIDs.Add(record.m_entryID), arIntervals);
+		}
+	}
+
+	EnterCriticalSection(&m_cs);
+	RemoveAll();
+	SetWindow(ftWindowStart, ftWindowEnd);
+	m_folderID=folderID;
+
+	// item i is arEntryIDs[i], an ID listed twice keeps its last item live
+	int i;
+	for(i=0;i<arEntryIDs.GetSize();i++)
+	{
+		RemoveItem(arEntryIDs[i]);
+		AddItem(arEntryIDs[i]);
+	}
+	for(i=0;i<arIntervals.GetSize();i++)
+	{
+		Interval& interval=arIntervals[i];
+		m_pIntervals->AddInterval(interval.m_nItem, interval.m_ullStart, interval.m_ullEnd, interval.m_nBusyStatus);
+	}
+
+	m_bBuilding=FALSE;
+	Replay();
+	if(bResult) Build();
+	LeaveCriticalSection(&m_cs);
+	return bResult;
+}
+
+// (re)builds the sorted intervals and their subtree ends, call after a series of Add()
+void CMAPICalendarIndex::Build()
+{
+	EnterCriticalSection(&m_cs);
+	if(m_pIntervals->m_nDeleted) Compact();
+	m_pIntervals->Build();
+	LeaveCriticalSection(&m_cs);
+}
+
+void CMAPICalendarIndex::RemoveAll()
+{
+	EnterCriticalSection(&m_cs);
+	m_pIntervals->RemoveAll();
+	m_arEntryIDs.RemoveAll();
+	m_mapItems.RemoveAll();
+	m_folderID.Empty();
+	memset(&m_ftWindowStart, 0, sizeof(FILETIME));
+	memset(&m_ftWindowEnd, 0, sizeof(FILETIME));
+	LeaveCriticalSection(&m_cs);
+}
+
+// the range recurring appointments are expanded in, only affects appointments added afterwards
+void CMAPICalendarIndex::SetWindow(const FILETIME& ftWindowStart, const FILETIME& ftWindowEnd)
+{
+	EnterCriticalSection(&m_cs);
+	m_ftWindowStart=ftWindowStart;
+	m_ftWindowEnd=ftWindowEnd;
+	LeaveCriticalSection(&m_cs);
+}
+
+// Adds (or replaces) an appointment without rebuilding, use for the initial load and then call Build().  With
+// pRecurrence its occurrences in the window are added, otherwise (or if the pattern can't be expanded) only
+// record's own start and end.  It is expanded before the index is locked
+void CMAPICalendarIndex::Add(CAppointmentRecord& record, CMAPIRecurrence* pRecurrence)
+{
+	EnterCriticalSection(&m_cs);
+	FILETIME ftWindowStart=m_ftWindowStart, ftWindowEnd=m_ftWindowEnd;
+	LeaveCriticalSection(&m_cs);
+
+	CArray<Interval, Interval&> arIntervals;
+	Expand(record, pRecurrence, ftWindowStart, ftWindowEnd, 0, arIntervals);
+
+	EnterCriticalSection(&m_cs);
+	Merge(record.m_entryID, arIntervals.GetData(), (int)arIntervals.GetSize());
+	LeaveCriticalSection(&m_cs);
+}
+
+// adds record, opening it with pMAPI for the pattern if it's recurring
+void CMAPICalendarIndex::Add(CMAPIEx* pMAPI, CAppointmentRecord& record)
+{
+	CMAPIRecurrence recurrence;
+	Add(record, GetRecurrence(pMAPI, record, recurrence) ? &recurrence : NULL);
+}
+
+// adds or replaces an appointment in the delta, the index is rebuilt once the delta gets too big
+void CMAPICalendarIndex::Update(CMAPIEx* pMAPI, CAppointmentRecord& record)
+{
+	Add(pMAPI, record);
+	EnterCriticalSection(&m_cs);
+	CheckDelta();
+	LeaveCriticalSection(&m_cs);
+}
+
+BOOL CMAPICalendarIndex::Remove(const CMAPIEntryID& entryID)
+{
+	if(entryID.IsEmpty()) return FALSE;
+
+	EnterCriticalSection(&m_cs);
+	BOOL bResult=RemoveItem(entryID);
+	if(m_bBuilding)
+	{
+		Item change;
+		change.m_entryID=entryID;
+		change.m_nIntervals=0;
+		change.m_bDeleted=TRUE;
+		m_arChanges.Add(change);
+	}
+	LeaveCriticalSection(&m_cs);
+	return bResult;
+}
+
+// number of appointments indexed
+int CMAPICalendarIndex::GetCount()
+{
+	EnterCriticalSection(&m_cs);
+	int nCount=(int)m_mapItems.GetCount();
+	LeaveCriticalSection(&m_cs);
+	return nCount;
+}
+
+// every interval overlapping ftStart..ftEnd (UTC, end exclusive) in start order, nMaxResults of 0 returns all
+int CMAPICalendarIndex::FindOverlaps(const FILETIME& ftStart, const FILETIME& ftEnd, CArray<CCalendarIndexResult, CCalendarIndexResult&>& arResults, int nMaxResults)
+{
+	std::vector<int> arMatches;
+	EnterCriticalSection(&m_cs);
+	m_pIntervals->Find(GetTicks(ftStart), GetTicks(ftEnd), arMatches, nMaxResults);
+	GetResults(arMatches, arResults);
+	LeaveCriticalSection(&m_cs);
+	return (int)arResults.GetSize();
+}
+
+// every interval containing ftTime
+int CMAPICalendarIndex::FindAt(const FILETIME& ftTime, CArray<CCalendarIndexResult, CCalendarIndexResult&>& arResults)
+{
+	ULONGLONG ullTime=GetTicks(ftTime);
+	std::vector<int> arMatches;
+	EnterCriticalSection(&m_cs);
+	m_pIntervals->Find(ullTime, ullTime+1, arMatches);
+	GetResults(arMatches, arResults);
+	LeaveCriticalSection(&m_cs);
+	return (int)arResults.GetSize();
+}
+
+// TRUE if anything overlaps ftStart..ftEnd, stops at the first match.  Free time is ignored with bIgnoreFree
+// and pIgnore skips the appointment being moved.  pbInWindow is set to FALSE if ftStart..ftEnd isn't inside
+// the window, recurring appointments may then conflict without it being found
+BOOL CMAPICalendarIndex::HasConflict(const FILETIME& ftStart, const FILETIME& ftEnd, BOOL bIgnoreFree, const CMAPIEntryID* pIgnore, BOOL* pbInWindow)
+{
+	std::vector<int> arMatches;
+	EnterCriticalSection(&m_cs);
+	if(pbInWindow) *pbInWindow=IsInWindow(ftStart, ftEnd);
+	int nIgnoreItem=-1;
+	if(pIgnore && !pIgnore->IsEmpty() && !m_mapItems.Lookup(*pIgnore, nIgnoreItem)) nIgnoreItem=-1;
+	BOOL bConflict=(m_pIntervals->Find(GetTicks(ftStart), GetTicks(ftEnd), arMatches, 1, bIgnoreFree!=FALSE, nIgnoreItem)>0);
+	LeaveCriticalSection(&m_cs);
+	return bConflict;
+}
+
+// TRUE if ftStart..ftEnd is inside the window recurring appointments were expanded in, FALSE without a window
+BOOL CMAPICalendarIndex::IsInWindow(const FILETIME& ftStart, const FILETIME& ftEnd)
+{
+	EnterCriticalSection(&m_cs);
+	ULONGLONG ullWindowEnd=GetTicks(m_ftWindowEnd);
+	BOOL bInWindow=(ullWindowEnd && GetTicks(ftStart)>=GetTicks(m_ftWindowStart) && GetTicks(ftEnd)<=ullWindowEnd);
+	LeaveCriticalSection(&m_cs);
+	return bInWindow;
+}
+
+// Call this from the Notify callback of the store holding the indexed folder.  Appointments created, changed or
+// moved into the folder are read with loader and updated, ones deleted or moved out are removed.  pMAPI's
+// session is used on the thread calling this, which is MAPI's notification thread unless a CMAPINotifyQueue
+// was passed to CMAPIEx::Notify, so initialize MAPI with multithreaded notifications (the CMAPIEx::Init
+// default) and keep pMAPI logged in until the sink is unadvised.  A slow OnNotify holds up every other sink
+// on that thread, use a queue when the calendar is busy.  Items that aren't appointments are left out like
+// Build leaves them out, and nothing is done until Build has set the folder or after RemoveAll
+void CMAPICalendarIndex::OnNotify(CMAPIEx* pMAPI, CMAPIAppointmentLoader& loader, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	if(!pMAPI || !pMAPI->GetSession()) return;
+
+	EnterCriticalSection(&m_cs);
+	CMAPIEntryID folderID=m_folderID;
+	LeaveCriticalSection(&m_cs);
+	if(folderID.IsEmpty()) return;
+
+	for(ULONG i=0;i<cNotification;i++)
+	{
+		NOTIFICATION& notification=lpNotifications[i];
+		OBJECT_NOTIFICATION& obj=notification.info.obj;
+		switch(notification.ulEventType)
+		{
+		case fnevObjectCreated:
+		case fnevObjectModified:
+		case fnevObjectMoved:
+		case fnevObjectCopied:
+			if(obj.ulObjType!=MAPI_MESSAGE) break;
+			if(notification.ulEventType==fnevObjectMoved) Remove(CMAPIEntryID(obj.cbOldID, (const BYTE*)obj.lpOldID));
+
+			if(pMAPI->CompareEntryIDs(obj.cbParentID, obj.lpParentID, folderID.GetSize(), folderID.GetEntryID()))
+			{
+				ULONG ulObjType;
+				IMAPIProp* pProp=NULL;
+				if(pMAPI->GetSession()->OpenEntry(obj.cbEntryID, obj.lpEntryID, NULL, MAPI_BEST_ACCESS, &ulObjType, (LPUNKNOWN*)&pProp)==S_OK)
+				{
+					CAppointmentRecord record;
+					BOOL bAppointment=CMAPIAppointmentLoader::IsAppointment(pProp);
+					BOOL bLoaded=bAppointment && loader.Load(pProp, record);
+					RELEASE(pProp);
+					if(bLoaded) Update(pMAPI, record);
+					else if(!bAppointment) Remove(CMAPIEntryID(obj.cbEntryID, (const BYTE*)obj.lpEntryID));
+				}
+			}
+			else
+			{
+				Remove(CMAPIEntryID(obj.cbEntryID, (const BYTE*)obj.lpEntryID));
+			}
+			break;
+
+		case fnevObjectDeleted:
+			if(obj.ulObjType!=MAPI_MESSAGE) break;
+			Remove(CMAPIEntryID(obj.cbEntryID, (const BYTE*)obj.lpEntryID));
+			break;
+		}
+	}
+
+	EnterCriticalSection(&m_cs);
+	CheckDelta();
+	LeaveCriticalSection(&m_cs);
+}
+
+// Writes the index to szPath in one go, the window and folder are kept so OnNotify and Add work the same after
+// Load.  The file is only meant to be read back by the same build
+BOOL CMAPICalendarIndex::Save(LPCTSTR szPath)
+{
+	CArray<BYTE, BYTE> arData;
+	arData.SetSize(0, INDEX_FILE_GROW_BY);
+
+	EnterCriticalSection(&m_cs);
+	Build();
+
+	DWORD dwValue=INDEX_FILE_MAGIC;
+	Append(arData, &dwValue, sizeof(DWORD));
+	dwValue=FILE_VERSION;
+	Append(arData, &dwValue, sizeof(DWORD));
+	Append(arData, &m_ftWindowStart, sizeof(FILETIME));
+	Append(arData, &m_ftWindowEnd, sizeof(FILETIME));
+	dwValue=m_folderID.GetSize();
+	Append(arData, &dwValue, sizeof(DWORD));
+	Append(arData, m_folderID.GetData(), dwValue);
+
+	dwValue=(DWORD)m_arEntryIDs.GetSize();
+	Append(arData, &dwValue, sizeof(DWORD));
+	for(int i=0;i<m_arEntryIDs.GetSize();i++)
+	{
+		CMAPIEntryID& entryID=m_arEntryIDs[i];
+		dwValue=entryID.GetSize();
+		Append(arData, &dwValue, sizeof(DWORD));
+		Append(arData, entryID.GetData(), dwValue);
+	}
+
+	std::vector<uint8_t> arIntervals;
+	m_pIntervals->Write(arIntervals);
+	Append(arData, &arIntervals[0], (int)arIntervals.size());
+	LeaveCriticalSection(&m_cs);
+
+	CFile file;
+	if(!file.Open(szPath, CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite)) return FALSE;
+	BOOL bResult=TRUE;
+	try
+	{
+		file.Write(arData.GetData(), (UINT)arData.GetSize());
+		file.Close();
+	}
+	catch(CFileException* e)
+	{
+		e->Delete();
+		bResult=FALSE;
+	}
+	return bResult;
+}
+
+// replaces the index with one written by Save, the index is left empty if the file can't be read
+BOOL CMAPICalendarIndex::Load(LPCTSTR szPath)
+{
+	CFile file;
+	if(!file.Open(szPath, CFile::modeRead | CFile::shareDenyWrite)) return FALSE;
+
+	CArray<BYTE, BYTE> arData;
+	BOOL bResult=TRUE;
+	try
+	{
+		arData.SetSize((INT_PTR)file.GetLength());
+		if(file.Read(arData.GetData(), (UINT)arData.GetSize())!=(UINT)arData.GetSize()) bResult=FALSE;
+		file.Close();
+	}
+	catch(CFileException* e)
+	{
+		e->Delete();
+		bResult=FALSE;
+	}
+	catch(CMemoryException* e)
+	{
+		e->Delete();
+		bResult=FALSE;
+	}
+	if(!bResult) return FALSE;
+
+	EnterCriticalSection(&m_cs);
+	RemoveAll();
+
+	const BYTE* pData=arData.GetData();
+	const BYTE* pEnd=pData+arData.GetSize();
+	DWORD dwMagic, dwVersion, cb, dwCount;
+	bResult=(Read(pData, pEnd, &dwMagic, sizeof(DWORD)) && dwMagic==INDEX_FILE_MAGIC);
+	bResult=bResult && Read(pData, pEnd, &dwVersion, sizeof(DWORD)) && dwVersion==FILE_VERSION;
+	bResult=bResult && Read(pData, pEnd, &m_ftWindowStart, sizeof(FILETIME)) && Read(pData, pEnd, &m_ftWindowEnd, sizeof(FILETIME));
+	bResult=bResult && Read(pData, pEnd, &cb, sizeof(DWORD)) && cb<=(DWORD)(pEnd-pData);
+	if(bResult)
+	{
+		m_folderID.Set(cb, pData);
+		pData+=cb;
+		bResult=Read(pData, pEnd, &dwCount, sizeof(DWORD));
+	}
+
+	DWORD i;
+	for(i=0;bResult && i<dwCount;i++)
+	{
+		bResult=(Read(pData, pEnd, &cb, sizeof(DWORD)) && cb<=(DWORD)(pEnd-pData));
+		if(!bResult) break;
+
+		// an ID in the file twice would leave two live items for one appointment
+		CMAPIEntryID entryID(cb, pData);
+		int nItem;
+		if(m_mapItems.Lookup(entryID, nItem)) bResult=FALSE;
+		else AddItem(entryID);
+		pData+=cb;
+	}
+
+	// the intervals run to the end of the file and are built as they're read
+	bResult=bResult && m_pIntervals->Read(pData, pEnd);
+	if(!bResult) RemoveAll();
+	LeaveCriticalSection(&m_cs);
+	return bResult;
+}
+
+// marks entryID's item deleted, the caller holds m_cs
+BOOL CMAPICalendarIndex::RemoveItem(const CMAPIEntryID& entryID)
+{
+	int nItem;
+	if(entryID.IsEmpty() || !m_mapItems.Lookup(entryID, nItem)) return FALSE;
+
+	m_pIntervals->RemoveItem(nItem);
+	m_mapItems.RemoveKey(entryID);
+	return TRUE;
+}
+
+// replaces entryID's intervals with nIntervals from pIntervals, kept for Replay while Build is reading.  The
+// caller holds m_cs
+void CMAPICalendarIndex::Merge(const CMAPIEntryID& entryID, const Interval* pIntervals, int nIntervals)
+{
+	RemoveItem(entryID);
+	int i, nItem=AddItem(entryID);
+	for(i=0;i<nIntervals;i++) m_pIntervals->AddInterval(nItem, pIntervals[i].m_ullStart, pIntervals[i].m_ullEnd, pIntervals[i].m_nBusyStatus);
+	if(!m_bBuilding) return;
+
+	Item change;
+	change.m_entryID=entryID;
+	change.m_nIntervals=nIntervals;
+	change.m_bDeleted=FALSE;
+	m_arChanges.Add(change);
+	for(i=0;i<nIntervals;i++)
+	{
+		Interval interval=pIntervals[i];
+		m_arChangeIntervals.Add(interval);
+	}
+}
+
+// merges the changes kept while Build was reading in the order they were made, the caller holds m_cs
+void CMAPICalendarIndex::Replay()
+{
+	int nInterval=0;
+	for(int i=0;i<m_arChanges.GetSize();i++)
+	{
+		Item& change=m_arChanges[i];
+		if(change.m_bDeleted) RemoveItem(change.m_entryID);
+		else Merge(change.m_entryID, m_arChangeIntervals.GetData()+nInterval, change.m_nIntervals);
+		nInterval+=change.m_nIntervals;
+	}
+	m_arChanges.RemoveAll();
+	m_arChangeIntervals.RemoveAll();
+}
+
+// appends record's intervals for item nItem to arIntervals, its occurrences between ftWindowStart and
+// ftWindowEnd with pRecurrence, otherwise (or if the pattern can't be expanded) its own start and end
+void CMAPICalendarIndex::Expand(CAppointmentRecord& record, CMAPIRecurrence* pRecurrence, const FILETIME& ftWindowStart, const FILETIME& ftWindowEnd, int nItem, CArray<Interval, Interval&>& arIntervals)
+{
+	Interval interval;
+	interval.m_nItem=nItem;
+
+	CRecurrenceIterator it;
+	if(pRecurrence && GetTicks(ftWindowEnd) && it.Begin(*pRecurrence, ftWindowStart, ftWindowEnd))
+	{
+		CRecurrenceOccurrence occurrence;
+		while(it.Next(occurrence))
+		{
+			interval.m_nBusyStatus=record.m_nBusyStatus;
+			if(occurrence.m_nException>=0 && pRecurrence->m_arExceptions[occurrence.m_nException].m_nBusyStatus>=0)
+			{
+				interval.m_nBusyStatus=pRecurrence->m_arExceptions[occurrence.m_nException].m_nBusyStatus;
+			}
+			interval.m_ullStart=GetTicks(occurrence.m_ftStart);
+			interval.m_ullEnd=GetTicks(occurrence.m_ftEnd);
+			arIntervals.Add(interval);
+		}
+	}
+	else if(GetTicks(record.m_ftStart))
+	{
+		interval.m_nBusyStatus=record.m_nBusyStatus;
+		interval.m_ullStart=GetTicks(record.m_ftStart);
+		interval.m_ullEnd=GetTicks(record.m_ftEnd);
+		arIntervals.Add(interval);
+	}
+}
+
+// opens a recurring record's appointment with pMAPI for its pattern
+BOOL CMAPICalendarIndex::GetRecurrence(CMAPIEx* pMAPI, CAppointmentRecord& record, CMAPIRecurrence& recurrence)
+{
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	CMAPIAppointment appointment;
+	if(!record.m_bRecurring || !pMAPI || !appointment.Open(pMAPI, *record.m_entryID.GetBinary())) return FALSE;
+
+	BOOL bRecurrence=appointment.GetRecurrence(recurrence);
+	appointment.Close();
+	return bRecurrence;
+#endif
+}
+
+int CMAPICalendarIndex::AddItem(const CMAPIEntryID& entryID)
+{
+	CMAPIEntryID itemID=entryID;
+	int nItem=m_pIntervals->AddItem();
+	m_arEntryIDs.SetAtGrow(nItem, itemID);
+	if(!entryID.IsEmpty()) m_mapItems.SetAt(entryID, nItem);
+	return nItem;
+}
+
+// rebuilds once the delta and the tombstones get past an eighth of the index
+void CMAPICalendarIndex::CheckDelta()
+{
+	if(m_pIntervals->IsDeltaFull()) Build();
+}
+
+// drops deleted items and their intervals, renumbering the entry IDs like CCalendarIntervals::Compact does
+// the items
+void CMAPICalendarIndex::Compact()
+{
+	std::vector<int> arNewItems;
+	m_pIntervals->Compact(arNewItems);
+
+	int nItems=0;
+	m_mapItems.RemoveAll();
+	for(int i=0;i<(int)arNewItems.size();i++)
+	{
+		if(arNewItems[i]<0) continue;
+		if(i!=nItems) m_arEntryIDs[nItems]=m_arEntryIDs[i];
+		if(!m_arEntryIDs[nItems].IsEmpty()) m_mapItems.SetAt(m_arEntryIDs[nItems], nItems);
+		nItems++;
+	}
+	m_arEntryIDs.SetSize(nItems);
+}
+
+void CMAPICalendarIndex::GetResults(std::vector<int>& arMatches, CArray<CCalendarIndexResult, CCalendarIndexResult&>& arResults)
+{
+	std::vector<Interval> arSorted;
+	m_pIntervals->GetSorted(arMatches, arSorted);
+
+	int nMatches=(int)arSorted.size();
+	arResults.SetSize(nMatches);
+	for(int i=0;i<nMatches;i++)
+	{
+		Interval& interval=arSorted[i];
+		CCalendarIndexResult& result=arResults[i];
+		result.m_entryID=m_arEntryIDs[interval.m_nItem];
+		SetTicks(interval.m_ullStart, result.m_ftStart);
+		SetTicks(interval.m_ullEnd, result.m_ftEnd);
+		result.m_nBusyStatus=interval.m_nBusyStatus;
+	}
+}
+
+void CMAPICalendarIndex::Append(CArray<BYTE, BYTE>& arData, const void* pData, int nBytes)
+{
+	if(nBytes<=0) return;
+	INT_PTR nOffset=arData.GetSize();
+	arData.SetSize(nOffset+nBytes);
+	memcpy(arData.GetData()+nOffset, pData, nBytes);
+}
+
+BOOL CMAPICalendarIndex::Read(const BYTE*& pData, const BYTE* pEnd, void* pValue, int nBytes)
+{
+	if(pEnd-pData<nBytes) return FALSE;
+	memcpy(pValue, pData, nBytes);
+	pData+=nBytes;
+	return TRUE;
+}
@@ -0,0 +1,128 @@
+#ifndef __MAPICALENDARINDEX_H__
+#define __MAPICALENDARINDEX_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPICalendarIndex.h
+// Description: In memory interval index over a calendar for conflict detection
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CCalendarIndexResult
+
+class AFX_EXT_CLASS CCalendarIndexResult
+{
+public:
+	CCalendarIndexResult();
+
+// Attributes
+public:
+	CMAPIEntryID m_entryID;
+	FILETIME m_ftStart;
+	FILETIME m_ftEnd;
+	int m_nBusyStatus;
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPICalendarIndex
+
+// Keeps one interval per single appointment and one per occurrence of a recurring appointment inside the
+// expansion window, in UTC ticks.  The intervals are kept in a CCalendarIntervals (CalendarIntervals.h, no MFC
+// or MAPI), sorted by start and used as an implicit balanced tree with the largest end of every subtree, so
+// overlap and point queries visit O(log n + k) intervals.
+//
+// Appointments added, changed or removed after Build() go to a small delta that is searched linearly; once it
+// grows past a fraction of the index everything is rebuilt.  Appointments are read and expanded before the
+// index is locked, the lock is only held to merge them, so OnNotify can run while bookings are checked.
+// Recurring appointments only have their occurrences inside the window, a query outside it isn't reliable
+// (HasConflict reports that), Build again with a later window to move it.  Save and Load keep the index
+// between runs, changes made to the folder while it was on disk aren't in it:
+//
+//		CMAPICalendarIndex index;
+//		if(!index.Load(szPath)) index.Build(*pMAPI->OpenCalendar(), loader, ftFrom, ftTo);
+//		if(index.HasConflict(ftStart, ftEnd, TRUE, NULL, &bInWindow) || !bInWindow) ...
+class AFX_EXT_CLASS CMAPICalendarIndex
+{
+public:
+	CMAPICalendarIndex();
+	~CMAPICalendarIndex();
+
+	enum { FILE_VERSION=1 };
+
+	// an appointment added or removed while Build is reading
+	struct Item
+	{
+		CMAPIEntryID m_entryID;
+		int m_nIntervals;
+		BOOL m_bDeleted;
+	};
+
+	typedef CCalendarInterval Interval;
+
+// Attributes
+protected:
+	CCalendarIntervals* m_pIntervals;
+	CArray<CMAPIEntryID, CMAPIEntryID&> m_arEntryIDs;	// by m_pIntervals item
+	CMap<CMAPIEntryID, const CMAPIEntryID&, int, int> m_mapItems;
+
+	FILETIME m_ftWindowStart;
+	FILETIME m_ftWindowEnd;
+	CMAPIEntryID m_folderID;
+	CRITICAL_SECTION m_cs;
+
+	// changes merged while Build reads the folder, replayed over what it read
+	BOOL m_bBuilding;
+	CArray<Item, Item&> m_arChanges;
+	CArray<Interval, Interval&> m_arChangeIntervals;
+
+// Operations
+public:
+	BOOL Build(CMAPIFolder& folder, CMAPIAppointmentLoader& loader, const FILETIME& ftWindowStart, const FILETIME& ftWindowEnd);
+	void Build();
+	void RemoveAll();
+	void SetWindow(const FILETIME& ftWindowStart, const FILETIME& ftWindowEnd);
+	void Add(CAppointmentRecord& record, CMAPIRecurrence* pRecurrence=NULL);
+	void Add(CMAPIEx* pMAPI, CAppointmentRecord& record);
+	void Update(CMAPIEx* pMAPI, CAppointmentRecord& record);
+	BOOL Remove(const CMAPIEntryID& entryID);
+	int GetCount();
+
+	int FindOverlaps(const FILETIME& ftStart, const FILETIME& ftEnd, CArray<CCalendarIndexResult, CCalendarIndexResult&>& arResults, int nMaxResults=0);
+	int FindAt(const FILETIME& ftTime, CArray<CCalendarIndexResult, CCalendarIndexResult&>& arResults);
+	BOOL HasConflict(const FILETIME& ftStart, const FILETIME& ftEnd, BOOL bIgnoreFree=TRUE, const CMAPIEntryID* pIgnore=NULL, BOOL* pbInWindow=NULL);
+	BOOL IsInWindow(const FILETIME& ftStart, const FILETIME& ftEnd);
+	void OnNotify(CMAPIEx* pMAPI, CMAPIAppointmentLoader& loader, ULONG cNotification, LPNOTIFICATION lpNotifications);
+
+	BOOL Save(LPCTSTR szPath);
+	BOOL Load(LPCTSTR szPath);
+
+protected:
+	BOOL RemoveItem(const CMAPIEntryID& entryID);
+	void Merge(const CMAPIEntryID& entryID, const Interval* pIntervals, int nIntervals);
+	void Replay();
+	static void Expand(CAppointmentRecord& record, CMAPIRecurrence* pRecurrence, const FILETIME& ftWindowStart, const FILETIME& ftWindowEnd, int nItem, CArray<Interval, Interval&>& arIntervals);
+	static BOOL GetRecurrence(CMAPIEx* pMAPI, CAppointmentRecord& record, CMAPIRecurrence& recurrence);
+	int AddItem(const CMAPIEntryID& entryID);
+	void CheckDelta();
+	void Compact();
+	void GetResults(std::vector<int>& arMatches, CArray<CCalendarIndexResult, CCalendarIndexResult&>& arResults);
+
+	static ULONGLONG GetTicks(const FILETIME& ft) { return ((ULONGLONG)ft.dwHighDateTime<<32) | ft.dwLowDateTime; }
+	static void SetTicks(ULONGLONG ullTicks, FILETIME& ft) { ft.dwLowDateTime=(DWORD)ullTicks; ft.dwHighDateTime=(DWORD)(ullTicks>>32); }
+	static void Append(CArray<BYTE, BYTE>& arData, const void* pData, int nBytes);
+	static BOOL Read(const BYTE*& pData, const BYTE* pEnd, void* pValue, int nBytes);
+
+private:
+	CMAPICalendarIndex(const CMAPICalendarIndex&);
+	CMAPICalendarIndex& operator=(const CMAPICalendarIndex&);
+};
+
+#endif
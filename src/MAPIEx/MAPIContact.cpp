@@ -118,7 +118,9 @@ BOOL CMAPIContact::SetPropertyString(ULONG ulProperty, LPCTSTR szProperty, BOOL
 }
 #endif
 
-BOOL CMAPIContact::Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder)
+// without bDefaults the message class, importance and sensitivity are left to the caller's own SetProps (see
+// CMAPIContactLoader::Write)
+BOOL CMAPIContact::Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder, BOOL bDefaults)
 {
 	if(!pMAPI) return FALSE;
 	if(!pFolder) pFolder=pMAPI->GetFolder();
@@ -132,19 +134,16 @@ BOOL CMAPIContact::Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder)
 	return FALSE;
 #else
 	if(!CMAPIObject::Create(pMAPI, pFolder)) return FALSE;
-
-	SPropValue prop;
-	prop.ulPropTag=PR_MESSAGE_CLASS;
-	prop.Value.LPSZ=_T("IPM.Contact");
-	Message()->SetProps(1, &prop, NULL);
-
-	prop.ulPropTag=PR_IMPORTANCE;
-	prop.Value.l=1;
-	Message()->SetProps(1, &prop, NULL);
-
-	prop.ulPropTag=PR_SENSITIVITY;
-	prop.Value.l=0;
-	Message()->SetProps(1, &prop, NULL);
+	if(!bDefaults) return TRUE;
+
+	SPropValue props[3];
+	props[0].ulPropTag=PR_MESSAGE_CLASS;
+	props[0].Value.LPSZ=_T("IPM.Contact");
+	props[1].ulPropTag=PR_IMPORTANCE;
+	props[1].Value.l=1;
+	props[2].ulPropTag=PR_SENSITIVITY;
+	props[2].Value.l=0;
+	Message()->SetProps(3, props, NULL);
 
 	return TRUE;
 #endif
@@ -85,7 +85,7 @@ public:
 	virtual BOOL SetPropertyString(ULONG ulProperty, LPCTSTR szProperty, BOOL bStream=FALSE);
 #endif
 
-	BOOL Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder=NULL);
+	BOOL Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder=NULL, BOOL bDefaults=TRUE);
 
 	BOOL GetName(CString& strName, ULONG ulNameID=PR_DISPLAY_NAME);
 	BOOL GetEmail(CString& strEmail, int nIndex=1); // 1, 2 or 3 for outlook email addresses
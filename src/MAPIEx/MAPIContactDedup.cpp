@@ -0,0 +1,594 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContactDedup.cpp
+// Description: Finds and merges duplicate contacts using normalized email and phone keys
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+// numbers usually shared by everyone at a company, they don't identify a person
+const ULONG DedupSharedPhones[]={
+	PR_COMPANY_MAIN_PHONE_NUMBER, PR_BUSINESS_FAX_NUMBER, PR_ASSISTANT_TELEPHONE_NUMBER, PR_TELEX_NUMBER
+};
+
+// single value string fields copied by Merge when the kept contact doesn't have them, and the label a
+// different value is kept under in the notes when it does
+struct DedupField
+{
+	CString CContactRecord::* m_pField;
+	ULONG m_ulPropTag;
+	LPCTSTR m_szLabel;
+};
+
+const DedupField DedupFields[]={
+	{ &CContactRecord::m_strDisplayName, PR_DISPLAY_NAME, _T("Name") }, { &CContactRecord::m_strGivenName, PR_GIVEN_NAME, _T("First name") },
+	{ &CContactRecord::m_strMiddleName, PR_MIDDLE_NAME, _T("Middle name") }, { &CContactRecord::m_strSurname, PR_SURNAME, _T("Last name") },
+	{ &CContactRecord::m_strDisplayNamePrefix, PR_DISPLAY_NAME_PREFIX, _T("Title") }, { &CContactRecord::m_strGeneration, PR_GENERATION, _T("Suffix") },
+	{ &CContactRecord::m_strNickName, PR_NICKNAME, _T("Nickname") }, { &CContactRecord::m_strTitle, PR_TITLE, _T("Job title") },
+	{ &CContactRecord::m_strCompany, PR_COMPANY_NAME, _T("Company") }, { &CContactRecord::m_strDepartment, PR_DEPARTMENT_NAME, _T("Department") },
+	{ &CContactRecord::m_strOffice, PR_OFFICE_LOCATION, _T("Office") }, { &CContactRecord::m_strProfession, PR_PROFESSION, _T("Profession") },
+	{ &CContactRecord::m_strManagerName, PR_MANAGER_NAME, _T("Manager") }, { &CContactRecord::m_strAssistantName, PR_ASSISTANT, _T("Assistant") },
+	{ &CContactRecord::m_strSpouseName, PR_SPOUSE_NAME, _T("Spouse") }, { &CContactRecord::m_strHomePage, PR_PERSONAL_HOME_PAGE, _T("Web page") },
+	{ &CContactRecord::m_strBusinessHomePage, PR_BUSINESS_HOME_PAGE, _T("Business web page") }, { NULL, 0, NULL }
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIContactDedup
+
+CMAPIContactDedup::CMAPIContactDedup()
+{
+	m_strCountryCode=_T("1");
+	m_nMaxBlock=DEFAULT_MAX_BLOCK;
+}
+
+CMAPIContactDedup::~CMAPIContactDedup()
+{
+	RemoveAll();
+}
+
+// reads every contact in folder through its contents table (see CMAPIFolder::GetContactContents)
+BOOL CMAPIContactDedup::Load(CMAPIFolder& folder, CMAPIContactLoader& loader)
+{
+	RemoveAll();
+	if(!folder.GetContactContents(loader)) return FALSE;
+
+	m_arEntries.SetSize(0, 4096);
+	m_arKeys.SetSize(0, 8192);
+	CContactRecord record;
+	while(folder.GetNextContact(record)) Add(record);
+	return TRUE;
+}
+
+// returns the index of the contact, used by GetCluster
+int CMAPIContactDedup::Add(CContactRecord& record)
+{
+	Entry entry;
+	entry.m_entryID=record.m_entryID;
+	entry.m_ftLastModified=record.m_ftLastModified;
+	entry.m_nScore=CountFields(record);
+	entry.m_nParent=(int)m_arEntries.GetSize();
+	entry.m_nSize=1;
+	int nEntry=(int)m_arEntries.Add(entry);
+
+	CStringArray arKeys;
+	GetKeys(record, arKeys);
+	for(int i=0;i<arKeys.GetSize();i++) AddKey(nEntry, arKeys[i]);
+	return nEntry;
+}
+
+// the normalized email and phone keys of record, each prefixed by its kind so an email and a phone number
+// can never share a key
+void CMAPIContactDedup::GetKeys(CContactRecord& record, CStringArray& arKeys)
+{
+	arKeys.RemoveAll();
+
+	CString strKey;
+	int i;
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		if(NormalizeEmail(record.m_strEmail[i], strKey)) arKeys.Add(CString((TCHAR)KEY_EMAIL, 1)+strKey);
+	}
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+	{
+		if(record.m_strPhoneNumbers[i].IsEmpty()) continue;
+
+		ULONG ulPhoneNumberID=CContactRecord::GetPhoneNumberID(i);
+		BOOL bShared=FALSE;
+		for(int j=0;j<(int)(sizeof(DedupSharedPhones)/sizeof(ULONG)) && !bShared;j++) bShared=(DedupSharedPhones[j]==ulPhoneNumberID);
+		if(!bShared && NormalizePhone(record.m_strPhoneNumbers[i], strKey)) arKeys.Add(CString((TCHAR)KEY_PHONE, 1)+strKey);
+	}
+}
+
+void CMAPIContactDedup::RemoveAll()
+{
+	m_arEntries.RemoveAll();
+	m_arKeys.RemoveAll();
+	m_arClusterStart.RemoveAll();
+	m_arMembers.RemoveAll();
+}
+
+// Sorts the keys so each block of contacts sharing one is contiguous and joins the contacts of every block,
+// no contact is ever compared with another directly.  Returns the number of clusters of 2 or more contacts
+int CMAPIContactDedup::FindDuplicates()
+{
+	int nEntries=GetCount(), nKeys=(int)m_arKeys.GetSize();
+	int i, j;
+	for(i=0;i<nEntries;i++)
+	{
+		m_arEntries[i].m_nParent=i;
+		m_arEntries[i].m_nSize=1;
+	}
+	qsort(m_arKeys.GetData(), nKeys, sizeof(Key), CompareKeys);
+
+	for(i=0;i<nKeys;i=j)
+	{
+		// keys are sorted by entry within a block, so a contact using the same key twice is only counted once
+		int nContacts=1;
+		for(j=i+1;j<nKeys && m_arKeys[j].m_ullHash==m_arKeys[i].m_ullHash;j++)
+		{
+			if(m_arKeys[j].m_nEntry!=m_arKeys[j-1].m_nEntry) nContacts++;
+		}
+		if(nContacts<2 || nContacts>m_nMaxBlock) continue;
+		for(int k=i+1;k<j;k++) Union(m_arKeys[i].m_nEntry, m_arKeys[k].m_nEntry);
+	}
+
+	// lay the clusters out one after the other in m_arMembers, in order of their first contact
+	CArray<int, int> arCluster, arNext;
+	arCluster.SetSize(nEntries);
+	int nClusters=0;
+	m_arClusterStart.RemoveAll();
+	m_arClusterStart.Add(0);
+	for(i=0;i<nEntries;i++)
+	{
+		int nRoot=FindRoot(i);
+		arCluster[i]=-1;
+		if(nRoot==i && m_arEntries[i].m_nSize>1)
+		{
+			arCluster[i]=nClusters++;
+			m_arClusterStart.Add(m_arClusterStart[nClusters-1]+m_arEntries[i].m_nSize);
+		}
+	}
+
+	m_arMembers.SetSize(m_arClusterStart[nClusters]);
+	arNext.SetSize(nClusters);
+	for(i=0;i<nClusters;i++) arNext[i]=m_arClusterStart[i];
+	for(i=0;i<nEntries;i++)
+	{
+		int nCluster=arCluster[FindRoot(i)];
+		if(nCluster>=0) m_arMembers[arNext[nCluster]++]=i;
+	}
+
+	for(i=0;i<nClusters;i++)
+	{
+		int nStart=m_arClusterStart[i];
+		qsort_s(m_arMembers.GetData()+nStart, m_arClusterStart[i+1]-nStart, sizeof(int), CompareMembers, m_arEntries.GetData());
+	}
+
+	return nClusters;
+}
+
+// the contacts of a cluster, most complete (then most recently modified) first
+int CMAPIContactDedup::GetCluster(int nCluster, CArray<int, int>& arEntries)
+{
+	arEntries.RemoveAll();
+	if(nCluster<0 || nCluster>=GetClusterCount()) return 0;
+
+	int nStart=m_arClusterStart[nCluster], nEnd=m_arClusterStart[nCluster+1];
+	arEntries.SetSize(nEnd-nStart);
+	for(int i=nStart;i<nEnd;i++) arEntries[i-nStart]=m_arMembers[i];
+	return (int)arEntries.GetSize();
+}
+
+// Keeps the first contact of the cluster and copies in anything it is missing from the others with the
+// CMAPIContact setters: empty fields, email addresses and phone numbers it doesn't already have, addresses,
+// dates and categories.  Values that don't fit (a different company, a phone number whose slot is taken, an
+// email address with no free slot) are appended to the kept contact's notes.  The others are then moved to
+// Deleted Items unless bDelete is FALSE, so whatever the contact record doesn't cover can still be recovered.
+// loader must read every column (COLUMNS_ALL), with COLUMNS_LIST the rest would be lost.  Clusters are
+// joined on key hashes, so before anything is merged or moved the contacts are read again and each must
+// share an actual normalized key with the kept contact or one already accepted; the rest are left alone
+BOOL CMAPIContactDedup::Merge(int nCluster, CMAPIEx* pMAPI, CMAPIFolder& folder, CMAPIContactLoader& loader, BOOL bDelete)
+{
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	CArray<int, int> arEntries;
+	if(!pMAPI || loader.GetColumns()!=CMAPIContactLoader::COLUMNS_ALL || GetCluster(nCluster, arEntries)<2) return FALSE;
+
+	CMAPIContact contact;
+	CContactRecord record;
+	if(!contact.Open(pMAPI, *m_arEntries[arEntries[0]].m_entryID.GetBinary()) || !loader.Load(contact, record)) return FALSE;
+
+	CMap<CString, LPCTSTR, int, int> mapKeys;
+	CStringArray arKeys;
+	GetKeys(record, arKeys);
+	int i, j;
+	for(i=0;i<arKeys.GetSize();i++) mapKeys[arKeys[i]]=0;
+
+	// skip contacts deleted since Load
+	CArray<CContactRecord, CContactRecord&> arDuplicates;
+	CArray<SBinary*, SBinary*> arEntryIDs;
+	for(i=1;i<arEntries.GetSize();i++)
+	{
+		CMAPIContact other;
+		CContactRecord duplicate;
+		SBinary* pEntryID=m_arEntries[arEntries[i]].m_entryID.GetBinary();
+		if(!other.Open(pMAPI, *pEntryID) || !loader.Load(other, duplicate)) continue;
+		arDuplicates.Add(duplicate);
+		arEntryIDs.Add(pEntryID);
+	}
+
+	// a contact may only match through another duplicate, so go round until nothing more is accepted
+	CArray<SBinary, SBinary&> arDelete;
+	CString strConflicts;
+	BOOL bChanged=FALSE, bAccepted=TRUE;
+	while(bAccepted)
+	{
+		bAccepted=FALSE;
+		for(i=0;i<arDuplicates.GetSize();i++)
+		{
+			if(!arEntryIDs[i]) continue;
+
+			int nValue;
+			BOOL bMatch=FALSE;
+			GetKeys(arDuplicates[i], arKeys);
+			for(j=0;j<arKeys.GetSize() && !bMatch;j++) bMatch=mapKeys.Lookup(arKeys[j], nValue);
+			if(!bMatch) continue;
+
+			for(j=0;j<arKeys.GetSize();j++) mapKeys[arKeys[j]]=0;
+			if(MergeRecord(contact, record, arDuplicates[i], strConflicts)) bChanged=TRUE;
+			arDelete.Add(*arEntryIDs[i]);
+			arEntryIDs[i]=NULL;
+			bAccepted=TRUE;
+		}
+	}
+	if(!strConflicts.IsEmpty())
+	{
+		CString strNotes;
+		contact.GetBody(strNotes, FALSE);
+		if(!strNotes.IsEmpty()) strNotes+=_T("\r\n\r\n");
+		if(!contact.SetPropertyString(PR_BODY, strNotes+strConflicts, TRUE)) return FALSE;
+		bChanged=TRUE;
+	}
+	if(bChanged && !contact.Save()) return FALSE;
+	contact.Close();
+
+	if(bDelete && arDelete.GetSize())
+	{
+		CMAPIFolder* pDeleted=pMAPI->OpenDeletedItems(FALSE);
+		if(!pDeleted) return FALSE;
+
+		ENTRYLIST entries={ (ULONG)arDelete.GetSize(), arDelete.GetData() };
+		HRESULT hr=folder.Folder()->CopyMessages(&entries, NULL, pDeleted->Folder(), NULL, NULL, MESSAGE_MOVE);
+		delete pDeleted;
+		if(hr!=S_OK) return FALSE;
+	}
+	return TRUE;
+#endif
+}
+
+// lower case, surrounding blanks and an SMTP: or mailto: prefix removed and plus addressing (name+tag@domain)
+// reduced to name@domain.  Returns FALSE for anything that isn't an SMTP address
+BOOL CMAPIContactDedup::NormalizeEmail(LPCTSTR szEmail, CString& strKey)
+{
+	strKey=szEmail;
+	strKey.Trim();
+	if(!_tcsnicmp(strKey, _T("SMTP:"), 5)) strKey.Delete(0, 5);
+	else if(!_tcsnicmp(strKey, _T("mailto:"), 7)) strKey.Delete(0, 7);
+	strKey.MakeLower();
+
+	int nAt=strKey.ReverseFind((TCHAR)'@');
+	if(nAt<=0 || nAt==strKey.GetLength()-1)
+	{
+		strKey.Empty();
+		return FALSE;
+	}
+
+	int nPlus=strKey.Find((TCHAR)'+');
+	if(nPlus>0 && nPlus<nAt) strKey.Delete(nPlus, nAt-nPlus);
+	return TRUE;
+}
+
+// Digits only with the country code and without any extension, so with country code 1 "+1 (555) 123-4567 x89",
+// "1-555-123-4567" and "555.123.4567" all become "15551234567".  A leading 00 is taken as an international
+// prefix and a single leading 0 as a trunk prefix, replaced by the country code
+BOOL CMAPIContactDedup::NormalizePhone(LPCTSTR szPhone, CString& strKey)
+{
+	strKey.Empty();
+	if(!szPhone) return FALSE;
+
+	TCHAR szDigits[64];
+	int nDigits=0;
+	BOOL bInternational=FALSE;
+	for(;*szPhone;szPhone++)
+	{
+		TCHAR ch=*szPhone;
+		if(ch>=(TCHAR)'0' && ch<=(TCHAR)'9')
+		{
+			if(nDigits<63) szDigits[nDigits++]=ch;
+		}
+		else if(ch==(TCHAR)'+' && !nDigits) bInternational=TRUE;
+		else if(_istalpha(ch) || ch==(TCHAR)',' || ch==(TCHAR)';' || ch==(TCHAR)'#') break;
+	}
+	szDigits[nDigits]=0;
+
+	LPCTSTR szNumber=szDigits;
+	if(!bInternational && szNumber[0]==(TCHAR)'0' && szNumber[1]==(TCHAR)'0')
+	{
+		bInternational=TRUE;
+		szNumber+=2;
+	}
+
+	if(bInternational) strKey=szNumber;
+	else
+	{
+		int nCountryCode=m_strCountryCode.GetLength();
+		if(szNumber[0]==(TCHAR)'0') szNumber++;
+		else if(nCountryCode && nDigits>10 && !_tcsncmp(szNumber, m_strCountryCode, nCountryCode))
+		{
+			// already has the country code, just not the +.  This takes national numbers to be 10 digits as
+			// they are in the North American plan, elsewhere they vary so it only holds for country code 1
+			nCountryCode=0;
+		}
+		if(nCountryCode) strKey=m_strCountryCode;
+		strKey+=szNumber;
+	}
+
+	if(strKey.GetLength()<MIN_PHONE_DIGITS)
+	{
+		strKey.Empty();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// number of fields set, used to pick the contact to keep
+int CMAPIContactDedup::CountFields(CContactRecord& record)
+{
+	int nCount=0, i;
+	for(i=0;DedupFields[i].m_pField;i++)
+	{
+		if(!(record.*DedupFields[i].m_pField).IsEmpty()) nCount++;
+	}
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		if(!record.m_strEmail[i].IsEmpty()) nCount++;
+	}
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+	{
+		if(!record.m_strPhoneNumbers[i].IsEmpty()) nCount++;
+	}
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		if(!record.m_strStreet[i].IsEmpty() || !record.m_strCity[i].IsEmpty() || !record.m_strPostalCode[i].IsEmpty()) nCount++;
+	}
+	if(!record.m_strFileAs.IsEmpty()) nCount++;
+	if(!record.m_strIMAddress.IsEmpty()) nCount++;
+	if(!record.m_strCategories.IsEmpty()) nCount++;
+	if(record.m_bBirthday) nCount++;
+	if(record.m_bAnniversary) nCount++;
+	return nCount;
+}
+
+void CMAPIContactDedup::AddKey(int nEntry, const CString& strKey)
+{
+	Key key;
+	key.m_ullHash=CMAPIEntryID::Hash(strKey.GetLength()*sizeof(TCHAR), (const BYTE*)(LPCTSTR)strKey);
+	key.m_nEntry=nEntry;
+	m_arKeys.Add(key);
+}
+
+int CMAPIContactDedup::FindRoot(int nEntry)
+{
+	int nRoot=nEntry;
+	while(m_arEntries[nRoot].m_nParent!=nRoot) nRoot=m_arEntries[nRoot].m_nParent;
+
+	// point everything on the path straight at the root
+	while(m_arEntries[nEntry].m_nParent!=nRoot)
+	{
+		int nParent=m_arEntries[nEntry].m_nParent;
+		m_arEntries[nEntry].m_nParent=nRoot;
+		nEntry=nParent;
+	}
+	return nRoot;
+}
+
+// the smaller cluster goes under the larger one to keep the trees flat
+void CMAPIContactDedup::Union(int nEntry1, int nEntry2)
+{
+	int nRoot1=FindRoot(nEntry1), nRoot2=FindRoot(nEntry2);
+	if(nRoot1==nRoot2) return;
+
+	if(m_arEntries[nRoot1].m_nSize<m_arEntries[nRoot2].m_nSize)
+	{
+		int nRoot=nRoot1;
+		nRoot1=nRoot2;
+		nRoot2=nRoot;
+	}
+	m_arEntries[nRoot2].m_nParent=nRoot1;
+	m_arEntries[nRoot1].m_nSize+=m_arEntries[nRoot2].m_nSize;
+}
+
+// Copies what record lacks from duplicate into both contact and record, returns TRUE if anything was set.
+// Values that differ from record's and have nowhere to go are added to strConflicts as "Label: value" lines
+BOOL CMAPIContactDedup::MergeRecord(CMAPIContact& contact, CContactRecord& record, CContactRecord& duplicate, CString& strConflicts)
+{
+	CString strLines;
+	BOOL bChanged=FALSE;
+	int i, j;
+	for(i=0;DedupFields[i].m_pField;i++)
+	{
+		CString& strField=record.*DedupFields[i].m_pField;
+		CString& strDuplicate=duplicate.*DedupFields[i].m_pField;
+		if(strDuplicate.IsEmpty()) continue;
+		if(strField.IsEmpty())
+		{
+			if(contact.SetPropertyString(DedupFields[i].m_ulPropTag, strDuplicate))
+			{
+				strField=strDuplicate;
+				bChanged=TRUE;
+			}
+		}
+		else if(strField.CompareNoCase(strDuplicate)) strLines.AppendFormat(_T("%s: %s\r\n"), DedupFields[i].m_szLabel, strDuplicate);
+	}
+	if(record.m_strFileAs.IsEmpty() && !duplicate.m_strFileAs.IsEmpty() && contact.SetFileAs(duplicate.m_strFileAs))
+	{
+		record.m_strFileAs=duplicate.m_strFileAs;
+		bChanged=TRUE;
+	}
+	if(record.m_strIMAddress.IsEmpty() && !duplicate.m_strIMAddress.IsEmpty() && contact.SetIMAddress(duplicate.m_strIMAddress))
+	{
+		record.m_strIMAddress=duplicate.m_strIMAddress;
+		bChanged=TRUE;
+	}
+
+	// email addresses go in the first free slot
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		if(duplicate.m_strEmail[i].IsEmpty() || HasEmail(record, duplicate.m_strEmail[i])) continue;
+		BOOL bSet=FALSE;
+		for(j=0;j<CContactRecord::MAX_EMAILS && !bSet;j++)
+		{
+			if(!record.m_strEmail[j].IsEmpty() || !contact.SetEmail(duplicate.m_strEmail[i], j+1)) continue;
+			if(!duplicate.m_strEmailDisplayAs[i].IsEmpty()) contact.SetEmailDisplayAs(duplicate.m_strEmailDisplayAs[i], j+1);
+			record.m_strEmail[j]=duplicate.m_strEmail[i];
+			bChanged=bSet=TRUE;
+		}
+		if(!bSet) strLines.AppendFormat(_T("Email: %s\r\n"), duplicate.m_strEmail[i]);
+	}
+
+	// phone numbers only go in the same kind of slot
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+	{
+		if(duplicate.m_strPhoneNumbers[i].IsEmpty() || HasPhone(record, duplicate.m_strPhoneNumbers[i])) continue;
+		if(record.m_strPhoneNumbers[i].IsEmpty() && contact.SetPhoneNumber(duplicate.m_strPhoneNumbers[i], CContactRecord::GetPhoneNumberID(i)))
+		{
+			record.m_strPhoneNumbers[i]=duplicate.m_strPhoneNumbers[i];
+			bChanged=TRUE;
+		}
+		else strLines.AppendFormat(_T("Phone: %s\r\n"), duplicate.m_strPhoneNumbers[i]);
+	}
+
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		if(duplicate.m_strStreet[i].IsEmpty() && duplicate.m_strCity[i].IsEmpty() && duplicate.m_strPostalCode[i].IsEmpty()) continue;
+		if(!record.m_strStreet[i].IsEmpty() || !record.m_strCity[i].IsEmpty() || !record.m_strPostalCode[i].IsEmpty())
+		{
+			if(record.m_strStreet[i].CompareNoCase(duplicate.m_strStreet[i]) || record.m_strCity[i].CompareNoCase(duplicate.m_strCity[i])
+				|| record.m_strPostalCode[i].CompareNoCase(duplicate.m_strPostalCode[i]))
+			{
+				strLines.AppendFormat(_T("Address: %s, %s %s %s %s\r\n"), duplicate.m_strStreet[i], duplicate.m_strCity[i],
+					duplicate.m_strStateOrProvince[i], duplicate.m_strPostalCode[i], duplicate.m_strCountry[i]);
+			}
+			continue;
+		}
+
+		CContactAddress address;
+		duplicate.GetAddress(address, (CContactAddress::AddressType)i);
+		if(contact.SetAddress(address, (CContactAddress::AddressType)i))
+		{
+			record.m_strStreet[i]=duplicate.m_strStreet[i];
+			record.m_strCity[i]=duplicate.m_strCity[i];
+			record.m_strStateOrProvince[i]=duplicate.m_strStateOrProvince[i];
+			record.m_strPostalCode[i]=duplicate.m_strPostalCode[i];
+			record.m_strCountry[i]=duplicate.m_strCountry[i];
+			bChanged=TRUE;
+		}
+	}
+
+	if(!record.m_bBirthday && duplicate.m_bBirthday && contact.SetBirthday(duplicate.m_tmBirthday))
+	{
+		record.m_bBirthday=TRUE;
+		record.m_tmBirthday=duplicate.m_tmBirthday;
+		bChanged=TRUE;
+	}
+	if(!record.m_bAnniversary && duplicate.m_bAnniversary && contact.SetAnniversary(duplicate.m_tmAnniversary))
+	{
+		record.m_bAnniversary=TRUE;
+		record.m_tmAnniversary=duplicate.m_tmAnniversary;
+		bChanged=TRUE;
+	}
+
+	// categories are the union of both
+	if(!duplicate.m_strCategories.IsEmpty())
+	{
+		CString strCategories=record.m_strCategories, strCategory;
+		CString strExisting=_T(";")+record.m_strCategories+_T(";");
+		int nIndex=0;
+		strCategory=duplicate.m_strCategories.Tokenize(_T(";"), nIndex);
+		while(strCategory.GetLength())
+		{
+			if(strExisting.Find(_T(";")+strCategory+_T(";"))<0)
+			{
+				if(strCategories.GetLength()) strCategories+=(TCHAR)';';
+				strCategories+=strCategory;
+			}
+			strCategory=duplicate.m_strCategories.Tokenize(_T(";"), nIndex);
+		}
+		if(strCategories!=record.m_strCategories && contact.SetCategories(strCategories))
+		{
+			record.m_strCategories=strCategories;
+			bChanged=TRUE;
+		}
+	}
+
+	if(!strLines.IsEmpty())
+	{
+		if(!strConflicts.IsEmpty()) strConflicts+=_T("\r\n");
+		strConflicts.AppendFormat(_T("Merged from %s:\r\n%s"), duplicate.m_strDisplayName.IsEmpty() ? (LPCTSTR)duplicate.m_strFileAs : (LPCTSTR)duplicate.m_strDisplayName, strLines);
+	}
+	return bChanged;
+}
+
+BOOL CMAPIContactDedup::HasEmail(CContactRecord& record, LPCTSTR szEmail)
+{
+	CString strKey, strOther;
+	if(!NormalizeEmail(szEmail, strKey)) strKey=szEmail;
+	for(int i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		if(record.m_strEmail[i].IsEmpty()) continue;
+		if(!NormalizeEmail(record.m_strEmail[i], strOther)) strOther=record.m_strEmail[i];
+		if(strKey==strOther) return TRUE;
+	}
+	return FALSE;
+}
+
+BOOL CMAPIContactDedup::HasPhone(CContactRecord& record, LPCTSTR szPhone)
+{
+	CString strKey, strOther;
+	if(!NormalizePhone(szPhone, strKey)) return FALSE;
+	for(int i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+	{
+		if(!record.m_strPhoneNumbers[i].IsEmpty() && NormalizePhone(record.m_strPhoneNumbers[i], strOther) && strKey==strOther) return TRUE;
+	}
+	return FALSE;
+}
+
+int __cdecl CMAPIContactDedup::CompareKeys(const void* p1, const void* p2)
+{
+	const Key* pKey1=(const Key*)p1;
+	const Key* pKey2=(const Key*)p2;
+	if(pKey1->m_ullHash!=pKey2->m_ullHash) return (pKey1->m_ullHash<pKey2->m_ullHash) ? -1 : 1;
+	return pKey1->m_nEntry-pKey2->m_nEntry;
+}
+
+// most fields first, then the most recently modified (pContext is the entry array)
+int __cdecl CMAPIContactDedup::CompareMembers(void* pContext, const void* p1, const void* p2)
+{
+	const Entry* pEntries=(const Entry*)pContext;
+	const Entry& entry1=pEntries[*(const int*)p1];
+	const Entry& entry2=pEntries[*(const int*)p2];
+	if(entry1.m_nScore!=entry2.m_nScore) return entry2.m_nScore-entry1.m_nScore;
+
+	int nCompare=CompareFileTime(&entry2.m_ftLastModified, &entry1.m_ftLastModified);
+	return nCompare ? nCompare : *(const int*)p1-*(const int*)p2;
+}
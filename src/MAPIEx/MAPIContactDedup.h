@@ -0,0 +1,105 @@
+#ifndef __MAPICONTACTDEDUP_H__
+#define __MAPICONTACTDEDUP_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContactDedup.h
+// Description: Finds and merges duplicate contacts using normalized email and phone keys
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIContactDedup
+
+// Each contact contributes a hashed key per normalized email address (lower case, no +tag) and phone number
+// (digits with the country code), the keys are sorted and contacts sharing one are joined into a cluster.
+// Keys shared by more than GetMaxBlock() contacts (a switchboard number, a shared mailbox) are ignored since
+// they don't identify a person.  Merge checks the actual keys again before it moves anything to Deleted Items
+// and needs a loader initialized with COLUMNS_ALL.  Clusters list the most complete contact first:
+//
+//		CMAPIContactDedup dedup;
+//		if(dedup.Load(folder, loader) && dedup.FindDuplicates())
+//		{
+//			for(int i=0;i<dedup.GetClusterCount();i++) dedup.Merge(i, pMAPI, folder, loader);
+//		}
+class AFX_EXT_CLASS CMAPIContactDedup
+{
+public:
+	CMAPIContactDedup();
+	~CMAPIContactDedup();
+
+	enum { DEFAULT_MAX_BLOCK=16, MIN_PHONE_DIGITS=7 };
+	enum { KEY_EMAIL=(TCHAR)'e', KEY_PHONE=(TCHAR)'p' };
+
+	struct Entry
+	{
+		CMAPIEntryID m_entryID;
+		FILETIME m_ftLastModified;
+		int m_nScore;
+		int m_nParent;
+		int m_nSize;
+	};
+
+	struct Key
+	{
+		ULONGLONG m_ullHash;
+		int m_nEntry;
+	};
+
+// Attributes
+protected:
+	CArray<Entry, Entry&> m_arEntries;
+	CArray<Key, Key&> m_arKeys;
+	CArray<int, int> m_arClusterStart;
+	CArray<int, int> m_arMembers;
+	CString m_strCountryCode;
+	int m_nMaxBlock;
+
+// Operations
+public:
+	void SetCountryCode(LPCTSTR szCountryCode) { m_strCountryCode=szCountryCode; }
+	void SetMaxBlock(int nMaxBlock) { m_nMaxBlock=nMaxBlock; }
+	int GetMaxBlock() { return m_nMaxBlock; }
+
+	BOOL Load(CMAPIFolder& folder, CMAPIContactLoader& loader);
+	int Add(CContactRecord& record);
+	void RemoveAll();
+	int GetCount() { return (int)m_arEntries.GetSize(); }
+
+	int FindDuplicates();
+	int GetClusterCount() { return m_arClusterStart.GetSize() ? (int)m_arClusterStart.GetSize()-1 : 0; }
+	int GetCluster(int nCluster, CArray<int, int>& arEntries);
+	const CMAPIEntryID& GetEntryID(int nEntry) { return m_arEntries[nEntry].m_entryID; }
+	int GetScore(int nEntry) { return m_arEntries[nEntry].m_nScore; }
+
+	BOOL Merge(int nCluster, CMAPIEx* pMAPI, CMAPIFolder& folder, CMAPIContactLoader& loader, BOOL bDelete=TRUE);
+
+	static BOOL NormalizeEmail(LPCTSTR szEmail, CString& strKey);
+	BOOL NormalizePhone(LPCTSTR szPhone, CString& strKey);
+	static int CountFields(CContactRecord& record);
+
+protected:
+	void GetKeys(CContactRecord& record, CStringArray& arKeys);
+	void AddKey(int nEntry, const CString& strKey);
+	int FindRoot(int nEntry);
+	void Union(int nEntry1, int nEntry2);
+	BOOL MergeRecord(CMAPIContact& contact, CContactRecord& record, CContactRecord& duplicate, CString& strConflicts);
+	BOOL HasEmail(CContactRecord& record, LPCTSTR szEmail);
+	BOOL HasPhone(CContactRecord& record, LPCTSTR szPhone);
+
+	static int __cdecl CompareKeys(const void* p1, const void* p2);
+	static int __cdecl CompareMembers(void* pContext, const void* p1, const void* p2);
+
+private:
+	CMAPIContactDedup(const CMAPIContactDedup&);
+	CMAPIContactDedup& operator=(const CMAPIContactDedup&);
+};
+
+#endif
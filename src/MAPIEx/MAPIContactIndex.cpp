@@ -0,0 +1,676 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContactIndex.cpp
+// Description: In memory prefix and trigram index over contacts for recipient autocomplete
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+// prefix matches rank above any fuzzy match
+#define PREFIX_SCORE 1000
+
+#define POOL_GROW_BY 65536
+
+/////////////////////////////////////////////////////////////
+// CContactIndexResult
+
+CContactIndexResult::CContactIndexResult()
+{
+	m_nScore=0;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIContactIndex
+
+CMAPIContactIndex::CMAPIContactIndex()
+{
+	InitializeCriticalSection(&m_cs);
+	m_nIndexed=0;
+	m_nDeleted=0;
+	m_arStrings.SetSize(0, POOL_GROW_BY);
+	m_arKeys.SetSize(0, POOL_GROW_BY);
+}
+
+CMAPIContactIndex::~CMAPIContactIndex()
+{
+	RemoveAll();
+	DeleteCriticalSection(&m_cs);
+}
+
+// loads every contact in folder from its contents table (see CMAPIFolder::GetContactContents) and builds the index,
+// a loader that isn't initialized yet is set up with COLUMNS_LIST since that's all the index keeps.  The folder
+// is read before taking the lock so searches and notifications carry on against the old index meanwhile
+BOOL CMAPIContactIndex::Build(CMAPIFolder& folder, CMAPIContactLoader& loader)
+{
+	if(!loader.IsInitialized() && !loader.Init(folder.Folder(), FALSE, CMAPIContactLoader::COLUMNS_LIST)) return FALSE;
+	if(!folder.GetContactContents(loader)) return FALSE;
+
+	CArray<CContactRecord, CContactRecord&> arRecords;
+	arRecords.SetSize(0, 1024);
+	CContactRecord record;
+	while(folder.GetNextContact(record)) arRecords.Add(record);
+
+	EnterCriticalSection(&m_cs);
+	RemoveAll();
+	m_folderID=folder.EntryID();
+	for(int i=0;i<arRecords.GetSize();i++) Add(arRecords[i]);
+	Build();
+	LeaveCriticalSection(&m_cs);
+	return TRUE;
+}
+
+// (re)builds the sorted word and trigram arrays over all entries, call after a series of Add()
+void CMAPIContactIndex::Build()
+{
+	EnterCriticalSection(&m_cs);
+	if(m_nDeleted) Compact();
+
+	int nEntries=(int)m_arEntries.GetSize();
+	m_arWords.RemoveAll();
+	m_arWords.SetSize(0, nEntries*4);
+
+	CArray<Posting, Posting&> arPostings;
+	arPostings.SetSize(0, nEntries*32);
+	CArray<ULONGLONG, ULONGLONG> arTrigrams;
+
+	int i, j;
+	for(i=0;i<nEntries;i++)
+	{
+		Entry& entry=m_arEntries[i];
+		for(j=0;j<FIELD_COUNT;j++)
+		{
+			LPCTSTR szKey=GetKey(entry.m_nKeys[j]);
+			if(!szKey) continue;
+
+			// a key for every word start, so "smi" finds "John Smith" and "jsmith@example.com" finds the email
+			WordKey word;
+			word.m_nEntry=i;
+			for(int k=0;szKey[k];k++)
+			{
+				if(!IsSeparator(szKey[k]) && (!k || IsSeparator(szKey[k-1])))
+				{
+					word.m_nKey=entry.m_nKeys[j]+k;
+					m_arWords.Add(word);
+				}
+			}
+
+			int nLength=(int)_tcslen(szKey);
+			arTrigrams.SetSize(nLength+1);
+			int nTrigrams=GetTrigrams(szKey, arTrigrams.GetData(), nLength+1);
+			Posting posting;
+			posting.m_nEntry=i;
+			for(int k=0;k<nTrigrams;k++)
+			{
+				posting.m_ullTrigram=arTrigrams[k];
+				arPostings.Add(posting);
+			}
+		}
+	}
+
+	qsort_s(m_arWords.GetData(), m_arWords.GetSize(), sizeof(WordKey), CompareWords, m_arKeys.GetData());
+	qsort(arPostings.GetData(), arPostings.GetSize(), sizeof(Posting), ComparePostings);
+
+	// compress the sorted pairs into unique trigrams with their entries
+	m_arTrigrams.RemoveAll();
+	m_arPostingStart.RemoveAll();
+	m_arPostings.RemoveAll();
+	m_arPostings.SetSize(0, arPostings.GetSize());
+	for(i=0;i<arPostings.GetSize();i++)
+	{
+		Posting& posting=arPostings[i];
+		if(!i || posting.m_ullTrigram!=arPostings[i-1].m_ullTrigram)
+		{
+			m_arTrigrams.Add(posting.m_ullTrigram);
+			m_arPostingStart.Add((int)m_arPostings.GetSize());
+		}
+		else if(posting.m_nEntry==arPostings[i-1].m_nEntry) continue;
+		m_arPostings.Add(posting.m_nEntry);
+	}
+	m_arPostingStart.Add((int)m_arPostings.GetSize());
+
+	m_arScores.SetSize(nEntries);
+	if(nEntries) memset(m_arScores.GetData(), 0, nEntries*sizeof(int));
+	m_nIndexed=nEntries;
+	LeaveCriticalSection(&m_cs);
+}
+
+void CMAPIContactIndex::RemoveAll()
+{
+	EnterCriticalSection(&m_cs);
+	m_arEntries.RemoveAll();
+	m_mapEntries.RemoveAll();
+	m_arStrings.RemoveAll();
+	m_arKeys.RemoveAll();
+	m_mapStrings.RemoveAll();
+	m_mapKeys.RemoveAll();
+	m_arWords.RemoveAll();
+	m_arTrigrams.RemoveAll();
+	m_arPostingStart.RemoveAll();
+	m_arPostings.RemoveAll();
+	m_arScores.RemoveAll();
+	m_folderID.Empty();
+	m_nIndexed=0;
+	m_nDeleted=0;
+	LeaveCriticalSection(&m_cs);
+}
+
+// adds (or replaces) a contact without rebuilding, use for the initial load and then call Build()
+void CMAPIContactIndex::Add(CContactRecord& record)
+{
+	EnterCriticalSection(&m_cs);
+	Remove(record.m_entryID);
+
+	LPCTSTR szFields[FIELD_COUNT];
+	szFields[FIELD_NAME]=record.m_strDisplayName.GetLength() ? record.m_strDisplayName : record.m_strFileAs;
+	szFields[FIELD_EMAIL1]=record.m_strEmail[0];
+	szFields[FIELD_EMAIL2]=record.m_strEmail[1];
+	szFields[FIELD_EMAIL3]=record.m_strEmail[2];
+	szFields[FIELD_COMPANY]=record.m_strCompany;
+	AddEntry(record.m_entryID, szFields);
+	LeaveCriticalSection(&m_cs);
+}
+
+// adds or replaces a contact in the delta, the index is rebuilt once the delta gets too big
+void CMAPIContactIndex::Update(CContactRecord& record)
+{
+	EnterCriticalSection(&m_cs);
+	Add(record);
+	CheckDelta();
+	LeaveCriticalSection(&m_cs);
+}
+
+BOOL CMAPIContactIndex::Remove(const CMAPIEntryID& entryID)
+{
+	if(entryID.IsEmpty()) return FALSE;
+
+	BOOL bResult=FALSE;
+	EnterCriticalSection(&m_cs);
+	int nEntry;
+	if(m_mapEntries.Lookup(entryID, nEntry))
+	{
+		m_arEntries[nEntry].m_bDeleted=TRUE;
+		m_mapEntries.RemoveKey(entryID);
+		m_nDeleted++;
+		bResult=TRUE;
+	}
+	LeaveCriticalSection(&m_cs);
+	return bResult;
+}
+
+int CMAPIContactIndex::GetCount()
+{
+	EnterCriticalSection(&m_cs);
+	int nCount=(int)m_arEntries.GetSize()-m_nDeleted;
+	LeaveCriticalSection(&m_cs);
+	return nCount;
+}
+
+// words in szText must all start a word in the same contact (in any order) to be a prefix match, fuzzy matches
+// share at least half the trigrams of szText.  Prefix matches come first
+int CMAPIContactIndex::Search(LPCTSTR szText, CArray<CContactIndexResult, CContactIndexResult&>& arResults, int nMaxResults, int nFlags)
+{
+	arResults.RemoveAll();
+	if(!szText || !*szText || nMaxResults<=0) return 0;
+
+	CString strQuery=szText;
+	strQuery.MakeLower();
+
+	// split a copy of the query into words
+	CString strTokens=strQuery;
+	LPTSTR szTokens=strTokens.GetBuffer();
+	LPCTSTR szTokenList[MAX_TOKENS];
+	int nTokens=0;
+	for(int i=0;szTokens[i];i++)
+	{
+		if(IsSeparator(szTokens[i])) szTokens[i]=0;
+		else if((!i || !szTokens[i-1]) && nTokens<MAX_TOKENS) szTokenList[nTokens++]=szTokens+i;
+	}
+	if(!nTokens) return 0;
+
+	CArray<int, int> arEntries, arScores;
+	EnterCriticalSection(&m_cs);
+	if(m_arScores.GetSize()<m_arEntries.GetSize())
+	{
+		int nOld=(int)m_arScores.GetSize();
+		m_arScores.SetSize(m_arEntries.GetSize());
+		memset(m_arScores.GetData()+nOld, 0, (m_arScores.GetSize()-nOld)*sizeof(int));
+	}
+
+	if(nFlags&SEARCH_PREFIX) SearchPrefix(szTokenList, nTokens, arEntries, arScores, nMaxResults);
+	if((nFlags&SEARCH_FUZZY) && arEntries.GetSize()<nMaxResults) SearchFuzzy(strQuery, arEntries, arScores, nMaxResults);
+
+	arResults.SetSize(arEntries.GetSize());
+	for(int i=0;i<arEntries.GetSize();i++)
+	{
+		GetResult(arEntries[i], arScores[i], arResults[i]);
+		m_arScores[arEntries[i]]=0;
+	}
+	LeaveCriticalSection(&m_cs);
+
+	strTokens.ReleaseBuffer();
+	return (int)arResults.GetSize();
+}
+
+// Call this from the Notify callback of the store holding the indexed folder.  Contacts created, changed or
+// moved into the folder are read with loader and updated, ones deleted or moved out are removed.  Items that
+// aren't contacts (see CMAPIContactLoader::Restrict) are left out like Build leaves them out, and nothing is
+// done until Build has set the folder or after RemoveAll
+void CMAPIContactIndex::OnNotify(CMAPIEx* pMAPI, CMAPIContactLoader& loader, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	if(!pMAPI || !pMAPI->GetSession()) return;
+
+	// Build may replace the folder ID at any time
+	EnterCriticalSection(&m_cs);
+	CMAPIEntryID folderID=m_folderID;
+	LeaveCriticalSection(&m_cs);
+	if(folderID.IsEmpty()) return;
+
+	for(ULONG i=0;i<cNotification;i++)
+	{
+		NOTIFICATION& notification=lpNotifications[i];
+		OBJECT_NOTIFICATION& obj=notification.info.obj;
+		switch(notification.ulEventType)
+		{
+		case fnevObjectCreated:
+		case fnevObjectModified:
+		case fnevObjectMoved:
+		case fnevObjectCopied:
+			if(obj.ulObjType!=MAPI_MESSAGE) break;
+			if(notification.ulEventType==fnevObjectMoved) Remove(CMAPIEntryID(obj.cbOldID, (const BYTE*)obj.lpOldID));
+
+			if(pMAPI->CompareEntryIDs(obj.cbParentID, obj.lpParentID, folderID.GetSize(), folderID.GetEntryID()))
+			{
+				ULONG ulObjType;
+				IMAPIProp* pProp=NULL;
+				if(pMAPI->GetSession()->OpenEntry(obj.cbEntryID, obj.lpEntryID, NULL, MAPI_BEST_ACCESS, &ulObjType, (LPUNKNOWN*)&pProp)==S_OK)
+				{
+					CContactRecord record;
+					if(!CMAPIContactLoader::IsContact(pProp))
+					{
+						// a contact whose class was changed drops out
+						Remove(CMAPIEntryID(obj.cbEntryID, (const BYTE*)obj.lpEntryID));
+						CheckDelta();
+					}
+					else if(loader.Load(pProp, record)) Update(record);
+					RELEASE(pProp);
+				}
+			}
+			else
+			{
+				Remove(CMAPIEntryID(obj.cbEntryID, (const BYTE*)obj.lpEntryID));
+				CheckDelta();
+			}
+			break;
+
+		case fnevObjectDeleted:
+			if(obj.ulObjType!=MAPI_MESSAGE) break;
+			Remove(CMAPIEntryID(obj.cbEntryID, (const BYTE*)obj.lpEntryID));
+			CheckDelta();
+			break;
+		}
+	}
+}
+
+void CMAPIContactIndex::AddEntry(const CMAPIEntryID& entryID, LPCTSTR* szFields)
+{
+	Entry entry;
+	entry.m_entryID=entryID;
+	entry.m_bDeleted=FALSE;
+	for(int i=0;i<FIELD_COUNT;i++)
+	{
+		if(szFields[i] && *szFields[i])
+		{
+			entry.m_nStrings[i]=AddString(szFields[i]);
+			entry.m_nKeys[i]=AddKey(szFields[i]);
+		}
+		else
+		{
+			entry.m_nStrings[i]=entry.m_nKeys[i]=-1;
+		}
+	}
+
+	int nEntry=(int)m_arEntries.Add(entry);
+	if(!entryID.IsEmpty()) m_mapEntries.SetAt(entryID, nEntry);
+}
+
+// returns the offset of szString in the pool, adding it if it isn't there yet
+int CMAPIContactIndex::AddString(LPCTSTR szString)
+{
+	int nOffset;
+	if(m_mapStrings.Lookup(szString, nOffset)) return nOffset;
+
+	nOffset=(int)m_arStrings.GetSize();
+	int nLength=(int)_tcslen(szString)+1;
+	m_arStrings.SetSize(nOffset+nLength);
+	memcpy(m_arStrings.GetData()+nOffset, szString, nLength*sizeof(TCHAR));
+	m_mapStrings.SetAt(szString, nOffset);
+	return nOffset;
+}
+
+// lower case copy of szString used for matching
+int CMAPIContactIndex::AddKey(LPCTSTR szString)
+{
+	CString strKey=szString;
+	strKey.MakeLower();
+
+	int nOffset;
+	if(m_mapKeys.Lookup(strKey, nOffset)) return nOffset;
+
+	nOffset=(int)m_arKeys.GetSize();
+	int nLength=strKey.GetLength()+1;
+	m_arKeys.SetSize(nOffset+nLength);
+	memcpy(m_arKeys.GetData()+nOffset, (LPCTSTR)strKey, nLength*sizeof(TCHAR));
+	m_mapKeys.SetAt(strKey, nOffset);
+	return nOffset;
+}
+
+// rebuilds once the delta and the tombstones get past an eighth of the index
+void CMAPIContactIndex::CheckDelta()
+{
+	int nDelta=(int)m_arEntries.GetSize()-m_nIndexed+m_nDeleted;
+	if(nDelta>max(MIN_DELTA, m_nIndexed/8)) Build();
+}
+
+// drops deleted entries and the strings only they used
+void CMAPIContactIndex::Compact()
+{
+	CArray<Entry, Entry&> arEntries;
+	arEntries.Copy(m_arEntries);
+	CArray<TCHAR, TCHAR> arStrings;
+	arStrings.Copy(m_arStrings);
+
+	m_arEntries.RemoveAll();
+	m_mapEntries.RemoveAll();
+	m_arStrings.RemoveAll();
+	m_arKeys.RemoveAll();
+	m_mapStrings.RemoveAll();
+	m_mapKeys.RemoveAll();
+	m_nDeleted=0;
+
+	LPCTSTR szFields[FIELD_COUNT];
+	for(int i=0;i<arEntries.GetSize();i++)
+	{
+		Entry& entry=arEntries[i];
+		if(entry.m_bDeleted) continue;
+		for(int j=0;j<FIELD_COUNT;j++)
+		{
+			szFields[j]=(entry.m_nStrings[j]>=0) ? arStrings.GetData()+entry.m_nStrings[j] : NULL;
+		}
+		AddEntry(entry.m_entryID, szFields);
+	}
+}
+
+// delta entries first (they are the most recently changed), then the sorted word keys
+void CMAPIContactIndex::SearchPrefix(LPCTSTR* szTokens, int nTokens, CArray<int, int>& arEntries, CArray<int, int>& arScores, int nMaxResults)
+{
+	int i;
+	for(i=m_nIndexed;i<m_arEntries.GetSize() && arEntries.GetSize()<nMaxResults;i++)
+	{
+		if(!m_arEntries[i].m_bDeleted && !m_arScores[i] && MatchesAllTokens(i, szTokens, nTokens))
+		{
+			m_arScores[i]=-1;
+			arEntries.Add(i);
+			arScores.Add(PREFIX_SCORE);
+		}
+	}
+
+	// lower bound of the first word, all keys starting with it follow
+	LPCTSTR szPrefix=szTokens[0];
+	int nLength=(int)_tcslen(szPrefix);
+	int nLow=0, nHigh=(int)m_arWords.GetSize();
+	while(nLow<nHigh)
+	{
+		int nMid=(nLow+nHigh)/2;
+		if(_tcscmp(GetKey(m_arWords[nMid].m_nKey), szPrefix)<0) nLow=nMid+1;
+		else nHigh=nMid;
+	}
+
+	for(i=nLow;i<m_arWords.GetSize() && arEntries.GetSize()<nMaxResults;i++)
+	{
+		WordKey& word=m_arWords[i];
+		if(_tcsncmp(GetKey(word.m_nKey), szPrefix, nLength)) break;
+		if(m_arEntries[word.m_nEntry].m_bDeleted || m_arScores[word.m_nEntry]) continue;
+		if(nTokens>1 && !MatchesAllTokens(word.m_nEntry, szTokens+1, nTokens-1)) continue;
+
+		m_arScores[word.m_nEntry]=-1;
+		arEntries.Add(word.m_nEntry);
+		arScores.Add(PREFIX_SCORE);
+	}
+}
+
+// counts the trigrams of szText each entry shares using the posting lists (and directly for the delta),
+// scores are the percentage of the query's trigrams found
+void CMAPIContactIndex::SearchFuzzy(LPCTSTR szText, CArray<int, int>& arEntries, CArray<int, int>& arScores, int nMaxResults)
+{
+	int nLength=(int)_tcslen(szText);
+	CArray<ULONGLONG, ULONGLONG> arQuery;
+	arQuery.SetSize(nLength+1);
+	int nQuery=GetTrigrams(szText, arQuery.GetData(), nLength+1);
+	if(!nQuery) return;
+
+	qsort(arQuery.GetData(), nQuery, sizeof(ULONGLONG), CompareTrigrams);
+	int nUnique=1;
+	for(int i=1;i<nQuery;i++)
+	{
+		if(arQuery[i]!=arQuery[nUnique-1]) arQuery[nUnique++]=arQuery[i];
+	}
+	nQuery=nUnique;
+
+	CArray<int, int> arTouched;
+	int i, j;
+	for(i=0;i<nQuery;i++)
+	{
+		int nTrigram=FindTrigram(arQuery[i]);
+		if(nTrigram<0) continue;
+		for(j=m_arPostingStart[nTrigram];j<m_arPostingStart[nTrigram+1];j++)
+		{
+			int nEntry=m_arPostings[j];
+			if(m_arScores[nEntry]<0 || m_arEntries[nEntry].m_bDeleted) continue;
+			if(!m_arScores[nEntry]) arTouched.Add(nEntry);
+			m_arScores[nEntry]++;
+		}
+	}
+
+	CArray<ULONGLONG, ULONGLONG> arTrigrams;
+	for(i=m_nIndexed;i<m_arEntries.GetSize();i++)
+	{
+		Entry& entry=m_arEntries[i];
+		if(entry.m_bDeleted || m_arScores[i]<0) continue;
+
+		// the delta is small, so gather the entry's trigrams and look each query trigram up directly
+		int nTrigrams=0;
+		for(j=0;j<FIELD_COUNT;j++)
+		{
+			LPCTSTR szKey=GetKey(entry.m_nKeys[j]);
+			if(!szKey) continue;
+			int nKeyLength=(int)_tcslen(szKey);
+			arTrigrams.SetSize(nTrigrams+nKeyLength+1);
+			nTrigrams+=GetTrigrams(szKey, arTrigrams.GetData()+nTrigrams, nKeyLength+1);
+		}
+
+		int nShared=0;
+		for(int k=0;k<nQuery;k++)
+		{
+			for(int t=0;t<nTrigrams;t++)
+			{
+				if(arTrigrams[t]==arQuery[k])
+				{
+					nShared++;
+					break;
+				}
+			}
+		}
+		if(nShared)
+		{
+			arTouched.Add(i);
+			m_arScores[i]=nShared;
+		}
+	}
+
+	// keep the candidates sharing at least half the trigrams, best first
+	int nCandidates=0;
+	for(i=0;i<arTouched.GetSize();i++)
+	{
+		int nEntry=arTouched[i];
+		if(m_arScores[nEntry]*2>=nQuery) arTouched[nCandidates++]=nEntry;
+		else m_arScores[nEntry]=0;
+	}
+	qsort_s(arTouched.GetData(), nCandidates, sizeof(int), CompareScores, m_arScores.GetData());
+
+	for(i=0;i<nCandidates;i++)
+	{
+		int nEntry=arTouched[i];
+		if(arEntries.GetSize()<nMaxResults)
+		{
+			arEntries.Add(nEntry);
+			arScores.Add(m_arScores[nEntry]*100/nQuery);
+			m_arScores[nEntry]=-1;
+		}
+		else m_arScores[nEntry]=0;
+	}
+	for(i=nCandidates;i<arTouched.GetSize();i++) m_arScores[arTouched[i]]=0;
+}
+
+BOOL CMAPIContactIndex::MatchesAllTokens(int nEntry, LPCTSTR* szTokens, int nTokens)
+{
+	Entry& entry=m_arEntries[nEntry];
+	for(int i=0;i<nTokens;i++)
+	{
+		int nLength=(int)_tcslen(szTokens[i]);
+		BOOL bFound=FALSE;
+		for(int j=0;j<FIELD_COUNT && !bFound;j++)
+		{
+			LPCTSTR szKey=GetKey(entry.m_nKeys[j]);
+			if(szKey) bFound=HasWordPrefix(szKey, szTokens[i], nLength);
+		}
+		if(!bFound) return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL CMAPIContactIndex::HasWordPrefix(LPCTSTR szKey, LPCTSTR szPrefix, int nLength)
+{
+	for(int i=0;szKey[i];i++)
+	{
+		if(!IsSeparator(szKey[i]) && (!i || IsSeparator(szKey[i-1])) && !_tcsncmp(szKey+i, szPrefix, nLength)) return TRUE;
+	}
+	return FALSE;
+}
+
+int CMAPIContactIndex::FindTrigram(ULONGLONG ullTrigram)
+{
+	int nLow=0, nHigh=(int)m_arTrigrams.GetSize()-1;
+	while(nLow<=nHigh)
+	{
+		int nMid=(nLow+nHigh)/2;
+		if(m_arTrigrams[nMid]==ullTrigram) return nMid;
+		if(m_arTrigrams[nMid]<ullTrigram) nLow=nMid+1;
+		else nHigh=nMid-1;
+	}
+	return -1;
+}
+
+void CMAPIContactIndex::GetResult(int nEntry, int nScore, CContactIndexResult& result)
+{
+	Entry& entry=m_arEntries[nEntry];
+	LPCTSTR szStrings=m_arStrings.GetData();
+
+	result.m_entryID=entry.m_entryID;
+	result.m_nScore=nScore;
+	result.m_strDisplayName=(entry.m_nStrings[FIELD_NAME]>=0) ? szStrings+entry.m_nStrings[FIELD_NAME] : _T("");
+	result.m_strEmail=_T("");
+	for(int i=FIELD_EMAIL1;i<=FIELD_EMAIL3;i++)
+	{
+		if(entry.m_nStrings[i]>=0)
+		{
+			result.m_strEmail=szStrings+entry.m_nStrings[i];
+			break;
+		}
+	}
+	result.m_strCompany=(entry.m_nStrings[FIELD_COMPANY]>=0) ? szStrings+entry.m_nStrings[FIELD_COMPANY] : _T("");
+}
+
+BOOL CMAPIContactIndex::IsSeparator(TCHAR ch)
+{
+	if(ch<=(TCHAR)' ') return TRUE;
+	switch(ch)
+	{
+	case (TCHAR)'.':
+	case (TCHAR)',':
+	case (TCHAR)';':
+	case (TCHAR)'@':
+	case (TCHAR)'-':
+	case (TCHAR)'_':
+	case (TCHAR)'(':
+	case (TCHAR)')':
+	case (TCHAR)'<':
+	case (TCHAR)'>':
+	case (TCHAR)'"':
+	case (TCHAR)'\'':
+		return TRUE;
+	}
+	return FALSE;
+}
+
+ULONGLONG CMAPIContactIndex::MakeTrigram(TCHAR ch1, TCHAR ch2, TCHAR ch3)
+{
+	return ((ULONGLONG)(_TUCHAR)ch1<<32) | ((ULONGLONG)(_TUCHAR)ch2<<16) | (ULONGLONG)(_TUCHAR)ch3;
+}
+
+// trigrams of szKey with separators folded to a space and a leading space, so word starts weigh more
+int CMAPIContactIndex::GetTrigrams(LPCTSTR szKey, ULONGLONG* pTrigrams, int nMax)
+{
+	int nTrigrams=0;
+	TCHAR ch1=(TCHAR)' ', ch2=0;
+	for(int i=0;szKey[i] && nTrigrams<nMax;i++)
+	{
+		TCHAR ch3=IsSeparator(szKey[i]) ? (TCHAR)' ' : szKey[i];
+		if(i) pTrigrams[nTrigrams++]=MakeTrigram(ch1, ch2, ch3);
+		if(i) ch1=ch2;
+		ch2=ch3;
+	}
+	return nTrigrams;
+}
+
+// orders the word keys by their text (pContext is the key pool)
+int __cdecl CMAPIContactIndex::CompareWords(void* pContext, const void* p1, const void* p2)
+{
+	LPCTSTR szKeys=(LPCTSTR)pContext;
+	const WordKey* pWord1=(const WordKey*)p1;
+	const WordKey* pWord2=(const WordKey*)p2;
+	int nCompare=_tcscmp(szKeys+pWord1->m_nKey, szKeys+pWord2->m_nKey);
+	return nCompare ? nCompare : pWord1->m_nEntry-pWord2->m_nEntry;
+}
+
+int __cdecl CMAPIContactIndex::ComparePostings(const void* p1, const void* p2)
+{
+	const Posting* pPosting1=(const Posting*)p1;
+	const Posting* pPosting2=(const Posting*)p2;
+	if(pPosting1->m_ullTrigram!=pPosting2->m_ullTrigram) return (pPosting1->m_ullTrigram<pPosting2->m_ullTrigram) ? -1 : 1;
+	return pPosting1->m_nEntry-pPosting2->m_nEntry;
+}
+
+// highest score first (pContext is the score array)
+int __cdecl CMAPIContactIndex::CompareScores(void* pContext, const void* p1, const void* p2)
+{
+	const int* pScores=(const int*)pContext;
+	int nEntry1=*(const int*)p1, nEntry2=*(const int*)p2;
+	if(pScores[nEntry1]!=pScores[nEntry2]) return pScores[nEntry2]-pScores[nEntry1];
+	return nEntry1-nEntry2;
+}
+
+int __cdecl CMAPIContactIndex::CompareTrigrams(const void* p1, const void* p2)
+{
+	ULONGLONG ull1=*(const ULONGLONG*)p1, ull2=*(const ULONGLONG*)p2;
+	if(ull1==ull2) return 0;
+	return (ull1<ull2) ? -1 : 1;
+}
@@ -0,0 +1,137 @@
+#ifndef __MAPICONTACTINDEX_H__
+#define __MAPICONTACTINDEX_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContactIndex.h
+// Description: In memory prefix and trigram index over contacts for recipient autocomplete
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CContactIndexResult
+
+class AFX_EXT_CLASS CContactIndexResult
+{
+public:
+	CContactIndexResult();
+
+// Attributes
+public:
+	CMAPIEntryID m_entryID;
+	CString m_strDisplayName;
+	CString m_strEmail;
+	CString m_strCompany;
+	int m_nScore;
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIContactIndex
+
+// Indexes display name, the three emails and company of each contact.  All strings live in two flat pools
+// (as entered and lower case, identical strings stored once), prefix search is a binary search over a sorted
+// array of word starts and fuzzy search counts shared trigrams using sorted posting lists.
+//
+// Contacts added, changed or removed after Build() go to a small delta that is searched linearly; once it
+// grows past a fraction of the index everything is rebuilt.  All functions lock, so OnNotify can be called from
+// the MAPI notification thread while the UI searches
+class AFX_EXT_CLASS CMAPIContactIndex
+{
+public:
+	CMAPIContactIndex();
+	~CMAPIContactIndex();
+
+	enum { FIELD_NAME, FIELD_EMAIL1, FIELD_EMAIL2, FIELD_EMAIL3, FIELD_COMPANY, FIELD_COUNT };
+	enum { SEARCH_PREFIX=1, SEARCH_FUZZY=2 };
+	enum { MIN_DELTA=256, MAX_TOKENS=8 };
+
+	struct Entry
+	{
+		CMAPIEntryID m_entryID;
+		int m_nStrings[FIELD_COUNT];
+		int m_nKeys[FIELD_COUNT];
+		BOOL m_bDeleted;
+	};
+
+	struct WordKey
+	{
+		int m_nKey;
+		int m_nEntry;
+	};
+
+	struct Posting
+	{
+		ULONGLONG m_ullTrigram;
+		int m_nEntry;
+	};
+
+// Attributes
+protected:
+	CArray<Entry, Entry&> m_arEntries;
+	CMap<CMAPIEntryID, const CMAPIEntryID&, int, int> m_mapEntries;
+	CArray<TCHAR, TCHAR> m_arStrings;
+	CArray<TCHAR, TCHAR> m_arKeys;
+	CMap<CString, LPCTSTR, int, int> m_mapStrings;
+	CMap<CString, LPCTSTR, int, int> m_mapKeys;
+
+	// built index, covers entries below m_nIndexed
+	int m_nIndexed;
+	int m_nDeleted;
+	CArray<WordKey, WordKey&> m_arWords;
+	CArray<ULONGLONG, ULONGLONG> m_arTrigrams;
+	CArray<int, int> m_arPostingStart;
+	CArray<int, int> m_arPostings;
+
+	CArray<int, int> m_arScores;
+	CMAPIEntryID m_folderID;
+	CRITICAL_SECTION m_cs;
+
+// Operations
+public:
+	BOOL Build(CMAPIFolder& folder, CMAPIContactLoader& loader);
+	void Build();
+	void RemoveAll();
+	void Add(CContactRecord& record);
+	void Update(CContactRecord& record);
+	BOOL Remove(const CMAPIEntryID& entryID);
+	int GetCount();
+
+	int Search(LPCTSTR szText, CArray<CContactIndexResult, CContactIndexResult&>& arResults, int nMaxResults=10, int nFlags=SEARCH_PREFIX | SEARCH_FUZZY);
+	void OnNotify(CMAPIEx* pMAPI, CMAPIContactLoader& loader, ULONG cNotification, LPNOTIFICATION lpNotifications);
+
+protected:
+	void AddEntry(const CMAPIEntryID& entryID, LPCTSTR* szFields);
+	int AddString(LPCTSTR szString);
+	int AddKey(LPCTSTR szString);
+	LPCTSTR GetKey(int nKey) { return (nKey>=0) ? m_arKeys.GetData()+nKey : NULL; }
+	void CheckDelta();
+	void Compact();
+
+	void SearchPrefix(LPCTSTR* szTokens, int nTokens, CArray<int, int>& arEntries, CArray<int, int>& arScores, int nMaxResults);
+	void SearchFuzzy(LPCTSTR szText, CArray<int, int>& arEntries, CArray<int, int>& arScores, int nMaxResults);
+	BOOL MatchesAllTokens(int nEntry, LPCTSTR* szTokens, int nTokens);
+	BOOL HasWordPrefix(LPCTSTR szKey, LPCTSTR szPrefix, int nLength);
+	int FindTrigram(ULONGLONG ullTrigram);
+	void GetResult(int nEntry, int nScore, CContactIndexResult& result);
+
+	static BOOL IsSeparator(TCHAR ch);
+	static ULONGLONG MakeTrigram(TCHAR ch1, TCHAR ch2, TCHAR ch3);
+	static int GetTrigrams(LPCTSTR szKey, ULONGLONG* pTrigrams, int nMax);
+	static int __cdecl CompareWords(void* pContext, const void* p1, const void* p2);
+	static int __cdecl ComparePostings(const void* p1, const void* p2);
+	static int __cdecl CompareScores(void* pContext, const void* p1, const void* p2);
+	static int __cdecl CompareTrigrams(const void* p1, const void* p2);
+
+private:
+	CMAPIContactIndex(const CMAPIContactIndex&);
+	CMAPIContactIndex& operator=(const CMAPIContactIndex&);
+};
+
+#endif
@@ -0,0 +1,574 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContactLoader.cpp
+// Description: Reads every field of a contact in one GetProps into a plain record
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+#define CATEGORIES_PROPERTY L"Keywords"
+
+// same order as PhoneNumberIDs in MAPIContact.cpp
+const ULONG ContactPhoneNumberTags[CContactRecord::MAX_PHONE_NUMBERS]={
+	PR_PRIMARY_TELEPHONE_NUMBER, PR_BUSINESS_TELEPHONE_NUMBER, PR_HOME_TELEPHONE_NUMBER,
+	PR_CALLBACK_TELEPHONE_NUMBER, PR_BUSINESS2_TELEPHONE_NUMBER, PR_MOBILE_TELEPHONE_NUMBER,
+	PR_RADIO_TELEPHONE_NUMBER, PR_CAR_TELEPHONE_NUMBER, PR_OTHER_TELEPHONE_NUMBER,
+	PR_PAGER_TELEPHONE_NUMBER, PR_PRIMARY_FAX_NUMBER, PR_BUSINESS_FAX_NUMBER,
+	PR_HOME_FAX_NUMBER, PR_TELEX_NUMBER, PR_ISDN_NUMBER, PR_ASSISTANT_TELEPHONE_NUMBER,
+	PR_HOME2_TELEPHONE_NUMBER, PR_TTYTDD_PHONE_NUMBER, PR_COMPANY_MAIN_PHONE_NUMBER
+};
+
+// same order as ContactAddressTag in MAPIContact.cpp
+const ULONG ContactAddressTags[CContactAddress::MAX_ADDRESS_TYPES][5]={
+	{ PR_HOME_ADDRESS_CITY, PR_HOME_ADDRESS_COUNTRY, PR_HOME_ADDRESS_STATE_OR_PROVINCE,
+		PR_HOME_ADDRESS_STREET, PR_HOME_ADDRESS_POSTAL_CODE },
+	{ PR_BUSINESS_ADDRESS_CITY, PR_BUSINESS_ADDRESS_COUNTRY, PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE,
+		PR_BUSINESS_ADDRESS_STREET, PR_BUSINESS_ADDRESS_POSTAL_CODE },
+	{ PR_OTHER_ADDRESS_CITY, PR_OTHER_ADDRESS_COUNTRY, PR_OTHER_ADDRESS_STATE_OR_PROVINCE,
+		PR_OTHER_ADDRESS_STREET, PR_OTHER_ADDRESS_POSTAL_CODE },
+};
+
+const ULONG ContactTags[]={
+	PR_MESSAGE_FLAGS, PR_ENTRYID, PR_LAST_MODIFICATION_TIME, PR_DISPLAY_NAME, PR_GIVEN_NAME, PR_MIDDLE_NAME, PR_SURNAME,
+	PR_DISPLAY_NAME_PREFIX, PR_GENERATION, PR_NICKNAME, PR_TITLE, PR_COMPANY_NAME, PR_DEPARTMENT_NAME, PR_OFFICE_LOCATION,
+	PR_PROFESSION, PR_MANAGER_NAME, PR_ASSISTANT, PR_SPOUSE_NAME, PR_PERSONAL_HOME_PAGE, PR_BUSINESS_HOME_PAGE,
+	PR_SENSITIVITY, PR_BIRTHDAY, PR_WEDDING_ANNIVERSARY, PR_POSTAL_ADDRESS
+};
+
+const GUID GUIDContactPublicStrings={0x00020329, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+
+/////////////////////////////////////////////////////////////
+// CContactRecord
+
+CContactRecord::CContactRecord()
+{
+	Empty();
+}
+
+void CContactRecord::Empty()
+{
+	m_entryID.Empty();
+	m_ftLastModified.dwLowDateTime=m_ftLastModified.dwHighDateTime=0;
+	m_strDisplayName.Empty();
+	m_strGivenName.Empty();
+	m_strMiddleName.Empty();
+	m_strSurname.Empty();
+	m_strDisplayNamePrefix.Empty();
+	m_strGeneration.Empty();
+	m_strNickName.Empty();
+	m_strFileAs.Empty();
+	int i;
+	for(i=0;i<MAX_EMAILS;i++)
+	{
+		m_strEmail[i].Empty();
+		m_strEmailDisplayAs[i].Empty();
+	}
+	m_strIMAddress.Empty();
+	m_strTitle.Empty();
+	m_strCompany.Empty();
+	m_strDepartment.Empty();
+	m_strOffice.Empty();
+	m_strProfession.Empty();
+	m_strManagerName.Empty();
+	m_strAssistantName.Empty();
+	m_strSpouseName.Empty();
+	m_strHomePage.Empty();
+	m_strBusinessHomePage.Empty();
+	for(i=0;i<MAX_PHONE_NUMBERS;i++) m_strPhoneNumbers[i].Empty();
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		m_strStreet[i].Empty();
+		m_strCity[i].Empty();
+		m_strStateOrProvince[i].Empty();
+		m_strPostalCode[i].Empty();
+		m_strCountry[i].Empty();
+	}
+	m_strPostalAddress.Empty();
+	m_strCategories.Empty();
+	m_nSensitivity=-1;
+	m_bBirthday=FALSE;
+	m_bAnniversary=FALSE;
+	memset(&m_tmBirthday, 0, sizeof(SYSTEMTIME));
+	memset(&m_tmAnniversary, 0, sizeof(SYSTEMTIME));
+}
+
+LPCTSTR CContactRecord::GetEmail(int nIndex)
+{
+	if(nIndex<1 || nIndex>MAX_EMAILS) return NULL;
+	return m_strEmail[nIndex-1];
+}
+
+// takes the same IDs as CMAPIContact::GetPhoneNumber (ie PR_BUSINESS_TELEPHONE_NUMBER)
+LPCTSTR CContactRecord::GetPhoneNumber(ULONG ulPhoneNumberID)
+{
+	int nIndex=GetPhoneNumberIndex(ulPhoneNumberID);
+	return (nIndex>=0) ? (LPCTSTR)m_strPhoneNumbers[nIndex] : NULL;
+}
+
+BOOL CContactRecord::GetAddress(CContactAddress& address, CContactAddress::AddressType nType)
+{
+	if(nType<CContactAddress::HOME || nType>CContactAddress::OTHER) return FALSE;
+	address.m_nType=nType;
+	address.m_strStreet=m_strStreet[nType];
+	address.m_strCity=m_strCity[nType];
+	address.m_strStateOrProvince=m_strStateOrProvince[nType];
+	address.m_strPostalCode=m_strPostalCode[nType];
+	address.m_strCountry=m_strCountry[nType];
+	return TRUE;
+}
+
+int CContactRecord::GetPhoneNumberIndex(ULONG ulPhoneNumberID)
+{
+	for(int i=0;i<MAX_PHONE_NUMBERS;i++)
+	{
+		if(ContactPhoneNumberTags[i]==ulPhoneNumberID) return i;
+	}
+	return -1;
+}
+
+ULONG CContactRecord::GetPhoneNumberID(int nIndex)
+{
+	return (nIndex>=0 && nIndex<MAX_PHONE_NUMBERS) ? ContactPhoneNumberTags[nIndex] : PR_NULL;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIContactLoader
+
+CMAPIContactLoader::CMAPIContactLoader()
+{
+	m_pTags=NULL;
+	m_nColumns=COLUMNS_ALL;
+}
+
+CMAPIContactLoader::~CMAPIContactLoader()
+{
+	Release();
+}
+
+// pProp is anything in the store the contacts live in (the contacts folder or one of its contacts), named
+// property IDs are per store so Init again before loading contacts from another store.  Use bCreate before
+// calling Write so named properties the store hasn't seen yet get IDs.  Write needs COLUMNS_ALL
+BOOL CMAPIContactLoader::Init(IMAPIProp* pProp, BOOL bCreate, int nColumns)
+{
+	Release();
+	m_nColumns=nColumns;
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	if(!pProp) return FALSE;
+
+	const GUID guidOutlookData1={CMAPIContact::OUTLOOK_DATA1, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+	const ULONG EmailIDs[CContactRecord::MAX_EMAILS]={ CMAPIContact::OUTLOOK_EMAIL1, CMAPIContact::OUTLOOK_EMAIL2, CMAPIContact::OUTLOOK_EMAIL3 };
+
+	// named properties in PROP_FILE_AS..CONTACT_COLS order
+	const int nNamed=CONTACT_COLS-PROP_FILE_AS;
+	MAPINAMEID nameIDs[nNamed];
+	LPMAPINAMEID lpNameIDs[nNamed];
+	int i, j;
+	for(i=0;i<nNamed;i++)
+	{
+		nameIDs[i].lpguid=(GUID*)&guidOutlookData1;
+		nameIDs[i].ulKind=MNID_ID;
+		lpNameIDs[i]=&nameIDs[i];
+	}
+	nameIDs[PROP_FILE_AS-PROP_FILE_AS].Kind.lID=CMAPIContact::OUTLOOK_FILE_AS;
+	nameIDs[PROP_IM_ADDRESS-PROP_FILE_AS].Kind.lID=CMAPIContact::OUTLOOK_IM_ADDRESS;
+	nameIDs[PROP_CATEGORIES-PROP_FILE_AS].lpguid=(GUID*)&GUIDContactPublicStrings;
+	nameIDs[PROP_CATEGORIES-PROP_FILE_AS].ulKind=MNID_STRING;
+	nameIDs[PROP_CATEGORIES-PROP_FILE_AS].Kind.lpwstrName=(LPWSTR)CATEGORIES_PROPERTY;
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		// see CMAPIContact::GetEmail and GetEmailDisplayAs
+		nameIDs[PROP_EMAIL_ADDRTYPE-PROP_FILE_AS+i].Kind.lID=EmailIDs[i]-1;
+		nameIDs[PROP_EMAIL-PROP_FILE_AS+i].Kind.lID=EmailIDs[i];
+		nameIDs[PROP_EMAIL_ORIGINAL-PROP_FILE_AS+i].Kind.lID=EmailIDs[i]+1;
+		nameIDs[PROP_EMAIL_DISPLAY_AS-PROP_FILE_AS+i].Kind.lID=EmailIDs[i]-3;
+	}
+
+	LPSPropTagArray pNamedTags=NULL;
+	if(FAILED(pProp->GetIDsFromNames(nNamed, lpNameIDs, bCreate ? MAPI_CREATE : 0, &pNamedTags))) return FALSE;
+
+	if(MAPIAllocateBuffer(CbNewSPropTagArray(CONTACT_COLS), (LPVOID*)&m_pTags)!=S_OK)
+	{
+		MAPIFreeBuffer(pNamedTags);
+		return FALSE;
+	}
+
+	m_pTags->cValues=CONTACT_COLS;
+	for(i=0;i<PROP_PHONE_NUMBERS;i++) m_pTags->aulPropTag[i]=ContactTags[i];
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++) m_pTags->aulPropTag[PROP_PHONE_NUMBERS+i]=ContactPhoneNumberTags[i];
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		for(j=0;j<5;j++) m_pTags->aulPropTag[PROP_ADDRESSES+i*5+j]=ContactAddressTags[i][j];
+	}
+
+	// named properties that don't exist in this store yet are left as empty columns, the tables need real
+	// types rather than the PT_UNSPECIFIED GetIDsFromNames returns
+	for(i=0;i<nNamed;i++)
+	{
+		ULONG ulTag=pNamedTags->aulPropTag[i];
+		if(PROP_TYPE(ulTag)==PT_ERROR) ulTag=PR_NULL;
+		else ulTag=PROP_TAG((PROP_FILE_AS+i==PROP_CATEGORIES) ? PT_MV_TSTRING : PT_TSTRING, PROP_ID(ulTag));
+		m_pTags->aulPropTag[PROP_FILE_AS+i]=ulTag;
+	}
+	MAPIFreeBuffer(pNamedTags);
+
+	if(m_nColumns==COLUMNS_LIST)
+	{
+		for(i=0;i<CONTACT_COLS;i++)
+		{
+			if(!IsListColumn(i)) m_pTags->aulPropTag[i]=PR_NULL;
+		}
+	}
+	return TRUE;
+#endif
+}
+
+void CMAPIContactLoader::Release()
+{
+	if(m_pTags) MAPIFreeBuffer(m_pTags);
+	m_pTags=NULL;
+}
+
+BOOL CMAPIContactLoader::Load(CMAPIContact& contact, CContactRecord& record)
+{
+	return Load(contact.Contact(), record);
+}
+
+// one GetProps for the whole contact
+BOOL CMAPIContactLoader::Load(IMAPIProp* pContact, CContactRecord& record)
+{
+	if(!m_pTags || !pContact)
+	{
+		record.Empty();
+		return FALSE;
+	}
+
+	CMAPIProperties props;
+	ULONG ulCount=0;
+	LPSPropValue pProps=NULL;
+	if(FAILED(pContact->GetProps(m_pTags, CMAPIEx::cm_nMAPICode, &ulCount, &pProps))) return FALSE;
+	props.Attach(pProps, ulCount);
+
+	Fill(props.GetProps(), props.GetCount(), record);
+	return TRUE;
+}
+
+// pProps is laid out like GetTags(), either from GetProps or a contents table row
+void CMAPIContactLoader::Fill(LPSPropValue pProps, ULONG ulCount, CContactRecord& record)
+{
+	record.Empty();
+	if(!pProps || ulCount<CONTACT_COLS) return;
+
+	if(PROP_TYPE(pProps[PROP_ENTRYID].ulPropTag)==PT_BINARY) record.m_entryID=pProps[PROP_ENTRYID].Value.bin;
+	if(PROP_TYPE(pProps[PROP_LAST_MODIFIED].ulPropTag)==PT_SYSTIME) record.m_ftLastModified=pProps[PROP_LAST_MODIFIED].Value.ft;
+
+	record.m_strDisplayName=GetString(pProps, ulCount, PROP_DISPLAY_NAME);
+	record.m_strGivenName=GetString(pProps, ulCount, PROP_GIVEN_NAME);
+	record.m_strMiddleName=GetString(pProps, ulCount, PROP_MIDDLE_NAME);
+	record.m_strSurname=GetString(pProps, ulCount, PROP_SURNAME);
+	record.m_strDisplayNamePrefix=GetString(pProps, ulCount, PROP_DISPLAY_NAME_PREFIX);
+	record.m_strGeneration=GetString(pProps, ulCount, PROP_GENERATION);
+	record.m_strNickName=GetString(pProps, ulCount, PROP_NICKNAME);
+	record.m_strTitle=GetString(pProps, ulCount, PROP_TITLE);
+	record.m_strCompany=GetString(pProps, ulCount, PROP_COMPANY);
+	record.m_strDepartment=GetString(pProps, ulCount, PROP_DEPARTMENT);
+	record.m_strOffice=GetString(pProps, ulCount, PROP_OFFICE);
+	record.m_strProfession=GetString(pProps, ulCount, PROP_PROFESSION);
+	record.m_strManagerName=GetString(pProps, ulCount, PROP_MANAGER_NAME);
+	record.m_strAssistantName=GetString(pProps, ulCount, PROP_ASSISTANT);
+	record.m_strSpouseName=GetString(pProps, ulCount, PROP_SPOUSE_NAME);
+	record.m_strHomePage=GetString(pProps, ulCount, PROP_HOME_PAGE);
+	record.m_strBusinessHomePage=GetString(pProps, ulCount, PROP_BUSINESS_HOME_PAGE);
+	record.m_strPostalAddress=GetString(pProps, ulCount, PROP_POSTAL_ADDRESS);
+	record.m_strFileAs=GetString(pProps, ulCount, PROP_FILE_AS);
+	record.m_strIMAddress=GetString(pProps, ulCount, PROP_IM_ADDRESS);
+
+	if(PROP_TYPE(pProps[PROP_SENSITIVITY].ulPropTag)==PT_LONG) record.m_nSensitivity=pProps[PROP_SENSITIVITY].Value.l;
+	record.m_bBirthday=GetDate(pProps, ulCount, PROP_BIRTHDAY, record.m_tmBirthday);
+	record.m_bAnniversary=GetDate(pProps, ulCount, PROP_ANNIVERSARY, record.m_tmAnniversary);
+
+	int i;
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+	{
+		record.m_strPhoneNumbers[i]=GetString(pProps, ulCount, PROP_PHONE_NUMBERS+i);
+	}
+
+	// in ContactAddressTags order: city, country, state, street, postal code
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		int nIndex=PROP_ADDRESSES+i*5;
+		record.m_strCity[i]=GetString(pProps, ulCount, nIndex);
+		record.m_strCountry[i]=GetString(pProps, ulCount, nIndex+1);
+		record.m_strStateOrProvince[i]=GetString(pProps, ulCount, nIndex+2);
+		record.m_strStreet[i]=GetString(pProps, ulCount, nIndex+3);
+		record.m_strPostalCode[i]=GetString(pProps, ulCount, nIndex+4);
+	}
+
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		record.m_strEmail[i]=GetString(pProps, ulCount, PROP_EMAIL+i);
+
+		// for EX types we use the original display name, like CMAPIContact::GetEmail
+		LPCTSTR szAddrType=GetString(pProps, ulCount, PROP_EMAIL_ADDRTYPE+i);
+		if(szAddrType && !_tcscmp(szAddrType, _T("EX")))
+		{
+			LPCTSTR szOriginal=GetString(pProps, ulCount, PROP_EMAIL_ORIGINAL+i);
+			if(szOriginal) record.m_strEmail[i]=szOriginal;
+		}
+		record.m_strEmailDisplayAs[i]=GetString(pProps, ulCount, PROP_EMAIL_DISPLAY_AS+i);
+	}
+
+	LPSPropValue pCategories=&pProps[PROP_CATEGORIES];
+	if(PROP_TYPE(pCategories->ulPropTag)==PT_MV_TSTRING)
+	{
+		for(ULONG j=0;j<pCategories->Value.MVSZ.cValues;j++)
+		{
+			LPCTSTR szCategory=CMAPIEx::GetValidMVString(*pCategories, j);
+			if(szCategory && *szCategory)
+			{
+				if(record.m_strCategories.GetLength()) record.m_strCategories+=';';
+				record.m_strCategories+=szCategory;
+			}
+		}
+	}
+}
+
+// Sets every non empty field of record on contact in one SetProps, email addresses are stored as SMTP like
+// CMAPIContact::SetEmail.  The display name and file as are built from the name parts when missing.  bNew adds
+// the defaults CMAPIContact::Create sets, for contacts created without them.  Nothing is saved, call
+// contact.Save() when done
+BOOL CMAPIContactLoader::Write(CMAPIContact& contact, CContactRecord& record, BOOL bNew)
+{
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	if(!m_pTags || m_nColumns!=COLUMNS_ALL || !contact.Contact()) return FALSE;
+
+	CString strDisplayName=record.m_strDisplayName, strFileAs=record.m_strFileAs;
+	if(strDisplayName.IsEmpty() || strFileAs.IsEmpty())
+	{
+		// see CMAPIContact::UpdateDisplayName
+		CString strName;
+		LPCTSTR szNames[]={ record.m_strGivenName, record.m_strMiddleName, record.m_strSurname };
+		for(int i=0;i<3;i++)
+		{
+			if(!*szNames[i]) continue;
+			if(strName.GetLength()) strName+=(TCHAR)' ';
+			strName+=szNames[i];
+		}
+		if(strDisplayName.IsEmpty())
+		{
+			strDisplayName=record.m_strDisplayNamePrefix;
+			if(strName.GetLength())
+			{
+				if(strDisplayName.GetLength()) strDisplayName+=(TCHAR)' ';
+				strDisplayName+=strName;
+			}
+			if(record.m_strGeneration.GetLength())
+			{
+				if(strDisplayName.GetLength()) strDisplayName+=(TCHAR)' ';
+				strDisplayName+=record.m_strGeneration;
+			}
+		}
+		if(strFileAs.IsEmpty()) strFileAs=strName.GetLength() ? strName : strDisplayName;
+	}
+
+	LPCTSTR szValues[CONTACT_COLS];
+	memset(szValues, 0, sizeof(szValues));
+	szValues[PROP_DISPLAY_NAME]=strDisplayName;
+	szValues[PROP_GIVEN_NAME]=record.m_strGivenName;
+	szValues[PROP_MIDDLE_NAME]=record.m_strMiddleName;
+	szValues[PROP_SURNAME]=record.m_strSurname;
+	szValues[PROP_DISPLAY_NAME_PREFIX]=record.m_strDisplayNamePrefix;
+	szValues[PROP_GENERATION]=record.m_strGeneration;
+	szValues[PROP_NICKNAME]=record.m_strNickName;
+	szValues[PROP_TITLE]=record.m_strTitle;
+	szValues[PROP_COMPANY]=record.m_strCompany;
+	szValues[PROP_DEPARTMENT]=record.m_strDepartment;
+	szValues[PROP_OFFICE]=record.m_strOffice;
+	szValues[PROP_PROFESSION]=record.m_strProfession;
+	szValues[PROP_MANAGER_NAME]=record.m_strManagerName;
+	szValues[PROP_ASSISTANT]=record.m_strAssistantName;
+	szValues[PROP_SPOUSE_NAME]=record.m_strSpouseName;
+	szValues[PROP_HOME_PAGE]=record.m_strHomePage;
+	szValues[PROP_BUSINESS_HOME_PAGE]=record.m_strBusinessHomePage;
+	szValues[PROP_POSTAL_ADDRESS]=record.m_strPostalAddress;
+	szValues[PROP_FILE_AS]=strFileAs;
+	szValues[PROP_IM_ADDRESS]=record.m_strIMAddress;
+
+	int i;
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++) szValues[PROP_PHONE_NUMBERS+i]=record.m_strPhoneNumbers[i];
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		int nIndex=PROP_ADDRESSES+i*5;
+		szValues[nIndex]=record.m_strCity[i];
+		szValues[nIndex+1]=record.m_strCountry[i];
+		szValues[nIndex+2]=record.m_strStateOrProvince[i];
+		szValues[nIndex+3]=record.m_strStreet[i];
+		szValues[nIndex+4]=record.m_strPostalCode[i];
+	}
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		if(record.m_strEmail[i].IsEmpty()) continue;
+		szValues[PROP_EMAIL_ADDRTYPE+i]=_T("SMTP");
+		szValues[PROP_EMAIL+i]=record.m_strEmail[i];
+		szValues[PROP_EMAIL_ORIGINAL+i]=record.m_strEmail[i];
+		szValues[PROP_EMAIL_DISPLAY_AS+i]=record.m_strEmailDisplayAs[i].GetLength() ? record.m_strEmailDisplayAs[i] : record.m_strEmail[i];
+	}
+
+	// the string columns plus subject, sensitivity, the two dates, categories, message class and importance
+	SPropValue props[CONTACT_COLS+8];
+	ULONG ulCount=0;
+	for(i=0;i<CONTACT_COLS;i++)
+	{
+		ULONG ulTag=m_pTags->aulPropTag[i];
+		if(!szValues[i] || !*szValues[i] || PROP_TYPE(ulTag)!=PT_TSTRING) continue;
+		props[ulCount].ulPropTag=ulTag;
+		props[ulCount++].Value.LPSZ=(LPTSTR)szValues[i];
+	}
+	if(strFileAs.GetLength())
+	{
+		props[ulCount].ulPropTag=PR_SUBJECT;
+		props[ulCount++].Value.LPSZ=(LPTSTR)(LPCTSTR)strFileAs;
+		props[ulCount].ulPropTag=PR_NORMALIZED_SUBJECT;
+		props[ulCount++].Value.LPSZ=(LPTSTR)(LPCTSTR)strFileAs;
+	}
+	if(record.m_nSensitivity>=0 || bNew)
+	{
+		props[ulCount].ulPropTag=PR_SENSITIVITY;
+		props[ulCount++].Value.l=max(record.m_nSensitivity, 0);
+	}
+	if(bNew)
+	{
+		props[ulCount].ulPropTag=PR_MESSAGE_CLASS;
+		props[ulCount++].Value.LPSZ=(LPTSTR)_T("IPM.Contact");
+		props[ulCount].ulPropTag=PR_IMPORTANCE;
+		props[ulCount++].Value.l=IMPORTANCE_NORMAL;
+	}
+	if(record.m_bBirthday && SetDate(record.m_tmBirthday, props[ulCount].Value.ft)) props[ulCount++].ulPropTag=PR_BIRTHDAY;
+	if(record.m_bAnniversary && SetDate(record.m_tmAnniversary, props[ulCount].Value.ft)) props[ulCount++].ulPropTag=PR_WEDDING_ANNIVERSARY;
+
+	// categories are ';' separated in the record and a multi-value property in the contact
+	CString strCategories=record.m_strCategories;
+	CArray<LPTSTR, LPTSTR> arCategories;
+	ULONG ulCategoriesTag=m_pTags->aulPropTag[PROP_CATEGORIES];
+	if(strCategories.GetLength() && PROP_TYPE(ulCategoriesTag)==PT_MV_TSTRING)
+	{
+		LPTSTR szCategories=strCategories.GetBuffer();
+		LPTSTR szCategory=szCategories;
+		for(i=0;;i++)
+		{
+			if(szCategories[i] && szCategories[i]!=(TCHAR)';') continue;
+			BOOL bEnd=!szCategories[i];
+			szCategories[i]=0;
+			if(*szCategory) arCategories.Add(szCategory);
+			if(bEnd) break;
+			szCategory=szCategories+i+1;
+		}
+		if(arCategories.GetSize())
+		{
+			props[ulCount].ulPropTag=ulCategoriesTag;
+			props[ulCount].Value.MVSZ.cValues=(ULONG)arCategories.GetSize();
+			props[ulCount++].Value.MVSZ.LPPSZ=arCategories.GetData();
+		}
+	}
+
+	HRESULT hr=contact.Contact()->SetProps(ulCount, props, NULL);
+	return SUCCEEDED(hr);
+#endif
+}
+
+// Restricts pTable to contacts (IPM.Contact and custom forms derived from it), distribution lists and
+// anything else filed in a contacts folder are left out by the store
+BOOL CMAPIContactLoader::Restrict(LPMAPITABLE pTable)
+{
+	if(!pTable) return FALSE;
+
+	SRestriction res;
+	SPropValue prop;
+	prop.ulPropTag=PR_MESSAGE_CLASS;
+	prop.Value.LPSZ=(LPTSTR)_T("IPM.Contact");
+	res.rt=RES_CONTENT;
+	res.res.resContent.ulFuzzyLevel=FL_PREFIX | FL_IGNORECASE;
+	res.res.resContent.ulPropTag=PR_MESSAGE_CLASS;
+	res.res.resContent.lpProp=&prop;
+	return (pTable->Restrict(&res, TBL_BATCH)==S_OK);
+}
+
+// the same test as Restrict for a single item, for notifications
+BOOL CMAPIContactLoader::IsContact(IMAPIProp* pProp)
+{
+	if(!pProp) return FALSE;
+
+	SizedSPropTagArray(1, Tags)={1,{PR_MESSAGE_CLASS}};
+	ULONG ulCount=0;
+	LPSPropValue pProps=NULL;
+	if(FAILED(pProp->GetProps((LPSPropTagArray)&Tags, CMAPIEx::cm_nMAPICode, &ulCount, &pProps))) return FALSE;
+
+	LPCTSTR szClass=CMAPIEx::GetValidString(pProps[0]);
+	BOOL bContact=(szClass && !_tcsnicmp(szClass, _T("IPM.Contact"), 11));
+	MAPIFreeBuffer(pProps);
+	return bContact;
+}
+
+BOOL CMAPIContactLoader::IsListColumn(int nColumn)
+{
+	if(nColumn>=PROP_PHONE_NUMBERS && nColumn<PROP_ADDRESSES) return TRUE;
+	if(nColumn>=PROP_EMAIL_ADDRTYPE) return TRUE;
+
+	switch(nColumn)
+	{
+	case PROP_MESSAGE_FLAGS:
+	case PROP_ENTRYID:
+	case PROP_LAST_MODIFIED:
+	case PROP_DISPLAY_NAME:
+	case PROP_GIVEN_NAME:
+	case PROP_MIDDLE_NAME:
+	case PROP_SURNAME:
+	case PROP_NICKNAME:
+	case PROP_TITLE:
+	case PROP_COMPANY:
+	case PROP_DEPARTMENT:
+	case PROP_FILE_AS:
+	case PROP_CATEGORIES:
+		return TRUE;
+	}
+	return FALSE;
+}
+
+LPCTSTR CMAPIContactLoader::GetString(LPSPropValue pProps, ULONG ulCount, int nIndex)
+{
+	if((ULONG)nIndex>=ulCount || PROP_TYPE(pProps[nIndex].ulPropTag)!=PT_TSTRING) return NULL;
+	return pProps[nIndex].Value.LPSZ;
+}
+
+// converted like CMAPIContact::GetBirthday
+BOOL CMAPIContactLoader::GetDate(LPSPropValue pProps, ULONG ulCount, int nIndex, SYSTEMTIME& tm)
+{
+	if((ULONG)nIndex>=ulCount || PROP_TYPE(pProps[nIndex].ulPropTag)!=PT_SYSTIME) return FALSE;
+
+	SYSTEMTIME tmUTC;
+	FileTimeToSystemTime(&pProps[nIndex].Value.ft, &tmUTC);
+	SystemTimeToTzSpecificLocalTime(NULL, &tmUTC, &tm);
+	return TRUE;
+}
+
+#ifndef _WIN32_WCE
+// reverses GetDate, tm is local time
+BOOL CMAPIContactLoader::SetDate(SYSTEMTIME& tm, FILETIME& ft)
+{
+	SYSTEMTIME tmUTC;
+	if(!TzSpecificLocalTimeToSystemTime(NULL, &tm, &tmUTC)) return FALSE;
+	return SystemTimeToFileTime(&tmUTC, &ft);
+}
+#endif
@@ -0,0 +1,146 @@
+#ifndef __MAPICONTACTLOADER_H__
+#define __MAPICONTACTLOADER_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContactLoader.h
+// Description: Reads every field of a contact in one GetProps into a plain record
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CContactRecord
+
+// Snapshot of a contact, strings are empty and m_bBirthday etc FALSE when the contact doesn't have the field
+class AFX_EXT_CLASS CContactRecord
+{
+public:
+	CContactRecord();
+
+	enum { MAX_EMAILS=3, MAX_PHONE_NUMBERS=19 };
+
+// Attributes
+public:
+	CMAPIEntryID m_entryID;
+	FILETIME m_ftLastModified;
+	CString m_strDisplayName;
+	CString m_strGivenName;
+	CString m_strMiddleName;
+	CString m_strSurname;
+	CString m_strDisplayNamePrefix;
+	CString m_strGeneration;
+	CString m_strNickName;
+	CString m_strFileAs;
+	CString m_strEmail[MAX_EMAILS];
+	CString m_strEmailDisplayAs[MAX_EMAILS];
+	CString m_strIMAddress;
+	CString m_strTitle;
+	CString m_strCompany;
+	CString m_strDepartment;
+	CString m_strOffice;
+	CString m_strProfession;
+	CString m_strManagerName;
+	CString m_strAssistantName;
+	CString m_strSpouseName;
+	CString m_strHomePage;
+	CString m_strBusinessHomePage;
+	CString m_strPhoneNumbers[MAX_PHONE_NUMBERS];
+	CString m_strStreet[CContactAddress::MAX_ADDRESS_TYPES];
+	CString m_strCity[CContactAddress::MAX_ADDRESS_TYPES];
+	CString m_strStateOrProvince[CContactAddress::MAX_ADDRESS_TYPES];
+	CString m_strPostalCode[CContactAddress::MAX_ADDRESS_TYPES];
+	CString m_strCountry[CContactAddress::MAX_ADDRESS_TYPES];
+	CString m_strPostalAddress;
+	CString m_strCategories;
+	int m_nSensitivity;
+	BOOL m_bBirthday;
+	SYSTEMTIME m_tmBirthday;
+	BOOL m_bAnniversary;
+	SYSTEMTIME m_tmAnniversary;
+
+// Operations
+public:
+	void Empty();
+	LPCTSTR GetEmail(int nIndex=1); // 1, 2 or 3 like CMAPIContact::GetEmail
+	LPCTSTR GetPhoneNumber(ULONG ulPhoneNumberID);
+	BOOL GetAddress(CContactAddress& address, CContactAddress::AddressType nType);
+
+	static int GetPhoneNumberIndex(ULONG ulPhoneNumberID);
+	static ULONG GetPhoneNumberID(int nIndex);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIContactLoader
+
+// Resolves the Outlook named properties of a contact once (per store) and then fills a CContactRecord with a
+// single GetProps per contact instead of the dozens of calls the CMAPIContact getters make:
+//
+//		CMAPIContactLoader loader;
+//		if(loader.Init(pFolder->Folder()))
+//		{
+//			while(pFolder->GetNextContact(contact)) loader.Load(contact, record);
+//		}
+class AFX_EXT_CLASS CMAPIContactLoader
+{
+public:
+	CMAPIContactLoader();
+	~CMAPIContactLoader();
+
+	// column layout of GetTags(), the named properties are resolved by Init.  The first two columns match
+	// CMAPIFolder::GetContents so the other GetNext functions work on a table set up with these columns
+	enum { PROP_MESSAGE_FLAGS, PROP_ENTRYID, PROP_LAST_MODIFIED, PROP_DISPLAY_NAME, PROP_GIVEN_NAME, PROP_MIDDLE_NAME, PROP_SURNAME,
+		PROP_DISPLAY_NAME_PREFIX, PROP_GENERATION, PROP_NICKNAME, PROP_TITLE, PROP_COMPANY, PROP_DEPARTMENT, PROP_OFFICE,
+		PROP_PROFESSION, PROP_MANAGER_NAME, PROP_ASSISTANT, PROP_SPOUSE_NAME, PROP_HOME_PAGE, PROP_BUSINESS_HOME_PAGE,
+		PROP_SENSITIVITY, PROP_BIRTHDAY, PROP_ANNIVERSARY, PROP_POSTAL_ADDRESS,
+		PROP_PHONE_NUMBERS, PROP_ADDRESSES=PROP_PHONE_NUMBERS+CContactRecord::MAX_PHONE_NUMBERS,
+		PROP_FILE_AS=PROP_ADDRESSES+5*CContactAddress::MAX_ADDRESS_TYPES, PROP_IM_ADDRESS, PROP_CATEGORIES,
+		PROP_EMAIL_ADDRTYPE, PROP_EMAIL=PROP_EMAIL_ADDRTYPE+CContactRecord::MAX_EMAILS,
+		PROP_EMAIL_ORIGINAL=PROP_EMAIL+CContactRecord::MAX_EMAILS, PROP_EMAIL_DISPLAY_AS=PROP_EMAIL_ORIGINAL+CContactRecord::MAX_EMAILS,
+		CONTACT_COLS=PROP_EMAIL_DISPLAY_AS+CContactRecord::MAX_EMAILS
+	};
+
+	// COLUMNS_LIST reads only what a contact list or index shows (names, company, emails, phone numbers and
+	// categories), the other columns are PR_NULL so the layout and Fill are the same
+	enum { COLUMNS_ALL, COLUMNS_LIST };
+
+// Attributes
+protected:
+	LPSPropTagArray m_pTags;
+	int m_nColumns;
+
+// Operations
+public:
+	BOOL Init(IMAPIProp* pProp, BOOL bCreate=FALSE, int nColumns=COLUMNS_ALL);
+	void Release();
+	BOOL IsInitialized() { return (m_pTags!=NULL); }
+	LPSPropTagArray GetTags() { return m_pTags; }
+	int GetColumns() { return m_nColumns; }
+
+	BOOL Load(CMAPIContact& contact, CContactRecord& record);
+	BOOL Load(IMAPIProp* pContact, CContactRecord& record);
+	static void Fill(LPSPropValue pProps, ULONG ulCount, CContactRecord& record);
+	BOOL Write(CMAPIContact& contact, CContactRecord& record, BOOL bNew=FALSE);
+	static BOOL Restrict(LPMAPITABLE pTable);
+	static BOOL IsContact(IMAPIProp* pProp);
+
+protected:
+	static BOOL IsListColumn(int nColumn);
+	static LPCTSTR GetString(LPSPropValue pProps, ULONG ulCount, int nIndex);
+	static BOOL GetDate(LPSPropValue pProps, ULONG ulCount, int nIndex, SYSTEMTIME& tm);
+#ifndef _WIN32_WCE
+	static BOOL SetDate(SYSTEMTIME& tm, FILETIME& ft);
+#endif
+
+private:
+	CMAPIContactLoader(const CMAPIContactLoader&);
+	CMAPIContactLoader& operator=(const CMAPIContactLoader&);
+};
+
+#endif
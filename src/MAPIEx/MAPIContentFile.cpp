@@ -0,0 +1,430 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContentFile.cpp
+// Description: Buffered reader and writer for the content lines of vCard and iCalendar files
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CMAPIContentFile
+
+CMAPIContentFile::CMAPIContentFile()
+{
+	m_bOpen=FALSE;
+	m_bWrite=FALSE;
+	m_bError=FALSE;
+	m_nLineLength=0;
+	m_nBufferLength=0;
+	m_nBufferPos=0;
+	m_bNext=FALSE;
+	m_nDeferred=0;
+}
+
+CMAPIContentFile::~CMAPIContentFile()
+{
+	DiscardDeferred();
+	Close();
+}
+
+// opens szPath for reading, or creates it for writing
+BOOL CMAPIContentFile::Open(LPCTSTR szPath, BOOL bWrite)
+{
+	Close();
+	UINT nFlags=bWrite ? (CFile::modeCreate | CFile::modeWrite | CFile::shareDenyWrite) : (CFile::modeRead | CFile::shareDenyWrite);
+	if(!m_file.Open(szPath, nFlags)) return FALSE;
+
+	m_bOpen=TRUE;
+	m_bWrite=bWrite;
+	m_bError=FALSE;
+	m_nLineLength=0;
+	m_nBufferLength=0;
+	m_nBufferPos=0;
+	m_bNext=FALSE;
+
+	if(!bWrite) Rewind();
+	return !m_bError;
+}
+
+// starts reading a file opened for reading from the beginning again
+BOOL CMAPIContentFile::Rewind()
+{
+	if(!m_bOpen || m_bWrite) return FALSE;
+	m_nBufferLength=0;
+	m_nBufferPos=0;
+	m_bNext=FALSE;
+	m_strNext.Empty();
+
+	// skip the UTF-8 byte order mark some tools write
+	try
+	{
+		m_file.SeekToBegin();
+		m_nBufferLength=m_file.Read(m_szBuffer, BUFFER_SIZE);
+	}
+	catch(CFileException* e)
+	{
+		e->Delete();
+		m_bError=TRUE;
+	}
+	if(m_nBufferLength>=3 && !memcmp(m_szBuffer, "\xEF\xBB\xBF", 3)) m_nBufferPos=3;
+	return !m_bError;
+}
+
+// flushes anything left to write, returns FALSE if any read or write failed
+BOOL CMAPIContentFile::Close()
+{
+	DiscardDeferred();
+	if(!m_bOpen) return FALSE;
+	if(m_bWrite) Flush();
+	try
+	{
+		m_file.Close();
+	}
+	catch(CFileException* e)
+	{
+		e->Delete();
+		m_bError=TRUE;
+	}
+	m_bOpen=FALSE;
+	m_strNext.Empty();
+	return !m_bError;
+}
+
+void CMAPIContentFile::BeginProperty(LPCSTR szName, LPCSTR szParams)
+{
+	PutASCII(szName);
+	if(szParams)
+	{
+		Put(";", 1);
+		PutASCII(szParams);
+	}
+	Put(":", 1);
+}
+
+// escapes szValue and writes it as UTF-8
+void CMAPIContentFile::PutValue(LPCTSTR szValue, int nLength)
+{
+	if(nLength<0) nLength=(int)_tcslen(szValue);
+#ifdef UNICODE
+	LPCWSTR wszValue=szValue;
+#else
+	CStringW strValue(szValue, nLength);
+	LPCWSTR wszValue=strValue;
+	nLength=strValue.GetLength();
+#endif
+
+	char szBytes[4];
+	for(int i=0;i<nLength;i++)
+	{
+		UINT ch=wszValue[i];
+		switch(ch)
+		{
+		case '\\':
+		case ';':
+		case ',':
+			szBytes[0]='\\';
+			szBytes[1]=(char)ch;
+			Put(szBytes, 2);
+			continue;
+		case '\r':
+			continue;
+		case '\n':
+			Put("\\n", 2);
+			continue;
+		}
+
+		if(ch>=0xD800 && ch<0xDC00 && i+1<nLength && wszValue[i+1]>=0xDC00 && wszValue[i+1]<0xE000)
+		{
+			ch=0x10000+((ch-0xD800)<<10)+(wszValue[++i]-0xDC00);
+		}
+
+		if(ch<0x80)
+		{
+			szBytes[0]=(char)ch;
+			Put(szBytes, 1);
+		}
+		else if(ch<0x800)
+		{
+			szBytes[0]=(char)(0xC0 | (ch>>6));
+			szBytes[1]=(char)(0x80 | (ch&0x3F));
+			Put(szBytes, 2);
+		}
+		else if(ch<0x10000)
+		{
+			szBytes[0]=(char)(0xE0 | (ch>>12));
+			szBytes[1]=(char)(0x80 | ((ch>>6)&0x3F));
+			szBytes[2]=(char)(0x80 | (ch&0x3F));
+			Put(szBytes, 3);
+		}
+		else
+		{
+			szBytes[0]=(char)(0xF0 | (ch>>18));
+			szBytes[1]=(char)(0x80 | ((ch>>12)&0x3F));
+			szBytes[2]=(char)(0x80 | ((ch>>6)&0x3F));
+			szBytes[3]=(char)(0x80 | (ch&0x3F));
+			Put(szBytes, 4);
+		}
+	}
+}
+
+void CMAPIContentFile::PutASCII(LPCSTR szText)
+{
+	while(*szText) Put(szText++, 1);
+}
+
+// szBytes is one character, lines are folded before a character that would take them past MAX_LINE octets
+void CMAPIContentFile::Put(const char* szBytes, int nBytes)
+{
+	if(m_nLineLength+nBytes>MAX_LINE)
+	{
+		if(m_nBufferLength+3>BUFFER_SIZE) Flush();
+		memcpy(m_szBuffer+m_nBufferLength, "\r\n ", 3);
+		m_nBufferLength+=3;
+		m_nLineLength=1;
+	}
+	if(m_nBufferLength+nBytes>BUFFER_SIZE) Flush();
+	memcpy(m_szBuffer+m_nBufferLength, szBytes, nBytes);
+	m_nBufferLength+=nBytes;
+	m_nLineLength+=nBytes;
+}
+
+void CMAPIContentFile::EndLine()
+{
+	if(m_nBufferLength+2>BUFFER_SIZE) Flush();
+	m_szBuffer[m_nBufferLength++]='\r';
+	m_szBuffer[m_nBufferLength++]='\n';
+	m_nLineLength=0;
+}
+
+BOOL CMAPIContentFile::Flush()
+{
+	if(m_nBufferLength && !m_bError)
+	{
+		try
+		{
+			m_file.Write(m_szBuffer, m_nBufferLength);
+		}
+		catch(CFileException* e)
+		{
+			e->Delete();
+			m_bError=TRUE;
+		}
+	}
+	m_nBufferLength=0;
+	return !m_bError;
+}
+
+// returns the next logical line, folded lines (continuations start with a space or tab) are joined
+BOOL CMAPIContentFile::ReadLine(CStringA& strLine)
+{
+	if(!m_bNext && !ReadPhysicalLine(m_strNext)) return FALSE;
+	strLine=m_strNext;
+	m_bNext=FALSE;
+
+	while(ReadPhysicalLine(m_strNext))
+	{
+		if(m_strNext.GetLength() && (m_strNext[0]==' ' || m_strNext[0]=='\t'))
+		{
+			strLine.Append((LPCSTR)m_strNext+1, m_strNext.GetLength()-1);
+		}
+		else
+		{
+			m_bNext=TRUE;
+			break;
+		}
+	}
+	return TRUE;
+}
+
+BOOL CMAPIContentFile::ReadPhysicalLine(CStringA& strLine)
+{
+	strLine.Empty();
+	BOOL bData=FALSE;
+	for(;;)
+	{
+		if(m_nBufferPos>=m_nBufferLength)
+		{
+			m_nBufferPos=0;
+			m_nBufferLength=0;
+			if(!m_bError)
+			{
+				try
+				{
+					m_nBufferLength=m_file.Read(m_szBuffer, BUFFER_SIZE);
+				}
+				catch(CFileException* e)
+				{
+					e->Delete();
+					m_bError=TRUE;
+				}
+			}
+			if(!m_nBufferLength)
+			{
+				if(!bData) return FALSE;
+				break;
+			}
+		}
+
+		bData=TRUE;
+		char* szStart=m_szBuffer+m_nBufferPos;
+		char* szEnd=(char*)memchr(szStart, '\n', m_nBufferLength-m_nBufferPos);
+		int nLength=szEnd ? (int)(szEnd-szStart) : m_nBufferLength-m_nBufferPos;
+		strLine.Append(szStart, nLength);
+		m_nBufferPos+=nLength;
+		if(szEnd)
+		{
+			m_nBufferPos++;
+			break;
+		}
+	}
+
+	int nLength=strLine.GetLength();
+	if(nLength && strLine[nLength-1]=='\r') strLine.Truncate(nLength-1);
+	return TRUE;
+}
+
+// Splits szLine, "[group.]NAME[;params]:value", in place and returns the name without its group.  Returns
+// NULL if there is no value, szParams is NULL if there are no parameters
+LPSTR CMAPIContentFile::SplitLine(LPSTR szLine, LPSTR& szParams, LPSTR& szValue)
+{
+	szValue=NULL;
+	BOOL bQuote=FALSE;
+	for(LPSTR sz=szLine;*sz;sz++)
+	{
+		if(*sz=='"') bQuote=!bQuote;
+		else if(*sz==':' && !bQuote)
+		{
+			*sz=0;
+			szValue=sz+1;
+			break;
+		}
+	}
+	if(!szValue) return NULL;
+
+	szParams=strchr(szLine, ';');
+	if(szParams) *szParams++=0;
+	LPSTR szName=strrchr(szLine, '.');
+	return szName ? szName+1 : szLine;
+}
+
+
+// splits szValue on unescaped chSeparator in place, the last component holds the rest of the value and
+// missing components are NULL.  Returns the number of components found
+int CMAPIContentFile::Split(LPSTR szValue, LPSTR* szComponents, int nMax, char chSeparator)
+{
+	int nCount=0;
+	szComponents[nCount++]=szValue;
+	for(LPSTR sz=szValue;*sz && nCount<nMax;sz++)
+	{
+		if(*sz=='\\' && sz[1]) sz++;
+		else if(*sz==chSeparator)
+		{
+			*sz=0;
+			szComponents[nCount++]=sz+1;
+		}
+	}
+	for(int i=nCount;i<nMax;i++) szComponents[i]=NULL;
+	return nCount;
+}
+
+// unescapes a UTF-8 value, values that aren't valid UTF-8 are taken as the ANSI code page
+void CMAPIContentFile::Decode(LPCSTR szValue, CString& strValue)
+{
+	strValue.Empty();
+	if(!szValue || !*szValue) return;
+
+	int nLength=(int)strlen(szValue);
+	CStringA strText;
+	LPSTR szText=strText.GetBuffer(nLength);
+	BOOL bASCII=TRUE;
+	int j=0;
+	for(int i=0;i<nLength;i++)
+	{
+		char ch=szValue[i];
+		if(ch=='\\' && i+1<nLength)
+		{
+			ch=szValue[++i];
+			if(ch=='n' || ch=='N')
+			{
+				szText[j++]='\r';
+				ch='\n';
+			}
+		}
+		if((BYTE)ch>=0x80) bASCII=FALSE;
+		szText[j++]=ch;
+	}
+
+	if(bASCII)
+	{
+		strValue=CString(szText, j);
+		return;
+	}
+
+	UINT nCodePage=CP_UTF8;
+	int nWide=MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, szText, j, NULL, 0);
+	if(!nWide)
+	{
+		nCodePage=CP_ACP;
+		nWide=MultiByteToWideChar(CP_ACP, 0, szText, j, NULL, 0);
+	}
+#ifdef UNICODE
+	LPWSTR wszValue=strValue.GetBuffer(nWide);
+	MultiByteToWideChar(nCodePage, 0, szText, j, wszValue, nWide);
+	strValue.ReleaseBuffer(nWide);
+#else
+	CStringW strWide;
+	LPWSTR wszValue=strWide.GetBuffer(nWide);
+	MultiByteToWideChar(nCodePage, 0, szText, j, wszValue, nWide);
+	strWide.ReleaseBuffer(nWide);
+	strValue=strWide;
+#endif
+}
+
+// Takes over item's message (item is closed) to be saved with the rest of the batch, a full batch is saved here.
+// Returns FALSE once an item couldn't be saved, nSaved and nFailed are added to like SaveDeferred
+BOOL CMAPIContentFile::Defer(CMAPIObject& item, int& nSaved, int& nFailed)
+{
+	LPMESSAGE pMessage=item.Message();
+	if(!pMessage)
+	{
+		nFailed++;
+		return FALSE;
+	}
+	pMessage->AddRef();
+	item.Close();
+	m_pDeferred[m_nDeferred++]=pMessage;
+	return (m_nDeferred<SAVE_BATCH) ? TRUE : SaveDeferred(nSaved, nFailed);
+}
+
+// Calls SaveChanges on the deferred items in the order they were created.  If one fails it and the ones after
+// it are released unsaved, so what's saved is always everything before the first failure
+BOOL CMAPIContentFile::SaveDeferred(int& nSaved, int& nFailed)
+{
+	int i=0;
+	for(;i<m_nDeferred;i++)
+	{
+		if(m_pDeferred[i]->SaveChanges(0)!=S_OK) break;
+		m_pDeferred[i]->Release();
+		nSaved++;
+	}
+	nFailed+=m_nDeferred-i;
+	BOOL bResult=(i==m_nDeferred);
+	for(;i<m_nDeferred;i++) m_pDeferred[i]->Release();
+	m_nDeferred=0;
+	return bResult;
+}
+
+void CMAPIContentFile::DiscardDeferred()
+{
+	for(int i=0;i<m_nDeferred;i++) m_pDeferred[i]->Release();
+	m_nDeferred=0;
+}
@@ -0,0 +1,78 @@
+#ifndef __MAPICONTENTFILE_H__
+#define __MAPICONTENTFILE_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIContentFile.h
+// Description: Buffered reader and writer for the content lines of vCard and iCalendar files
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIContentFile
+
+// vCard (RFC 6350) and iCalendar (RFC 5545) share the same "NAME;params:value" lines, escaping and folding.
+// This does the file side of both through one fixed buffer: values are written as escaped UTF-8 with lines
+// folded at 75 octets, and read back a logical (unfolded) line at a time.  Imports hand each item they create to
+// Defer, which saves them SAVE_BATCH at a time and stops at the first that can't be saved
+class AFX_EXT_CLASS CMAPIContentFile
+{
+public:
+	CMAPIContentFile();
+	~CMAPIContentFile();
+
+	enum { BUFFER_SIZE=65536, MAX_LINE=75, SAVE_BATCH=64 };
+
+// Attributes
+protected:
+	CFile m_file;
+	BOOL m_bOpen;
+	BOOL m_bWrite;
+	BOOL m_bError;
+	int m_nLineLength;
+	int m_nBufferLength;
+	int m_nBufferPos;
+	CStringA m_strNext;
+	BOOL m_bNext;
+	char m_szBuffer[BUFFER_SIZE];
+	LPMESSAGE m_pDeferred[SAVE_BATCH];
+	int m_nDeferred;
+
+// Operations
+public:
+	BOOL Open(LPCTSTR szPath, BOOL bWrite=FALSE);
+	BOOL Close();
+	BOOL Rewind();
+	BOOL IsOpen() { return m_bOpen; }
+
+protected:
+	void BeginProperty(LPCSTR szName, LPCSTR szParams);
+	void PutValue(LPCTSTR szValue, int nLength=-1);
+	void PutASCII(LPCSTR szText);
+	void Put(const char* szBytes, int nBytes);
+	void EndLine();
+	BOOL Flush();
+
+	BOOL ReadLine(CStringA& strLine);
+	BOOL ReadPhysicalLine(CStringA& strLine);
+	static LPSTR SplitLine(LPSTR szLine, LPSTR& szParams, LPSTR& szValue);
+	static int Split(LPSTR szValue, LPSTR* szComponents, int nMax, char chSeparator);
+	static void Decode(LPCSTR szValue, CString& strValue);
+
+	BOOL Defer(CMAPIObject& item, int& nSaved, int& nFailed);
+	BOOL SaveDeferred(int& nSaved, int& nFailed);
+	void DiscardDeferred();
+
+private:
+	CMAPIContentFile(const CMAPIContentFile&);
+	CMAPIContentFile& operator=(const CMAPIContentFile&);
+};
+
+#endif
@@ -0,0 +1,353 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIDateTime.cpp
+// Description: Cached time zone conversion and precompiled date formats for formatting many dates
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+const ULONGLONG DateTicksPerMinute=600000000;
+const ULONGLONG DateTicksPerDay=864000000000;
+const ULONGLONG DateMaxTicks=0x8000000000000000; // FileTimeToSystemTime's limit
+
+/////////////////////////////////////////////////////////////
+// CMAPITimeZone
+
+CMAPITimeZone::CMAPITimeZone()
+{
+	memset(&m_tzi, 0, sizeof(TIME_ZONE_INFORMATION));
+	SetTimeZone(m_tzi);
+	Refresh();
+}
+
+// reloads the local time zone, call after WM_TIMECHANGE or WM_SETTINGCHANGE
+BOOL CMAPITimeZone::Refresh()
+{
+	TIME_ZONE_INFORMATION tzi;
+	if(GetTimeZoneInformation(&tzi)==TIME_ZONE_ID_INVALID) return FALSE;
+	SetTimeZone(tzi);
+	return TRUE;
+}
+
+// converts with the rules of tzi instead of the local time zone
+void CMAPITimeZone::SetTimeZone(const TIME_ZONE_INFORMATION& tzi)
+{
+	m_tzi=tzi;
+	m_bDaylight=(m_tzi.StandardDate.wMonth && m_tzi.DaylightDate.wMonth);
+	m_llStandardBias=(LONGLONG)(m_tzi.Bias+m_tzi.StandardBias)*(LONGLONG)DateTicksPerMinute;
+	m_llDaylightBias=(LONGLONG)(m_tzi.Bias+m_tzi.DaylightBias)*(LONGLONG)DateTicksPerMinute;
+	m_ullYearStart=m_ullYearEnd=0;
+	m_ullDaylight=m_ullStandard=0;
+}
+
+ULONGLONG CMAPITimeZone::ToLocal(ULONGLONG ullUTC)
+{
+	if(!m_bDaylight) return ullUTC-m_llStandardBias;
+	if(ullUTC<m_ullYearStart || ullUTC>=m_ullYearEnd) SetYear(ullUTC);
+
+	// the southern hemisphere switches to daylight time late in the year
+	BOOL bDaylight;
+	if(m_ullDaylight<m_ullStandard) bDaylight=(ullUTC>=m_ullDaylight && ullUTC<m_ullStandard);
+	else bDaylight=(ullUTC>=m_ullDaylight || ullUTC<m_ullStandard);
+	return ullUTC-(bDaylight ? m_llDaylightBias : m_llStandardBias);
+}
+
+// FALSE for a zero (unset) ftUTC
+BOOL CMAPITimeZone::ToLocal(const FILETIME& ftUTC, FILETIME& ftLocal)
+{
+	ULONGLONG ullUTC=GetTicks(ftUTC);
+	if(!ullUTC || ullUTC>=DateMaxTicks) return FALSE;
+	SetTicks(ToLocal(ullUTC), ftLocal);
+	return TRUE;
+}
+
+BOOL CMAPITimeZone::ToLocal(const FILETIME& ftUTC, SYSTEMTIME& tmLocal)
+{
+	ULONGLONG ullUTC=GetTicks(ftUTC);
+	if(!ullUTC || ullUTC>=DateMaxTicks) return FALSE;
+	return TicksToSystemTime(ToLocal(ullUTC), tmLocal);
+}
+
+// converts nCount dates, ones that can't be converted are zeroed.  Returns the number converted
+int CMAPITimeZone::ToLocal(const FILETIME* pUTC, SYSTEMTIME* pLocal, int nCount)
+{
+	int nConverted=0;
+	for(int i=0;i<nCount;i++)
+	{
+		if(ToLocal(pUTC[i], pLocal[i])) nConverted++;
+		else memset(&pLocal[i], 0, sizeof(SYSTEMTIME));
+	}
+	return nConverted;
+}
+
+// same result as FileTimeToSystemTime without the call
+BOOL CMAPITimeZone::TicksToSystemTime(ULONGLONG ullTicks, SYSTEMTIME& tm)
+{
+	if(ullTicks>=DateMaxTicks) return FALSE;
+
+	int nDays=(int)(ullTicks/DateTicksPerDay);
+	int nYear, nMonth, nDay;
+	CMAPIRecurrence::DateFromDays(nDays, nYear, nMonth, nDay);
+	tm.wYear=(WORD)nYear;
+	tm.wMonth=(WORD)nMonth;
+	tm.wDay=(WORD)nDay;
+	tm.wDayOfWeek=(WORD)CMAPIRecurrence::GetDayOfWeek(nDays);
+
+	DWORD dwMilliseconds=(DWORD)((ullTicks%DateTicksPerDay)/10000);
+	tm.wMilliseconds=(WORD)(dwMilliseconds%1000);
+	tm.wSecond=(WORD)((dwMilliseconds/1000)%60);
+	tm.wMinute=(WORD)((dwMilliseconds/60000)%60);
+	tm.wHour=(WORD)(dwMilliseconds/3600000);
+	return TRUE;
+}
+
+// Caches the UTC year holding ullUTC and its transitions.  Each transition is given in the local time in
+// effect before it.  Absolute (wYear) rules are applied to every year like relative ones
+void CMAPITimeZone::SetYear(ULONGLONG ullUTC)
+{
+	int nYear, nMonth, nDay;
+	CMAPIRecurrence::DateFromDays((int)(ullUTC/DateTicksPerDay), nYear, nMonth, nDay);
+	m_ullYearStart=(ULONGLONG)CMAPIRecurrence::DaysFromDate(nYear, 1, 1)*DateTicksPerDay;
+	m_ullYearEnd=(ULONGLONG)CMAPIRecurrence::DaysFromDate(nYear+1, 1, 1)*DateTicksPerDay;
+	m_ullDaylight=(ULONGLONG)CMAPIRecurrence::GetTransition(nYear, m_tzi.DaylightDate)*DateTicksPerMinute+m_llStandardBias;
+	m_ullStandard=(ULONGLONG)CMAPIRecurrence::GetTransition(nYear, m_tzi.StandardDate)*DateTicksPerMinute+m_llDaylightBias;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIDateFormat
+
+CMAPIDateFormat::CMAPIDateFormat()
+{
+}
+
+CMAPIDateFormat::CMAPIDateFormat(LPCTSTR szFormat, LCID lcid)
+{
+	Compile(szFormat, lcid);
+}
+
+// Parses a GetDateFormat/GetTimeFormat picture (d dd ddd dddd M MM MMM MMMM y yy yyyy h hh H HH m mm s ss t tt,
+// 'quoted' text and anything else as is) and loads lcid's names.  Like GetDateFormat, month names are in the
+// genitive (where the locale has one) if the picture has a d or dd.  FALSE if szFormat is empty
+BOOL CMAPIDateFormat::Compile(LPCTSTR szFormat, LCID lcid)
+{
+	m_arFields.RemoveAll();
+	m_strLiterals.Empty();
+	if(!szFormat || !*szFormat) return FALSE;
+
+	int i;
+	for(i=0;i<7;i++)
+	{
+		// LOCALE_SDAYNAME1 is Monday
+		m_strDayNames[(i+1)%7]=GetLocaleString(lcid, LOCALE_SDAYNAME1+i);
+		m_strDayAbbrevs[(i+1)%7]=GetLocaleString(lcid, LOCALE_SABBREVDAYNAME1+i);
+	}
+	m_strAM=GetLocaleString(lcid, LOCALE_S1159);
+	m_strPM=GetLocaleString(lcid, LOCALE_S2359);
+
+	while(*szFormat)
+	{
+		TCHAR ch=*szFormat;
+		if(ch=='\'')
+		{
+			// '' is a quote, otherwise the text up to the closing quote
+			szFormat++;
+			if(*szFormat=='\'')
+			{
+				AddLiteral(szFormat++, 1);
+				continue;
+			}
+			LPCTSTR szText=szFormat;
+			while(*szFormat && *szFormat!='\'') szFormat++;
+			AddLiteral(szText, (int)(szFormat-szText));
+			if(*szFormat) szFormat++;
+			continue;
+		}
+
+		int nCount=1;
+		while(szFormat[nCount]==ch) nCount++;
+		switch(ch)
+		{
+		case 'd': AddField((nCount>=4) ? FIELD_DAY_NAME : (nCount==3) ? FIELD_DAY_ABBREV : FIELD_DAY, nCount); break;
+		case 'M': AddField((nCount>=4) ? FIELD_MONTH_NAME : (nCount==3) ? FIELD_MONTH_ABBREV : FIELD_MONTH, nCount); break;
+		case 'y': AddField(FIELD_YEAR, (nCount>=3) ? 4 : nCount); break;
+		case 'h': AddField(FIELD_HOUR12, min(nCount, 2)); break;
+		case 'H': AddField(FIELD_HOUR24, min(nCount, 2)); break;
+		case 'm': AddField(FIELD_MINUTE, min(nCount, 2)); break;
+		case 's': AddField(FIELD_SECOND, min(nCount, 2)); break;
+		case 't': AddField(FIELD_AMPM, min(nCount, 2)); break;
+		default: AddLiteral(szFormat, nCount); break;
+		}
+		szFormat+=nCount;
+	}
+
+	BOOL bGenitive=FALSE;
+	for(i=0;i<m_arFields.GetSize() && !bGenitive;i++) bGenitive=(m_arFields[i].m_nType==FIELD_DAY);
+	for(i=0;i<12;i++)
+	{
+		m_strMonthNames[i]=GetMonthName(lcid, i+1, FALSE, bGenitive);
+		m_strMonthAbbrevs[i]=GetMonthName(lcid, i+1, TRUE, bGenitive);
+	}
+	return TRUE;
+}
+
+// Writes tm into szBuffer (nSize characters including the terminator).  Returns the length written, or 0 with
+// an empty szBuffer if it doesn't fit
+int CMAPIDateFormat::Format(const SYSTEMTIME& tm, LPTSTR szBuffer, int nSize)
+{
+	if(!szBuffer || nSize<=0) return 0;
+
+	LPTSTR szOut=szBuffer;
+	LPTSTR szEnd=szBuffer+nSize-1;
+	BOOL bFits=TRUE;
+	for(int i=0;i<m_arFields.GetSize() && bFits;i++)
+	{
+		Field& field=m_arFields[i];
+		CString* pName=NULL;
+		switch(field.m_nType)
+		{
+		case FIELD_LITERAL:
+			bFits=PutText(szOut, szEnd, (LPCTSTR)m_strLiterals+field.m_nLiteral, field.m_nLength);
+			break;
+		case FIELD_DAY:
+			bFits=PutNumber(szOut, szEnd, tm.wDay, field.m_nWidth);
+			break;
+		case FIELD_DAY_ABBREV:
+			pName=&m_strDayAbbrevs[tm.wDayOfWeek%7];
+			break;
+		case FIELD_DAY_NAME:
+			pName=&m_strDayNames[tm.wDayOfWeek%7];
+			break;
+		case FIELD_MONTH:
+			bFits=PutNumber(szOut, szEnd, tm.wMonth, field.m_nWidth);
+			break;
+		case FIELD_MONTH_ABBREV:
+			pName=&m_strMonthAbbrevs[(tm.wMonth+11)%12];
+			break;
+		case FIELD_MONTH_NAME:
+			pName=&m_strMonthNames[(tm.wMonth+11)%12];
+			break;
+		case FIELD_YEAR:
+			bFits=PutNumber(szOut, szEnd, (field.m_nWidth<=2) ? tm.wYear%100 : tm.wYear, field.m_nWidth);
+			break;
+		case FIELD_HOUR12:
+			bFits=PutNumber(szOut, szEnd, (tm.wHour%12) ? tm.wHour%12 : 12, field.m_nWidth);
+			break;
+		case FIELD_HOUR24:
+			bFits=PutNumber(szOut, szEnd, tm.wHour, field.m_nWidth);
+			break;
+		case FIELD_MINUTE:
+			bFits=PutNumber(szOut, szEnd, tm.wMinute, field.m_nWidth);
+			break;
+		case FIELD_SECOND:
+			bFits=PutNumber(szOut, szEnd, tm.wSecond, field.m_nWidth);
+			break;
+		case FIELD_AMPM:
+			{
+				CString& strAMPM=(tm.wHour<12) ? m_strAM : m_strPM;
+				bFits=PutText(szOut, szEnd, strAMPM, (field.m_nWidth==1) ? min(strAMPM.GetLength(), 1) : strAMPM.GetLength());
+			}
+			break;
+		}
+		if(pName) bFits=PutText(szOut, szEnd, *pName, pName->GetLength());
+	}
+
+	if(!bFits) szOut=szBuffer;
+	*szOut=0;
+	return (int)(szOut-szBuffer);
+}
+
+// ftUTC in the local time of timeZone, 0 with an empty szBuffer for an unset date
+int CMAPIDateFormat::Format(CMAPITimeZone& timeZone, const FILETIME& ftUTC, LPTSTR szBuffer, int nSize)
+{
+	SYSTEMTIME tm;
+	if(!timeZone.ToLocal(ftUTC, tm))
+	{
+		if(szBuffer && nSize>0) *szBuffer=0;
+		return 0;
+	}
+	return Format(tm, szBuffer, nSize);
+}
+
+void CMAPIDateFormat::AddField(int nType, int nWidth)
+{
+	Field field;
+	field.m_nType=nType;
+	field.m_nWidth=nWidth;
+	field.m_nLiteral=field.m_nLength=0;
+	m_arFields.Add(field);
+}
+
+// adjacent literals are merged into one field
+void CMAPIDateFormat::AddLiteral(LPCTSTR szText, int nLength)
+{
+	if(nLength<=0) return;
+
+	int nFields=(int)m_arFields.GetSize();
+	if(!nFields || m_arFields[nFields-1].m_nType!=FIELD_LITERAL)
+	{
+		AddField(FIELD_LITERAL, 0);
+		m_arFields[nFields].m_nLiteral=m_strLiterals.GetLength();
+		nFields++;
+	}
+	m_strLiterals.Append(szText, nLength);
+	m_arFields[nFields-1].m_nLength+=nLength;
+}
+
+BOOL CMAPIDateFormat::PutText(LPTSTR& szBuffer, LPTSTR szEnd, LPCTSTR szText, int nLength)
+{
+	if(szEnd-szBuffer<nLength) return FALSE;
+	memcpy(szBuffer, szText, nLength*sizeof(TCHAR));
+	szBuffer+=nLength;
+	return TRUE;
+}
+
+// nValue zero padded to nWidth digits
+BOOL CMAPIDateFormat::PutNumber(LPTSTR& szBuffer, LPTSTR szEnd, int nValue, int nWidth)
+{
+	TCHAR szDigits[16];
+	int nDigits=0;
+	do
+	{
+		szDigits[nDigits++]=(TCHAR)('0'+nValue%10);
+		nValue/=10;
+	} while(nValue && nDigits<16);
+	while(nDigits<nWidth && nDigits<16) szDigits[nDigits++]='0';
+
+	if(szEnd-szBuffer<nDigits) return FALSE;
+	while(nDigits) *szBuffer++=szDigits[--nDigits];
+	return TRUE;
+}
+
+CString CMAPIDateFormat::GetLocaleString(LCID lcid, LCTYPE lcType)
+{
+	TCHAR szValue[80];
+	if(!GetLocaleInfo(lcid, lcType, szValue, 80)) return CString();
+	return szValue;
+}
+
+// Month nMonth (1-12) of lcid, with bGenitive as GetDateFormat writes it after a day number.  "dd" is always
+// two digits, so the name is what GetDateFormat puts after them
+CString CMAPIDateFormat::GetMonthName(LCID lcid, int nMonth, BOOL bAbbrev, BOOL bGenitive)
+{
+	if(bGenitive)
+	{
+		SYSTEMTIME tm;
+		memset(&tm, 0, sizeof(SYSTEMTIME));
+		tm.wYear=2000;
+		tm.wMonth=(WORD)nMonth;
+		tm.wDay=1;
+
+		TCHAR szValue[80];
+		if(GetDateFormat(lcid, 0, &tm, bAbbrev ? _T("ddMMM") : _T("ddMMMM"), szValue, 80) && lstrlen(szValue)>2) return szValue+2;
+	}
+	return GetLocaleString(lcid, (bAbbrev ? LOCALE_SABBREVMONTHNAME1 : LOCALE_SMONTHNAME1)+nMonth-1);
+}
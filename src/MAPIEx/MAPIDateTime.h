@@ -0,0 +1,117 @@
+#ifndef __MAPIDATETIME_H__
+#define __MAPIDATETIME_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIDateTime.h
+// Description: Cached time zone conversion and precompiled date formats for formatting many dates
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPITimeZone
+
+// Converts UTC FILETIMEs (or their 100ns ticks) to local time with the rules of one time zone, the local one
+// unless SetTimeZone is called.  The daylight transitions of the last year converted are cached in UTC ticks,
+// so converting the dates of a list is a couple of compares and an add per date.  Results match
+// SystemTimeToTzSpecificLocalTime.  Keeps its cache between calls, so use one per thread
+class AFX_EXT_CLASS CMAPITimeZone
+{
+public:
+	CMAPITimeZone();
+
+// Attributes
+protected:
+	TIME_ZONE_INFORMATION m_tzi;
+	BOOL m_bDaylight;
+	LONGLONG m_llStandardBias;
+	LONGLONG m_llDaylightBias;
+
+	// the UTC year last converted
+	ULONGLONG m_ullYearStart;
+	ULONGLONG m_ullYearEnd;
+	ULONGLONG m_ullDaylight;
+	ULONGLONG m_ullStandard;
+
+// Operations
+public:
+	BOOL Refresh();
+	void SetTimeZone(const TIME_ZONE_INFORMATION& tzi);
+	const TIME_ZONE_INFORMATION& GetTimeZone() { return m_tzi; }
+
+	ULONGLONG ToLocal(ULONGLONG ullUTC);
+	BOOL ToLocal(const FILETIME& ftUTC, FILETIME& ftLocal);
+	BOOL ToLocal(const FILETIME& ftUTC, SYSTEMTIME& tmLocal);
+	int ToLocal(const FILETIME* pUTC, SYSTEMTIME* pLocal, int nCount);
+
+	static ULONGLONG GetTicks(const FILETIME& ft) { return ((ULONGLONG)ft.dwHighDateTime<<32) | ft.dwLowDateTime; }
+	static void SetTicks(ULONGLONG ullTicks, FILETIME& ft) { ft.dwLowDateTime=(DWORD)ullTicks; ft.dwHighDateTime=(DWORD)(ullTicks>>32); }
+	static BOOL TicksToSystemTime(ULONGLONG ullTicks, SYSTEMTIME& tm);
+
+protected:
+	void SetYear(ULONGLONG ullUTC);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIDateFormat
+
+// A GetDateFormat/GetTimeFormat picture such as "MM/dd/yyyy hh:mm:ss tt" parsed once into fields, with the
+// locale's month and day names and AM/PM strings loaded up front.  Format then writes into the caller's buffer
+// without calling the NLS functions or allocating:
+//
+//		CMAPITimeZone timeZone;
+//		CMAPIDateFormat format(_T("MM/dd/yyyy hh:mm tt"));
+//		TCHAR szDate[64];
+//		while(folder.GetNextAppointment(record)) format.Format(timeZone, record.m_ftStart, szDate, 64);
+class AFX_EXT_CLASS CMAPIDateFormat
+{
+public:
+	CMAPIDateFormat();
+	CMAPIDateFormat(LPCTSTR szFormat, LCID lcid=LOCALE_SYSTEM_DEFAULT);
+
+	enum { FIELD_LITERAL, FIELD_DAY, FIELD_DAY_ABBREV, FIELD_DAY_NAME, FIELD_MONTH, FIELD_MONTH_ABBREV, FIELD_MONTH_NAME,
+		FIELD_YEAR, FIELD_HOUR12, FIELD_HOUR24, FIELD_MINUTE, FIELD_SECOND, FIELD_AMPM
+	};
+
+	struct Field
+	{
+		int m_nType;
+		int m_nWidth;
+		int m_nLiteral;		// FIELD_LITERAL, offset in m_strLiterals
+		int m_nLength;
+	};
+
+// Attributes
+protected:
+	CArray<Field, Field&> m_arFields;
+	CString m_strLiterals;
+	CString m_strMonthNames[12];
+	CString m_strMonthAbbrevs[12];
+	CString m_strDayNames[7];	// Sunday first like SYSTEMTIME
+	CString m_strDayAbbrevs[7];
+	CString m_strAM;
+	CString m_strPM;
+
+// Operations
+public:
+	BOOL Compile(LPCTSTR szFormat, LCID lcid=LOCALE_SYSTEM_DEFAULT);
+	int Format(const SYSTEMTIME& tm, LPTSTR szBuffer, int nSize);
+	int Format(CMAPITimeZone& timeZone, const FILETIME& ftUTC, LPTSTR szBuffer, int nSize);
+
+protected:
+	void AddField(int nType, int nWidth);
+	void AddLiteral(LPCTSTR szText, int nLength);
+	static BOOL PutText(LPTSTR& szBuffer, LPTSTR szEnd, LPCTSTR szText, int nLength);
+	static BOOL PutNumber(LPTSTR& szBuffer, LPTSTR szEnd, int nValue, int nWidth);
+	static CString GetLocaleString(LCID lcid, LCTYPE lcType);
+	static CString GetMonthName(LCID lcid, int nMonth, BOOL bAbbrev, BOOL bGenitive);
+};
+
+#endif
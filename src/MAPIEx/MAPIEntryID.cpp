@@ -0,0 +1,393 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIEntryID.cpp
+// Description: Entry ID value type usable as a hash key, with hex conversion and an interning table
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+// entry IDs start with 4 flag bytes followed by the 16 byte UID of the provider that issued them
+#define ENTRYID_FLAGS_SIZE 4
+#define ENTRYID_HEADER_SIZE (ENTRYID_FLAGS_SIZE+sizeof(MAPIUID))
+
+// Exchange address book entries (flags, MUIDEMSAB, version, type) are followed by the X500 DN
+#define EMSAB_DN_OFFSET (ENTRYID_HEADER_SIZE+8)
+
+const BYTE MUIDExchangeAB[]={ 0xDC, 0xA7, 0x40, 0xC8, 0xC0, 0x42, 0x10, 0x1A, 0xB4, 0xB9, 0x08, 0x00, 0x2B, 0x2F, 0xE1, 0x82 };
+
+// 64 bit FNV-1a
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
+#define FNV_PRIME 0x00000100000001B3ULL
+
+/////////////////////////////////////////////////////////////
+// CMAPIEntryID
+
+CMAPIEntryID::CMAPIEntryID()
+{
+	m_entryID.cb=0;
+	m_entryID.lpb=m_buffer;
+	m_ullHash=FNV_OFFSET_BASIS;
+}
+
+CMAPIEntryID::CMAPIEntryID(const SBinary& entryID)
+{
+	m_entryID.cb=0;
+	m_entryID.lpb=m_buffer;
+	Set(entryID.cb, entryID.lpb);
+}
+
+CMAPIEntryID::CMAPIEntryID(ULONG cb, const BYTE* lpb)
+{
+	m_entryID.cb=0;
+	m_entryID.lpb=m_buffer;
+	Set(cb, lpb);
+}
+
+CMAPIEntryID::CMAPIEntryID(const CMAPIEntryID& entryID)
+{
+	m_entryID.cb=0;
+	m_entryID.lpb=m_buffer;
+	*this=entryID;
+}
+
+#if _MSC_VER>=1600
+CMAPIEntryID::CMAPIEntryID(CMAPIEntryID&& entryID)
+{
+	m_entryID.cb=0;
+	m_entryID.lpb=m_buffer;
+	*this=(CMAPIEntryID&&)entryID;
+}
+#endif
+
+CMAPIEntryID::~CMAPIEntryID()
+{
+	Free();
+}
+
+void CMAPIEntryID::Set(ULONG cb, const BYTE* lpb)
+{
+	if(!lpb) cb=0;
+	const BYTE* pCurrent=GetData();
+	if(lpb==pCurrent && cb==m_entryID.cb) return;
+
+	// lpb may point into our own buffer, so copy before freeing
+	BYTE* pData=(cb>INLINE_SIZE) ? new BYTE[cb] : m_buffer;
+	if(cb) memmove(pData, lpb, cb);
+	if(pData!=pCurrent) Free();
+	m_entryID.lpb=pData;
+	m_entryID.cb=cb;
+	m_ullHash=Hash(cb, pData);
+}
+
+void CMAPIEntryID::Set(const SBinary* pEntryID)
+{
+	if(pEntryID) Set(pEntryID->cb, pEntryID->lpb);
+	else Empty();
+}
+
+void CMAPIEntryID::Empty()
+{
+	Free();
+	m_entryID.cb=0;
+	m_ullHash=FNV_OFFSET_BASIS;
+}
+
+// same format as before: two upper case hex digits per byte
+BOOL CMAPIEntryID::ToString(CString& strEntryID) const
+{
+	if(!m_entryID.cb) return FALSE;
+	ToString(m_entryID.cb, GetData(), strEntryID);
+	return TRUE;
+}
+
+BOOL CMAPIEntryID::FromString(LPCTSTR szEntryID)
+{
+	Empty();
+	if(!szEntryID) return FALSE;
+
+	int nLength=(int)_tcslen(szEntryID);
+	if(!nLength || (nLength&1)) return FALSE;
+
+	ULONG cb=nLength/2;
+	BYTE* pData=Allocate(cb);
+	if(FromString(szEntryID, pData, cb)!=(int)cb)
+	{
+		if(pData!=m_buffer) delete [] pData;
+		return FALSE;
+	}
+	m_entryID.lpb=pData;
+	m_entryID.cb=cb;
+	m_ullHash=Hash(cb, pData);
+	return TRUE;
+}
+
+// byte order, shorter IDs first; gives a stable order for sorting
+int CMAPIEntryID::Compare(const CMAPIEntryID& entryID) const
+{
+	if(m_entryID.cb!=entryID.m_entryID.cb) return (m_entryID.cb<entryID.m_entryID.cb) ? -1 : 1;
+	return memcmp(GetData(), entryID.GetData(), m_entryID.cb);
+}
+
+// binary equality only, see CMAPIEx::CompareEntryIDs for provider aware comparison
+BOOL CMAPIEntryID::operator==(const CMAPIEntryID& entryID) const
+{
+	if(m_ullHash!=entryID.m_ullHash || m_entryID.cb!=entryID.m_entryID.cb) return FALSE;
+	return !memcmp(GetData(), entryID.GetData(), m_entryID.cb);
+}
+
+int CMAPIEntryID::CompareLocal(const CMAPIEntryID& entryID, const MAPIUID* pStoreUIDs, int nStoreUIDs) const
+{
+	return CompareLocal(m_entryID.cb, GetData(), entryID.m_entryID.cb, entryID.GetData(), pStoreUIDs, nStoreUIDs);
+}
+
+CMAPIEntryID& CMAPIEntryID::operator=(const CMAPIEntryID& entryID)
+{
+	if(this!=&entryID)
+	{
+		Set(entryID.m_entryID.cb, entryID.GetData());
+	}
+	return *this;
+}
+
+CMAPIEntryID& CMAPIEntryID::operator=(const SBinary& entryID)
+{
+	Set(entryID.cb, entryID.lpb);
+	return *this;
+}
+
+#if _MSC_VER>=1600
+// heap allocated IDs are handed over, inline ones are copied
+CMAPIEntryID& CMAPIEntryID::operator=(CMAPIEntryID&& entryID)
+{
+	if(this!=&entryID)
+	{
+		if(entryID.m_entryID.cb>INLINE_SIZE)
+		{
+			Free();
+			m_entryID=entryID.m_entryID;
+			m_ullHash=entryID.m_ullHash;
+			entryID.m_entryID.lpb=entryID.m_buffer;
+			entryID.m_entryID.cb=0;
+			entryID.Empty();
+		}
+		else
+		{
+			Set(entryID.m_entryID.cb, entryID.GetData());
+		}
+	}
+	return *this;
+}
+#endif
+
+ULONGLONG CMAPIEntryID::Hash(ULONG cb, const BYTE* lpb)
+{
+	ULONGLONG ullHash=FNV_OFFSET_BASIS;
+	for(ULONG i=0;i<cb;i++)
+	{
+		ullHash^=lpb[i];
+		ullHash*=FNV_PRIME;
+	}
+	return ullHash;
+}
+
+// writes straight into the string buffer, two digits per byte from a lookup table
+void CMAPIEntryID::ToString(ULONG cb, const BYTE* lpb, CString& strHex)
+{
+	static const TCHAR szDigits[]=_T("0123456789ABCDEF");
+
+	LPTSTR szHex=strHex.GetBuffer(cb*2);
+	for(ULONG i=0;i<cb;i++)
+	{
+		*szHex++=szDigits[lpb[i]>>4];
+		*szHex++=szDigits[lpb[i]&0x0F];
+	}
+	strHex.ReleaseBuffer(cb*2);
+}
+
+// decodes pairs of hex digits (either case) into pData, returns the number of bytes written or -1 if
+// szHex contains anything but hex digits
+int CMAPIEntryID::FromString(LPCTSTR szHex, BYTE* pData, int nMaxBytes)
+{
+	int nBytes=0;
+	while(nBytes<nMaxBytes && szHex[0] && szHex[1])
+	{
+		int nHigh=HexValue(szHex[0]), nLow=HexValue(szHex[1]);
+		if(nHigh<0 || nLow<0) return -1;
+		pData[nBytes++]=(BYTE)((nHigh<<4)|nLow);
+		szHex+=2;
+	}
+	return nBytes;
+}
+
+// Answers what IMAPISession::CompareEntryIDs would without a round trip to the providers where the format is
+// known, returns ENTRYID_UNKNOWN when only the session can tell:
+//
+//	- byte identical IDs, or IDs that differ only in the flag bytes, are equal
+//	- long term IDs issued by one of pStoreUIDs (the stores of the session, PST/OST or Exchange) are equal
+//	  only if the rest of the ID is identical; IDs from two different stores are never equal
+//	- Exchange address book IDs are equal if their DNs match, ignoring case
+//	- short term IDs and anything else are left to the session
+int CMAPIEntryID::CompareLocal(ULONG cb1, const BYTE* lpb1, ULONG cb2, const BYTE* lpb2, const MAPIUID* pStoreUIDs, int nStoreUIDs)
+{
+	if(!lpb1) cb1=0;
+	if(!lpb2) cb2=0;
+	if(!cb1 || !cb2) return ENTRYID_DIFFERENT;
+	if(cb1==cb2 && !memcmp(lpb1, lpb2, cb1)) return ENTRYID_EQUAL;
+	if(cb1<ENTRYID_HEADER_SIZE || cb2<ENTRYID_HEADER_SIZE) return ENTRYID_UNKNOWN;
+
+	const BYTE* pUID1=lpb1+ENTRYID_FLAGS_SIZE;
+	const BYTE* pUID2=lpb2+ENTRYID_FLAGS_SIZE;
+	BOOL bSameProvider=!memcmp(pUID1, pUID2, sizeof(MAPIUID));
+
+	if(!bSameProvider)
+	{
+		if(IsStoreUID(pUID1, pStoreUIDs, nStoreUIDs) && IsStoreUID(pUID2, pStoreUIDs, nStoreUIDs)) return ENTRYID_DIFFERENT;
+		return ENTRYID_UNKNOWN;
+	}
+
+	if(!memcmp(pUID1, MUIDExchangeAB, sizeof(MAPIUID)))
+	{
+		if(cb1<=EMSAB_DN_OFFSET || cb2<=EMSAB_DN_OFFSET) return ENTRYID_UNKNOWN;
+		return CompareDN(lpb1+EMSAB_DN_OFFSET, cb1-EMSAB_DN_OFFSET, lpb2+EMSAB_DN_OFFSET, cb2-EMSAB_DN_OFFSET) ? ENTRYID_EQUAL : ENTRYID_DIFFERENT;
+	}
+
+	// the flags (MAPI_NOTRECIP, MAPI_THISSESSION etc) don't change which object the ID refers to
+	if(cb1==cb2 && !memcmp(lpb1+ENTRYID_HEADER_SIZE, lpb2+ENTRYID_HEADER_SIZE, cb1-ENTRYID_HEADER_SIZE)) return ENTRYID_EQUAL;
+
+	// abFlags[0] is zero for long term IDs, anything else (ie MAPI_SHORTTERM) needs the provider to resolve
+	if(!lpb1[0] && !lpb2[0] && IsStoreUID(pUID1, pStoreUIDs, nStoreUIDs)) return ENTRYID_DIFFERENT;
+	return ENTRYID_UNKNOWN;
+}
+
+// TRUE if the provider UID in the ID's header is one of pStoreUIDs
+BOOL CMAPIEntryID::IsFromStore(ULONG cb, const BYTE* lpb, const MAPIUID* pStoreUIDs, int nStoreUIDs)
+{
+	if(!lpb || cb<ENTRYID_HEADER_SIZE) return FALSE;
+	return IsStoreUID(lpb+ENTRYID_FLAGS_SIZE, pStoreUIDs, nStoreUIDs);
+}
+
+BOOL CMAPIEntryID::IsStoreUID(const BYTE* pUID, const MAPIUID* pStoreUIDs, int nStoreUIDs)
+{
+	for(int i=0;i<nStoreUIDs;i++)
+	{
+		if(!memcmp(pUID, &pStoreUIDs[i], sizeof(MAPIUID))) return TRUE;
+	}
+	return FALSE;
+}
+
+// DNs are ASCII and case insensitive, they end at a NULL or the end of the ID
+BOOL CMAPIEntryID::CompareDN(const BYTE* pDN1, ULONG cb1, const BYTE* pDN2, ULONG cb2)
+{
+	ULONG i=0;
+	for(;i<cb1 && i<cb2;i++)
+	{
+		BYTE ch1=pDN1[i], ch2=pDN2[i];
+		if(ch1>='a' && ch1<='z') ch1-='a'-'A';
+		if(ch2>='a' && ch2<='z') ch2-='a'-'A';
+		if(ch1!=ch2) return FALSE;
+		if(!ch1) return TRUE;
+	}
+	return (i==cb1 || !pDN1[i]) && (i==cb2 || !pDN2[i]);
+}
+
+int CMAPIEntryID::HexValue(TCHAR ch)
+{
+	if(ch>=(TCHAR)'0' && ch<=(TCHAR)'9') return ch-(TCHAR)'0';
+	if(ch>=(TCHAR)'A' && ch<=(TCHAR)'F') return ch-(TCHAR)'A'+10;
+	if(ch>=(TCHAR)'a' && ch<=(TCHAR)'f') return ch-(TCHAR)'a'+10;
+	return -1;
+}
+
+BYTE* CMAPIEntryID::Allocate(ULONG cb)
+{
+	Free();
+	return (cb>INLINE_SIZE) ? new BYTE[cb] : m_buffer;
+}
+
+void CMAPIEntryID::Free()
+{
+	if(m_entryID.cb>INLINE_SIZE) delete [] m_entryID.lpb;
+	m_entryID.lpb=m_buffer;
+	m_entryID.cb=0;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIEntryIDTable
+
+CMAPIEntryIDTable::CMAPIEntryIDTable()
+{
+	InitializeCriticalSection(&m_cs);
+}
+
+CMAPIEntryIDTable::~CMAPIEntryIDTable()
+{
+	RemoveAll();
+	DeleteCriticalSection(&m_cs);
+}
+
+int CMAPIEntryIDTable::Intern(const SBinary& entryID)
+{
+	return Intern(CMAPIEntryID(entryID));
+}
+
+// returns the number for this ID, adding it if it hasn't been seen yet
+int CMAPIEntryIDTable::Intern(const CMAPIEntryID& entryID)
+{
+	if(entryID.IsEmpty()) return -1;
+
+	int nID;
+	EnterCriticalSection(&m_cs);
+	if(!m_map.Lookup(entryID, nID))
+	{
+		nID=(int)m_arEntryIDs.Add(new CMAPIEntryID(entryID));
+		m_map.SetAt(entryID, nID);
+	}
+	LeaveCriticalSection(&m_cs);
+	return nID;
+}
+
+// returns -1 if the ID has not been interned
+int CMAPIEntryIDTable::Find(const CMAPIEntryID& entryID)
+{
+	int nID;
+	EnterCriticalSection(&m_cs);
+	if(!m_map.Lookup(entryID, nID)) nID=-1;
+	LeaveCriticalSection(&m_cs);
+	return nID;
+}
+
+// the returned ID lives until RemoveAll or the table is destroyed
+const CMAPIEntryID* CMAPIEntryIDTable::GetAt(int nID)
+{
+	const CMAPIEntryID* pEntryID=NULL;
+	EnterCriticalSection(&m_cs);
+	if(nID>=0 && nID<m_arEntryIDs.GetCount()) pEntryID=m_arEntryIDs[nID];
+	LeaveCriticalSection(&m_cs);
+	return pEntryID;
+}
+
+int CMAPIEntryIDTable::GetCount()
+{
+	EnterCriticalSection(&m_cs);
+	int nCount=(int)m_arEntryIDs.GetCount();
+	LeaveCriticalSection(&m_cs);
+	return nCount;
+}
+
+void CMAPIEntryIDTable::RemoveAll()
+{
+	EnterCriticalSection(&m_cs);
+	for(int i=0;i<m_arEntryIDs.GetCount();i++) delete m_arEntryIDs[i];
+	m_arEntryIDs.RemoveAll();
+	m_map.RemoveAll();
+	LeaveCriticalSection(&m_cs);
+}
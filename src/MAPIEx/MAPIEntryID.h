@@ -0,0 +1,127 @@
+#ifndef __MAPIENTRYID_H__
+#define __MAPIENTRYID_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIEntryID.h
+// Description: Entry ID value type usable as a hash key, with hex conversion and an interning table
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIEntryID
+
+// Holds a copy of an entry ID.  IDs up to INLINE_SIZE bytes (nearly all message and folder IDs) are kept
+// inside the object so copying one never touches the heap.  Nothing points into the object itself, so it can
+// be kept in a CArray (which moves elements with memcpy).  The hash is computed once when the value is set,
+// which makes it a cheap key for CMap:
+//
+//		CMap<CMAPIEntryID, const CMAPIEntryID&, int, int> map;
+//		map[message.EntryID()]=nIndex;
+class AFX_EXT_CLASS CMAPIEntryID
+{
+public:
+	CMAPIEntryID();
+	CMAPIEntryID(const SBinary& entryID);
+	CMAPIEntryID(ULONG cb, const BYTE* lpb);
+	CMAPIEntryID(const CMAPIEntryID& entryID);
+#if _MSC_VER>=1600
+	CMAPIEntryID(CMAPIEntryID&& entryID);
+#endif
+	~CMAPIEntryID();
+
+	enum { INLINE_SIZE=72 };
+	enum { ENTRYID_DIFFERENT, ENTRYID_EQUAL, ENTRYID_UNKNOWN };
+
+// Attributes
+protected:
+	SBinary m_entryID;
+	ULONGLONG m_ullHash;
+	BYTE m_buffer[INLINE_SIZE];
+
+// Operations
+public:
+	void Set(ULONG cb, const BYTE* lpb);
+	void Set(const SBinary* pEntryID);
+	void Empty();
+
+	BOOL IsEmpty() const { return !m_entryID.cb; }
+	ULONG GetSize() const { return m_entryID.cb; }
+	const BYTE* GetData() const { return (m_entryID.cb>INLINE_SIZE) ? m_entryID.lpb : m_buffer; }
+	LPENTRYID GetEntryID() const { return (LPENTRYID)GetData(); }
+	SBinary* GetBinary() { m_entryID.lpb=(BYTE*)GetData(); return &m_entryID; }
+	ULONGLONG GetHash() const { return m_ullHash; }
+
+	BOOL ToString(CString& strEntryID) const;
+	BOOL FromString(LPCTSTR szEntryID);
+
+	int Compare(const CMAPIEntryID& entryID) const;
+	BOOL operator==(const CMAPIEntryID& entryID) const;
+	BOOL operator!=(const CMAPIEntryID& entryID) const { return !(*this==entryID); }
+	BOOL operator<(const CMAPIEntryID& entryID) const { return Compare(entryID)<0; }
+	int CompareLocal(const CMAPIEntryID& entryID, const MAPIUID* pStoreUIDs=NULL, int nStoreUIDs=0) const;
+	CMAPIEntryID& operator=(const CMAPIEntryID& entryID);
+	CMAPIEntryID& operator=(const SBinary& entryID);
+#if _MSC_VER>=1600
+	CMAPIEntryID& operator=(CMAPIEntryID&& entryID);
+#endif
+
+	static ULONGLONG Hash(ULONG cb, const BYTE* lpb);
+	static void ToString(ULONG cb, const BYTE* lpb, CString& strHex);
+	static int FromString(LPCTSTR szHex, BYTE* pData, int nMaxBytes);
+	static int CompareLocal(ULONG cb1, const BYTE* lpb1, ULONG cb2, const BYTE* lpb2, const MAPIUID* pStoreUIDs=NULL, int nStoreUIDs=0);
+	static BOOL IsFromStore(ULONG cb, const BYTE* lpb, const MAPIUID* pStoreUIDs, int nStoreUIDs);
+
+protected:
+	static int HexValue(TCHAR ch);
+	static BOOL IsStoreUID(const BYTE* pUID, const MAPIUID* pStoreUIDs, int nStoreUIDs);
+	static BOOL CompareDN(const BYTE* pDN1, ULONG cb1, const BYTE* pDN2, ULONG cb2);
+	BYTE* Allocate(ULONG cb);
+	void Free();
+};
+
+template<> AFX_INLINE UINT AFXAPI HashKey<const CMAPIEntryID&>(const CMAPIEntryID& key)
+{
+	ULONGLONG ullHash=key.GetHash();
+	return (UINT)(ullHash^(ullHash>>32));
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIEntryIDTable
+
+// Interning table: each distinct entry ID is stored once and given a small sequential number, so large
+// sets of IDs (dedup, sync state) can be kept as ints and compared with ==.  Safe to share between threads
+class AFX_EXT_CLASS CMAPIEntryIDTable
+{
+public:
+	CMAPIEntryIDTable();
+	~CMAPIEntryIDTable();
+
+// Attributes
+protected:
+	CMap<CMAPIEntryID, const CMAPIEntryID&, int, int> m_map;
+	CArray<CMAPIEntryID*, CMAPIEntryID*> m_arEntryIDs;
+	CRITICAL_SECTION m_cs;
+
+// Operations
+public:
+	int Intern(const SBinary& entryID);
+	int Intern(const CMAPIEntryID& entryID);
+	int Find(const CMAPIEntryID& entryID);
+	const CMAPIEntryID* GetAt(int nID);
+	int GetCount();
+	void RemoveAll();
+
+private:
+	CMAPIEntryIDTable(const CMAPIEntryIDTable&);
+	CMAPIEntryIDTable& operator=(const CMAPIEntryIDTable&);
+};
+
+#endif
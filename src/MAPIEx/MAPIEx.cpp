@@ -41,6 +41,8 @@ CMAPIEx::CMAPIEx()
 	m_pMsgStore=NULL;
 	m_pFolder=NULL;	
 	m_sink=0;
+	m_bStoreUIDs=FALSE;
+	m_hrError=S_OK;
 }
 
 CMAPIEx::~CMAPIEx()
@@ -102,7 +104,12 @@ void CMAPIEx::Logout()
 	delete m_pFolder;
 	m_pFolder=NULL;
 	RELEASE(m_pMsgStore);
+	m_stores.Close();
+	m_storeID.Empty();
 	RELEASE(m_pSession);
+	m_arRecordKeys.RemoveAll();
+	m_arMappingSignatures.RemoveAll();
+	m_bStoreUIDs=FALSE;
 }
 
 BOOL CMAPIEx::CreateProfile(LPCTSTR szProfileName)
@@ -185,53 +192,54 @@ BOOL CMAPIEx::GetProfileEmail(CString& strProfileEmail)
 }
 
 // do not set MAPI_NO_CACHE flag for Outlook 97 and 2000
+// szStore NULL opens the default store, otherwise the store with that name or the first one containing it
 BOOL CMAPIEx::OpenMessageStore(LPCTSTR szStore, ULONG ulFlags)
 {
-	if(!m_pSession) return FALSE;
+	CMAPIStoreDirectory* pStores=GetStoreDirectory();
+	if(!pStores) return FALSE;
 
+	if(!m_bStoreUIDs) LoadStoreUIDs();
 	m_ulMDBFlags=ulFlags;
+	int nStore=szStore ? pStores->FindName(szStore) : pStores->FindDefault();
+	LPMDB pMsgStore=pStores->OpenStore(nStore);
+	if(!pMsgStore) return FALSE;
 
-	LPSRowSet pRows=NULL;
-	const int nProperties=3;
-	SizedSPropTagArray(nProperties, Columns)={nProperties,{PR_DISPLAY_NAME, PR_ENTRYID, PR_DEFAULT_STORE}};
+	RELEASE(m_pMsgStore);
+	m_pMsgStore=pMsgStore;
+	m_storeID=*pStores->GetEntryID(nStore);
+	return TRUE;
+}
 
-	BOOL bResult=FALSE;
-	IMAPITable*	pMsgStoresTable;
-	if(m_pSession->GetMsgStoresTable(0, &pMsgStoresTable)==S_OK) 
+// stores already opened in this session are reused from the store directory, an ID it doesn't know (a store
+// not in the stores table yet) is opened directly
+BOOL CMAPIEx::OpenMessageStore(const CMAPIEntryID& storeID, ULONG ulFlags)
+{
+	CMAPIStoreDirectory* pStores=GetStoreDirectory();
+	if(!pStores) return FALSE;
+
+	if(!m_bStoreUIDs) LoadStoreUIDs();
+	m_ulMDBFlags=ulFlags;
+	LPMDB pMsgStore=NULL;
+	int nStore=pStores->FindEntryID(storeID);
+	if(nStore>=0) pMsgStore=pStores->OpenStore(nStore);
+	else if(!storeID.IsEmpty())
 	{
-		if(pMsgStoresTable->SetColumns((LPSPropTagArray)&Columns, 0)==S_OK) 
-		{
-			while(pMsgStoresTable->QueryRows(1, 0, &pRows)==S_OK) 
-			{
-				if(pRows->cRows!=1) FreeProws(pRows);
-				else {
-					if(!szStore) 
-					{ 
-						if(pRows->aRow[0].lpProps[2].Value.b) bResult=TRUE;
-					} 
-					else 
-					{
-						CString strStore=GetValidString(pRows->aRow[0].lpProps[0]);
-						if(strStore.Find(szStore)!=-1) bResult=TRUE;
-					}
-					if(!bResult) 
-					{
-						FreeProws(pRows);
-						continue;
-					}
-				}
-				break;
-			}
-			if(bResult) 
-			{
-				RELEASE(m_pMsgStore);
-				bResult=(m_pSession->OpenMsgStore(NULL, pRows->aRow[0].lpProps[1].Value.bin.cb, (ENTRYID*)pRows->aRow[0].lpProps[1].Value.bin.lpb, NULL,MDB_NO_DIALOG | MAPI_BEST_ACCESS, &m_pMsgStore)==S_OK);
-				FreeProws(pRows);
-			}
-		}
-		RELEASE(pMsgStoresTable);
+		if(m_pSession->OpenMsgStore(NULL, storeID.GetSize(), storeID.GetEntryID(), NULL, MDB_NO_DIALOG | MAPI_BEST_ACCESS, &pMsgStore)!=S_OK) pMsgStore=NULL;
 	}
-	return bResult;
+	if(!pMsgStore) return FALSE;
+
+	RELEASE(m_pMsgStore);
+	m_pMsgStore=pMsgStore;
+	m_storeID=(nStore>=0) ? *pStores->GetEntryID(nStore) : storeID;
+	return TRUE;
+}
+
+// the session's stores table, read the first time it's needed
+CMAPIStoreDirectory* CMAPIEx::GetStoreDirectory()
+{
+	if(!m_pSession) return NULL;
+	if(!m_stores.IsLoaded() && !m_stores.Load(m_pSession)) return NULL;
+	return &m_stores;
 }
 
 ULONG CMAPIEx::GetMessageStoreSupport()
@@ -260,21 +268,31 @@ CPOOM* CMAPIEx::GetPOOM()
 
 CMAPIFolder* CMAPIEx::OpenFolder(unsigned long ulFolderID, BOOL bInternal)
 {
+	m_hrError=S_OK;
 	if(!m_pMsgStore) return NULL;
 
+	CMAPIFolder* pMAPIFolder=OpenCachedFolder(CMAPIStoreDirectory::GetSpecialFolder(ulFolderID), bInternal);
+	if(pMAPIFolder) return pMAPIFolder;
+
 	LPSPropValue props=NULL;
 	ULONG cValues=0;
 	DWORD dwObjType;
 	ULONG rgTags[]={ 1, ulFolderID };
 	LPMAPIFOLDER pFolder;
 
-	if(m_pMsgStore->GetProps((LPSPropTagArray) rgTags, cm_nMAPICode, &cValues, &props)!=S_OK) return NULL;
-	if(m_pMsgStore->OpenEntry(props[0].Value.bin.cb, (LPENTRYID)props[0].Value.bin.lpb, NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder)!=S_OK) return NULL;
+	m_hrError=m_pMsgStore->GetProps((LPSPropTagArray) rgTags, cm_nMAPICode, &cValues, &props);
+	if(m_hrError!=S_OK)
+	{
+		if(props) MAPIFreeBuffer(props);
+		return NULL;
+	}
+	m_hrError=m_pMsgStore->OpenEntry(props[0].Value.bin.cb, (LPENTRYID)props[0].Value.bin.lpb, NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder);
 	MAPIFreeBuffer(props);
+	if(m_hrError!=S_OK) return NULL;
 
 	if(pFolder) 
 	{
-		CMAPIFolder* pMAPIFolder=new CMAPIFolder(this, pFolder);
+		pMAPIFolder=new CMAPIFolder(this, pFolder);
 		if(bInternal) 
 		{
 			delete m_pFolder;
@@ -292,6 +310,7 @@ CMAPIFolder* CMAPIEx::OpenFolder(LPCTSTR szFolderName, BOOL bInternal)
 	if(pRoot)
 	{
 		pFolder=pRoot->OpenSubFolder(szFolderName);
+		if(!pFolder) m_hrError=MAPI_E_NOT_FOUND;
 		if(bInternal) 
 		{
 			delete m_pFolder;
@@ -302,6 +321,30 @@ CMAPIFolder* CMAPIEx::OpenFolder(LPCTSTR szFolderName, BOOL bInternal)
 	return pFolder;
 }
 
+// opens a folder in the current store directly from its entry ID
+CMAPIFolder* CMAPIEx::OpenFolder(const CMAPIEntryID& folderID, BOOL bInternal)
+{
+	m_hrError=S_OK;
+	if(!m_pMsgStore || folderID.IsEmpty()) return NULL;
+
+	DWORD dwObjType;
+	LPMAPIFOLDER pFolder=NULL;
+	m_hrError=m_pMsgStore->OpenEntry(folderID.GetSize(), folderID.GetEntryID(), NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder);
+	if(m_hrError!=S_OK) return NULL;
+
+	if(pFolder) 
+	{
+		CMAPIFolder* pMAPIFolder=new CMAPIFolder(this, pFolder);
+		if(bInternal) 
+		{
+			delete m_pFolder;
+			m_pFolder=pMAPIFolder;
+		}
+		return pMAPIFolder;
+	}
+	return NULL;
+}
+
 CMAPIFolder* CMAPIEx::OpenSpecialFolder(unsigned long ulFolderID, BOOL bInternal)
 {
 #ifdef _WIN32_WCE
@@ -317,8 +360,16 @@ CMAPIFolder* CMAPIEx::OpenSpecialFolder(unsigned long ulFolderID, BOOL bInternal
 	}
 	return NULL;
 #else
+	// the entry IDs the Inbox points to are read once per store
+	CMAPIFolder* pMAPIFolder=OpenCachedFolder(CMAPIStoreDirectory::GetSpecialFolder(ulFolderID), bInternal);
+	if(pMAPIFolder) return pMAPIFolder;
+
 	CMAPIFolder* pInbox=OpenInbox(FALSE);
-	if(!pInbox || !m_pMsgStore) return FALSE;
+	if(!pInbox || !m_pMsgStore) 
+	{
+		delete pInbox;
+		return NULL;
+	}
 
 	LPSPropValue props=NULL;
 	ULONG cValues=0;
@@ -326,15 +377,21 @@ CMAPIFolder* CMAPIEx::OpenSpecialFolder(unsigned long ulFolderID, BOOL bInternal
 	ULONG rgTags[]={ 1, ulFolderID };
 	LPMAPIFOLDER pFolder;
 
-	if(pInbox->Folder()->GetProps((LPSPropTagArray) rgTags, cm_nMAPICode, &cValues, &props)!=S_OK) return NULL;
-	HRESULT hr=m_pMsgStore->OpenEntry(props[0].Value.bin.cb, (LPENTRYID)props[0].Value.bin.lpb, NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder);
+	m_hrError=pInbox->Folder()->GetProps((LPSPropTagArray) rgTags, cm_nMAPICode, &cValues, &props);
+	if(m_hrError!=S_OK) 
+	{
+		if(props) MAPIFreeBuffer(props);
+		delete pInbox;
+		return NULL;
+	}
+	m_hrError=m_pMsgStore->OpenEntry(props[0].Value.bin.cb, (LPENTRYID)props[0].Value.bin.lpb, NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder);
 	MAPIFreeBuffer(props);
 	delete pInbox;
-	if(hr!=S_OK) return NULL;
+	if(m_hrError!=S_OK) return NULL;
 
 	if(pFolder) 
 	{
-		CMAPIFolder* pMAPIFolder=new CMAPIFolder(this, pFolder);
+		pMAPIFolder=new CMAPIFolder(this, pFolder);
 		if(bInternal) 
 		{
 			delete m_pFolder;
@@ -356,20 +413,25 @@ CMAPIFolder* CMAPIEx::OpenInbox(BOOL bInternal)
 #ifdef _WIN32_WCE
 	return OpenFolder(PR_CE_IPM_INBOX_ENTRYID, bInternal);
 #else
+	m_hrError=S_OK;
 	if(!m_pMsgStore) return NULL;
 
+	CMAPIFolder* pMAPIFolder=OpenCachedFolder(CMAPIStoreDirectory::FOLDER_INBOX, bInternal);
+	if(pMAPIFolder) return pMAPIFolder;
+
 	ULONG cbEntryID;
 	LPENTRYID pEntryID;
 	DWORD dwObjType;
 	LPMAPIFOLDER pFolder;
 
-	if(m_pMsgStore->GetReceiveFolder(NULL, 0, &cbEntryID, &pEntryID, NULL)!=S_OK) return NULL;
-	HRESULT hr=m_pMsgStore->OpenEntry(cbEntryID, pEntryID, NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder);
+	m_hrError=m_pMsgStore->GetReceiveFolder(NULL, 0, &cbEntryID, &pEntryID, NULL);
+	if(m_hrError!=S_OK) return NULL;
+	m_hrError=m_pMsgStore->OpenEntry(cbEntryID, pEntryID, NULL, m_ulMDBFlags, &dwObjType, (LPUNKNOWN*)&pFolder);
 	MAPIFreeBuffer(pEntryID);
 
-	if(hr==S_OK && pFolder) 
+	if(m_hrError==S_OK && pFolder) 
 	{
-		CMAPIFolder* pMAPIFolder=new CMAPIFolder(this, pFolder);
+		pMAPIFolder=new CMAPIFolder(this, pFolder);
 		if(bInternal) 
 		{
 			delete m_pFolder;
@@ -415,9 +477,39 @@ CMAPIFolder* CMAPIEx::OpenCalendar(BOOL bInternal)
 	return OpenSpecialFolder(PR_IPM_APPOINTMENT_ENTRYID, bInternal);
 }
 
+// Stores without PR_ADDITIONAL_REN_ENTRYIDS on the Inbox fall back to searching by name, once
 CMAPIFolder* CMAPIEx::OpenJunkFolder(BOOL bInternal)
 {
-	return OpenFolder(_T("Junk E-mail"), bInternal);
+	CMAPIFolder* pFolder=OpenCachedFolder(CMAPIStoreDirectory::FOLDER_JUNK, bInternal);
+	if(pFolder) return pFolder;
+
+	pFolder=OpenFolder(_T("Junk E-mail"), bInternal);
+	CMAPIStoreDirectory* pStores=GetStoreDirectory();
+	if(pFolder && pStores && !m_storeID.IsEmpty()) 
+	{
+		pStores->SetFolderID(pStores->FindEntryID(m_storeID), CMAPIStoreDirectory::FOLDER_JUNK, pFolder->EntryID());
+	}
+	return pFolder;
+}
+
+// nFolder is one of CMAPIStoreDirectory's FOLDER_ values, the IDs are those of the current message store
+BOOL CMAPIEx::GetSpecialFolderID(int nFolder, CMAPIEntryID& folderID)
+{
+	CMAPIStoreDirectory* pStores=GetStoreDirectory();
+	if(!m_pMsgStore || !pStores || m_storeID.IsEmpty()) return FALSE;
+
+	const CMAPIEntryID* pFolderID=pStores->GetFolderID(pStores->FindEntryID(m_storeID), nFolder);
+	if(!pFolderID) return FALSE;
+	folderID=*pFolderID;
+	return TRUE;
+}
+
+// NULL if the folder isn't cached or its entry ID no longer opens, callers then look it up the slow way
+CMAPIFolder* CMAPIEx::OpenCachedFolder(int nFolder, BOOL bInternal)
+{
+	CMAPIEntryID folderID;
+	if(nFolder<0 || !GetSpecialFolderID(nFolder, folderID)) return NULL;
+	return OpenFolder(folderID, bInternal);
 }
 
 LPMAPITABLE CMAPIEx::GetHierarchy()
@@ -471,12 +563,13 @@ BOOL CMAPIEx::GetNextSubFolder(CMAPIFolder& folder, CString& strFolder)
 }
 
 // call with ulEventMask set to ALL notifications ORed together, only one Advise Sink is used.
-BOOL CMAPIEx::Notify(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG ulEventMask)
+// pass a started CMAPINotifyQueue to have lpfnCallback called on the queue's workers instead of MAPI's thread
+BOOL CMAPIEx::Notify(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG ulEventMask, CMAPINotifyQueue* pQueue)
 {
 	if(GetMessageStoreSupport()&STORE_NOTIFY_OK) 
 	{
 		if(m_sink) m_pMsgStore->Unadvise(m_sink);
-		CMAPISink* pAdviseSink=new CMAPISink(lpfnCallback, lpvContext);
+		CMAPISink* pAdviseSink=new CMAPISink(lpfnCallback, lpvContext, pQueue);
 		if(m_pMsgStore->Advise(0, NULL,ulEventMask, pAdviseSink, &m_sink)==S_OK) return TRUE;
 		delete pAdviseSink;
 		m_sink=0;
@@ -495,44 +588,31 @@ void CMAPIEx::PumpMessages()
 	}
 }
 
-// sometimes the string in prop is invalid, causing unexpected crashes
-#ifndef _WIN32_WCE
-LPCTSTR CMAPIEx::ValidateString(LPCTSTR s)
-{
-	if(s && !::IsBadStringPtr(s, (UINT_PTR)-1)) return s;
-	return NULL;
-}
-#else
-// Windows Mobile does not have IsBadStringPtr so I use SEH
-// I shut off optimization because the optimizer still had trouble with the try/catch
-#pragma optimize("",off)
-LPCTSTR CMAPIEx::ValidateString(LPCTSTR s)
+// strings are only valid if the property came back as a string, a missing property comes back as PT_ERROR
+// with an error code in place of the pointer.  Checking the type is much cheaper than probing the memory
+// and works the same on Windows Mobile
+LPCTSTR CMAPIEx::GetValidString(SPropValue& prop)
 {
-	try 
-	{
-		if(s) 
-		{
-			TCHAR ch=*s;
-			return s;
-		}
-	} 
-	catch(...) 
+	switch(PROP_TYPE(prop.ulPropTag))
 	{
+	case PT_STRING8:
+	case PT_UNICODE:
+		return prop.Value.LPSZ;
 	}
 	return NULL;
 }
-#pragma optimize("",on)
-#endif
-
-LPCTSTR CMAPIEx::GetValidString(SPropValue& prop)
-{
-	return ValidateString(prop.Value.LPSZ);
-}
 
-// sometimes the string in prop is invalid, causing unexpected crashes
+// as above, also checks nIndex against the number of values
 LPCTSTR CMAPIEx::GetValidMVString(SPropValue& prop, int nIndex)
 {
-	return ValidateString(prop.Value.MVSZ.LPPSZ[nIndex]);
+	switch(PROP_TYPE(prop.ulPropTag))
+	{
+	case PT_MV_STRING8:
+	case PT_MV_UNICODE:
+		if(nIndex>=0 && (ULONG)nIndex<prop.Value.MVSZ.cValues) return prop.Value.MVSZ.LPPSZ[nIndex];
+		break;
+	}
+	return NULL;
 }
 
 // special case of GetValidString to take the narrow string in UNICODE
@@ -615,8 +695,25 @@ void CMAPIEx::ReleaseAddressList(LPADRLIST pAddressList)
 #endif
 }
 
+// most pairs are answered locally (see CMAPIEntryID::CompareLocal), the session is only asked about IDs
+// whose format we don't know.  Store UIDs are only used when both IDs come from the same kind of store,
+// they are read once by the first OpenMessageStore and never change after that, so this is safe to call
+// from notification threads
 BOOL CMAPIEx::CompareEntryIDs(ULONG cb1, LPENTRYID lpb1, ULONG cb2, LPENTRYID lpb2)
 {
+	const MAPIUID* pStoreUIDs=NULL;
+	int nStoreUIDs=0;
+	ULONG ulKind=GetStoreUIDKind(cb1, lpb1);
+	if(ulKind && ulKind==GetStoreUIDKind(cb2, lpb2))
+	{
+		CArray<MAPIUID, MAPIUID&>& arStoreUIDs=(ulKind==PR_MAPPING_SIGNATURE) ? m_arMappingSignatures : m_arRecordKeys;
+		pStoreUIDs=arStoreUIDs.GetData();
+		nStoreUIDs=(int)arStoreUIDs.GetCount();
+	}
+
+	int nResult=CMAPIEntryID::CompareLocal(cb1, (const BYTE*)lpb1, cb2, (const BYTE*)lpb2, pStoreUIDs, nStoreUIDs);
+	if(nResult!=CMAPIEntryID::ENTRYID_UNKNOWN) return (nResult==CMAPIEntryID::ENTRYID_EQUAL);
+
 	ULONG ulResult;
 	if(m_pSession && m_pSession->CompareEntryIDs(cb1, lpb1, cb2, lpb2, 0, &ulResult)==S_OK) 
 	{
@@ -625,6 +722,56 @@ BOOL CMAPIEx::CompareEntryIDs(ULONG cb1, LPENTRYID lpb1, ULONG cb2, LPENTRYID lp
 	return FALSE;
 }
 
+// the UIDs the stores in the profile put in the entry IDs they issue: PR_RECORD_KEY for PST/OST and
+// PR_MAPPING_SIGNATURE for Exchange mailboxes, kept apart so IDs of the two kinds are never compared locally
+BOOL CMAPIEx::LoadStoreUIDs()
+{
+	m_arRecordKeys.RemoveAll();
+	m_arMappingSignatures.RemoveAll();
+	if(!m_pSession) return FALSE;
+	m_bStoreUIDs=TRUE;
+
+	enum { PROP_RECORD_KEY, PROP_MAPPING_SIGNATURE, STORE_COLS };
+	SizedSPropTagArray(STORE_COLS, Columns)={STORE_COLS,{PR_RECORD_KEY, PR_MAPPING_SIGNATURE}};
+
+	IMAPITable*	pMsgStoresTable;
+	if(m_pSession->GetMsgStoresTable(0, &pMsgStoresTable)!=S_OK) return FALSE;
+	if(pMsgStoresTable->SetColumns((LPSPropTagArray)&Columns, 0)==S_OK) 
+	{
+		LPSRowSet pRows=NULL;
+		while(pMsgStoresTable->QueryRows(16, 0, &pRows)==S_OK) 
+		{
+			ULONG cRows=pRows->cRows;
+			for(ULONG i=0;i<cRows;i++)
+			{
+				for(int j=0;j<STORE_COLS;j++)
+				{
+					SPropValue& prop=pRows->aRow[i].lpProps[j];
+					if(PROP_TYPE(prop.ulPropTag)==PT_BINARY && prop.Value.bin.cb==sizeof(MAPIUID))
+					{
+						if(j==PROP_RECORD_KEY) m_arRecordKeys.Add(*(MAPIUID*)prop.Value.bin.lpb);
+						else m_arMappingSignatures.Add(*(MAPIUID*)prop.Value.bin.lpb);
+					}
+				}
+			}
+			FreeProws(pRows);
+			if(!cRows) break;
+		}
+	}
+	RELEASE(pMsgStoresTable);
+	return TRUE;
+}
+
+// PR_RECORD_KEY or PR_MAPPING_SIGNATURE for the store that issued the ID, 0 if it isn't one of ours or if
+// the UID appears in both lists
+ULONG CMAPIEx::GetStoreUIDKind(ULONG cb, LPENTRYID lpb)
+{
+	BOOL bRecordKey=CMAPIEntryID::IsFromStore(cb, (const BYTE*)lpb, m_arRecordKeys.GetData(), (int)m_arRecordKeys.GetCount());
+	BOOL bMappingSignature=CMAPIEntryID::IsFromStore(cb, (const BYTE*)lpb, m_arMappingSignatures.GetData(), (int)m_arMappingSignatures.GetCount());
+	if(bRecordKey==bMappingSignature) return 0;
+	return bRecordKey ? PR_RECORD_KEY : PR_MAPPING_SIGNATURE;
+}
+
 // ADDRENTRY objects from Address don't come in unicode so I check for _A and force narrow strings
 BOOL CMAPIEx::GetEmail(ADRENTRY& adrEntry, CString& strEmail)
 {
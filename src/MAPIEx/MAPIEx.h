@@ -28,11 +28,35 @@
 #define MAPI_NO_CACHE ((ULONG)0x00000200)
 #define MAPIEX_NOTIFICATIONS 0x007F
 
+#include "MAPIEntryID.h"
+#include "MAPIProperties.h"
 #include "MAPIObject.h"
 #include "MAPIMessage.h"
 #include "MAPIContact.h"
 #include "MAPIAppointment.h"
 #include "MAPIFolder.h"
+#include "MAPIRTFStream.h"
+#include "MAPIHTMLText.h"
+#include "MAPIContactLoader.h"
+#include "MAPIContactIndex.h"
+#include "MAPIContentFile.h"
+#include "MAPIVCard.h"
+#include "MAPIContactDedup.h"
+#include "MAPIAppointmentLoader.h"
+#include "RecurrencePattern.h"
+#include "MAPIRecurrence.h"
+#include "MAPIFreeBusy.h"
+#include "MAPIICalendar.h"
+#include "CalendarIntervals.h"
+#include "MAPICalendarIndex.h"
+#include "MAPIDateTime.h"
+#include "MAPISessionPool.h"
+#include "MAPILimiter.h"
+#include "MAPIExecutor.h"
+#include "MAPIScan.h"
+#include "MAPIStoreDirectory.h"
+#include "MAPINotifyQueue.h"
+#include "MAPINotifyCoalescer.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // CMAPIEx
@@ -53,6 +77,12 @@ protected:
 	ULONG m_ulMDBFlags;
 	CMAPIFolder* m_pFolder;
 	ULONG m_sink;
+	CArray<MAPIUID, MAPIUID&> m_arRecordKeys;
+	CArray<MAPIUID, MAPIUID&> m_arMappingSignatures;
+	BOOL m_bStoreUIDs;
+	CMAPIStoreDirectory m_stores;
+	CMAPIEntryID m_storeID;
+	HRESULT m_hrError;
 
 // Operations
 public:
@@ -66,11 +96,14 @@ public:
 	IMAPISession* GetSession() { return m_pSession; }
 	LPMDB GetMessageStore() { return m_pMsgStore; }
 	CMAPIFolder* GetFolder() { return m_pFolder; }
+	HRESULT GetError() { return m_hrError; } // of the MAPI call that failed the last OpenFolder or Open*Folder
 	void SetFolder(CMAPIFolder* pFolder);
 
 	BOOL GetProfileName(CString& strProfileName);
 	BOOL GetProfileEmail(CString& strProfileEmail);
 	BOOL OpenMessageStore(LPCTSTR szStore=NULL, ULONG ulFlags=MAPI_MODIFY | MAPI_NO_CACHE);
+	BOOL OpenMessageStore(const CMAPIEntryID& storeID, ULONG ulFlags=MAPI_MODIFY | MAPI_NO_CACHE);
+	CMAPIStoreDirectory* GetStoreDirectory();
 	ULONG GetMessageStoreSupport();
 
 #ifdef _WIN32_WCE
@@ -81,6 +114,7 @@ public:
 	// remember to eventually delete returned folders if calling with bInternal=FALSE
 	CMAPIFolder* OpenFolder(unsigned long ulFolderID, BOOL bInternal);
 	CMAPIFolder* OpenFolder(LPCTSTR szFolderName, BOOL bInternal);
+	CMAPIFolder* OpenFolder(const CMAPIEntryID& folderID, BOOL bInternal);
 	CMAPIFolder* OpenSpecialFolder(unsigned long ulFolderID, BOOL bInternal);
 	CMAPIFolder* OpenRootFolder(BOOL bInternal=TRUE);
 	CMAPIFolder* OpenInbox(BOOL bInternal=TRUE);
@@ -91,6 +125,7 @@ public:
 	CMAPIFolder* OpenDrafts(BOOL bInternal=TRUE);
 	CMAPIFolder* OpenCalendar(BOOL bInternal=TRUE);
 	CMAPIFolder* OpenJunkFolder(BOOL bInternal=TRUE);
+	BOOL GetSpecialFolderID(int nFolder, CMAPIEntryID& folderID);
 
 	LPMAPITABLE GetHierarchy();
 	LPMAPITABLE GetContents();
@@ -103,7 +138,7 @@ public:
 	BOOL GetNextAppointment(CMAPIAppointment& appointment);
 	BOOL GetNextSubFolder(CMAPIFolder& folder, CString& strFolder);
 
-	BOOL Notify(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG ulEventMask=MAPIEX_NOTIFICATIONS);
+	BOOL Notify(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG ulEventMask=MAPIEX_NOTIFICATIONS, CMAPINotifyQueue* pQueue=NULL);
 	static void PumpMessages();
 
 	int ShowAddressBook(LPADRLIST& pAddressList, LPCTSTR szCaption=NULL);
@@ -117,7 +152,9 @@ public:
 	BOOL CompareEntryIDs(ULONG cb1, LPENTRYID lpb1, ULONG cb2, LPENTRYID lpb2);
 
 protected:
-	static LPCTSTR ValidateString(LPCTSTR s);
+	BOOL LoadStoreUIDs();
+	ULONG GetStoreUIDKind(ULONG cb, LPENTRYID lpb);
+	CMAPIFolder* OpenCachedFolder(int nFolder, BOOL bInternal);
 };
 
 #ifndef MSGSTATUS_HAS_PR_BODY_HTML
@@ -129,6 +166,22 @@ protected:
 #define PR_BODY_HTML_A PROP_TAG( PT_STRING8, 0x1013)
 #endif
 
+#ifndef PR_HTML
+#define PR_HTML PROP_TAG( PT_BINARY, 0x1013)
+#endif
+
+#ifndef PR_INTERNET_CPID
+#define PR_INTERNET_CPID PROP_TAG( PT_LONG, 0x3FDE)
+#endif
+
+#ifndef PR_MESSAGE_CODEPAGE
+#define PR_MESSAGE_CODEPAGE PROP_TAG( PT_LONG, 0x3FFD)
+#endif
+
+#ifndef PR_MAPPING_SIGNATURE
+#define PR_MAPPING_SIGNATURE PROP_TAG( PT_BINARY, 0x0FF8)
+#endif
+
 #ifndef STORE_HTML_OK
 #define	STORE_HTML_OK ((ULONG)0x00010000)
 #endif
@@ -156,4 +209,8 @@ protected:
 #define PR_IPM_TASK_ENTRYID (PROP_TAG(PT_BINARY, 0x36D4))
 #define PR_IPM_DRAFTS_ENTRYID (PROP_TAG(PT_BINARY, 0x36D7))
 
+#ifndef PR_ADDITIONAL_REN_ENTRYIDS
+#define PR_ADDITIONAL_REN_ENTRYIDS PROP_TAG(PT_MV_BINARY, 0x36D8)
+#endif
+
 #endif
@@ -0,0 +1,566 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIExecutor.cpp
+// Description: Worker threads with sessions of their own running MAPI jobs queued by other threads
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+#ifndef _WIN32_WCE
+#include <process.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// CMAPIJob
+
+CMAPIJob::CMAPIJob()
+{
+	m_lRefCount=1;
+	m_lState=JOB_PENDING;
+	m_bResult=FALSE;
+	m_hrError=S_OK;
+	m_hDone=CreateEvent(NULL, TRUE, FALSE, NULL);
+	m_pCallback=NULL;
+	m_pContext=NULL;
+	m_nWorker=-1;
+	m_bContinue=FALSE;
+	m_pLimiter=NULL;
+}
+
+CMAPIJob::~CMAPIJob()
+{
+	if(m_hDone) CloseHandle(m_hDone);
+}
+
+LONG CMAPIJob::AddRef()
+{
+	return InterlockedIncrement(&m_lRefCount);
+}
+
+LONG CMAPIJob::Release()
+{
+	LONG lCount=InterlockedDecrement(&m_lRefCount);
+	if(!lCount) delete this;
+	return lCount;
+}
+
+// TRUE once the job has finished or was cancelled, FALSE on timeout
+BOOL CMAPIJob::Wait(DWORD dwTimeout)
+{
+	return (m_hDone && WaitForSingleObject(m_hDone, dwTimeout)==WAIT_OBJECT_0);
+}
+
+// cancels the job if it hasn't started yet or is between steps, one that's running always finishes its step
+BOOL CMAPIJob::Cancel()
+{
+	if(InterlockedCompareExchange(&m_lState, JOB_RUNNING, JOB_PENDING)!=JOB_PENDING) return FALSE;
+	m_bResult=FALSE;
+	Complete(JOB_CANCELLED);
+	return TRUE;
+}
+
+// Ends call with hr and fails the step with hr in m_hrError, E_FAIL when the call failed without an error.
+// Failed calls don't count towards the limiter's latency, throttled ones lower its limit
+BOOL CMAPIJob::Fail(CMAPILimiterCall& call, HRESULT hr)
+{
+	m_hrError=FAILED(hr) ? hr : E_FAIL;
+	call.End(m_hrError);
+	return FALSE;
+}
+
+// the caller owns the job (it's running or was still pending), calls back before waking up any Wait
+void CMAPIJob::Complete(int nState)
+{
+	InterlockedExchange(&m_lState, nState);
+	if(m_pCallback) m_pCallback(this, m_pContext);
+	if(m_hDone) SetEvent(m_hDone);
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIOpenFolderJob
+
+CMAPIOpenFolderJob::CMAPIOpenFolderJob(unsigned long ulFolderID)
+{
+	m_ulFolderID=ulFolderID;
+}
+
+CMAPIOpenFolderJob::CMAPIOpenFolderJob(LPCTSTR szFolderName)
+{
+	m_ulFolderID=0;
+	m_strFolderName=szFolderName;
+}
+
+BOOL CMAPIOpenFolderJob::Run(CMAPIEx* pMAPI)
+{
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+
+	CMAPIFolder* pFolder=m_ulFolderID ? pMAPI->OpenFolder(m_ulFolderID, FALSE) : pMAPI->OpenFolder(m_strFolderName, FALSE);
+	if(!pFolder) return Fail(call, pMAPI->GetError());
+
+	m_folderID=pFolder->EntryID();
+	if(!pFolder->GetPropertyString(PR_DISPLAY_NAME, m_strName)) m_strName=pFolder->GetName();
+	delete pFolder;
+	if(m_folderID.IsEmpty()) return Fail(call, MAPI_E_NOT_FOUND);
+	return TRUE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIQueryRowsJob
+
+CMAPIQueryRowsJob::CMAPIQueryRowsJob(const CMAPIEntryID& folderID, int nStart, int nCount, const ULONG* pulColumns, int nColumns)
+	: m_folderID(folderID)
+{
+	m_nStart=max(0, nStart);
+	m_nCount=max(1, nCount);
+	m_ulSortField=PR_NULL;
+	m_ulSortParam=TABLE_SORT_ASCEND;
+	m_pRows=NULL;
+	m_nRowCount=-1;
+
+	if(pulColumns && nColumns>0)
+	{
+		for(int i=0;i<nColumns;i++) m_arColumns.Add(pulColumns[i]);
+	}
+	else
+	{
+		m_arColumns.Add(PR_ENTRYID);
+		m_arColumns.Add(PR_MESSAGE_FLAGS);
+	}
+}
+
+CMAPIQueryRowsJob::~CMAPIQueryRowsJob()
+{
+	if(m_pRows) FreeProws(m_pRows);
+}
+
+LPSRowSet CMAPIQueryRowsJob::DetachRows()
+{
+	LPSRowSet pRows=m_pRows;
+	m_pRows=NULL;
+	return pRows;
+}
+
+// sets m_nRowCount to the number of rows in the whole table, fails if the table can't be read
+BOOL CMAPIQueryRowsJob::Run(CMAPIEx* pMAPI)
+{
+	CMAPIFolder folder;
+	{
+		CMAPILimiterCall call(m_pLimiter);
+		if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+		if(!folder.Open(pMAPI, *m_folderID.GetBinary())) return Fail(call, folder.GetError());
+	}
+
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+
+	LPMAPITABLE pContents=NULL;
+	HRESULT hr=folder.Folder()->GetContentsTable(CMAPIEx::cm_nMAPICode, &pContents);
+	if(hr!=S_OK) return Fail(call, hr);
+
+	BOOL bResult=FALSE;
+	int nColumns=(int)m_arColumns.GetSize();
+	LPSPropTagArray pTags=NULL;
+	if(MAPIAllocateBuffer(CbNewSPropTagArray(nColumns), (LPVOID*)&pTags)==S_OK)
+	{
+		pTags->cValues=nColumns;
+		for(int i=0;i<nColumns;i++) pTags->aulPropTag[i]=m_arColumns[i];
+
+		SizedSSortOrderSet(1, SortColums)={1, 0, 0, {{m_ulSortField, m_ulSortParam}}};
+		ULONG ulCount=0;
+		if((hr=pContents->SetColumns(pTags, TBL_BATCH))==S_OK
+			&& (m_ulSortField==PR_NULL || (hr=pContents->SortTable((LPSSortOrderSet)&SortColums, TBL_BATCH))==S_OK)
+			&& (hr=pContents->GetRowCount(0, &ulCount))==S_OK
+			&& (hr=pContents->SeekRow(BOOKMARK_BEGINNING, m_nStart, NULL))==S_OK)
+		{
+			m_nRowCount=(int)ulCount;
+			if(m_pRows) FreeProws(m_pRows);
+			m_pRows=NULL;
+			hr=pContents->QueryRows(m_nCount, 0, &m_pRows);
+			if(hr==S_OK) bResult=TRUE;
+			else m_pRows=NULL;
+		}
+		MAPIFreeBuffer(pTags);
+	}
+	else hr=MAPI_E_NOT_ENOUGH_MEMORY;
+	RELEASE(pContents);
+	if(!bResult) return Fail(call, hr);
+	return TRUE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIOpenMessageJob
+
+CMAPIOpenMessageJob::CMAPIOpenMessageJob(const CMAPIEntryID& messageID, BOOL bBody) : m_messageID(messageID)
+{
+	m_bBody=bBody;
+	memset(&m_tmReceived, 0, sizeof(SYSTEMTIME));
+	m_nMessageFlags=0;
+	m_nAttachments=0;
+}
+
+BOOL CMAPIOpenMessageJob::Run(CMAPIEx* pMAPI)
+{
+	CMAPIMessage message;
+	{
+		CMAPILimiterCall call(m_pLimiter);
+		if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+		if(!message.Open(pMAPI, *m_messageID.GetBinary())) return Fail(call, message.GetError());
+	}
+
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+
+	m_strSubject=message.GetSubject();
+	m_strSenderName=message.GetSenderName();
+	m_strSenderEmail=message.GetSenderEmail();
+	message.GetTo(m_strTo);
+	message.GetReceivedTime(m_tmReceived);
+	m_nMessageFlags=message.GetMessageFlags();
+	m_nAttachments=message.GetAttachmentCount();
+	if(m_bBody) message.GetBody(m_strBody);
+	return TRUE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPISaveAttachmentJob
+
+CMAPISaveAttachmentJob::CMAPISaveAttachmentJob(const CMAPIEntryID& messageID, LPCTSTR szFolder, int nIndex, LPCTSTR szFileName)
+	: m_messageID(messageID)
+{
+	m_strFolder=szFolder;
+	m_nIndex=nIndex;
+	m_strFileName=szFileName;
+}
+
+BOOL CMAPISaveAttachmentJob::Run(CMAPIEx* pMAPI)
+{
+	CMAPIMessage message;
+	{
+		CMAPILimiterCall call(m_pLimiter);
+		if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+		if(!message.Open(pMAPI, *m_messageID.GetBinary())) return Fail(call, message.GetError());
+	}
+
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+	if(!message.SaveAttachment(m_strFolder, m_nIndex, m_strFileName.IsEmpty() ? NULL : (LPCTSTR)m_strFileName)) return Fail(call, message.GetError());
+	return TRUE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPISendJob
+
+CMAPISendJob::CMAPISendJob()
+{
+	m_nPriority=IMPORTANCE_NORMAL;
+	m_bSaveToSentFolder=TRUE;
+}
+
+void CMAPISendJob::AddRecipient(LPCTSTR szEmail, int nType)
+{
+	Recipient recipient;
+	recipient.m_strEmail=szEmail;
+	recipient.m_nType=nType;
+	m_arRecipients.Add(recipient);
+}
+
+BOOL CMAPISendJob::Run(CMAPIEx* pMAPI)
+{
+	if(!m_arRecipients.GetSize())
+	{
+		m_hrError=MAPI_E_INVALID_PARAMETER;
+		return FALSE;
+	}
+
+	CMAPIMessage message;
+	{
+		CMAPILimiterCall call(m_pLimiter);
+		if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+		if(!message.Create(pMAPI, m_nPriority, m_bSaveToSentFolder)) return Fail(call, message.GetError());
+		for(int i=0;i<m_arRecipients.GetSize();i++)
+		{
+			if(!message.AddRecipient(m_arRecipients[i].m_strEmail, m_arRecipients[i].m_nType)) return Fail(call, E_FAIL);
+		}
+		message.SetSubject(m_strSubject);
+		if(!message.SetBody(m_strBody)) return Fail(call, E_FAIL);
+	}
+
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+	if(!message.Send()) return Fail(call, message.GetError());
+	return TRUE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIExecutor
+
+CMAPIExecutor::CMAPIExecutor()
+{
+	InitializeCriticalSection(&m_cs);
+	m_bProfile=FALSE;
+	m_bStore=FALSE;
+	m_bInitAsService=FALSE;
+	m_hJobs=NULL;
+	m_hStop=NULL;
+	m_nThreads=0;
+	m_lRunning=0;
+	m_pLimiter=NULL;
+}
+
+CMAPIExecutor::~CMAPIExecutor()
+{
+	Stop();
+	DeleteCriticalSection(&m_cs);
+}
+
+// Starts nThreads workers (0 for one per processor), each logs on to szProfileName (NULL for the default) and
+// opens szStore (NULL for the default store) on its own thread.  Fails on one of its own workers, see Stop.
+// Not available on Windows Mobile
+BOOL CMAPIExecutor::Start(LPCTSTR szProfileName, int nThreads, LPCTSTR szStore, BOOL bInitAsService)
+{
+	if(!Stop()) return FALSE;
+
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	if(nThreads<=0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		nThreads=(int)info.dwNumberOfProcessors;
+	}
+	nThreads=min(nThreads, (int)MAX_THREADS);
+
+	m_bProfile=(szProfileName!=NULL);
+	m_strProfile=szProfileName ? szProfileName : _T("");
+	m_bStore=(szStore!=NULL);
+	m_strStore=szStore ? szStore : _T("");
+	m_bInitAsService=bInitAsService;
+
+	m_hJobs=CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+	m_hStop=CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!m_hJobs || !m_hStop)
+	{
+		Stop();
+		return FALSE;
+	}
+
+	for(int i=0;i<nThreads;i++)
+	{
+		Worker& worker=m_workers[m_nThreads];
+		worker.m_pExecutor=this;
+		worker.m_nWorker=m_nThreads;
+		worker.m_hJobs=CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+		if(!worker.m_hJobs) break;
+
+		unsigned uThreadID=0;
+		m_hThreads[m_nThreads]=(HANDLE)_beginthreadex(NULL, 0, WorkerThread, &worker, 0, &uThreadID);
+		m_dwThreadIDs[m_nThreads]=(DWORD)uThreadID;
+		if(!m_hThreads[m_nThreads])
+		{
+			CloseHandle(worker.m_hJobs);
+			continue;
+		}
+
+		EnterCriticalSection(&m_cs);
+		m_nThreads++;
+		LeaveCriticalSection(&m_cs);
+	}
+	if(!m_nThreads) Stop();
+	return (m_nThreads>0);
+#endif
+}
+
+// Cancels the jobs still queued and waits for the steps running to finish, workers cancel their own jobs.
+// Fails when called on one of the workers (from a job or a callback), which would wait for itself
+BOOL CMAPIExecutor::Stop()
+{
+	int i;
+	DWORD dwThreadID=GetCurrentThreadId();
+	for(i=0;i<m_nThreads;i++)
+	{
+		if(m_dwThreadIDs[i]==dwThreadID) return FALSE;
+	}
+
+	// Submit checks m_nThreads under the lock, so nothing is queued after this
+	EnterCriticalSection(&m_cs);
+	int nThreads=m_nThreads;
+	m_nThreads=0;
+	LeaveCriticalSection(&m_cs);
+
+	if(m_hStop) SetEvent(m_hStop);
+	if(nThreads) WaitForMultipleObjects(nThreads, m_hThreads, TRUE, INFINITE);
+	for(i=0;i<nThreads;i++)
+	{
+		CloseHandle(m_hThreads[i]);
+		CloseHandle(m_workers[i].m_hJobs);
+		m_workers[i].m_hJobs=NULL;
+	}
+
+	CMAPIJob* pJob;
+	while((pJob=NextJob())!=NULL)
+	{
+		pJob->Cancel();
+		pJob->Release();
+	}
+
+	if(m_hJobs)
+	{
+		CloseHandle(m_hJobs);
+		m_hJobs=NULL;
+	}
+	if(m_hStop)
+	{
+		CloseHandle(m_hStop);
+		m_hStop=NULL;
+	}
+	return TRUE;
+}
+
+int CMAPIExecutor::GetQueuedCount()
+{
+	EnterCriticalSection(&m_cs);
+	int nCount=(int)m_lstJobs.GetCount();
+	for(int i=0;i<m_nThreads;i++) nCount+=(int)m_workers[i].m_lstJobs.GetCount();
+	LeaveCriticalSection(&m_cs);
+	return nCount;
+}
+
+// Queues pJob and returns at once.  pCallback is called on the worker thread once it finishes, or on the thread
+// that cancels it; either way Wait returns afterwards.  The executor keeps its own reference to the job.
+// Fails once Stop has begun
+BOOL CMAPIExecutor::Submit(CMAPIJob* pJob, LPMAPIJOBCALLBACK pCallback, LPVOID pContext)
+{
+	if(!pJob || pJob->m_lState!=CMAPIJob::JOB_PENDING) return FALSE;
+
+	EnterCriticalSection(&m_cs);
+	BOOL bStarted=(m_nThreads>0);
+	if(bStarted)
+	{
+		pJob->m_pCallback=pCallback;
+		pJob->m_pContext=pContext;
+		pJob->m_nWorker=-1;
+		pJob->AddRef();
+		m_lstJobs.AddTail(pJob);
+		ReleaseSemaphore(m_hJobs, 1, NULL);
+	}
+	LeaveCriticalSection(&m_cs);
+	return bStarted;
+}
+
+// the next job submitted, or with nWorker the next one continuing on that worker
+CMAPIJob* CMAPIExecutor::NextJob(int nWorker)
+{
+	CMAPIJob* pJob=NULL;
+	EnterCriticalSection(&m_cs);
+	CList<CMAPIJob*, CMAPIJob*>& lstJobs=(nWorker<0) ? m_lstJobs : m_workers[nWorker].m_lstJobs;
+	if(!lstJobs.IsEmpty()) pJob=lstJobs.RemoveHead();
+	LeaveCriticalSection(&m_cs);
+	return pJob;
+}
+
+BOOL CMAPIExecutor::Logon(CMAPIEx& mapi)
+{
+	mapi.Logout();
+	if(mapi.Login(m_bProfile ? (LPCTSTR)m_strProfile : NULL, m_bInitAsService) && mapi.OpenMessageStore(m_bStore ? (LPCTSTR)m_strStore : NULL)) return TRUE;
+	mapi.Logout();
+	return FALSE;
+}
+
+// Skips jobs cancelled while they were queued and logs the worker on again if its session couldn't be opened.
+// pMAPI is NULL when MAPI didn't initialize on this thread, its jobs then fail instead of staying queued.  A job
+// that continues keeps the executor's reference and goes to the back of the worker's own queue
+void CMAPIExecutor::RunJob(CMAPIJob* pJob, Worker& worker, CMAPIEx* pMAPI, BOOL& bLoggedOn)
+{
+	if(InterlockedCompareExchange(&pJob->m_lState, CMAPIJob::JOB_RUNNING, CMAPIJob::JOB_PENDING)==CMAPIJob::JOB_PENDING)
+	{
+		InterlockedIncrement(&m_lRunning);
+		if(pMAPI && !bLoggedOn) bLoggedOn=Logon(*pMAPI);
+		BOOL bResult=bLoggedOn ? RunStep(pJob, pMAPI) : FALSE;
+		InterlockedDecrement(&m_lRunning);
+
+		if(bLoggedOn && pJob->m_bContinue)
+		{
+			pJob->m_nWorker=worker.m_nWorker;
+			InterlockedExchange(&pJob->m_lState, CMAPIJob::JOB_PENDING);
+			EnterCriticalSection(&m_cs);
+			worker.m_lstJobs.AddTail(pJob);
+			LeaveCriticalSection(&m_cs);
+			ReleaseSemaphore(worker.m_hJobs, 1, NULL);
+			return;
+		}
+		pJob->ReleaseSession();
+		pJob->m_bResult=bResult;
+		pJob->Complete(CMAPIJob::JOB_DONE);
+	}
+	else if(pJob->m_nWorker>=0) pJob->ReleaseSession();
+	pJob->Release();
+}
+
+// Runs one step of pJob, retrying a step that failed with a throttling error after the limiter's backoff (cut
+// short by Stop).  The job takes the limiter's slots itself, one per MAPI call, so its callbacks don't hold one
+BOOL CMAPIExecutor::RunStep(CMAPIJob* pJob, CMAPIEx* pMAPI)
+{
+	pJob->m_pLimiter=m_pLimiter;
+	for(int nAttempt=0;;nAttempt++)
+	{
+		pJob->m_bContinue=FALSE;
+		pJob->m_hrError=S_OK;
+		BOOL bResult=pJob->Run(pMAPI);
+
+		DWORD dwDelay;
+		if(bResult || !m_pLimiter || !m_pLimiter->ShouldRetry(pJob->m_hrError, nAttempt, dwDelay)) return bResult;
+		if(WaitForSingleObject(m_hStop, dwDelay)==WAIT_OBJECT_0) return FALSE;
+	}
+}
+
+#ifndef _WIN32_WCE
+unsigned __stdcall CMAPIExecutor::WorkerThread(void* pParam)
+{
+	Worker& worker=*(Worker*)pParam;
+	CMAPIExecutor* pExecutor=worker.m_pExecutor;
+
+	// each worker initializes MAPI and logs on to get a session of its own
+	BOOL bInit=CMAPIEx::Init();
+	{
+		CMAPIEx mapi;
+		CMAPIEx* pMAPI=bInit ? &mapi : NULL;
+		BOOL bLoggedOn=bInit && pExecutor->Logon(mapi);
+
+		// new jobs and continuing ones take turns so a long scan doesn't hold up the queue or the other way round
+		BOOL bOwnFirst=FALSE;
+		CMAPIJob* pJob;
+		for(;;)
+		{
+			HANDLE hEvents[3]={ pExecutor->m_hStop, bOwnFirst ? worker.m_hJobs : pExecutor->m_hJobs, bOwnFirst ? pExecutor->m_hJobs : worker.m_hJobs };
+			DWORD dwWait=WaitForMultipleObjects(3, hEvents, FALSE, INFINITE);
+			if(dwWait!=WAIT_OBJECT_0+1 && dwWait!=WAIT_OBJECT_0+2) break;
+
+			pJob=pExecutor->NextJob(hEvents[dwWait-WAIT_OBJECT_0]==worker.m_hJobs ? worker.m_nWorker : -1);
+			if(pJob) pExecutor->RunJob(pJob, worker, pMAPI, bLoggedOn);
+			bOwnFirst=!bOwnFirst;
+		}
+
+		// jobs between steps may hold objects from this session, drop them before logging out
+		while((pJob=pExecutor->NextJob(worker.m_nWorker))!=NULL)
+		{
+			pJob->Cancel();
+			pJob->ReleaseSession();
+			pJob->Release();
+		}
+		mapi.Logout();
+	}
+	if(bInit) CMAPIEx::Term();
+	return bInit ? 0 : 1;
+}
+#endif
@@ -0,0 +1,298 @@
+#ifndef __MAPIEXECUTOR_H__
+#define __MAPIEXECUTOR_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIExecutor.h
+// Description: Worker threads with sessions of their own running MAPI jobs queued by other threads
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CMAPIJob;
+class CMAPIExecutor;
+
+// called on the thread that finished or cancelled the job, keep it short
+typedef void (*LPMAPIJOBCALLBACK)(CMAPIJob* pJob, LPVOID pContext);
+
+/////////////////////////////////////////////////////////////
+// CMAPIJob
+
+// One queued MAPI call and its result, it stands in for a future.  Jobs are reference counted since the
+// executor holds one until it has run: create with new, Submit, then Wait (or get the callback) and Release.
+// Inputs and results are copies (strings, entry IDs) because MAPI objects can't cross sessions.
+//
+// A job that works in steps calls Continue from Run, it's then queued again behind the other jobs on the same
+// worker (it may hold objects from that session) and only completes after a step that doesn't continue;
+// ReleaseSession is called there once it won't run again.  Run holds a slot of the executor's limiter (if it
+// has one) with a CMAPILimiterCall on m_pLimiter around each MAPI call, never around a callback, and puts the
+// HRESULT of a failed call in m_hrError (see Fail).  A job that fails with a throttling error is retried after
+// a backoff when the executor has a limiter
+class AFX_EXT_CLASS CMAPIJob
+{
+public:
+	CMAPIJob();
+
+	enum { JOB_PENDING, JOB_RUNNING, JOB_DONE, JOB_CANCELLED };
+
+// Attributes
+protected:
+	LONG m_lRefCount;
+	LONG m_lState;
+	BOOL m_bResult;
+	HRESULT m_hrError;
+	HANDLE m_hDone;
+	LPMAPIJOBCALLBACK m_pCallback;
+	LPVOID m_pContext;
+	int m_nWorker;
+	BOOL m_bContinue;
+	CMAPILimiter* m_pLimiter;
+
+// Operations
+public:
+	LONG AddRef();
+	LONG Release();
+
+	int GetState() { return (int)m_lState; }
+	BOOL IsDone() { return (m_lState==JOB_DONE || m_lState==JOB_CANCELLED); }
+	BOOL GetResult() { return m_bResult; }
+	HRESULT GetError() { return m_hrError; }
+	BOOL Wait(DWORD dwTimeout=INFINITE);
+	BOOL Cancel();
+
+protected:
+	virtual ~CMAPIJob();
+	virtual BOOL Run(CMAPIEx* pMAPI)=0;
+	virtual void ReleaseSession() { }
+	void Continue() { m_bContinue=TRUE; }
+	BOOL Fail(CMAPILimiterCall& call, HRESULT hr);
+	void Complete(int nState);
+
+	friend class CMAPIExecutor;
+
+private:
+	CMAPIJob(const CMAPIJob&);
+	CMAPIJob& operator=(const CMAPIJob&);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIOpenFolderJob
+
+// finds a folder by PR_IPM_*_ENTRYID style ID or by name, the result is its entry ID for the other jobs
+class AFX_EXT_CLASS CMAPIOpenFolderJob : public CMAPIJob
+{
+public:
+	CMAPIOpenFolderJob(unsigned long ulFolderID);
+	CMAPIOpenFolderJob(LPCTSTR szFolderName);
+
+// Attributes
+public:
+	unsigned long m_ulFolderID;
+	CString m_strFolderName;
+
+	CMAPIEntryID m_folderID;
+	CString m_strName;
+
+protected:
+	virtual BOOL Run(CMAPIEx* pMAPI);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIQueryRowsJob
+
+// Reads nCount rows of a folder's contents table from nStart, with the given columns (PR_ENTRYID and
+// PR_MESSAGE_FLAGS by default).  The rows belong to the job until DetachRows, free detached ones with FreeProws
+class AFX_EXT_CLASS CMAPIQueryRowsJob : public CMAPIJob
+{
+public:
+	CMAPIQueryRowsJob(const CMAPIEntryID& folderID, int nStart, int nCount, const ULONG* pulColumns=NULL, int nColumns=0);
+
+// Attributes
+public:
+	CMAPIEntryID m_folderID;
+	int m_nStart;
+	int m_nCount;
+	CArray<ULONG, ULONG> m_arColumns;
+	ULONG m_ulSortField;
+	ULONG m_ulSortParam;
+
+protected:
+	LPSRowSet m_pRows;
+	int m_nRowCount;
+
+// Operations
+public:
+	LPSRowSet GetRows() { return m_pRows; }
+	LPSRowSet DetachRows();
+	int GetRowCount() { return m_nRowCount; }
+
+protected:
+	virtual ~CMAPIQueryRowsJob();
+	virtual BOOL Run(CMAPIEx* pMAPI);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIOpenMessageJob
+
+// opens a message and copies its envelope, and with bBody its plain text body
+class AFX_EXT_CLASS CMAPIOpenMessageJob : public CMAPIJob
+{
+public:
+	CMAPIOpenMessageJob(const CMAPIEntryID& messageID, BOOL bBody=TRUE);
+
+// Attributes
+public:
+	CMAPIEntryID m_messageID;
+	BOOL m_bBody;
+
+	CString m_strSubject;
+	CString m_strSenderName;
+	CString m_strSenderEmail;
+	CString m_strTo;
+	SYSTEMTIME m_tmReceived;
+	int m_nMessageFlags;
+	int m_nAttachments;
+	CString m_strBody;
+
+protected:
+	virtual BOOL Run(CMAPIEx* pMAPI);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPISaveAttachmentJob
+
+// saves attachment nIndex (-1 for all of them) of a message to szFolder
+class AFX_EXT_CLASS CMAPISaveAttachmentJob : public CMAPIJob
+{
+public:
+	CMAPISaveAttachmentJob(const CMAPIEntryID& messageID, LPCTSTR szFolder, int nIndex=-1, LPCTSTR szFileName=NULL);
+
+// Attributes
+public:
+	CMAPIEntryID m_messageID;
+	CString m_strFolder;
+	int m_nIndex;
+	CString m_strFileName;
+
+protected:
+	virtual BOOL Run(CMAPIEx* pMAPI);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPISendJob
+
+// creates and sends a plain text message, add recipients, subject and body before submitting it
+class AFX_EXT_CLASS CMAPISendJob : public CMAPIJob
+{
+public:
+	CMAPISendJob();
+
+	struct Recipient
+	{
+		CString m_strEmail;
+		int m_nType;
+	};
+
+// Attributes
+public:
+	CArray<Recipient, Recipient&> m_arRecipients;
+	CString m_strSubject;
+	CString m_strBody;
+	int m_nPriority;
+	BOOL m_bSaveToSentFolder;
+
+// Operations
+public:
+	void AddRecipient(LPCTSTR szEmail, int nType=MAPI_TO);
+
+protected:
+	virtual BOOL Run(CMAPIEx* pMAPI);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIExecutor
+
+// A few worker threads, each with its own CMAPIEx logged on to the profile, running jobs in the order they were
+// submitted.  Submit returns at once so one thread can have hundreds of calls in flight and collect them later
+// (or in callbacks) instead of blocking a thread per call.  A worker whose session fails to log on tries
+// again on its next job, which fails if it still can't.  With SetLimiter every MAPI call a job makes holds a
+// slot of the limiter, so executors (and session pools) sharing one limiter back off together when the server
+// is throttling:
+//
+//		CMAPIExecutor executor;
+//		executor.Start(NULL, 4);
+//		CMAPIOpenMessageJob* pJob=new CMAPIOpenMessageJob(messageID);
+//		executor.Submit(pJob);
+//		...
+//		if(pJob->Wait() && pJob->GetResult()) ... pJob->m_strSubject ...
+//		pJob->Release();
+class AFX_EXT_CLASS CMAPIExecutor
+{
+public:
+	CMAPIExecutor();
+	~CMAPIExecutor();
+
+	enum { MAX_THREADS=32 };
+
+	// jobs that continued, they stay on the worker whose session they used
+	struct Worker
+	{
+		CMAPIExecutor* m_pExecutor;
+		int m_nWorker;
+		HANDLE m_hJobs;
+		CList<CMAPIJob*, CMAPIJob*> m_lstJobs;
+	};
+
+// Attributes
+protected:
+	CString m_strProfile;
+	CString m_strStore;
+	BOOL m_bProfile;
+	BOOL m_bStore;
+	BOOL m_bInitAsService;
+	CList<CMAPIJob*, CMAPIJob*> m_lstJobs;
+	HANDLE m_hJobs;
+	HANDLE m_hStop;
+	HANDLE m_hThreads[MAX_THREADS];
+	DWORD m_dwThreadIDs[MAX_THREADS];
+	Worker m_workers[MAX_THREADS];
+	int m_nThreads;
+	LONG m_lRunning;
+	CMAPILimiter* m_pLimiter;
+	CRITICAL_SECTION m_cs;
+
+// Operations
+public:
+	BOOL Start(LPCTSTR szProfileName, int nThreads=0, LPCTSTR szStore=NULL, BOOL bInitAsService=FALSE);
+	BOOL Stop();
+	BOOL IsStarted() { return (m_nThreads>0); }
+	int GetThreadCount() { return m_nThreads; }
+	int GetQueuedCount();
+	int GetRunningCount() { return (int)m_lRunning; }
+	void SetLimiter(CMAPILimiter* pLimiter) { m_pLimiter=pLimiter; }
+	CMAPILimiter* GetLimiter() { return m_pLimiter; }
+
+	BOOL Submit(CMAPIJob* pJob, LPMAPIJOBCALLBACK pCallback=NULL, LPVOID pContext=NULL);
+
+protected:
+	CMAPIJob* NextJob(int nWorker=-1);
+	BOOL Logon(CMAPIEx& mapi);
+	void RunJob(CMAPIJob* pJob, Worker& worker, CMAPIEx* pMAPI, BOOL& bLoggedOn);
+	BOOL RunStep(CMAPIJob* pJob, CMAPIEx* pMAPI);
+
+#ifndef _WIN32_WCE
+	static unsigned __stdcall WorkerThread(void* pParam);
+#endif
+
+private:
+	CMAPIExecutor(const CMAPIExecutor&);
+	CMAPIExecutor& operator=(const CMAPIExecutor&);
+};
+
+#endif
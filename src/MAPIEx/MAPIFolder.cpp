@@ -26,8 +26,6 @@ CMAPIFolder::CMAPIFolder()
 CMAPIFolder::CMAPIFolder(CMAPIEx* pMAPI, LPMAPIFOLDER pFolder, LPCTSTR szName)
 {
 	Init();
-
-	m_entryID.cb=0;
 	Attach(pMAPI, pFolder, szName);
 }
 
@@ -278,6 +276,37 @@ BOOL CMAPIFolder::GetNextContact(CMAPIContact& contact)
 #endif
 }
 
+// like GetContents but with the loader's contact fields as columns (the loader is initialized from this folder
+// with COLUMNS_ALL if necessary) and only IPM.Contact items, so GetNextContact(CContactRecord&) reads contacts
+// straight from the table rows
+LPMAPITABLE CMAPIFolder::GetContactContents(CMAPIContactLoader& loader)
+{
+	ClearBuffer();
+	RELEASE(m_pContents);
+#ifdef _WIN32_WCE
+	return NULL;
+#else
+	if(!loader.IsInitialized() && !loader.Init(Folder())) return NULL;
+	if(Folder()->GetContentsTable(CMAPIEx::cm_nMAPICode, &m_pContents)!=S_OK) return NULL;
+
+	if(m_pContents->SetColumns(loader.GetTags(), TBL_BATCH)!=S_OK || !CMAPIContactLoader::Restrict(m_pContents)) 
+	{
+		RELEASE(m_pContents);
+		return NULL;
+	}
+	return m_pContents;
+#endif
+}
+
+// requires GetContactContents, returns records in batches of SetBufferSize rows without opening the contacts
+BOOL CMAPIFolder::GetNextContact(CContactRecord& record)
+{
+	SRow* pRow=GetNextRow();
+	if(!pRow) return FALSE;
+	CMAPIContactLoader::Fill(pRow->lpProps, pRow->cValues, record);
+	return TRUE;
+}
+
 BOOL CMAPIFolder::GetNextAppointment(CMAPIAppointment& appointment)
 {
 #ifdef _WIN32_WCE
@@ -288,6 +317,69 @@ BOOL CMAPIFolder::GetNextAppointment(CMAPIAppointment& appointment)
 #endif
 }
 
+// every appointment in the folder in the loader's columns, unsorted
+LPMAPITABLE CMAPIFolder::GetAppointmentContents(CMAPIAppointmentLoader& loader)
+{
+	ClearBuffer();
+	RELEASE(m_pContents);
+#ifdef _WIN32_WCE
+	return NULL;
+#else
+	if(!loader.IsInitialized() && !loader.Init(Folder())) return NULL;
+	if(Folder()->GetContentsTable(CMAPIEx::cm_nMAPICode, &m_pContents)!=S_OK) return NULL;
+
+	if(m_pContents->SetColumns(loader.GetTags(), 0)!=S_OK) 
+	{
+		RELEASE(m_pContents);
+		return NULL;
+	}
+	return m_pContents;
+#endif
+}
+
+// Like GetContactContents for a calendar, but only the appointments overlapping tmStart..tmEnd (local time)
+// are returned, sorted by start time.  The store filters and sorts the rows so the other appointments are
+// never read (see CMAPIAppointmentLoader::Restrict)
+LPMAPITABLE CMAPIFolder::GetAppointmentContents(CMAPIAppointmentLoader& loader, SYSTEMTIME& tmStart, SYSTEMTIME& tmEnd)
+{
+#ifdef _WIN32_WCE
+	return NULL;
+#else
+	FILETIME ftStart, ftEnd;
+	if(!CMAPIAppointmentLoader::LocalToFileTime(tmStart, ftStart) || !CMAPIAppointmentLoader::LocalToFileTime(tmEnd, ftEnd)) return NULL;
+	return GetAppointmentContents(loader, ftStart, ftEnd);
+#endif
+}
+
+// same as above with the range in UTC
+LPMAPITABLE CMAPIFolder::GetAppointmentContents(CMAPIAppointmentLoader& loader, FILETIME& ftStart, FILETIME& ftEnd)
+{
+	ClearBuffer();
+	RELEASE(m_pContents);
+#ifdef _WIN32_WCE
+	return NULL;
+#else
+	if(!loader.IsInitialized() && !loader.Init(Folder())) return NULL;
+	if(Folder()->GetContentsTable(CMAPIEx::cm_nMAPICode, &m_pContents)!=S_OK) return NULL;
+
+	if(m_pContents->SetColumns(loader.GetTags(), TBL_BATCH)!=S_OK || !loader.Restrict(m_pContents, ftStart, ftEnd))
+	{
+		RELEASE(m_pContents);
+		return NULL;
+	}
+	return m_pContents;
+#endif
+}
+
+// requires GetAppointmentContents, returns records without opening the appointments
+BOOL CMAPIFolder::GetNextAppointment(CAppointmentRecord& record)
+{
+	SRow* pRow=GetNextRow();
+	if(!pRow) return FALSE;
+	CMAPIAppointmentLoader::Fill(pRow->lpProps, pRow->cValues, record);
+	return TRUE;
+}
+
 BOOL CMAPIFolder::GetNextSubFolder(CMAPIFolder& folder, CString& strFolder)
 {
 	if(!m_pHierarchy) return NULL;
@@ -22,6 +22,11 @@
 #define DEFAULT_FOLDER_BUFFER_SIZE 512
 #endif
 
+class CMAPIContactLoader;
+class CContactRecord;
+class CMAPIAppointmentLoader;
+class CAppointmentRecord;
+
 /////////////////////////////////////////////////////////////
 // CMAPIFolder
 
@@ -75,7 +80,13 @@ public:
 	BOOL SetRestriction(SRestriction* pRestriction);
 	BOOL GetNextMessage(CMAPIMessage& message);
 	BOOL GetNextContact(CMAPIContact& contact);
+	LPMAPITABLE GetContactContents(CMAPIContactLoader& loader);
+	BOOL GetNextContact(CContactRecord& record);
 	BOOL GetNextAppointment(CMAPIAppointment& appointment);
+	LPMAPITABLE GetAppointmentContents(CMAPIAppointmentLoader& loader);
+	LPMAPITABLE GetAppointmentContents(CMAPIAppointmentLoader& loader, SYSTEMTIME& tmStart, SYSTEMTIME& tmEnd);
+	LPMAPITABLE GetAppointmentContents(CMAPIAppointmentLoader& loader, FILETIME& ftStart, FILETIME& ftEnd);
+	BOOL GetNextAppointment(CAppointmentRecord& record);
 	BOOL GetNextSubFolder(CMAPIFolder& folder, CString& strFolder);
 
 	BOOL DeleteMessage(CMAPIMessage& message);
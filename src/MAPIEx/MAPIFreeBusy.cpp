@@ -0,0 +1,380 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIFreeBusy.cpp
+// Description: Free/busy bitmaps for a set of calendars and common free time queries
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+#ifndef _WIN32_WCE
+#include <process.h>
+#endif
+
+// longest window SetWindow accepts, keeps slot arithmetic well inside a DWORD of minutes
+const DWORD FreeBusyMaxMinutes=10*366*CMAPIRecurrence::MINUTES_PER_DAY;
+
+/////////////////////////////////////////////////////////////
+// CMAPIFreeBusy
+
+CMAPIFreeBusy::CMAPIFreeBusy()
+{
+	m_dwStart=0;
+	m_nSlots=0;
+	m_nSlotMinutes=DEFAULT_SLOT_MINUTES;
+	m_nWords=0;
+	m_bTentativeBusy=TRUE;
+	m_pPool=NULL;
+	m_pLoadPool=NULL;
+	m_lNextCalendar=0;
+}
+
+CMAPIFreeBusy::~CMAPIFreeBusy()
+{
+	ClosePool();
+}
+
+// sets the window to nSlots slots of nSlotMinutes starting at ftStart (UTC, rounded down to the minute), this
+// clears every calendar's bits
+BOOL CMAPIFreeBusy::SetWindow(const FILETIME& ftStart, int nSlots, int nSlotMinutes)
+{
+	if(nSlots<=0 || nSlotMinutes<=0 || (DWORD)nSlots>FreeBusyMaxMinutes/(DWORD)nSlotMinutes) return FALSE;
+
+	m_dwStart=CMAPIRecurrence::FileTimeToMinutes(ftStart);
+	m_nSlots=nSlots;
+	m_nSlotMinutes=nSlotMinutes;
+	m_nWords=(nSlots+BITS_PER_WORD-1)/BITS_PER_WORD;
+
+	int nCalendars=GetCalendarCount();
+	m_arBits.SetSize(nCalendars*m_nWords);
+	for(int i=0;i<nCalendars;i++) Clear(i);
+	return TRUE;
+}
+
+void CMAPIFreeBusy::GetSlotTime(int nSlot, FILETIME& ftSlot)
+{
+	CMAPIRecurrence::MinutesToFileTime(m_dwStart+(DWORD)nSlot*m_nSlotMinutes, ftSlot);
+}
+
+// returns the calendar's index, the bits start out free until it's loaded
+int CMAPIFreeBusy::AddCalendar(const CMAPIEntryID& calendarID)
+{
+	CMAPIEntryID entryID(calendarID);
+	int nCalendar=(int)m_arCalendars.Add(entryID);
+	m_arLoaded.Add(FALSE);
+	m_arBits.SetSize((nCalendar+1)*m_nWords);
+	Clear(nCalendar);
+	return nCalendar;
+}
+
+void CMAPIFreeBusy::RemoveAll()
+{
+	m_arCalendars.RemoveAll();
+	m_arLoaded.RemoveAll();
+	m_arBits.RemoveAll();
+}
+
+BOOL CMAPIFreeBusy::IsLoaded(int nCalendar)
+{
+	return (nCalendar>=0 && nCalendar<GetCalendarCount()) ? m_arLoaded[nCalendar] : FALSE;
+}
+
+// Loads every calendar, nThreads workers (0 for one per processor) take the next calendar until none are left.
+// The workers lease from a pool logged on to pMAPI's profile that's kept for the next Load, it's only logged
+// on again when the profile changes or more threads are asked for.  Calendars a worker couldn't read are
+// retried on pMAPI before returning; returns TRUE if all of them loaded
+BOOL CMAPIFreeBusy::Load(CMAPIEx* pMAPI, int nThreads)
+{
+	if(!pMAPI || !m_nSlots) return FALSE;
+
+#ifndef _WIN32_WCE
+	nThreads=GetThreadCount(nThreads);
+	if(nThreads>1)
+	{
+		CString strProfile;
+		pMAPI->GetProfileName(strProfile);
+		if(m_pPool && (!m_pPool->IsOpen() || m_pPool->GetSessionCount()<nThreads || strProfile!=m_strProfile)) ClosePool();
+		if(!m_pPool)
+		{
+			m_pPool=new CMAPISessionPool;
+			m_strProfile=strProfile;
+			m_pPool->Open(m_strProfile.IsEmpty() ? NULL : (LPCTSTR)m_strProfile, nThreads);
+		}
+		if(m_pPool->IsOpen()) return Load(*m_pPool, pMAPI, nThreads);
+	}
+#endif
+
+	BOOL bResult=TRUE;
+	for(int i=0;i<GetCalendarCount();i++)
+	{
+		if(!LoadCalendar(i, pMAPI)) bResult=FALSE;
+	}
+	return bResult;
+}
+
+// Loads every calendar with nThreads workers (0 for one per processor, no more than the pool's sessions)
+// leasing from pool, whose sessions must be logged on to the calendars' profile.  Calendars the workers
+// couldn't read are retried on pMAPI if it's set; returns TRUE if all of them loaded
+BOOL CMAPIFreeBusy::Load(CMAPISessionPool& pool, CMAPIEx* pMAPI, int nThreads)
+{
+	int nCalendars=GetCalendarCount(), i;
+	if(!m_nSlots) return FALSE;
+	for(i=0;i<nCalendars;i++) m_arLoaded[i]=FALSE;
+
+#ifndef _WIN32_WCE
+	LoadWorkers(pool, min(GetThreadCount(nThreads), pool.GetSessionCount()));
+#endif
+
+	BOOL bResult=TRUE;
+	for(i=0;i<nCalendars;i++)
+	{
+		if(!m_arLoaded[i] && (!pMAPI || !LoadCalendar(i, pMAPI))) bResult=FALSE;
+	}
+	return bResult;
+}
+
+// logs off the sessions Load(CMAPIEx*) keeps between calls, the next threaded Load logs on again
+void CMAPIFreeBusy::ClosePool()
+{
+	if(m_pPool)
+	{
+		delete m_pPool;
+		m_pPool=NULL;
+	}
+	m_strProfile.Empty();
+}
+
+// Reads one calendar's busy time in the window using pMAPI's session, safe to call for different calendars
+// from different threads since each one only writes its own bits
+BOOL CMAPIFreeBusy::LoadCalendar(int nCalendar, CMAPIEx* pMAPI)
+{
+	if(nCalendar<0 || nCalendar>=GetCalendarCount() || !pMAPI || !pMAPI->GetSession()) return FALSE;
+	m_arLoaded[nCalendar]=FALSE;
+	Clear(nCalendar);
+
+	DWORD dwObjType;
+	LPMAPIFOLDER pFolder=NULL;
+	CMAPIEntryID& calendarID=m_arCalendars[nCalendar];
+	if(pMAPI->GetSession()->OpenEntry(calendarID.GetSize(), calendarID.GetEntryID(), NULL, MAPI_BEST_ACCESS, &dwObjType, (LPUNKNOWN*)&pFolder)!=S_OK) return FALSE;
+	CMAPIFolder folder(pMAPI, pFolder);
+
+	FILETIME ftStart, ftEnd;
+	GetSlotTime(0, ftStart);
+	GetSlotTime(m_nSlots, ftEnd);
+
+	CMAPIAppointmentLoader loader;
+	if(!folder.GetAppointmentContents(loader, ftStart, ftEnd)) return FALSE;
+
+	CAppointmentRecord record;
+	CMAPIAppointment appointment;
+	CMAPIRecurrence recurrence;
+	CRecurrenceIterator it;
+	CRecurrenceOccurrence occurrence;
+	while(folder.GetNextAppointment(record))
+	{
+		if(record.m_bRecurring && appointment.Open(pMAPI, *record.m_entryID.GetBinary()))
+		{
+			BOOL bExpanded=(appointment.GetRecurrence(recurrence) && it.Begin(recurrence, ftStart, ftEnd));
+			appointment.Close();
+			if(bExpanded)
+			{
+				while(it.Next(occurrence))
+				{
+					int nBusyStatus=record.m_nBusyStatus;
+					if(occurrence.m_nException>=0 && recurrence.m_arExceptions[occurrence.m_nException].m_nBusyStatus>=0)
+					{
+						nBusyStatus=recurrence.m_arExceptions[occurrence.m_nException].m_nBusyStatus;
+					}
+					if(IsBusyStatus(nBusyStatus)) AddBusy(nCalendar, occurrence.m_ftStart, occurrence.m_ftEnd);
+				}
+				continue;
+			}
+		}
+
+		// single appointments, and recurring ones whose pattern can't be expanded are busy for their first occurrence
+		if(IsBusyStatus(record.m_nBusyStatus)) AddBusy(nCalendar, record.m_ftStart, record.m_ftEnd);
+	}
+
+	m_arLoaded[nCalendar]=TRUE;
+	return TRUE;
+}
+
+void CMAPIFreeBusy::Clear(int nCalendar)
+{
+	if(nCalendar<0 || nCalendar>=GetCalendarCount() || !m_nWords) return;
+	memset(m_arBits.GetData()+nCalendar*m_nWords, 0, m_nWords*sizeof(DWORD));
+}
+
+// marks the slots overlapping ftStart..ftEnd (UTC) busy, a slot is busy if any part of it is
+void CMAPIFreeBusy::AddBusy(int nCalendar, const FILETIME& ftStart, const FILETIME& ftEnd)
+{
+	AddBusy(nCalendar, CMAPIRecurrence::FileTimeToMinutes(ftStart), CMAPIRecurrence::FileTimeToMinutes(ftEnd, TRUE));
+}
+
+void CMAPIFreeBusy::AddBusy(int nCalendar, DWORD dwStart, DWORD dwEnd)
+{
+	if(nCalendar<0 || nCalendar>=GetCalendarCount() || !m_nSlots) return;
+
+	DWORD dwWindowEnd=m_dwStart+(DWORD)m_nSlots*m_nSlotMinutes;
+	if(dwStart<m_dwStart) dwStart=m_dwStart;
+	if(dwEnd>dwWindowEnd) dwEnd=dwWindowEnd;
+	if(dwEnd<=dwStart) return;
+
+	int nFirst=(int)((dwStart-m_dwStart)/m_nSlotMinutes);
+	int nLast=(int)((dwEnd-m_dwStart+m_nSlotMinutes-1)/m_nSlotMinutes)-1;
+
+	DWORD* pBits=m_arBits.GetData()+nCalendar*m_nWords;
+	int nFirstWord=nFirst/BITS_PER_WORD, nLastWord=nLast/BITS_PER_WORD;
+	DWORD dwFirstMask=0xFFFFFFFF<<(nFirst%BITS_PER_WORD);
+	DWORD dwLastMask=0xFFFFFFFF>>(BITS_PER_WORD-1-nLast%BITS_PER_WORD);
+	if(nFirstWord==nLastWord)
+	{
+		pBits[nFirstWord]|=(dwFirstMask & dwLastMask);
+		return;
+	}
+	pBits[nFirstWord]|=dwFirstMask;
+	for(int i=nFirstWord+1;i<nLastWord;i++) pBits[i]=0xFFFFFFFF;
+	pBits[nLastWord]|=dwLastMask;
+}
+
+BOOL CMAPIFreeBusy::IsBusy(int nCalendar, int nSlot)
+{
+	if(nCalendar<0 || nCalendar>=GetCalendarCount() || nSlot<0 || nSlot>=m_nSlots) return FALSE;
+	return (m_arBits[nCalendar*m_nWords+nSlot/BITS_PER_WORD]>>(nSlot%BITS_PER_WORD)) & 1;
+}
+
+// slot n is bit n%32 of word n/32, bits past GetSlotCount() are always 0
+const DWORD* CMAPIFreeBusy::GetBits(int nCalendar)
+{
+	if(nCalendar<0 || nCalendar>=GetCalendarCount() || !m_nWords) return NULL;
+	return m_arBits.GetData()+nCalendar*m_nWords;
+}
+
+// ORs the bits of nCount calendars (every calendar if pCalendars is NULL), a slot in arBusy is busy if any
+// of them are busy then
+void CMAPIFreeBusy::Combine(const int* pCalendars, int nCount, CArray<DWORD, DWORD>& arBusy)
+{
+	arBusy.SetSize(m_nWords);
+	if(!m_nWords) return;
+
+	DWORD* pBusy=arBusy.GetData();
+	memset(pBusy, 0, m_nWords*sizeof(DWORD));
+	int nCalendars=GetCalendarCount();
+	if(!pCalendars) nCount=nCalendars;
+	for(int i=0;i<nCount;i++)
+	{
+		int nCalendar=pCalendars ? pCalendars[i] : i;
+		if(nCalendar<0 || nCalendar>=nCalendars) continue;
+
+		const DWORD* pBits=m_arBits.GetData()+nCalendar*m_nWords;
+		for(int j=0;j<m_nWords;j++) pBusy[j]|=pBits[j];
+	}
+}
+
+// Returns the first slot at or after nFromSlot starting nLength slots in a row that all of the calendars
+// (see Combine) are free, or -1 if there are none in the window.  Whole free or busy words are skipped
+int CMAPIFreeBusy::FindFirstFree(const int* pCalendars, int nCount, int nLength, int nFromSlot)
+{
+	if(nLength<1) nLength=1;
+	if(nFromSlot<0) nFromSlot=0;
+	if(nFromSlot+nLength>m_nSlots) return -1;
+
+	CArray<DWORD, DWORD> arBusy;
+	Combine(pCalendars, nCount, arBusy);
+	const DWORD* pBusy=arBusy.GetData();
+
+	int nSlot=nFromSlot, nRunStart=nFromSlot;
+	while(nSlot<m_nSlots)
+	{
+		DWORD dwWord=pBusy[nSlot/BITS_PER_WORD];
+		int nBit=nSlot%BITS_PER_WORD;
+		if(!nBit && dwWord==0xFFFFFFFF)
+		{
+			nSlot+=BITS_PER_WORD;
+			nRunStart=nSlot;
+			continue;
+		}
+		if(!nBit && !dwWord) nSlot=min(nSlot+(int)BITS_PER_WORD, m_nSlots);
+		else if((dwWord>>nBit) & 1)
+		{
+			nRunStart=++nSlot;
+			continue;
+		}
+		else nSlot++;
+
+		if(nSlot-nRunStart>=nLength) return nRunStart;
+	}
+	return -1;
+}
+
+// appointments without a busy status (-1) are treated as tentative
+BOOL CMAPIFreeBusy::IsBusyStatus(int nBusyStatus)
+{
+	if(nBusyStatus==BUSY_FREE) return FALSE;
+	if(nBusyStatus==BUSY_TENTATIVE || nBusyStatus<0) return m_bTentativeBusy;
+	return TRUE;
+}
+
+// nThreads, or one per processor if it's 0, and no more than there are calendars
+int CMAPIFreeBusy::GetThreadCount(int nThreads)
+{
+	if(nThreads<=0)
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		nThreads=(int)info.dwNumberOfProcessors;
+	}
+	return min(nThreads, min((int)MAX_THREADS, GetCalendarCount()));
+}
+
+#ifndef _WIN32_WCE
+// starts nThreads LoadThreads on pool and waits for them, calendars they couldn't load are left unloaded
+void CMAPIFreeBusy::LoadWorkers(CMAPISessionPool& pool, int nThreads)
+{
+	if(nThreads<1) return;
+	m_pLoadPool=&pool;
+	m_lNextCalendar=0;
+
+	HANDLE hThreads[MAX_THREADS];
+	int nStarted=0, i;
+	for(i=0;i<nThreads && i<MAX_THREADS;i++)
+	{
+		hThreads[nStarted]=(HANDLE)_beginthreadex(NULL, 0, LoadThread, this, 0, NULL);
+		if(hThreads[nStarted]) nStarted++;
+	}
+	if(nStarted) WaitForMultipleObjects(nStarted, hThreads, TRUE, INFINITE);
+	for(i=0;i<nStarted;i++) CloseHandle(hThreads[i]);
+	m_pLoadPool=NULL;
+}
+
+unsigned __stdcall CMAPIFreeBusy::LoadThread(void* pParam)
+{
+	CMAPIFreeBusy* pFreeBusy=(CMAPIFreeBusy*)pParam;
+
+	// MAPI has to be initialized on every thread using a session, the session itself is leased for all of the
+	// calendars this worker takes
+	if(!CMAPIEx::Init()) return 1;
+	{
+		CMAPISessionLease mapi(*pFreeBusy->m_pLoadPool, LEASE_TIMEOUT);
+		if(mapi.IsValid())
+		{
+			int nCalendars=pFreeBusy->GetCalendarCount();
+			int nCalendar;
+			while((nCalendar=(int)InterlockedIncrement(&pFreeBusy->m_lNextCalendar)-1)<nCalendars)
+			{
+				pFreeBusy->LoadCalendar(nCalendar, mapi);
+			}
+		}
+	}
+	CMAPIEx::Term();
+	return 0;
+}
+#endif
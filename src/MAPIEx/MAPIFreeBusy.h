@@ -0,0 +1,98 @@
+#ifndef __MAPIFREEBUSY_H__
+#define __MAPIFREEBUSY_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIFreeBusy.h
+// Description: Free/busy bitmaps for a set of calendars and common free time queries
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CMAPISessionPool;
+
+/////////////////////////////////////////////////////////////
+// CMAPIFreeBusy
+
+// Splits a window into fixed slots (15 minutes by default) and keeps one bit per slot per calendar, set when
+// the calendar is busy.  Calendars are read with CMAPIFolder::GetAppointmentContents, recurring appointments
+// are expanded with CRecurrenceIterator, and Load spreads the calendars over worker threads that lease their
+// sessions from a CMAPISessionPool, either the caller's or one kept logged on between Loads until ClosePool.
+// Queries combine the bitmaps 32 slots at a time:
+//
+//		CMAPIFreeBusy freebusy;
+//		freebusy.SetWindow(ftStart, 30*96);
+//		for(i=0;i<nRooms;i++) freebusy.AddCalendar(arRoomCalendarIDs[i]);
+//		if(freebusy.Load(pMAPI)) nSlot=freebusy.FindFirstFree(NULL, 0, 4); // an hour all rooms are free
+class AFX_EXT_CLASS CMAPIFreeBusy
+{
+public:
+	CMAPIFreeBusy();
+	~CMAPIFreeBusy();
+
+	enum { DEFAULT_SLOT_MINUTES=15, MAX_THREADS=16, BITS_PER_WORD=32, LEASE_TIMEOUT=60000 };
+
+	// PidLidBusyStatus values
+	enum { BUSY_FREE, BUSY_TENTATIVE, BUSY_BUSY, BUSY_OUT_OF_OFFICE, BUSY_WORKING_ELSEWHERE };
+
+// Attributes
+protected:
+	DWORD m_dwStart;
+	int m_nSlots;
+	int m_nSlotMinutes;
+	int m_nWords;
+	BOOL m_bTentativeBusy;
+	CArray<CMAPIEntryID, CMAPIEntryID&> m_arCalendars;
+	CArray<BOOL, BOOL> m_arLoaded;
+	CArray<DWORD, DWORD> m_arBits;
+	CString m_strProfile;
+	CMAPISessionPool* m_pPool;
+	CMAPISessionPool* m_pLoadPool;
+	volatile LONG m_lNextCalendar;
+
+// Operations
+public:
+	BOOL SetWindow(const FILETIME& ftStart, int nSlots, int nSlotMinutes=DEFAULT_SLOT_MINUTES);
+	void SetTentativeBusy(BOOL bTentativeBusy) { m_bTentativeBusy=bTentativeBusy; }
+	int GetSlotCount() { return m_nSlots; }
+	int GetSlotMinutes() { return m_nSlotMinutes; }
+	void GetSlotTime(int nSlot, FILETIME& ftSlot);
+
+	int AddCalendar(const CMAPIEntryID& calendarID);
+	void RemoveAll();
+	int GetCalendarCount() { return (int)m_arCalendars.GetSize(); }
+	BOOL IsLoaded(int nCalendar);
+
+	BOOL Load(CMAPIEx* pMAPI, int nThreads=0);
+	BOOL Load(CMAPISessionPool& pool, CMAPIEx* pMAPI=NULL, int nThreads=0);
+	BOOL LoadCalendar(int nCalendar, CMAPIEx* pMAPI);
+	void ClosePool();
+
+	void Clear(int nCalendar);
+	void AddBusy(int nCalendar, const FILETIME& ftStart, const FILETIME& ftEnd);
+	BOOL IsBusy(int nCalendar, int nSlot);
+	const DWORD* GetBits(int nCalendar);
+	void Combine(const int* pCalendars, int nCount, CArray<DWORD, DWORD>& arBusy);
+	int FindFirstFree(const int* pCalendars, int nCount, int nLength, int nFromSlot=0);
+
+protected:
+	BOOL IsBusyStatus(int nBusyStatus);
+	void AddBusy(int nCalendar, DWORD dwStart, DWORD dwEnd);
+	int GetThreadCount(int nThreads);
+#ifndef _WIN32_WCE
+	void LoadWorkers(CMAPISessionPool& pool, int nThreads);
+	static unsigned __stdcall LoadThread(void* pParam);
+#endif
+
+private:
+	CMAPIFreeBusy(const CMAPIFreeBusy&);
+	CMAPIFreeBusy& operator=(const CMAPIFreeBusy&);
+};
+
+#endif
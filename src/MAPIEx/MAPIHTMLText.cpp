@@ -0,0 +1,490 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIHTMLText.cpp
+// Description: Single pass HTML to plain text extractor
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+// tags that start a new line in the text output
+const char* HTMLBlockTags[]={
+	"address", "blockquote", "br", "dd", "div", "dl", "dt", "h1", "h2", "h3", "h4", "h5", "h6", "hr",
+	"li", "ol", "p", "pre", "table", "td", "th", "title", "tr", "ul", NULL
+};
+
+struct HTMLEntity
+{
+	const char* m_szName;
+	WCHAR m_wch;
+};
+
+// must stay sorted by strcmp order (upper case before lower case) for the binary search
+const HTMLEntity HTMLEntities[]={
+	{ "AElig", 198 }, { "Aacute", 193 }, { "Agrave", 192 }, { "Auml", 196 }, { "Ccedil", 199 }, { "Eacute", 201 },
+	{ "Egrave", 200 }, { "Ntilde", 209 }, { "Ouml", 214 }, { "Uuml", 220 }, { "aacute", 225 }, { "aelig", 230 },
+	{ "agrave", 224 }, { "amp", 38 }, { "apos", 39 }, { "auml", 228 }, { "bull", 8226 }, { "ccedil", 231 },
+	{ "cent", 162 }, { "copy", 169 }, { "deg", 176 }, { "eacute", 233 }, { "egrave", 232 }, { "euro", 8364 },
+	{ "gt", 62 }, { "hellip", 8230 }, { "iexcl", 161 }, { "iquest", 191 }, { "laquo", 171 }, { "ldquo", 8220 },
+	{ "lsquo", 8216 }, { "lt", 60 }, { "mdash", 8212 }, { "middot", 183 }, { "nbsp", 160 }, { "ndash", 8211 },
+	{ "ntilde", 241 }, { "ouml", 246 }, { "para", 182 }, { "pound", 163 }, { "quot", 34 }, { "raquo", 187 },
+	{ "rdquo", 8221 }, { "reg", 174 }, { "rsquo", 8217 }, { "sect", 167 }, { "shy", 173 }, { "szlig", 223 },
+	{ "times", 215 }, { "trade", 8482 }, { "uuml", 252 }, { "yen", 165 }
+};
+
+struct HTMLCharset
+{
+	const char* m_szName;
+	UINT m_nCodePage;
+};
+
+// charsets commonly declared by mail, iso-8859-1 is decoded as windows-1252 like browsers do
+const HTMLCharset HTMLCharsets[]={
+	{ "utf-8", CP_UTF8 }, { "utf8", CP_UTF8 }, { "us-ascii", 20127 }, { "iso-8859-1", 1252 }, { "iso-8859-2", 28592 },
+	{ "iso-8859-5", 28595 }, { "iso-8859-7", 28597 }, { "iso-8859-9", 28599 }, { "iso-8859-15", 28605 },
+	{ "windows-1250", 1250 }, { "windows-1251", 1251 }, { "windows-1252", 1252 }, { "windows-1253", 1253 },
+	{ "windows-1254", 1254 }, { "windows-1255", 1255 }, { "windows-1256", 1256 }, { "windows-1257", 1257 },
+	{ "windows-1258", 1258 }, { "koi8-r", 20866 }, { "koi8-u", 21866 }, { "shift_jis", 932 }, { "euc-jp", 20932 },
+	{ "gb2312", 936 }, { "gbk", 936 }, { "big5", 950 }, { "euc-kr", 949 }, { "ks_c_5601-1987", 949 }, { NULL, 0 }
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIHTMLText
+
+CMAPIHTMLText::CMAPIHTMLText()
+{
+	m_pText=NULL;
+	m_nBufferLength=0;
+	m_nCodePage=CP_ACP;
+	m_nMaxCharSize=1;
+}
+
+// output is appended to strText, pass PR_INTERNET_CPID as nCodePage if the message has one
+void CMAPIHTMLText::Begin(CString& strText, UINT nCodePage)
+{
+	m_pText=&strText;
+	m_nState=STATE_TEXT;
+	m_bClosing=FALSE;
+	m_bNameDone=FALSE;
+	m_chQuote=0;
+	m_nDashes=0;
+	m_nName=0;
+	m_szName[0]=0;
+	m_szSkip[0]=0;
+	m_nAttributes=0;
+	m_bDetectCodePage=(nCodePage==CP_ACP);
+	SetCodePage(nCodePage);
+	m_bSpace=FALSE;
+	m_chLast=0;
+	m_nBufferLength=0;
+}
+
+void CMAPIHTMLText::Write(const char* pData, int nLength)
+{
+	for(int i=0;i<nLength;i++)
+	{
+		char ch=pData[i];
+		switch(m_nState)
+		{
+		case STATE_TEXT:
+			if(ch=='<')
+			{
+				m_nState=STATE_TAG;
+				m_bClosing=FALSE;
+				m_bNameDone=FALSE;
+				m_chQuote=0;
+				m_nDashes=0;
+				m_nName=0;
+				m_nAttributes=0;
+			}
+			else if(m_szSkip[0])
+			{
+				// inside script or style
+			}
+			else if(ch=='&')
+			{
+				m_nState=STATE_ENTITY;
+				m_nName=0;
+			}
+			else if(ch==' ' || ch=='\t' || ch=='\r' || ch=='\n' || ch=='\f')
+			{
+				m_bSpace=TRUE;
+			}
+			else PutText(ch);
+			break;
+
+		case STATE_TAG:
+			// m_nDashes counts how much of "!--" the tag has matched, -1 once it can't be a comment
+			if(m_nDashes>=0)
+			{
+				if(ch=="!--"[m_nDashes])
+				{
+					if(++m_nDashes==3)
+					{
+						m_nState=STATE_COMMENT;
+						m_nDashes=0;
+					}
+					break;
+				}
+				m_nDashes=-1;
+			}
+
+			// only <meta> attributes are kept, to look for a charset
+			if(m_bNameDone && m_bDetectCodePage && m_nAttributes<MAX_ATTRIBUTES && m_nName==4 && !memcmp(m_szName, "meta", 4))
+			{
+				if(ch!='>' || m_chQuote) m_szAttributes[m_nAttributes++]=ch;
+			}
+
+			if(m_chQuote)
+			{
+				if(ch==m_chQuote) m_chQuote=0;
+			}
+			else if(ch=='>')
+			{
+				m_szName[m_nName]=0;
+				OnTag();
+				m_nState=STATE_TEXT;
+			}
+			else if(!m_bNameDone)
+			{
+				if(ch=='/' && !m_nName) m_bClosing=TRUE;
+				else if((ch>='a' && ch<='z') || (ch>='0' && ch<='9'))
+				{
+					if(m_nName<MAX_NAME) m_szName[m_nName++]=ch;
+				}
+				else if(ch>='A' && ch<='Z')
+				{
+					if(m_nName<MAX_NAME) m_szName[m_nName++]=ch-'A'+'a';
+				}
+				else m_bNameDone=TRUE;
+			}
+			else if(ch=='"' || ch=='\'') m_chQuote=ch;
+			break;
+
+		case STATE_COMMENT:
+			if(ch=='-') m_nDashes++;
+			else
+			{
+				if(ch=='>' && m_nDashes>=2) m_nState=STATE_TEXT;
+				m_nDashes=0;
+			}
+			break;
+
+		case STATE_ENTITY:
+			if(ch==';')
+			{
+				m_szName[m_nName]=0;
+				OnEntity();
+				m_nState=STATE_TEXT;
+			}
+			else if(m_nName<MAX_NAME && ((ch>='a' && ch<='z') || (ch>='A' && ch<='Z') || (ch>='0' && ch<='9') || ch=='#'))
+			{
+				m_szName[m_nName++]=ch;
+			}
+			else
+			{
+				// not an entity after all, output what we held back and reprocess this character as text
+				PutText('&');
+				for(int j=0;j<m_nName;j++) PutText(m_szName[j]);
+				m_nState=STATE_TEXT;
+				i--;
+			}
+			break;
+		}
+	}
+}
+
+// flushes the remaining text, text held back by an unterminated entity is output as is
+void CMAPIHTMLText::End()
+{
+	if(!m_pText) return;
+	if(m_nState==STATE_ENTITY)
+	{
+		PutText('&');
+		for(int j=0;j<m_nName;j++) PutText(m_szName[j]);
+	}
+	Flush();
+	m_pText=NULL;
+}
+
+// reads the whole stream, appending the text to strText
+BOOL CMAPIHTMLText::Extract(IStream* pStream, CString& strText, UINT nCodePage)
+{
+	if(!pStream) return FALSE;
+
+	CMAPIHTMLText extractor;
+	extractor.Begin(strText, nCodePage);
+
+	char szBuf[BUFFER_SIZE];
+	ULONG ulRead;
+	HRESULT hr;
+	do
+	{
+		ulRead=0;
+		hr=pStream->Read(szBuf, BUFFER_SIZE, &ulRead);
+		if(ulRead) extractor.Write(szBuf, ulRead);
+	} while(hr==S_OK && ulRead);
+
+	extractor.End();
+	return SUCCEEDED(hr);
+}
+
+void CMAPIHTMLText::OnTag()
+{
+	if(m_szSkip[0])
+	{
+		if(m_bClosing && !strcmp(m_szName, m_szSkip)) m_szSkip[0]=0;
+		return;
+	}
+
+	if(!m_bClosing && m_bDetectCodePage && !strcmp(m_szName, "meta"))
+	{
+		m_szAttributes[m_nAttributes]=0;
+		OnMeta();
+	}
+	else if(!m_bClosing && (!strcmp(m_szName, "script") || !strcmp(m_szName, "style")))
+	{
+		strcpy_s(m_szSkip, MAX_NAME+1, m_szName);
+	}
+	else if(IsBlockTag(m_szName))
+	{
+		PutLine();
+	}
+}
+
+void CMAPIHTMLText::OnEntity()
+{
+	WCHAR wch=0;
+	if(m_szName[0]=='#')
+	{
+		ULONG ulCode=0;
+		if(m_szName[1]=='x' || m_szName[1]=='X') ulCode=strtoul(m_szName+2, NULL, 16);
+		else ulCode=strtoul(m_szName+1, NULL, 10);
+		if(ulCode>0xFFFF && ulCode<=0x10FFFF)
+		{
+			// outside the BMP, written as a surrogate pair
+			ulCode-=0x10000;
+			PutText((WCHAR)(0xD800+(ulCode>>10)));
+			PutText((WCHAR)(0xDC00+(ulCode&0x3FF)));
+			return;
+		}
+		wch=(ulCode>0 && ulCode<=0xFFFF) ? (WCHAR)ulCode : (WCHAR)0xFFFD;
+	}
+	else
+	{
+		int nIndex=FindEntity(m_szName);
+		if(nIndex>=0) wch=HTMLEntities[nIndex].m_wch;
+	}
+
+	if(!wch)
+	{
+		PutText('&');
+		for(int j=0;j<m_nName;j++) PutText(m_szName[j]);
+		PutText(';');
+	}
+	else if(wch==160 || wch==' ' || wch=='\t' || wch=='\r' || wch=='\n')
+	{
+		m_bSpace=TRUE;
+	}
+	else if(wch==173)
+	{
+		// soft hyphen, invisible
+	}
+	else if(wch<0x80)
+	{
+		PutText((char)wch);
+	}
+	else
+	{
+		PutText(wch);
+	}
+}
+
+// looks for charset=name in <meta charset="..."> or <meta http-equiv=... content="text/html; charset=...">,
+// only bytes still in the buffer are decoded with the new code page so the meta tag should come early
+void CMAPIHTMLText::OnMeta()
+{
+	const char* szCharset=m_szAttributes;
+	for(;;)
+	{
+		szCharset=strchr(szCharset, '=');
+		if(!szCharset) return;
+		if(szCharset-m_szAttributes>=7 && !_strnicmp(szCharset-7, "charset", 7)) break;
+		szCharset++;
+	}
+
+	szCharset++;
+	while(*szCharset==' ' || *szCharset=='"' || *szCharset=='\'') szCharset++;
+	int nLength=0;
+	while(szCharset[nLength] && !strchr(" \"';/>", szCharset[nLength])) nLength++;
+
+	UINT nCodePage=GetCharsetCodePage(szCharset, nLength);
+	if(nCodePage)
+	{
+		SetCodePage(nCodePage);
+		m_bDetectCodePage=FALSE;
+	}
+}
+
+// returns 0 if the charset is unknown or not installed
+UINT CMAPIHTMLText::GetCharsetCodePage(const char* szCharset, int nLength)
+{
+	for(int i=0;HTMLCharsets[i].m_szName;i++)
+	{
+		if((int)strlen(HTMLCharsets[i].m_szName)==nLength && !_strnicmp(szCharset, HTMLCharsets[i].m_szName, nLength))
+		{
+			return IsValidCodePage(HTMLCharsets[i].m_nCodePage) ? HTMLCharsets[i].m_nCodePage : 0;
+		}
+	}
+	return 0;
+}
+
+void CMAPIHTMLText::SetCodePage(UINT nCodePage)
+{
+	CPINFO info;
+	m_nCodePage=nCodePage;
+	m_nMaxCharSize=GetCPInfo(nCodePage, &info) ? info.MaxCharSize : 1;
+}
+
+void CMAPIHTMLText::PutText(char ch)
+{
+	if(m_bSpace) PutSpace();
+	Put(ch);
+}
+
+// decoded characters (entities) skip the byte buffer and are appended as UTF-16
+void CMAPIHTMLText::PutText(WCHAR wch)
+{
+	if(m_bSpace) PutSpace();
+	Flush();
+	if(!m_pText) return;
+#ifdef UNICODE
+	m_pText->AppendChar(wch);
+#else
+	char szBytes[4];
+	int nBytes=WideCharToMultiByte(CP_ACP, 0, &wch, 1, szBytes, sizeof(szBytes), NULL, NULL);
+	if(nBytes>0) m_pText->Append(szBytes, nBytes);
+#endif
+	m_chLast=(char)0x80;
+}
+
+// whitespace is only written once more text follows, so lines never end in spaces
+void CMAPIHTMLText::PutSpace()
+{
+	m_bSpace=FALSE;
+	if(m_chLast && m_chLast!='\n') Put(' ');
+}
+
+void CMAPIHTMLText::PutLine()
+{
+	m_bSpace=FALSE;
+	if(m_chLast && m_chLast!='\n')
+	{
+		Put('\r');
+		Put('\n');
+	}
+}
+
+void CMAPIHTMLText::Put(char ch)
+{
+	if(m_nBufferLength==BUFFER_SIZE) Flush(FALSE);
+	m_szBuffer[m_nBufferLength++]=ch;
+	m_chLast=ch;
+}
+
+// decodes the buffer into the text, unless bAll is set a character cut off at the end is kept for the next flush
+void CMAPIHTMLText::Flush(BOOL bAll)
+{
+	int nLength=bAll ? m_nBufferLength : GetCompleteLength();
+	if(nLength && m_pText)
+	{
+#ifdef UNICODE
+		// never more characters than bytes, so decode straight into the string
+		int nOffset=m_pText->GetLength();
+		LPWSTR szText=m_pText->GetBuffer(nOffset+nLength);
+		int nChars=MultiByteToWideChar(m_nCodePage, 0, m_szBuffer, nLength, szText+nOffset, nLength);
+		m_pText->ReleaseBuffer(nOffset+max(nChars, 0));
+#else
+		if(m_nCodePage==CP_ACP || m_nCodePage==GetACP())
+		{
+			m_pText->Append(m_szBuffer, nLength);
+		}
+		else
+		{
+			CStringW strWide;
+			LPWSTR szWide=strWide.GetBuffer(nLength);
+			int nChars=MultiByteToWideChar(m_nCodePage, 0, m_szBuffer, nLength, szWide, nLength);
+			strWide.ReleaseBuffer(max(nChars, 0));
+			*m_pText+=CString(strWide);
+		}
+#endif
+	}
+	m_nBufferLength-=nLength;
+	if(m_nBufferLength) memmove(m_szBuffer, m_szBuffer+nLength, m_nBufferLength);
+}
+
+// length of the buffer up to the last whole character
+int CMAPIHTMLText::GetCompleteLength() const
+{
+	if(m_nCodePage==CP_UTF8)
+	{
+		// back up over continuation bytes to the lead byte and see if all of its sequence is here
+		int i=m_nBufferLength-1, nTrail=0;
+		while(i>=0 && nTrail<3 && ((BYTE)m_szBuffer[i]&0xC0)==0x80)
+		{
+			i--;
+			nTrail++;
+		}
+		if(i<0) return m_nBufferLength;
+
+		BYTE chLead=(BYTE)m_szBuffer[i];
+		int nNeeded=(chLead>=0xF0) ? 4 : (chLead>=0xE0) ? 3 : (chLead>=0xC0) ? 2 : 1;
+		return (nNeeded>nTrail+1) ? i : m_nBufferLength;
+	}
+	else if(m_nMaxCharSize==2)
+	{
+		// trail bytes of DBCS code pages can look like lead bytes, so walk forward from the start
+		int i=0;
+		while(i<m_nBufferLength)
+		{
+			if(IsDBCSLeadByteEx(m_nCodePage, (BYTE)m_szBuffer[i]))
+			{
+				if(i+1==m_nBufferLength) return i;
+				i+=2;
+			}
+			else i++;
+		}
+	}
+	return m_nBufferLength;
+}
+
+BOOL CMAPIHTMLText::IsBlockTag(const char* szName)
+{
+	for(int i=0;HTMLBlockTags[i];i++)
+	{
+		if(!strcmp(szName, HTMLBlockTags[i])) return TRUE;
+	}
+	return FALSE;
+}
+
+int CMAPIHTMLText::FindEntity(const char* szName)
+{
+	int nLow=0, nHigh=sizeof(HTMLEntities)/sizeof(HTMLEntity)-1;
+	while(nLow<=nHigh)
+	{
+		int nMid=(nLow+nHigh)/2;
+		int nCompare=strcmp(szName, HTMLEntities[nMid].m_szName);
+		if(!nCompare) return nMid;
+		if(nCompare<0) nHigh=nMid-1;
+		else nLow=nMid+1;
+	}
+	return -1;
+}
@@ -0,0 +1,81 @@
+#ifndef __MAPIHTMLTEXT_H__
+#define __MAPIHTMLTEXT_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIHTMLText.h
+// Description: Single pass HTML to plain text extractor
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIHTMLText
+
+// Converts raw HTML bytes to text as they are read: tags are dropped (block tags become line breaks),
+// script and style contents are skipped, entities are decoded and runs of whitespace collapse to one space.
+// Feed it with Write() as often as you like between Begin() and End(), see CMAPIObject::GetHTMLText.
+// The bytes are decoded with the code page passed to Begin (PR_INTERNET_CPID), or if that is CP_ACP with
+// the charset of the first <meta> tag that declares one, characters split across writes are carried over
+class AFX_EXT_CLASS CMAPIHTMLText
+{
+public:
+	CMAPIHTMLText();
+
+	enum { BUFFER_SIZE=4096, MAX_NAME=12, MAX_ATTRIBUTES=128 };
+	enum { STATE_TEXT, STATE_TAG, STATE_ENTITY, STATE_COMMENT };
+
+// Attributes
+protected:
+	CString* m_pText;
+	int m_nState;
+	BOOL m_bClosing;
+	BOOL m_bNameDone;
+	char m_chQuote;
+	int m_nDashes;
+	int m_nName;
+	char m_szName[MAX_NAME+1];
+	char m_szSkip[MAX_NAME+1];
+	int m_nAttributes;
+	char m_szAttributes[MAX_ATTRIBUTES+1];
+	UINT m_nCodePage;
+	UINT m_nMaxCharSize;
+	BOOL m_bDetectCodePage;
+	BOOL m_bSpace;
+	char m_chLast;
+	int m_nBufferLength;
+	char m_szBuffer[BUFFER_SIZE];
+
+// Operations
+public:
+	void Begin(CString& strText, UINT nCodePage=CP_ACP);
+	void Write(const char* pData, int nLength);
+	void End();
+	UINT GetCodePage() const { return m_nCodePage; }
+
+	static BOOL Extract(IStream* pStream, CString& strText, UINT nCodePage=CP_ACP);
+	static UINT GetCharsetCodePage(const char* szCharset, int nLength);
+
+protected:
+	void OnTag();
+	void OnEntity();
+	void OnMeta();
+	void SetCodePage(UINT nCodePage);
+	void PutText(char ch);
+	void PutText(WCHAR wch);
+	void PutSpace();
+	void PutLine();
+	void Put(char ch);
+	void Flush(BOOL bAll=TRUE);
+	int GetCompleteLength() const;
+	static BOOL IsBlockTag(const char* szName);
+	static int FindEntity(const char* szName);
+};
+
+#endif
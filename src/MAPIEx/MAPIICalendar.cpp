@@ -0,0 +1,1057 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIICalendar.cpp
+// Description: Streaming iCalendar (RFC 5545) reader and writer for appointments
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+// BYDAY names, Sunday first like SYSTEMTIME and the recurrence day masks
+const LPCSTR ICalDays[]={ "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+
+// X-MICROSOFT-CDO-BUSYSTATUS values in CMAPIFreeBusy::BUSY_ order
+const LPCSTR ICalBusyStatus[]={ "FREE", "TENTATIVE", "BUSY", "OOF", "WORKINGELSEWHERE" };
+
+const ULONGLONG ICalTicksPerSecond=10000000;
+const LONGLONG ICalSecondsPerDay=86400;
+
+/////////////////////////////////////////////////////////////
+// CICalendarRecurrence
+
+CICalendarRecurrence::CICalendarRecurrence()
+{
+	Empty();
+}
+
+void CICalendarRecurrence::Empty()
+{
+	m_strUID.Empty();
+	m_strRule.Empty();
+	m_bDates=FALSE;
+	m_bOverride=FALSE;
+	m_ftOriginalStart.dwLowDateTime=m_ftOriginalStart.dwHighDateTime=0;
+	m_dwStart=m_dwEnd=0;
+	m_arDeleted.RemoveAll();
+	m_bTimeZone=FALSE;
+	memset(&m_tzi, 0, sizeof(TIME_ZONE_INFORMATION));
+}
+
+// converts a UTC time to local minutes in the event's time zone
+BOOL CICalendarRecurrence::ToLocal(const FILETIME& ft, DWORD& dwLocal)
+{
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	FILETIME ftLocal=ft;
+	if(m_bTimeZone)
+	{
+		SYSTEMTIME tmUTC, tmLocal;
+		if(!FileTimeToSystemTime(&ft, &tmUTC) || !SystemTimeToTzSpecificLocalTime(&m_tzi, &tmUTC, &tmLocal)) return FALSE;
+		if(!SystemTimeToFileTime(&tmLocal, &ftLocal)) return FALSE;
+	}
+	dwLocal=CMAPIRecurrence::FileTimeToMinutes(ftLocal);
+	return TRUE;
+#endif
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIICalendar
+
+CMAPIICalendar::CMAPIICalendar()
+{
+	*m_szStamp=0;
+}
+
+CMAPIICalendar::~CMAPIICalendar()
+{
+	Close();
+}
+
+// opens szPath for reading, or creates it and starts the VCALENDAR for writing
+BOOL CMAPIICalendar::Open(LPCTSTR szPath, BOOL bWrite)
+{
+	Close();
+	m_arWrittenZones.RemoveAll();
+	m_arTimeZones.RemoveAll();
+	if(!CMAPIContentFile::Open(szPath, bWrite)) return FALSE;
+
+	if(bWrite)
+	{
+		FILETIME ftNow;
+		GetSystemTimeAsFileTime(&ftNow);
+		FormatUTC(ftNow, m_szStamp);
+
+		PutASCII("BEGIN:VCALENDAR");
+		EndLine();
+		PutASCII("VERSION:2.0");
+		EndLine();
+		PutASCII("PRODID:-//CMapiEx//iCalendar//EN");
+		EndLine();
+	}
+	return !m_bError;
+}
+
+// ends the VCALENDAR if writing, returns FALSE if any read or write failed
+BOOL CMAPIICalendar::Close()
+{
+	if(m_bOpen && m_bWrite)
+	{
+		PutASCII("END:VCALENDAR");
+		EndLine();
+	}
+	return CMAPIContentFile::Close();
+}
+
+// Writes record as a VEVENT.  If pRecurrence is its pattern (see CMAPIAppointment::GetRecurrence) the VEVENT
+// gets an RRULE in the pattern's time zone and each modified occurrence is written after it as a VEVENT with
+// the same UID and a RECURRENCE-ID.  Patterns CRecurrenceIterator can't expand are written as the first
+// occurrence only.  All day events are written as VALUE=DATE dates in local time with no time zone
+BOOL CMAPIICalendar::Write(CAppointmentRecord& record, CMAPIRecurrence* pRecurrence)
+{
+	if(!m_bOpen || !m_bWrite) return FALSE;
+
+	if(pRecurrence && !pRecurrence->IsSupported()) pRecurrence=NULL;
+	BOOL bDate=record.m_bAllDay;
+	CStringA strTZID;
+	if(pRecurrence && !bDate) WriteTimeZone(*pRecurrence, strTZID);
+
+	CString strUID;
+	record.m_entryID.ToString(strUID);
+
+	PutASCII("BEGIN:VEVENT");
+	EndLine();
+	WriteText("UID", strUID);
+	WriteASCII("DTSTAMP", m_szStamp);
+	if(pRecurrence)
+	{
+		WriteLocal("DTSTART", strTZID, pRecurrence->m_dwStartDate+pRecurrence->m_dwStartTimeOffset, bDate);
+		WriteLocal("DTEND", strTZID, pRecurrence->m_dwStartDate+pRecurrence->m_dwEndTimeOffset, bDate);
+	}
+	else if(bDate)
+	{
+		SYSTEMTIME tm;
+		if(record.GetStartTime(tm)) WriteDate("DTSTART", tm);
+		if(record.GetEndTime(tm)) WriteDate("DTEND", tm);
+	}
+	else
+	{
+		WriteUTC("DTSTART", record.m_ftStart);
+		WriteUTC("DTEND", record.m_ftEnd);
+	}
+	WriteText("SUMMARY", record.m_strSubject);
+	WriteText("LOCATION", record.m_strLocation);
+	WriteBusyStatus(record.m_nBusyStatus);
+	WriteUTC("LAST-MODIFIED", record.m_ftLastModified);
+	if(pRecurrence)
+	{
+		CStringA strRule;
+		FormatRule(*pRecurrence, !strTZID.IsEmpty(), bDate, strRule);
+		WriteASCII("RRULE", strRule);
+		WriteDeleted(*pRecurrence, strTZID, bDate);
+	}
+	PutASCII("END:VEVENT");
+	EndLine();
+	if(!pRecurrence) return !m_bError;
+
+	for(int i=0;i<pRecurrence->m_arExceptionOrder.GetSize();i++)
+	{
+		CRecurrenceException& exception=pRecurrence->m_arExceptions[pRecurrence->m_arExceptionOrder[i]];
+		PutASCII("BEGIN:VEVENT");
+		EndLine();
+		WriteText("UID", strUID);
+		WriteASCII("DTSTAMP", m_szStamp);
+		WriteLocal("RECURRENCE-ID", strTZID, exception.m_dwOriginalStart, bDate);
+		WriteLocal("DTSTART", strTZID, exception.m_dwStart, bDate);
+		WriteLocal("DTEND", strTZID, exception.m_dwEnd, bDate);
+		WriteText("SUMMARY", (exception.m_wOverrideFlags&CMAPIRecurrence::ARO_SUBJECT) ? exception.m_strSubject : record.m_strSubject);
+		WriteText("LOCATION", (exception.m_wOverrideFlags&CMAPIRecurrence::ARO_LOCATION) ? exception.m_strLocation : record.m_strLocation);
+		WriteBusyStatus((exception.m_nBusyStatus>=0) ? exception.m_nBusyStatus : record.m_nBusyStatus);
+		PutASCII("END:VEVENT");
+		EndLine();
+	}
+	return !m_bError;
+}
+
+// Reads the next VEVENT into record, returns FALSE at the end of the file.  VTIMEZONEs before it are kept
+// for converting its times.  m_bRecurring is set for an event with an RRULE or RDATE and for the
+// RECURRENCE-ID events overriding one of its occurrences, pRecurrence gets the details
+BOOL CMAPIICalendar::Read(CAppointmentRecord& record, CICalendarRecurrence* pRecurrence)
+{
+	record.Empty();
+	if(pRecurrence) pRecurrence->Empty();
+	if(!m_bOpen || m_bWrite) return FALSE;
+
+	CStringA strLine, strStartTZID;
+	BOOL bEvent=FALSE, bStartDate=FALSE, bStartUTC=FALSE, bEnd=FALSE, bDuration=FALSE, bTransparent=FALSE, bDate;
+	LONGLONG llDuration=0;
+	CArray<FILETIME, FILETIME&> arDeleted;
+	FILETIME ft;
+	int nDepth=0;
+	while(ReadLine(strLine))
+	{
+		LPSTR szLine=strLine.GetBuffer();
+		if(!bEvent)
+		{
+			if(!_stricmp(szLine, "BEGIN:VEVENT"))
+			{
+				bEvent=TRUE;
+			}
+			else if(!_stricmp(szLine, "BEGIN:VTIMEZONE"))
+			{
+				strLine.ReleaseBuffer();
+				ReadTimeZone();
+				continue;
+			}
+		}
+		else if(!_strnicmp(szLine, "BEGIN:", 6))
+		{
+			// VALARMs and anything else nested in the event are skipped
+			nDepth++;
+		}
+		else if(!_strnicmp(szLine, "END:", 4))
+		{
+			if(!nDepth)
+			{
+				strLine.ReleaseBuffer();
+				break;
+			}
+			nDepth--;
+		}
+		else if(!nDepth)
+		{
+			LPSTR szParams, szValue;
+			LPSTR szName=SplitLine(szLine, szParams, szValue);
+			if(!szName)
+			{
+			}
+			else if(!_stricmp(szName, "SUMMARY"))
+			{
+				Decode(szValue, record.m_strSubject);
+			}
+			else if(!_stricmp(szName, "LOCATION"))
+			{
+				Decode(szValue, record.m_strLocation);
+			}
+			else if(!_stricmp(szName, "DTSTART"))
+			{
+				if(ParseDateTime(szValue, szParams, record.m_ftStart, bDate)) bStartDate=bDate;
+				if(!GetParam(szParams, "TZID", strStartTZID)) strStartTZID.Empty();
+				bStartUTC=(*szValue && toupper((BYTE)szValue[strlen(szValue)-1])=='Z');
+			}
+			else if(!_stricmp(szName, "DTEND"))
+			{
+				bEnd=ParseDateTime(szValue, szParams, record.m_ftEnd, bDate);
+			}
+			else if(!_stricmp(szName, "DURATION"))
+			{
+				bDuration=ParseDuration(szValue, llDuration);
+			}
+			else if(!_stricmp(szName, "RRULE"))
+			{
+				record.m_bRecurring=TRUE;
+				if(pRecurrence) pRecurrence->m_strRule=szValue;
+			}
+			else if(!_stricmp(szName, "RDATE"))
+			{
+				record.m_bRecurring=TRUE;
+				if(pRecurrence) pRecurrence->m_bDates=TRUE;
+			}
+			else if(!_stricmp(szName, "RECURRENCE-ID"))
+			{
+				record.m_bRecurring=TRUE;
+				if(pRecurrence) pRecurrence->m_bOverride=ParseDateTime(szValue, szParams, pRecurrence->m_ftOriginalStart, bDate);
+			}
+			else if(!_stricmp(szName, "EXDATE"))
+			{
+				for(LPSTR szDate=pRecurrence ? szValue : NULL;szDate;)
+				{
+					LPSTR szNext=strchr(szDate, ',');
+					if(szNext) *szNext++=0;
+					if(ParseDateTime(szDate, szParams, ft, bDate)) arDeleted.Add(ft);
+					szDate=szNext;
+				}
+			}
+			else if(!_stricmp(szName, "UID"))
+			{
+				if(pRecurrence) pRecurrence->m_strUID=szValue;
+			}
+			else if(!_stricmp(szName, "TRANSP"))
+			{
+				bTransparent=!_stricmp(szValue, "TRANSPARENT");
+			}
+			else if(!_stricmp(szName, "X-MICROSOFT-CDO-BUSYSTATUS"))
+			{
+				record.m_nBusyStatus=ParseBusyStatus(szValue);
+			}
+			else if(!_stricmp(szName, "LAST-MODIFIED"))
+			{
+				ParseDateTime(szValue, szParams, record.m_ftLastModified, bDate);
+			}
+		}
+		strLine.ReleaseBuffer();
+	}
+	if(!bEvent) return FALSE;
+
+	// without DTEND the event lasts its DURATION, or a day for a date and no time for a date and time
+	if(!bEnd && (record.m_ftStart.dwLowDateTime || record.m_ftStart.dwHighDateTime))
+	{
+		LONGLONG llSeconds=bDuration ? llDuration : (bStartDate ? ICalSecondsPerDay : 0);
+		ULONGLONG ullEnd=((ULONGLONG)record.m_ftStart.dwHighDateTime<<32)|record.m_ftStart.dwLowDateTime;
+		if(llSeconds>0) ullEnd+=(ULONGLONG)llSeconds*ICalTicksPerSecond;
+		record.m_ftEnd.dwLowDateTime=(DWORD)ullEnd;
+		record.m_ftEnd.dwHighDateTime=(DWORD)(ullEnd>>32);
+	}
+	if(record.m_nBusyStatus<0) record.m_nBusyStatus=bTransparent ? CMAPIFreeBusy::BUSY_FREE : CMAPIFreeBusy::BUSY_BUSY;
+	record.m_bAllDay=bStartDate;
+	if(!pRecurrence) return TRUE;
+
+	// the event's time zone is the one its DTSTART was read in, see ParseDateTime
+#ifndef _WIN32_WCE
+	TIME_ZONE_INFORMATION* pTZI=(bStartDate || strStartTZID.IsEmpty()) ? NULL : FindTimeZone(strStartTZID);
+	if(pTZI)
+	{
+		pRecurrence->m_tzi=*pTZI;
+		pRecurrence->m_bTimeZone=TRUE;
+	}
+	else if(!bStartUTC)
+	{
+		GetTimeZoneInformation(&pRecurrence->m_tzi);
+		pRecurrence->m_bTimeZone=TRUE;
+	}
+#endif
+	pRecurrence->ToLocal(record.m_ftStart, pRecurrence->m_dwStart);
+	pRecurrence->ToLocal(record.m_ftEnd, pRecurrence->m_dwEnd);
+
+	DWORD dwDeleted;
+	for(int i=0;i<arDeleted.GetSize();i++)
+	{
+		if(pRecurrence->ToLocal(arDeleted[i], dwDeleted)) pRecurrence->m_arDeleted.Add(dwDeleted);
+	}
+	return TRUE;
+}
+
+// writes every appointment in folder using its contents table, returns the number written or -1 on error
+int CMAPIICalendar::Export(CMAPIFolder& folder, CMAPIAppointmentLoader& loader)
+{
+	if(!m_bOpen || !m_bWrite || !folder.GetAppointmentContents(loader)) return -1;
+
+	CAppointmentRecord record;
+	CMAPIAppointment appointment;
+	CMAPIRecurrence recurrence;
+	int nCount=0;
+	while(folder.GetNextAppointment(record))
+	{
+		// the pattern is too big for a table column so only recurring appointments are opened
+		CMAPIRecurrence* pRecurrence=NULL;
+#ifndef _WIN32_WCE
+		if(record.m_bRecurring && appointment.Open(folder.GetMAPI(), *record.m_entryID.GetBinary()))
+		{
+			if(appointment.GetRecurrence(recurrence)) pRecurrence=&recurrence;
+			appointment.Close();
+		}
+#endif
+
+		if(!Write(record, pRecurrence)) return -1;
+		nCount++;
+	}
+	return Flush() ? nCount : -1;
+}
+
+// Creates an appointment in pFolder (the calendar if NULL) for every event in the file with a single SetProps
+// each, the SaveChanges are deferred and done in batches (see Defer).  The file is read twice, the first time
+// for the RECURRENCE-ID events: the occurrence each one overrides is deleted from its series, which may come
+// before or after it, and the event itself is imported as a single appointment.  A recurring event Outlook
+// can't store (an RDATE, or an RRULE CMAPIRecurrence::ParseRule rejects) fails the import before anything is
+// created, unless pnSkipped is given to skip and count them.  Init loader with bCreate on the target store
+// first, otherwise it is initialized from the first appointment created.  Returns the number of appointments
+// imported, or -1 if the file or folder couldn't be used.  Like CMAPIVCard::Import the import stops at the
+// first appointment that can't be created, written or saved and the ones before it stay in the folder:
+// pnFailed gets the number of events that weren't imported (that one and the rest of the file)
+int CMAPIICalendar::Import(CMAPIEx* pMAPI, CMAPIFolder* pFolder, CMAPIAppointmentLoader& loader, int* pnSkipped, int* pnFailed)
+{
+	if(pnSkipped) *pnSkipped=0;
+	if(pnFailed) *pnFailed=0;
+#ifdef _WIN32_WCE
+	return -1;
+#else
+	if(!m_bOpen || m_bWrite || !pMAPI) return -1;
+	if(!pFolder) pFolder=pMAPI->GetFolder();
+	if(!pFolder) pFolder=pMAPI->OpenCalendar();
+	if(!pFolder) return -1;
+
+	CArray<CStringA, CStringA&> arUIDs;
+	CArray<FILETIME, FILETIME&> arOriginalStarts;
+	if(!FindOverrides(arUIDs, arOriginalStarts, pnSkipped)) return -1;
+
+	CAppointmentRecord record;
+	CICalendarRecurrence event;
+	CMAPIRecurrence recurrence;
+	CMAPIAppointment appointment;
+	int nCount=0, nFailed=0;
+	BOOL bFailed=FALSE;
+	while(Read(record, &event))
+	{
+		if(bFailed)
+		{
+			nFailed++;
+			continue;
+		}
+
+		CMAPIRecurrence* pRecurrence=NULL;
+		if(event.IsRecurring() && !event.m_bOverride)
+		{
+			if(!GetRecurrence(event, arUIDs, arOriginalStarts, recurrence))
+			{
+				if(pnSkipped) (*pnSkipped)++;
+				continue;
+			}
+
+			// the appointment's own start and end are its first occurrence's, DTSTART may not be one
+			CRecurrenceIterator it;
+			FILETIME ftNone={ 0, 0 };
+			it.Begin(recurrence, ftNone, ftNone);
+			CMAPIRecurrence::MinutesToFileTime(it.LocalToUTC(recurrence.m_dwStartDate+recurrence.m_dwStartTimeOffset), record.m_ftStart);
+			CMAPIRecurrence::MinutesToFileTime(it.LocalToUTC(recurrence.m_dwStartDate+recurrence.m_dwEndTimeOffset), record.m_ftEnd);
+			pRecurrence=&recurrence;
+		}
+
+		if(!appointment.Create(pMAPI, pFolder, FALSE) || (!loader.IsInitialized() && !loader.Init(appointment.Message(), TRUE)) || !loader.Write(appointment, record, TRUE, pRecurrence))
+		{
+			appointment.Close();
+			nFailed++;
+			bFailed=TRUE;
+		}
+		else if(!Defer(appointment, nCount, nFailed)) bFailed=TRUE;
+	}
+	SaveDeferred(nCount, nFailed);
+
+	if(pnFailed) *pnFailed=nFailed;
+	return nCount;
+#endif
+}
+
+// The first pass of Import, lists the UID and original start (UTC) of every RECURRENCE-ID event and rewinds.
+// Without pnSkipped it fails on the first recurring event Import couldn't store
+BOOL CMAPIICalendar::FindOverrides(CArray<CStringA, CStringA&>& arUIDs, CArray<FILETIME, FILETIME&>& arOriginalStarts, int* pnSkipped)
+{
+	CAppointmentRecord record;
+	CICalendarRecurrence event;
+	CMAPIRecurrence recurrence;
+	CArray<CStringA, CStringA&> arNone;
+	CArray<FILETIME, FILETIME&> arNoStarts;
+	while(Read(record, &event))
+	{
+		if(event.m_bOverride)
+		{
+			if(event.m_strUID.IsEmpty()) continue;
+			arUIDs.Add(event.m_strUID);
+			arOriginalStarts.Add(event.m_ftOriginalStart);
+		}
+		else if(!pnSkipped && event.IsRecurring() && !GetRecurrence(event, arNone, arNoStarts, recurrence))
+		{
+			return FALSE;
+		}
+	}
+	return Rewind();
+}
+
+// Sets recurrence from a recurring event's RRULE less its EXDATEs and the occurrences the RECURRENCE-ID events
+// in arUIDs and arOriginalStarts override, FALSE for an RDATE or a rule Outlook can't store
+BOOL CMAPIICalendar::GetRecurrence(CICalendarRecurrence& event, CArray<CStringA, CStringA&>& arUIDs, CArray<FILETIME, FILETIME&>& arOriginalStarts, CMAPIRecurrence& recurrence)
+{
+	if(event.m_bDates || event.m_strRule.IsEmpty()) return FALSE;
+	recurrence.SetTimeZone(event.m_bTimeZone ? &event.m_tzi : NULL);
+	if(!recurrence.ParseRule(event.m_strRule, event.m_dwStart, event.m_dwEnd)) return FALSE;
+
+	int i;
+	for(i=0;i<event.m_arDeleted.GetSize();i++) recurrence.DeleteOccurrence(event.m_arDeleted[i]);
+
+	DWORD dwOriginalStart;
+	for(i=0;i<arUIDs.GetSize();i++)
+	{
+		if(arUIDs[i]==event.m_strUID && event.ToLocal(arOriginalStarts[i], dwOriginalStart)) recurrence.DeleteOccurrence(dwOriginalStart);
+	}
+	return TRUE;
+}
+
+void CMAPIICalendar::WriteText(LPCSTR szName, LPCTSTR szValue)
+{
+	if(!szValue || !*szValue) return;
+	BeginProperty(szName, NULL);
+	PutValue(szValue);
+	EndLine();
+}
+
+// szValue is written as is, for values that need no escaping
+void CMAPIICalendar::WriteASCII(LPCSTR szName, LPCSTR szValue, LPCSTR szParams)
+{
+	BeginProperty(szName, szParams);
+	PutASCII(szValue);
+	EndLine();
+}
+
+// nothing is written for a zero ft
+void CMAPIICalendar::WriteUTC(LPCSTR szName, const FILETIME& ft)
+{
+	char szDate[MAX_DATE];
+	if((ft.dwLowDateTime || ft.dwHighDateTime) && FormatUTC(ft, szDate)) WriteASCII(szName, szDate);
+}
+
+// dwLocal is minutes since 1601 in szTZID, or UTC if szTZID is empty.  With bDate only its date is written
+// as a floating VALUE=DATE
+void CMAPIICalendar::WriteLocal(LPCSTR szName, LPCSTR szTZID, DWORD dwLocal, BOOL bDate)
+{
+	char szDate[MAX_DATE];
+	FormatMinutes(dwLocal, szDate, !*szTZID);
+	if(bDate)
+	{
+		szDate[8]=0;
+		WriteASCII(szName, szDate, "VALUE=DATE");
+		return;
+	}
+	if(!*szTZID)
+	{
+		WriteASCII(szName, szDate);
+		return;
+	}
+
+	CStringA strParams("TZID=");
+	strParams+=szTZID;
+	WriteASCII(szName, szDate, strParams);
+}
+
+// tm is a local time, only its date is written
+void CMAPIICalendar::WriteDate(LPCSTR szName, SYSTEMTIME& tm)
+{
+	char szDate[MAX_DATE];
+	sprintf_s(szDate, MAX_DATE, "%04d%02d%02d", tm.wYear, tm.wMonth, tm.wDay);
+	WriteASCII(szName, szDate, "VALUE=DATE");
+}
+
+void CMAPIICalendar::WriteBusyStatus(int nBusyStatus)
+{
+	if(nBusyStatus<0 || nBusyStatus>=(int)(sizeof(ICalBusyStatus)/sizeof(LPCSTR))) return;
+	WriteASCII("TRANSP", (nBusyStatus==CMAPIFreeBusy::BUSY_FREE) ? "TRANSPARENT" : "OPAQUE");
+	WriteASCII("X-MICROSOFT-CDO-BUSYSTATUS", ICalBusyStatus[nBusyStatus]);
+}
+
+// Sets strTZID to the time zone of recurrence, writing its VTIMEZONE the first time it's seen.  The TZID is
+// made from the zone's rules since the TimeZoneStruct has no name.  strTZID is empty if the pattern has no
+// time zone, its times are UTC then
+void CMAPIICalendar::WriteTimeZone(CMAPIRecurrence& recurrence, CStringA& strTZID)
+{
+	strTZID.Empty();
+	if(!recurrence.m_bTimeZone) return;
+
+	char szStandard[MAX_DATE], szDaylight[MAX_DATE];
+	LONG lStandard=-(recurrence.m_lBias+recurrence.m_lStandardBias);
+	LONG lDaylight=-(recurrence.m_lBias+recurrence.m_lDaylightBias);
+	FormatOffset(lStandard, szStandard);
+	FormatOffset(lDaylight, szDaylight);
+
+	DWORD dwDaylight, dwStandard;
+	SYSTEMTIME& tmDaylight=recurrence.m_tmDaylightDate;
+	SYSTEMTIME& tmStandard=recurrence.m_tmStandardDate;
+	BOOL bDaylight=recurrence.GetTransitions(1601, dwDaylight, dwStandard);
+	if(bDaylight)
+	{
+		strTZID.Format("UTC%s/%s M%d.%d.%d/%d M%d.%d.%d/%d", szStandard, szDaylight,
+			tmDaylight.wMonth, tmDaylight.wDay, tmDaylight.wDayOfWeek, tmDaylight.wHour,
+			tmStandard.wMonth, tmStandard.wDay, tmStandard.wDayOfWeek, tmStandard.wHour);
+	}
+	else strTZID.Format("UTC%s", szStandard);
+
+	for(int i=0;i<m_arWrittenZones.GetSize();i++)
+	{
+		if(m_arWrittenZones[i]==strTZID) return;
+	}
+	m_arWrittenZones.Add(strTZID);
+
+	PutASCII("BEGIN:VTIMEZONE");
+	EndLine();
+	WriteASCII("TZID", strTZID);
+	if(bDaylight)
+	{
+		WriteTransition("STANDARD", dwStandard, lDaylight, lStandard, &tmStandard);
+		WriteTransition("DAYLIGHT", dwDaylight, lStandard, lDaylight, &tmDaylight);
+	}
+	else WriteTransition("STANDARD", 0, lStandard, lStandard, NULL);
+	PutASCII("END:VTIMEZONE");
+	EndLine();
+}
+
+// a STANDARD or DAYLIGHT sub-component starting at dwStart (local minutes) and repeating yearly on pRule
+void CMAPIICalendar::WriteTransition(LPCSTR szName, DWORD dwStart, LONG lFrom, LONG lTo, SYSTEMTIME* pRule)
+{
+	char szValue[MAX_DATE];
+	PutASCII("BEGIN:");
+	PutASCII(szName);
+	EndLine();
+	FormatMinutes(dwStart, szValue, FALSE);
+	WriteASCII("DTSTART", szValue);
+	FormatOffset(lFrom, szValue);
+	WriteASCII("TZOFFSETFROM", szValue);
+	FormatOffset(lTo, szValue);
+	WriteASCII("TZOFFSETTO", szValue);
+	if(pRule)
+	{
+		CStringA strRule;
+		if(pRule->wYear) strRule.Format("FREQ=YEARLY;BYMONTH=%d;BYMONTHDAY=%d", pRule->wMonth, pRule->wDay);
+		else strRule.Format("FREQ=YEARLY;BYMONTH=%d;BYDAY=%d%s", pRule->wMonth, (pRule->wDay>=5) ? -1 : pRule->wDay, ICalDays[pRule->wDayOfWeek%7]);
+		WriteASCII("RRULE", strRule);
+	}
+	PutASCII("END:");
+	PutASCII(szName);
+	EndLine();
+}
+
+// The RRULE value for a pattern IsSupported accepts.  UNTIL is converted from the pattern's time zone with
+// bTimeZone and is a date with bDate
+void CMAPIICalendar::FormatRule(CMAPIRecurrence& recurrence, BOOL bTimeZone, BOOL bDate, CStringA& strRule)
+{
+	int nPeriod=max((int)recurrence.m_dwPeriod, 1);
+	int nDayOfMonth=(int)recurrence.m_dwDayOfMonth;
+	int nYear, nMonth, nDay;
+	CMAPIRecurrence::DateFromDays(recurrence.m_dwStartDate/CMAPIRecurrence::MINUTES_PER_DAY, nYear, nMonth, nDay);
+
+	switch(recurrence.m_wPatternType)
+	{
+	case CMAPIRecurrence::PATTERN_DAY:
+		strRule.Format("FREQ=DAILY;INTERVAL=%d", max(nPeriod/CMAPIRecurrence::MINUTES_PER_DAY, 1));
+		break;
+	case CMAPIRecurrence::PATTERN_WEEK:
+		strRule.Format("FREQ=WEEKLY;INTERVAL=%d;WKST=%s;BYDAY=", nPeriod, ICalDays[recurrence.m_dwFirstDOW%7]);
+		FormatDays(recurrence.m_dwDayMask, strRule);
+		break;
+	default:
+		// yearly patterns are monthly ones every 12 months
+		if(recurrence.m_wFrequency==CMAPIRecurrence::FREQUENCY_YEARLY && !(nPeriod%12)) strRule.Format("FREQ=YEARLY;INTERVAL=%d;BYMONTH=%d", nPeriod/12, nMonth);
+		else strRule.Format("FREQ=MONTHLY;INTERVAL=%d", nPeriod);
+
+		if(recurrence.m_wPatternType==CMAPIRecurrence::PATTERN_MONTH_END)
+		{
+			strRule+=";BYMONTHDAY=-1";
+		}
+		else if(recurrence.m_wPatternType==CMAPIRecurrence::PATTERN_MONTH_NTH)
+		{
+			strRule+=";BYDAY=";
+			FormatDays(recurrence.m_dwDayMask, strRule);
+			strRule.AppendFormat(";BYSETPOS=%d", (nDayOfMonth>=5) ? -1 : nDayOfMonth);
+		}
+		else if(nDayOfMonth>=29)
+		{
+			// Outlook moves the 29th to 31st to the last day of shorter months, BYMONTHDAY alone would skip them
+			strRule+=";BYMONTHDAY=28";
+			for(int i=29;i<=nDayOfMonth && i<=31;i++) strRule.AppendFormat(",%d", i);
+			strRule+=";BYSETPOS=-1";
+		}
+		else strRule.AppendFormat(";BYMONTHDAY=%d", nDayOfMonth);
+		break;
+	}
+
+	if(recurrence.m_dwEndType==CMAPIRecurrence::END_AFTER_COUNT)
+	{
+		strRule.AppendFormat(";COUNT=%d", (int)recurrence.m_dwOccurrenceCount);
+	}
+	else if(recurrence.m_dwEndType==CMAPIRecurrence::END_AFTER_DATE && recurrence.HasEndDate())
+	{
+		// UNTIL is UTC, the last occurrence starts on m_dwEndDate.  Begin only sets up LocalToUTC here
+		CRecurrenceIterator it;
+		FILETIME ftNone={ 0, 0 };
+		it.Begin(recurrence, ftNone, ftNone);
+		char szUntil[MAX_DATE];
+		FormatMinutes(bTimeZone ? it.LocalToUTC(recurrence.m_dwEndDate+recurrence.m_dwStartTimeOffset) : recurrence.m_dwEndDate+recurrence.m_dwStartTimeOffset, szUntil, TRUE);
+		if(bDate) szUntil[8]=0;
+		strRule+=";UNTIL=";
+		strRule+=szUntil;
+	}
+}
+
+// EXDATE for the deleted occurrences.  The original dates of modified occurrences are in the deleted list
+// too, those are replaced by their RECURRENCE-ID events rather than removed
+void CMAPIICalendar::WriteDeleted(CMAPIRecurrence& recurrence, LPCSTR szTZID, BOOL bDate)
+{
+	CStringA strParams("TZID=");
+	strParams+=szTZID;
+	if(bDate) strParams="VALUE=DATE";
+	char szDate[MAX_DATE];
+	BOOL bFirst=TRUE;
+	for(int i=0;i<recurrence.m_arDeletedDates.GetSize();i++)
+	{
+		DWORD dwDate=recurrence.m_arDeletedDates[i];
+		int j;
+		for(j=0;j<recurrence.m_arExceptions.GetSize();j++)
+		{
+			DWORD dwOriginal=recurrence.m_arExceptions[j].m_dwOriginalStart;
+			if(dwOriginal-dwOriginal%CMAPIRecurrence::MINUTES_PER_DAY==dwDate) break;
+		}
+		if(j<recurrence.m_arExceptions.GetSize()) continue;
+
+		if(bFirst) BeginProperty("EXDATE", (*szTZID || bDate) ? (LPCSTR)strParams : NULL);
+		else Put(",", 1);
+		FormatMinutes(dwDate+recurrence.m_dwStartTimeOffset, szDate, !*szTZID);
+		if(bDate) szDate[8]=0;
+		PutASCII(szDate);
+		bFirst=FALSE;
+	}
+	if(!bFirst) EndLine();
+}
+
+BOOL CMAPIICalendar::FormatUTC(const FILETIME& ft, LPSTR szDate)
+{
+	SYSTEMTIME tm;
+	if(!FileTimeToSystemTime(&ft, &tm)) return FALSE;
+	sprintf_s(szDate, MAX_DATE, "%04d%02d%02dT%02d%02d%02dZ", tm.wYear, tm.wMonth, tm.wDay, tm.wHour, tm.wMinute, tm.wSecond);
+	return TRUE;
+}
+
+// dwMinutes is minutes since 1601 like the recurrence times
+void CMAPIICalendar::FormatMinutes(DWORD dwMinutes, LPSTR szDate, BOOL bUTC)
+{
+	int nYear, nMonth, nDay;
+	CMAPIRecurrence::DateFromDays(dwMinutes/CMAPIRecurrence::MINUTES_PER_DAY, nYear, nMonth, nDay);
+	int nMinute=dwMinutes%CMAPIRecurrence::MINUTES_PER_DAY;
+	sprintf_s(szDate, MAX_DATE, "%04d%02d%02dT%02d%02d00%s", nYear, nMonth, nDay, nMinute/60, nMinute%60, bUTC ? "Z" : "");
+}
+
+// lOffset is minutes east of UTC, written as +hhmm or -hhmm
+void CMAPIICalendar::FormatOffset(LONG lOffset, LPSTR szOffset)
+{
+	LONG lMinutes=(lOffset<0) ? -lOffset : lOffset;
+	sprintf_s(szOffset, MAX_DATE, "%c%02d%02d", (lOffset<0) ? '-' : '+', (int)(lMinutes/60), (int)(lMinutes%60));
+}
+
+// appends the days of a recurrence day mask (bit 0 is Sunday) as a BYDAY list
+void CMAPIICalendar::FormatDays(DWORD dwDayMask, CStringA& strRule)
+{
+	BOOL bFirst=TRUE;
+	for(int i=0;i<7;i++)
+	{
+		if(!(dwDayMask&(1<<i))) continue;
+		if(!bFirst) strRule+=',';
+		strRule+=ICalDays[i];
+		bFirst=FALSE;
+	}
+}
+
+// Reads the rest of a VTIMEZONE.  When there are several STANDARD or DAYLIGHT sub-components (historical
+// rules) the one starting last is used, and daylight time is only kept if both have a yearly RRULE
+void CMAPIICalendar::ReadTimeZone()
+{
+	CICalendarTimeZone zone;
+	memset(&zone.m_tzi, 0, sizeof(TIME_ZONE_INFORMATION));
+
+	// index 0 is standard time, 1 is daylight time
+	CStringA strStart[2], strPartStart;
+	LONG lOffset[2]={ 0, 0 }, lPartOffset=0;
+	BOOL bOffset[2]={ FALSE, FALSE }, bRule[2]={ FALSE, FALSE }, bPartRule=FALSE, bPartOffset=FALSE;
+	SYSTEMTIME tmRule[2], tmPart;
+	memset(tmRule, 0, sizeof(tmRule));
+	memset(&tmPart, 0, sizeof(SYSTEMTIME));
+	int nPart=-1;
+
+	CStringA strLine;
+	while(ReadLine(strLine))
+	{
+		LPSTR szLine=strLine.GetBuffer();
+		BOOL bEnd=!_stricmp(szLine, "END:VTIMEZONE");
+		if(bEnd)
+		{
+		}
+		else if(!_stricmp(szLine, "BEGIN:STANDARD") || !_stricmp(szLine, "BEGIN:DAYLIGHT"))
+		{
+			nPart=_stricmp(szLine, "BEGIN:STANDARD") ? 1 : 0;
+			strPartStart.Empty();
+			bPartRule=bPartOffset=FALSE;
+			memset(&tmPart, 0, sizeof(SYSTEMTIME));
+		}
+		else if(!_strnicmp(szLine, "END:", 4))
+		{
+			if(nPart>=0 && bPartOffset && (!bOffset[nPart] || strPartStart.Compare(strStart[nPart])>=0))
+			{
+				strStart[nPart]=strPartStart;
+				lOffset[nPart]=lPartOffset;
+				bOffset[nPart]=TRUE;
+				bRule[nPart]=bPartRule;
+				tmRule[nPart]=tmPart;
+			}
+			nPart=-1;
+		}
+		else
+		{
+			LPSTR szParams, szValue;
+			LPSTR szName=SplitLine(szLine, szParams, szValue);
+			if(!szName)
+			{
+			}
+			else if(nPart<0)
+			{
+				if(!_stricmp(szName, "TZID")) zone.m_strTZID=szValue;
+			}
+			else if(!_stricmp(szName, "DTSTART"))
+			{
+				// the time of day of the transition
+				strPartStart=szValue;
+				LPCSTR szTime=strchr(szValue, 'T');
+				if(szTime && strlen(szTime)>=5)
+				{
+					tmPart.wHour=(WORD)((szTime[1]-'0')*10+szTime[2]-'0');
+					tmPart.wMinute=(WORD)((szTime[3]-'0')*10+szTime[4]-'0');
+				}
+			}
+			else if(!_stricmp(szName, "TZOFFSETTO"))
+			{
+				bPartOffset=ParseOffset(szValue, lPartOffset);
+			}
+			else if(!_stricmp(szName, "RRULE"))
+			{
+				bPartRule=ParseTransition(szValue, tmPart);
+			}
+		}
+		strLine.ReleaseBuffer();
+		if(bEnd) break;
+	}
+
+	if(!bOffset[0])
+	{
+		// a zone without standard time only has the one offset
+		if(!bOffset[1]) return;
+		lOffset[0]=lOffset[1];
+		bOffset[1]=FALSE;
+	}
+	if(zone.m_strTZID.IsEmpty()) return;
+
+	zone.m_tzi.Bias=-lOffset[0];
+	if(bOffset[1] && bRule[0] && bRule[1])
+	{
+		zone.m_tzi.DaylightBias=-(lOffset[1]-lOffset[0]);
+		zone.m_tzi.StandardDate=tmRule[0];
+		zone.m_tzi.DaylightDate=tmRule[1];
+	}
+
+	for(int i=0;i<m_arTimeZones.GetSize();i++)
+	{
+		if(m_arTimeZones[i].m_strTZID==zone.m_strTZID)
+		{
+			m_arTimeZones[i]=zone;
+			return;
+		}
+	}
+	m_arTimeZones.Add(zone);
+}
+
+// Dates (yyyymmdd) and floating times are local, times ending in Z are UTC and times with a TZID are in
+// that VTIMEZONE or local if the file didn't have it.  bDate is set for a date without a time
+BOOL CMAPIICalendar::ParseDateTime(LPCSTR szValue, LPCSTR szParams, FILETIME& ft, BOOL& bDate)
+{
+	int nDigits[14];
+	int nCount=0;
+	BOOL bUTC=FALSE;
+	for(;*szValue;szValue++)
+	{
+		if(*szValue>='0' && *szValue<='9')
+		{
+			if(nCount==14) return FALSE;
+			nDigits[nCount++]=*szValue-'0';
+		}
+		else if((*szValue=='T' || *szValue=='t') && nCount==8) continue;
+		else if((*szValue=='Z' || *szValue=='z') && nCount==14) bUTC=TRUE;
+		else return FALSE;
+	}
+	if(nCount!=8 && nCount!=14) return FALSE;
+
+	SYSTEMTIME tm;
+	memset(&tm, 0, sizeof(SYSTEMTIME));
+	tm.wYear=(WORD)(nDigits[0]*1000+nDigits[1]*100+nDigits[2]*10+nDigits[3]);
+	tm.wMonth=(WORD)(nDigits[4]*10+nDigits[5]);
+	tm.wDay=(WORD)(nDigits[6]*10+nDigits[7]);
+	bDate=(nCount==8);
+	if(!bDate)
+	{
+		tm.wHour=(WORD)(nDigits[8]*10+nDigits[9]);
+		tm.wMinute=(WORD)(nDigits[10]*10+nDigits[11]);
+		tm.wSecond=(WORD)(nDigits[12]*10+nDigits[13]);
+		if(tm.wSecond==60) tm.wSecond=59;
+	}
+	if(bUTC) return SystemTimeToFileTime(&tm, &ft);
+
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	TIME_ZONE_INFORMATION* pTZI=NULL;
+	CStringA strTZID;
+	if(!bDate && GetParam(szParams, "TZID", strTZID)) pTZI=FindTimeZone(strTZID);
+
+	SYSTEMTIME tmUTC;
+	if(!TzSpecificLocalTimeToSystemTime(pTZI, &tm, &tmUTC)) return FALSE;
+	return SystemTimeToFileTime(&tmUTC, &ft);
+#endif
+}
+
+// the VTIMEZONE read with szTZID, NULL if there wasn't one
+TIME_ZONE_INFORMATION* CMAPIICalendar::FindTimeZone(LPCSTR szTZID)
+{
+	for(int i=0;i<m_arTimeZones.GetSize();i++)
+	{
+		if(m_arTimeZones[i].m_strTZID==szTZID) return &m_arTimeZones[i].m_tzi;
+	}
+	return NULL;
+}
+
+// [+-]P[nW][nD][T[nH][nM][nS]]
+BOOL CMAPIICalendar::ParseDuration(LPCSTR szValue, LONGLONG& llSeconds)
+{
+	llSeconds=0;
+	LONGLONG llSign=1;
+	if(*szValue=='+' || *szValue=='-')
+	{
+		if(*szValue=='-') llSign=-1;
+		szValue++;
+	}
+	if(*szValue!='P' && *szValue!='p') return FALSE;
+
+	LONGLONG llValue=0;
+	BOOL bDigits=FALSE;
+	for(szValue++;*szValue;szValue++)
+	{
+		char ch=(char)toupper((BYTE)*szValue);
+		if(ch>='0' && ch<='9')
+		{
+			llValue=llValue*10+(ch-'0');
+			bDigits=TRUE;
+			continue;
+		}
+		if(ch=='T') continue;
+		if(!bDigits) return FALSE;
+
+		switch(ch)
+		{
+		case 'W': llSeconds+=llValue*7*ICalSecondsPerDay; break;
+		case 'D': llSeconds+=llValue*ICalSecondsPerDay; break;
+		case 'H': llSeconds+=llValue*3600; break;
+		case 'M': llSeconds+=llValue*60; break;
+		case 'S': llSeconds+=llValue; break;
+		default: return FALSE;
+		}
+		llValue=0;
+		bDigits=FALSE;
+	}
+	llSeconds*=llSign;
+	return !bDigits;
+}
+
+// +hhmm[ss] or -hhmm[ss] into minutes east of UTC
+BOOL CMAPIICalendar::ParseOffset(LPCSTR szValue, LONG& lOffset)
+{
+	if((*szValue!='+' && *szValue!='-') || strlen(szValue)<5) return FALSE;
+	for(int i=1;i<5;i++)
+	{
+		if(szValue[i]<'0' || szValue[i]>'9') return FALSE;
+	}
+	lOffset=((szValue[1]-'0')*10+szValue[2]-'0')*60+(szValue[3]-'0')*10+szValue[4]-'0';
+	if(*szValue=='-') lOffset=-lOffset;
+	return TRUE;
+}
+
+// Reads a VTIMEZONE RRULE (FREQ=YEARLY;BYMONTH=3;BYDAY=2SU or -1SU, or BYMONTHDAY=8,...,14;BYDAY=SU) into
+// the month, week (5 is last) and day of tm like a TIME_ZONE_INFORMATION date.  szRule is modified
+BOOL CMAPIICalendar::ParseTransition(LPSTR szRule, SYSTEMTIME& tm)
+{
+	LPSTR szParts[MAX_COMPONENTS];
+	int nParts=Split(szRule, szParts, MAX_COMPONENTS, ';');
+	BOOL bYearly=FALSE;
+	int nWeek=0, nDayOfWeek=-1, nMonthDay=0;
+	tm.wMonth=0;
+	for(int i=0;i<nParts;i++)
+	{
+		LPSTR szValue=strchr(szParts[i], '=');
+		if(!szValue) continue;
+		*szValue++=0;
+		if(!_stricmp(szParts[i], "FREQ"))
+		{
+			bYearly=!_stricmp(szValue, "YEARLY");
+		}
+		else if(!_stricmp(szParts[i], "BYMONTH"))
+		{
+			tm.wMonth=(WORD)atoi(szValue);
+		}
+		else if(!_stricmp(szParts[i], "BYMONTHDAY"))
+		{
+			nMonthDay=atoi(szValue);
+		}
+		else if(!_stricmp(szParts[i], "BYDAY"))
+		{
+			nWeek=atoi(szValue);
+			while(*szValue=='+' || *szValue=='-' || (*szValue>='0' && *szValue<='9')) szValue++;
+			nDayOfWeek=ParseDay(szValue);
+		}
+	}
+
+	if(!nWeek && nMonthDay>0) nWeek=(nMonthDay+6)/7;
+	if(nWeek<0 || nWeek>5) nWeek=5;
+	if(!bYearly || tm.wMonth<1 || tm.wMonth>12 || !nWeek || nDayOfWeek<0) return FALSE;
+
+	tm.wYear=0;
+	tm.wDay=(WORD)nWeek;
+	tm.wDayOfWeek=(WORD)nDayOfWeek;
+	return TRUE;
+}
+
+// finds szName=value in "a=b;c=\"d\"" parameters, quotes are removed
+BOOL CMAPIICalendar::GetParam(LPCSTR szParams, LPCSTR szName, CStringA& strValue)
+{
+	int nName=(int)strlen(szName);
+	while(szParams && *szParams)
+	{
+		LPCSTR szEnd=szParams;
+		BOOL bQuote=FALSE;
+		for(;*szEnd && (bQuote || *szEnd!=';');szEnd++)
+		{
+			if(*szEnd=='"') bQuote=!bQuote;
+		}
+
+		if(!_strnicmp(szParams, szName, nName) && szParams[nName]=='=')
+		{
+			LPCSTR szValue=szParams+nName+1;
+			int nLength=(int)(szEnd-szValue);
+			if(nLength>=2 && szValue[0]=='"' && szValue[nLength-1]=='"')
+			{
+				szValue++;
+				nLength-=2;
+			}
+			strValue=CStringA(szValue, nLength);
+			return TRUE;
+		}
+		szParams=*szEnd ? szEnd+1 : NULL;
+	}
+	return FALSE;
+}
+
+// -1 for values we don't know
+int CMAPIICalendar::ParseBusyStatus(LPCSTR szValue)
+{
+	for(int i=0;i<(int)(sizeof(ICalBusyStatus)/sizeof(LPCSTR));i++)
+	{
+		if(!_stricmp(szValue, ICalBusyStatus[i])) return i;
+	}
+	return -1;
+}
+
+// SU..SA into 0..6, -1 for anything else
+int CMAPIICalendar::ParseDay(LPCSTR szValue)
+{
+	for(int i=0;i<7;i++)
+	{
+		if(!_strnicmp(szValue, ICalDays[i], 2)) return i;
+	}
+	return -1;
+}
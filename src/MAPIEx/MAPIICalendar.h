@@ -0,0 +1,139 @@
+#ifndef __MAPIICALENDAR_H__
+#define __MAPIICALENDAR_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIICalendar.h
+// Description: Streaming iCalendar (RFC 5545) reader and writer for appointments
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CICalendarTimeZone
+
+// A VTIMEZONE read from the file, only its current rules are kept
+class AFX_EXT_CLASS CICalendarTimeZone
+{
+public:
+	CStringA m_strTZID;
+	TIME_ZONE_INFORMATION m_tzi;
+};
+
+/////////////////////////////////////////////////////////////
+// CICalendarRecurrence
+
+// What Read found about a VEVENT's recurrence.  Local times are minutes since 1601 in the event's time zone,
+// m_tzi when m_bTimeZone is set and UTC otherwise
+class AFX_EXT_CLASS CICalendarRecurrence
+{
+public:
+	CICalendarRecurrence();
+
+// Attributes
+public:
+	CStringA m_strUID;
+	CStringA m_strRule;
+	BOOL m_bDates;
+	BOOL m_bOverride;
+	FILETIME m_ftOriginalStart;
+	DWORD m_dwStart;
+	DWORD m_dwEnd;
+	CArray<DWORD, DWORD> m_arDeleted;
+	BOOL m_bTimeZone;
+	TIME_ZONE_INFORMATION m_tzi;
+
+// Operations
+public:
+	void Empty();
+	BOOL IsRecurring() { return (m_strRule.GetLength() || m_bDates); }
+	BOOL ToLocal(const FILETIME& ft, DWORD& dwLocal);
+
+private:
+	CICalendarRecurrence(const CICalendarRecurrence&);
+	CICalendarRecurrence& operator=(const CICalendarRecurrence&);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIICalendar
+
+// Reads or writes a .ics file one VEVENT at a time through the buffer of CMAPIContentFile, so a calendar of
+// any size takes the same memory apart from the RECURRENCE-ID list Import keeps.  Export reads the folder from its contents table and only opens recurring
+// appointments to get their pattern, which is written as RRULE and EXDATE in a VTIMEZONE for the pattern's
+// time zone with a RECURRENCE-ID VEVENT per modified occurrence.  Import creates each appointment with one
+// SetProps and saves them in batches (see CMAPIContentFile::Defer), recurring ones get their pattern from the
+// RRULE and EXDATEs and a RECURRENCE-ID event becomes a single appointment in place of the occurrence it
+// overrides:
+//
+//		CMAPIICalendar ical;
+//		if(ical.Open(szPath, TRUE)) ical.Export(folder, loader);
+//
+//		CMAPIAppointmentLoader loader;
+//		int nSkipped, nFailed;
+//		if(ical.Open(szPath) && loader.Init(folder.Folder(), TRUE)) ical.Import(pMAPI, &folder, loader, &nSkipped, &nFailed);
+class AFX_EXT_CLASS CMAPIICalendar : public CMAPIContentFile
+{
+public:
+	CMAPIICalendar();
+	~CMAPIICalendar();
+
+	enum { MAX_COMPONENTS=16, MAX_DATE=32 };
+
+// Attributes
+protected:
+	char m_szStamp[MAX_DATE];
+	CArray<CStringA, CStringA&> m_arWrittenZones;
+	CArray<CICalendarTimeZone, CICalendarTimeZone&> m_arTimeZones;
+
+// Operations
+public:
+	BOOL Open(LPCTSTR szPath, BOOL bWrite=FALSE);
+	BOOL Close();
+
+	BOOL Write(CAppointmentRecord& record, CMAPIRecurrence* pRecurrence=NULL);
+	BOOL Read(CAppointmentRecord& record, CICalendarRecurrence* pRecurrence=NULL);
+	int Export(CMAPIFolder& folder, CMAPIAppointmentLoader& loader);
+	int Import(CMAPIEx* pMAPI, CMAPIFolder* pFolder, CMAPIAppointmentLoader& loader, int* pnSkipped=NULL, int* pnFailed=NULL);
+
+	static void FormatRule(CMAPIRecurrence& recurrence, BOOL bTimeZone, BOOL bDate, CStringA& strRule);
+	static BOOL ParseDuration(LPCSTR szValue, LONGLONG& llSeconds);
+
+protected:
+	void WriteText(LPCSTR szName, LPCTSTR szValue);
+	void WriteASCII(LPCSTR szName, LPCSTR szValue, LPCSTR szParams=NULL);
+	void WriteUTC(LPCSTR szName, const FILETIME& ft);
+	void WriteLocal(LPCSTR szName, LPCSTR szTZID, DWORD dwLocal, BOOL bDate=FALSE);
+	void WriteDate(LPCSTR szName, SYSTEMTIME& tm);
+	void WriteBusyStatus(int nBusyStatus);
+	void WriteTimeZone(CMAPIRecurrence& recurrence, CStringA& strTZID);
+	void WriteTransition(LPCSTR szName, DWORD dwStart, LONG lFrom, LONG lTo, SYSTEMTIME* pRule);
+	void WriteDeleted(CMAPIRecurrence& recurrence, LPCSTR szTZID, BOOL bDate);
+	static BOOL FormatUTC(const FILETIME& ft, LPSTR szDate);
+	static void FormatMinutes(DWORD dwMinutes, LPSTR szDate, BOOL bUTC);
+	static void FormatOffset(LONG lOffset, LPSTR szOffset);
+	static void FormatDays(DWORD dwDayMask, CStringA& strRule);
+
+	void ReadTimeZone();
+	BOOL ParseDateTime(LPCSTR szValue, LPCSTR szParams, FILETIME& ft, BOOL& bDate);
+	TIME_ZONE_INFORMATION* FindTimeZone(LPCSTR szTZID);
+	static BOOL ParseOffset(LPCSTR szValue, LONG& lOffset);
+	static BOOL ParseTransition(LPSTR szRule, SYSTEMTIME& tm);
+	static BOOL GetParam(LPCSTR szParams, LPCSTR szName, CStringA& strValue);
+	static int ParseBusyStatus(LPCSTR szValue);
+	static int ParseDay(LPCSTR szValue);
+
+	BOOL FindOverrides(CArray<CStringA, CStringA&>& arUIDs, CArray<FILETIME, FILETIME&>& arOriginalStarts, int* pnSkipped);
+	BOOL GetRecurrence(CICalendarRecurrence& event, CArray<CStringA, CStringA&>& arUIDs, CArray<FILETIME, FILETIME&>& arOriginalStarts, CMAPIRecurrence& recurrence);
+
+private:
+	CMAPIICalendar(const CMAPIICalendar&);
+	CMAPIICalendar& operator=(const CMAPIICalendar&);
+};
+
+#endif
@@ -0,0 +1,300 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPILimiter.cpp
+// Description: Adaptive limit on the MAPI calls in flight against one server, with jittered retry backoff
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CLimiterStats
+
+CLimiterStats::CLimiterStats()
+{
+	m_nLimit=0;
+	m_nInFlight=0;
+	m_nWaiting=0;
+	m_ulCalls=0;
+	m_ulThrottled=0;
+	m_ulSlow=0;
+	m_ulDecreases=0;
+	m_ulIncreases=0;
+	m_ulRetries=0;
+	m_ulTimeouts=0;
+	m_dwAverageLatency=0;
+	m_dwMinLatency=0;
+	m_dwLatencyTarget=0;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPILimiterCall
+
+CMAPILimiterCall::CMAPILimiterCall(CMAPILimiter& limiter, DWORD dwTimeout)
+{
+	m_pLimiter=&limiter;
+	m_bAcquired=m_pLimiter->Acquire(dwTimeout);
+	m_dwStart=GetTickCount();
+}
+
+CMAPILimiterCall::CMAPILimiterCall(CMAPILimiter* pLimiter, DWORD dwTimeout)
+{
+	m_pLimiter=pLimiter;
+	m_bAcquired=m_pLimiter ? m_pLimiter->Acquire(dwTimeout) : TRUE;
+	m_dwStart=GetTickCount();
+}
+
+// a call that wasn't ended explicitly counts as a success
+CMAPILimiterCall::~CMAPILimiterCall()
+{
+	End(S_OK);
+}
+
+void CMAPILimiterCall::End(HRESULT hr)
+{
+	if(m_bAcquired && m_pLimiter) m_pLimiter->Release(GetTickCount()-m_dwStart, hr);
+	m_bAcquired=FALSE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPILimiter
+
+CMAPILimiter::CMAPILimiter(int nMaxLimit, int nInitialLimit, int nMinLimit)
+{
+	InitializeCriticalSection(&m_cs);
+	m_nMinLimit=max(1, nMinLimit);
+	m_nMaxLimit=max(m_nMinLimit, nMaxLimit);
+	m_nLimit=max(m_nMinLimit, min(nInitialLimit, m_nMaxLimit));
+	m_nInFlight=0;
+	m_nWaiting=0;
+	m_nIncrease=0;
+	m_dwLatencyTarget=0;
+	m_dwAverageLatency=0;
+	m_dwMinLatency=0;
+	m_bLatency=FALSE;
+	m_dwWindowMin=MAXDWORD;
+	m_nWindowSamples=0;
+	m_dwLastDecrease=GetTickCount();
+	m_nMaxRetries=DEFAULT_MAX_RETRIES;
+	m_dwBaseBackoff=DEFAULT_BASE_BACKOFF;
+	m_dwMaxBackoff=DEFAULT_MAX_BACKOFF;
+	m_ulSeed=(GetTickCount() ^ (ULONG)(DWORD_PTR)this) | 1;
+	m_hSlot=CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+CMAPILimiter::~CMAPILimiter()
+{
+	if(m_hSlot) CloseHandle(m_hSlot);
+	DeleteCriticalSection(&m_cs);
+}
+
+void CMAPILimiter::SetLimits(int nMinLimit, int nMaxLimit)
+{
+	EnterCriticalSection(&m_cs);
+	m_nMinLimit=max(1, nMinLimit);
+	m_nMaxLimit=max(m_nMinLimit, nMaxLimit);
+	m_nLimit=max(m_nMinLimit, min(m_nLimit, m_nMaxLimit));
+	BOOL bWake=(m_nWaiting && m_nInFlight<m_nLimit);
+	LeaveCriticalSection(&m_cs);
+	if(bWake) SetEvent(m_hSlot);
+}
+
+// nMaxRetries of 0 turns retrying off
+void CMAPILimiter::SetBackoff(int nMaxRetries, DWORD dwBaseBackoff, DWORD dwMaxBackoff)
+{
+	EnterCriticalSection(&m_cs);
+	m_nMaxRetries=max(0, nMaxRetries);
+	m_dwBaseBackoff=max(1, dwBaseBackoff);
+	m_dwMaxBackoff=max(m_dwBaseBackoff, dwMaxBackoff);
+	LeaveCriticalSection(&m_cs);
+}
+
+// Waits up to dwTimeout for a slot under the current limit, every successful Acquire needs a Release.
+// Waiters wake one another in turn while slots are free so a raised limit or a burst of releases isn't lost
+BOOL CMAPILimiter::Acquire(DWORD dwTimeout)
+{
+	if(!m_hSlot) return FALSE;
+
+	DWORD dwStart=GetTickCount();
+	EnterCriticalSection(&m_cs);
+	for(;;)
+	{
+		if(m_nInFlight<m_nLimit)
+		{
+			m_nInFlight++;
+			BOOL bWake=(m_nWaiting && m_nInFlight<m_nLimit);
+			LeaveCriticalSection(&m_cs);
+			if(bWake) SetEvent(m_hSlot);
+			return TRUE;
+		}
+
+		DWORD dwWait=INFINITE;
+		if(dwTimeout!=INFINITE)
+		{
+			DWORD dwElapsed=GetTickCount()-dwStart;
+			if(dwElapsed>=dwTimeout)
+			{
+				m_stats.m_ulTimeouts++;
+				LeaveCriticalSection(&m_cs);
+				return FALSE;
+			}
+			dwWait=dwTimeout-dwElapsed;
+		}
+
+		m_nWaiting++;
+		LeaveCriticalSection(&m_cs);
+		WaitForSingleObject(m_hSlot, dwWait);
+		EnterCriticalSection(&m_cs);
+		m_nWaiting--;
+	}
+}
+
+// Gives a slot back with how long the call took and its result, which moves the limit
+void CMAPILimiter::Release(DWORD dwLatency, HRESULT hr)
+{
+	EnterCriticalSection(&m_cs);
+	BOOL bAtLimit=(m_nInFlight>=m_nLimit || m_nWaiting);
+	if(m_nInFlight>0) m_nInFlight--;
+	m_stats.m_ulCalls++;
+
+	// throttled calls often fail fast, they'd drag the latencies down, and so would a MAPI_E_NOT_FOUND
+	if(IsThrottled(hr))
+	{
+		m_stats.m_ulThrottled++;
+		Decrease();
+	}
+	else if(!FAILED(hr))
+	{
+		AddLatency(dwLatency);
+		if(m_dwAverageLatency>GetLatencyTarget())
+		{
+			m_stats.m_ulSlow++;
+			Decrease();
+		}
+		else if(bAtLimit) Increase();
+	}
+
+	BOOL bWake=(m_nWaiting && m_nInFlight<m_nLimit);
+	LeaveCriticalSection(&m_cs);
+	if(bWake) SetEvent(m_hSlot);
+}
+
+// TRUE with the delay to wait when hr is a throttling error and nAttempt (from 0) retries haven't run out
+BOOL CMAPILimiter::ShouldRetry(HRESULT hr, int nAttempt, DWORD& dwDelay)
+{
+	dwDelay=0;
+	if(!IsThrottled(hr)) return FALSE;
+
+	EnterCriticalSection(&m_cs);
+	BOOL bRetry=(nAttempt<m_nMaxRetries);
+	if(bRetry)
+	{
+		DWORD dwCeiling=m_dwBaseBackoff;
+		for(int i=0;i<nAttempt && dwCeiling<m_dwMaxBackoff;i++) dwCeiling*=2;
+		dwCeiling=min(dwCeiling, m_dwMaxBackoff);
+		dwDelay=Random()%(dwCeiling+1);
+		m_stats.m_ulRetries++;
+	}
+	LeaveCriticalSection(&m_cs);
+	return bRetry;
+}
+
+void CMAPILimiter::GetStats(CLimiterStats& stats)
+{
+	EnterCriticalSection(&m_cs);
+	stats=m_stats;
+	stats.m_nLimit=m_nLimit;
+	stats.m_nInFlight=m_nInFlight;
+	stats.m_nWaiting=m_nWaiting;
+	stats.m_dwAverageLatency=m_dwAverageLatency;
+	stats.m_dwMinLatency=m_dwMinLatency;
+	stats.m_dwLatencyTarget=GetLatencyTarget();
+	LeaveCriticalSection(&m_cs);
+}
+
+// the limit and the latencies learned so far are kept
+void CMAPILimiter::ResetStats()
+{
+	EnterCriticalSection(&m_cs);
+	m_stats=CLimiterStats();
+	LeaveCriticalSection(&m_cs);
+}
+
+// the errors a busy Exchange server or the RPC layer in front of it returns when it sheds load
+BOOL CMAPILimiter::IsThrottled(HRESULT hr)
+{
+	return (hr==MAPI_E_BUSY || hr==MAPI_E_TIMEOUT || hr==MAPI_E_NOT_ENOUGH_RESOURCES || hr==MAPI_E_NETWORK_ERROR
+		|| hr==HRESULT_FROM_WIN32(RPC_S_SERVER_TOO_BUSY) || hr==HRESULT_FROM_WIN32(RPC_S_SERVER_UNAVAILABLE));
+}
+
+DWORD CMAPILimiter::GetLatencyTarget()
+{
+	if(m_dwLatencyTarget) return m_dwLatencyTarget;
+	return max((DWORD)MIN_LATENCY_TARGET, m_dwMinLatency*LATENCY_TOLERANCE);
+}
+
+// Keeps an average over about the last 8 calls and the lowest latency of the last window, so the automatic
+// target follows the server if its baseline moves
+void CMAPILimiter::AddLatency(DWORD dwLatency)
+{
+	if(!m_bLatency)
+	{
+		m_dwAverageLatency=dwLatency;
+		m_dwMinLatency=dwLatency;
+		m_bLatency=TRUE;
+	}
+	m_dwAverageLatency=(DWORD)((LONGLONG)m_dwAverageLatency+((LONGLONG)dwLatency-(LONGLONG)m_dwAverageLatency)/8);
+	m_dwMinLatency=min(m_dwMinLatency, dwLatency);
+	m_dwWindowMin=min(m_dwWindowMin, dwLatency);
+	if(++m_nWindowSamples>=LATENCY_WINDOW)
+	{
+		m_dwMinLatency=m_dwWindowMin;
+		m_dwWindowMin=MAXDWORD;
+		m_nWindowSamples=0;
+	}
+}
+
+// additive increase, one more slot after a full limit's worth of good calls
+void CMAPILimiter::Increase()
+{
+	if(++m_nIncrease<m_nLimit) return;
+	m_nIncrease=0;
+	if(m_nLimit<m_nMaxLimit)
+	{
+		m_nLimit++;
+		m_stats.m_ulIncreases++;
+	}
+}
+
+// multiplicative decrease, once per average round trip since the calls in flight all see the same overload
+void CMAPILimiter::Decrease()
+{
+	DWORD dwNow=GetTickCount();
+	if(dwNow-m_dwLastDecrease<max(m_dwAverageLatency, (DWORD)MIN_LATENCY_TARGET)) return;
+
+	m_dwLastDecrease=dwNow;
+	m_nIncrease=0;
+	int nLimit=max(m_nMinLimit, m_nLimit*DECREASE_PERCENT/100);
+	if(nLimit<m_nLimit)
+	{
+		m_nLimit=nLimit;
+		m_stats.m_ulDecreases++;
+	}
+}
+
+// xorshift, only used for jitter
+ULONG CMAPILimiter::Random()
+{
+	m_ulSeed^=m_ulSeed<<13;
+	m_ulSeed^=m_ulSeed>>17;
+	m_ulSeed^=m_ulSeed<<5;
+	return m_ulSeed;
+}
@@ -0,0 +1,159 @@
+#ifndef __MAPILIMITER_H__
+#define __MAPILIMITER_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPILimiter.h
+// Description: Adaptive limit on the MAPI calls in flight against one server, with jittered retry backoff
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CMAPILimiter;
+
+/////////////////////////////////////////////////////////////
+// CLimiterStats
+
+// counters since the limiter was created or ResetStats, latencies in milliseconds
+class AFX_EXT_CLASS CLimiterStats
+{
+public:
+	CLimiterStats();
+
+// Attributes
+public:
+	int m_nLimit;
+	int m_nInFlight;
+	int m_nWaiting;
+	ULONG m_ulCalls;
+	ULONG m_ulThrottled;
+	ULONG m_ulSlow;
+	ULONG m_ulDecreases;
+	ULONG m_ulIncreases;
+	ULONG m_ulRetries;
+	ULONG m_ulTimeouts;
+	DWORD m_dwAverageLatency;
+	DWORD m_dwMinLatency;
+	DWORD m_dwLatencyTarget;
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPILimiterCall
+
+// Holds one of the limiter's slots while a call is made and reports how long it took and how it ended.  With
+// a NULL limiter it's always valid and does nothing, for code that may run with or without one:
+//
+//		for(int nAttempt=0;;nAttempt++)
+//		{
+//			CMAPILimiterCall call(limiter);
+//			if(!call.IsValid()) break;
+//			hr=pContents->QueryRows(50, 0, &pRows);
+//			call.End(hr);
+//			if(!limiter.ShouldRetry(hr, nAttempt, dwDelay)) break;
+//			Sleep(dwDelay);
+//		}
+class AFX_EXT_CLASS CMAPILimiterCall
+{
+public:
+	CMAPILimiterCall(CMAPILimiter& limiter, DWORD dwTimeout=INFINITE);
+	CMAPILimiterCall(CMAPILimiter* pLimiter, DWORD dwTimeout=INFINITE);
+	~CMAPILimiterCall();
+
+// Attributes
+protected:
+	CMAPILimiter* m_pLimiter;
+	BOOL m_bAcquired;
+	DWORD m_dwStart;
+
+// Operations
+public:
+	BOOL IsValid() { return m_bAcquired; }
+	void End(HRESULT hr);
+
+private:
+	CMAPILimiterCall(const CMAPILimiterCall&);
+	CMAPILimiterCall& operator=(const CMAPILimiterCall&);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPILimiter
+
+// Caps the calls in flight against one server and moves the cap with AIMD: it grows by one for every limit
+// calls that come back quickly while the cap is in use, and drops by 30% (at most once per round trip) when a
+// call is throttled (MAPI_E_BUSY, MAPI_E_TIMEOUT, RPC server too busy...) or the average latency climbs past
+// the target.  Other failures (MAPI_E_NOT_FOUND...) don't count towards the latency.  With no target set it's
+// twice the lowest latency seen lately, so throughput settles near what the server can take.  Share one
+// limiter between all the executors (SetLimiter) and session pools (SetLimiter, then CMAPILimiterCall with
+// the lease's GetLimiter around each call) working against the same store;
+// ShouldRetry gives the delay before retrying a throttled call, exponential with full jitter so clients
+// backing off together don't come back together
+class AFX_EXT_CLASS CMAPILimiter
+{
+public:
+	CMAPILimiter(int nMaxLimit=DEFAULT_MAX_LIMIT, int nInitialLimit=DEFAULT_INITIAL_LIMIT, int nMinLimit=1);
+	~CMAPILimiter();
+
+	enum { DEFAULT_MAX_LIMIT=64, DEFAULT_INITIAL_LIMIT=4 };
+	enum { DECREASE_PERCENT=70, LATENCY_WINDOW=256, LATENCY_TOLERANCE=2, MIN_LATENCY_TARGET=20 };
+	enum { DEFAULT_MAX_RETRIES=5, DEFAULT_BASE_BACKOFF=100, DEFAULT_MAX_BACKOFF=10000 };
+
+// Attributes
+protected:
+	int m_nLimit;
+	int m_nMinLimit;
+	int m_nMaxLimit;
+	int m_nInFlight;
+	int m_nWaiting;
+	int m_nIncrease;
+	DWORD m_dwLatencyTarget;
+	DWORD m_dwAverageLatency;
+	DWORD m_dwMinLatency;
+	BOOL m_bLatency;
+	DWORD m_dwWindowMin;
+	int m_nWindowSamples;
+	DWORD m_dwLastDecrease;
+	int m_nMaxRetries;
+	DWORD m_dwBaseBackoff;
+	DWORD m_dwMaxBackoff;
+	ULONG m_ulSeed;
+	CLimiterStats m_stats;
+	HANDLE m_hSlot;
+	CRITICAL_SECTION m_cs;
+
+// Operations
+public:
+	void SetLimits(int nMinLimit, int nMaxLimit);
+	void SetLatencyTarget(DWORD dwLatencyTarget) { m_dwLatencyTarget=dwLatencyTarget; }
+	void SetBackoff(int nMaxRetries, DWORD dwBaseBackoff, DWORD dwMaxBackoff);
+
+	BOOL Acquire(DWORD dwTimeout=INFINITE);
+	void Release(DWORD dwLatency, HRESULT hr);
+	BOOL ShouldRetry(HRESULT hr, int nAttempt, DWORD& dwDelay);
+
+	int GetLimit() { return m_nLimit; }
+	int GetInFlight() { return m_nInFlight; }
+	int GetQueueDepth() { return m_nWaiting; }
+	void GetStats(CLimiterStats& stats);
+	void ResetStats();
+
+	static BOOL IsThrottled(HRESULT hr);
+
+protected:
+	DWORD GetLatencyTarget();
+	void AddLatency(DWORD dwLatency);
+	void Increase();
+	void Decrease();
+	ULONG Random();
+
+private:
+	CMAPILimiter(const CMAPILimiter&);
+	CMAPILimiter& operator=(const CMAPILimiter&);
+};
+
+#endif
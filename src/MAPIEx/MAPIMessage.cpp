@@ -438,11 +438,10 @@ BOOL CMAPIMessage::SetDeliveryReceipt(BOOL bSet)
 	return (Message()->SetProps(1, &prop, NULL)!=S_OK);
 }
 
-// limited compare, compares entry IDs and subject to determine if two emails are equal
+// limited compare, compares entry IDs (ignoring flags) and subject to determine if two emails are equal
 BOOL CMAPIMessage::operator==(CMAPIMessage& message)
 {
-	if(!m_entryID.cb || !message.m_entryID.cb || m_entryID.cb!=message.m_entryID.cb) return FALSE;
-	if(memcmp(m_entryID.lpb,message.m_entryID.lpb, m_entryID.cb)) return FALSE;
+	if(m_entryID.CompareLocal(message.m_entryID)!=CMAPIEntryID::ENTRYID_EQUAL) return FALSE;
 	return (!m_strSubject.Compare(message.m_strSubject));
 }
 
@@ -514,7 +513,8 @@ int CMAPIMessage::ShowForm(CMAPIEx* pMAPI)
 
 BOOL CMAPIMessage::Send()
 {
-	if(Message() && Message()->SubmitMessage(0)==S_OK) 
+	m_hrError=Message() ? Message()->SubmitMessage(0) : E_UNEXPECTED;
+	if(m_hrError==S_OK) 
 	{
 		Close();
 		return TRUE;
@@ -0,0 +1,410 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPINotifyCoalescer.cpp
+// Description: Merges bursts of notifications for the same item and delivers them in batches
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+#ifndef _WIN32_WCE
+#include <process.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// CCoalesceStats
+
+CCoalesceStats::CCoalesceStats()
+{
+	m_nPending=0;
+	m_ulReceived=0;
+	m_ulDelivered=0;
+	m_ulMerged=0;
+	m_ulCancelled=0;
+	m_ulBatches=0;
+}
+
+// notifications received for each one delivered, 0 until something is delivered
+double CCoalesceStats::GetRatio() const
+{
+	return m_ulDelivered ? (double)m_ulReceived/m_ulDelivered : 0.0;
+}
+
+double CCoalesceStats::GetBatchSize() const
+{
+	return m_ulBatches ? (double)m_ulDelivered/m_ulBatches : 0.0;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPINotifyCoalescer
+
+CMAPINotifyCoalescer::CMAPINotifyCoalescer()
+{
+	InitializeCriticalSection(&m_cs);
+	InitializeCriticalSection(&m_csDeliver);
+	m_lpfnCallback=NULL;
+	m_lpvContext=NULL;
+	m_dwWindow=DEFAULT_WINDOW;
+	m_dwMaxDelay=DEFAULT_MAX_DELAY;
+	m_bStarted=FALSE;
+	m_hWake=NULL;
+	m_hStop=NULL;
+	m_hThread=NULL;
+}
+
+CMAPINotifyCoalescer::~CMAPINotifyCoalescer()
+{
+	Stop();
+	DeleteCriticalSection(&m_csDeliver);
+	DeleteCriticalSection(&m_cs);
+}
+
+// lpfnCallback gets the merged batches on the coalescer's thread
+BOOL CMAPINotifyCoalescer::Start(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, DWORD dwWindow, DWORD dwMaxDelay)
+{
+	Stop();
+
+	m_lpfnCallback=lpfnCallback;
+	m_lpvContext=lpvContext;
+	SetWindow(dwWindow, dwMaxDelay);
+
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	m_hWake=CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_hStop=CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(m_hWake && m_hStop) m_hThread=(HANDLE)_beginthreadex(NULL, 0, FlushThread, this, 0, NULL);
+	if(!m_hThread)
+	{
+		Stop();
+		return FALSE;
+	}
+
+	ResetStats();
+	EnterCriticalSection(&m_cs);
+	m_bStarted=TRUE;
+	LeaveCriticalSection(&m_cs);
+	return TRUE;
+#endif
+}
+
+// Delivers what's pending, notifications that arrive afterwards are passed straight through.  m_csDeliver is
+// held from the switch until the last batch is out so a notification passed through can't overtake it
+void CMAPINotifyCoalescer::Stop()
+{
+	if(m_hThread)
+	{
+		SetEvent(m_hStop);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread=NULL;
+	}
+
+	EnterCriticalSection(&m_csDeliver);
+	EnterCriticalSection(&m_cs);
+	m_bStarted=FALSE;
+	LeaveCriticalSection(&m_cs);
+	Deliver(TRUE);
+	LeaveCriticalSection(&m_csDeliver);
+
+	if(m_hWake)
+	{
+		CloseHandle(m_hWake);
+		m_hWake=NULL;
+	}
+	if(m_hStop)
+	{
+		CloseHandle(m_hStop);
+		m_hStop=NULL;
+	}
+}
+
+// dwMaxDelay bounds how long a busy item can be held back, it's at least dwWindow
+void CMAPINotifyCoalescer::SetWindow(DWORD dwWindow, DWORD dwMaxDelay)
+{
+	EnterCriticalSection(&m_cs);
+	m_dwWindow=dwWindow;
+	m_dwMaxDelay=max(dwWindow, dwMaxDelay);
+	LeaveCriticalSection(&m_cs);
+	if(m_hWake) SetEvent(m_hWake);
+}
+
+// delivers everything pending now, whether or not its window is over
+void CMAPINotifyCoalescer::Flush()
+{
+	Deliver(TRUE);
+}
+
+// Copies and merges the notifications.  If a copy fails what's pending is delivered first and the rest of the
+// batch is passed straight through, so nothing reaches the callback ahead of an earlier notification
+void CMAPINotifyCoalescer::Add(ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	EnterCriticalSection(&m_cs);
+	if(!m_bStarted)
+	{
+		LeaveCriticalSection(&m_cs);
+		EnterCriticalSection(&m_csDeliver);
+		if(m_lpfnCallback) m_lpfnCallback(m_lpvContext, cNotification, lpNotifications);
+		LeaveCriticalSection(&m_csDeliver);
+		return;
+	}
+
+	BOOL bWasEmpty=m_lstPending.IsEmpty();
+	DWORD dwNow=GetTickCount();
+	ULONG i;
+	for(i=0;i<cNotification;i++)
+	{
+		if(!AddNotification(lpNotifications[i], dwNow)) break;
+		m_stats.m_ulReceived++;
+	}
+	ULONG cDirect=cNotification-i;
+	m_stats.m_ulReceived+=cDirect;
+	m_stats.m_ulDelivered+=cDirect;
+	BOOL bWake=(bWasEmpty && !m_lstPending.IsEmpty());
+	LeaveCriticalSection(&m_cs);
+
+	// the flush thread only needs waking when it was idle, pending items are never due sooner than new ones
+	if(bWake) SetEvent(m_hWake);
+	if(cDirect)
+	{
+		EnterCriticalSection(&m_csDeliver);
+		Deliver(TRUE);
+		if(m_lpfnCallback) m_lpfnCallback(m_lpvContext, cDirect, &lpNotifications[i]);
+		LeaveCriticalSection(&m_csDeliver);
+	}
+}
+
+void CMAPINotifyCoalescer::GetStats(CCoalesceStats& stats)
+{
+	EnterCriticalSection(&m_cs);
+	stats=m_stats;
+	stats.m_nPending=(int)m_lstPending.GetCount();
+	LeaveCriticalSection(&m_cs);
+}
+
+void CMAPINotifyCoalescer::ResetStats()
+{
+	EnterCriticalSection(&m_cs);
+	m_stats=CCoalesceStats();
+	LeaveCriticalSection(&m_cs);
+}
+
+// pass as the callback to CMAPIEx::Notify with the coalescer as the context
+LONG STDAPICALLTYPE CMAPINotifyCoalescer::OnNotify(LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	CMAPINotifyCoalescer* pCoalescer=(CMAPINotifyCoalescer*)lpvContext;
+	if(pCoalescer) pCoalescer->Add(cNotification, lpNotifications);
+	return 0;
+}
+
+// the EVENT_ index of the notifications merged by entry ID, -1 for the others
+int CMAPINotifyCoalescer::GetEvent(ULONG ulEventType)
+{
+	switch(ulEventType)
+	{
+	case fnevNewMail: return EVENT_NEWMAIL;
+	case fnevObjectCreated: return EVENT_CREATED;
+	case fnevObjectDeleted: return EVENT_DELETED;
+	case fnevObjectModified: return EVENT_MODIFIED;
+	case fnevObjectMoved: return EVENT_MOVED;
+	case fnevObjectCopied: return EVENT_COPIED;
+	}
+	return -1;
+}
+
+// Merges one notification into the pending items, FALSE if it couldn't be copied
+BOOL CMAPINotifyCoalescer::AddNotification(NOTIFICATION& notification, DWORD dwNow)
+{
+	int nEvent=GetEvent(notification.ulEventType);
+	ULONG cbEntryID=0;
+	LPENTRYID lpEntryID=NULL;
+	if(nEvent==EVENT_NEWMAIL)
+	{
+		cbEntryID=notification.info.newmail.cbEntryID;
+		lpEntryID=notification.info.newmail.lpEntryID;
+	}
+	else if(nEvent>=0)
+	{
+		cbEntryID=notification.info.obj.cbEntryID;
+		lpEntryID=notification.info.obj.lpEntryID;
+	}
+	if(!cbEntryID || !lpEntryID) nEvent=-1;
+
+	CMAPIEntryID entryID;
+	Pending* pPending;
+	if(nEvent>=0)
+	{
+		entryID.Set(cbEntryID, (const BYTE*)lpEntryID);
+		switch(nEvent)
+		{
+		case EVENT_MODIFIED:
+			// whoever handles the create reads the item as it is by then
+			pPending=Find(EVENT_CREATED, entryID);
+			if(pPending)
+			{
+				pPending->m_dwLast=dwNow;
+				m_stats.m_ulMerged++;
+				return TRUE;
+			}
+			break;
+
+		case EVENT_DELETED:
+			pPending=Find(EVENT_MODIFIED, entryID);
+			if(pPending)
+			{
+				Remove(pPending);
+				m_stats.m_ulMerged++;
+			}
+			pPending=Find(EVENT_CREATED, entryID);
+			if(pPending)
+			{
+				Remove(pPending);
+				m_stats.m_ulCancelled+=2;
+				return TRUE;
+			}
+			break;
+		}
+
+		// the latest notification of a burst replaces the one held
+		pPending=Find(nEvent, entryID);
+		if(pPending)
+		{
+			LPNOTIFICATION pCopy=Copy(notification);
+			if(pCopy)
+			{
+				MAPIFreeBuffer(pPending->m_pNotification);
+				pPending->m_pNotification=pCopy;
+			}
+			pPending->m_dwLast=dwNow;
+			m_stats.m_ulMerged++;
+			return TRUE;
+		}
+	}
+
+	LPNOTIFICATION pCopy=Copy(notification);
+	if(!pCopy) return FALSE;
+
+	pPending=new Pending;
+	pPending->m_pNotification=pCopy;
+	pPending->m_nEvent=nEvent;
+	pPending->m_entryID=entryID;
+	pPending->m_dwFirst=dwNow;
+	pPending->m_dwLast=dwNow;
+	pPending->m_pos=m_lstPending.AddTail(pPending);
+	if(nEvent>=0) m_mapPending[nEvent].SetAt(pPending->m_entryID, pPending);
+	return TRUE;
+}
+
+CMAPINotifyCoalescer::Pending* CMAPINotifyCoalescer::Find(int nEvent, const CMAPIEntryID& entryID)
+{
+	Pending* pPending;
+	return m_mapPending[nEvent].Lookup(entryID, pPending) ? pPending : NULL;
+}
+
+// drops a pending item without delivering it
+void CMAPINotifyCoalescer::Remove(Pending* pPending)
+{
+	m_lstPending.RemoveAt(pPending->m_pos);
+	if(pPending->m_nEvent>=0) m_mapPending[pPending->m_nEvent].RemoveKey(pPending->m_entryID);
+	MAPIFreeBuffer(pPending->m_pNotification);
+	delete pPending;
+}
+
+// one block per notification so a merge can replace it on its own
+LPNOTIFICATION CMAPINotifyCoalescer::Copy(NOTIFICATION& notification)
+{
+#ifdef _WIN32_WCE
+	return NULL;
+#else
+	ULONG cb=0;
+	LPNOTIFICATION pCopy=NULL;
+	if(FAILED(ScCountNotifications(1, &notification, &cb)) || MAPIAllocateBuffer(cb, (LPVOID*)&pCopy)!=S_OK) return NULL;
+	if(FAILED(ScCopyNotifications(1, &notification, pCopy, NULL)))
+	{
+		MAPIFreeBuffer(pCopy);
+		return NULL;
+	}
+	return pCopy;
+#endif
+}
+
+// quiet for the window since the last event, or the max delay since the first
+DWORD CMAPINotifyCoalescer::GetDue(Pending* pPending)
+{
+	DWORD dwQuiet=pPending->m_dwLast+m_dwWindow;
+	DWORD dwLatest=pPending->m_dwFirst+m_dwMaxDelay;
+	return ((LONG)(dwQuiet-dwLatest)<0) ? dwQuiet : dwLatest;
+}
+
+// Delivers the due items (all of them with bAll) in the order they came in as one batch and returns how long
+// until the next one is due.  The callback is called outside the lock so new notifications aren't held up
+DWORD CMAPINotifyCoalescer::Deliver(BOOL bAll)
+{
+	EnterCriticalSection(&m_csDeliver);
+
+	CArray<Pending*, Pending*> arDue;
+	DWORD dwWait=INFINITE;
+	EnterCriticalSection(&m_cs);
+	DWORD dwNow=GetTickCount();
+	POSITION pos=m_lstPending.GetHeadPosition();
+	while(pos)
+	{
+		Pending* pPending=m_lstPending.GetNext(pos);
+		DWORD dwDue=GetDue(pPending);
+		if(bAll || (LONG)(dwDue-dwNow)<=0)
+		{
+			m_lstPending.RemoveAt(pPending->m_pos);
+			if(pPending->m_nEvent>=0) m_mapPending[pPending->m_nEvent].RemoveKey(pPending->m_entryID);
+			arDue.Add(pPending);
+		}
+		else dwWait=min(dwWait, dwDue-dwNow);
+	}
+	int i, nDue=(int)arDue.GetSize();
+	if(nDue)
+	{
+		m_stats.m_ulDelivered+=nDue;
+		m_stats.m_ulBatches++;
+	}
+	LeaveCriticalSection(&m_cs);
+
+	if(nDue)
+	{
+		if(m_lpfnCallback)
+		{
+			NOTIFICATION* pBatch=new NOTIFICATION[nDue];
+			for(i=0;i<nDue;i++) pBatch[i]=*arDue[i]->m_pNotification;
+			m_lpfnCallback(m_lpvContext, nDue, pBatch);
+			delete [] pBatch;
+		}
+		for(i=0;i<nDue;i++)
+		{
+			MAPIFreeBuffer(arDue[i]->m_pNotification);
+			delete arDue[i];
+		}
+	}
+	LeaveCriticalSection(&m_csDeliver);
+	return dwWait;
+}
+
+#ifndef _WIN32_WCE
+// sleeps until the next item is due, woken early when the first item arrives, the window changes or on Stop
+unsigned __stdcall CMAPINotifyCoalescer::FlushThread(void* pParam)
+{
+	CMAPINotifyCoalescer* pCoalescer=(CMAPINotifyCoalescer*)pParam;
+
+	BOOL bInit=CMAPIEx::Init();
+	HANDLE hEvents[2]={ pCoalescer->m_hStop, pCoalescer->m_hWake };
+	DWORD dwWait=INFINITE;
+	while(WaitForMultipleObjects(2, hEvents, FALSE, dwWait)!=WAIT_OBJECT_0) dwWait=pCoalescer->Deliver(FALSE);
+	if(bInit) CMAPIEx::Term();
+	return 0;
+}
+#endif
@@ -0,0 +1,125 @@
+#ifndef __MAPINOTIFYCOALESCER_H__
+#define __MAPINOTIFYCOALESCER_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPINotifyCoalescer.h
+// Description: Merges bursts of notifications for the same item and delivers them in batches
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CCoalesceStats
+
+// counters since the coalescer was started or ResetStats
+class AFX_EXT_CLASS CCoalesceStats
+{
+public:
+	CCoalesceStats();
+
+// Attributes
+public:
+	int m_nPending;
+	ULONG m_ulReceived;
+	ULONG m_ulDelivered;
+	ULONG m_ulMerged;
+	ULONG m_ulCancelled;
+	ULONG m_ulBatches;
+
+// Operations
+public:
+	double GetRatio() const;
+	double GetBatchSize() const;
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPINotifyCoalescer
+
+// Holds notifications for a short window and merges those for the same event type and entry ID, so the
+// callback sees one fnevObjectModified for a burst of saves instead of one per save.  A modify while a create
+// is pending is folded into the create, a delete drops a pending modify, and a create followed by a delete
+// cancels out.  An item is delivered once no event came in for it for dwWindow, or dwMaxDelay after its first
+// event if the events keep coming.  Notifications without an entry ID (tables, errors...) aren't merged but
+// wait their turn so the order of the batch is the order they came in.  Due items go to the callback together:
+//
+//		coalescer.Start(OnNotify, this, 250);
+//		mapi.Notify(CMAPINotifyCoalescer::OnNotify, &coalescer, fnevObjectCreated | fnevObjectDeleted | fnevObjectModified);
+//
+// It can sit behind a CMAPINotifyQueue too.  Unadvise before the coalescer is stopped or destroyed, and don't
+// stop or destroy it from the callback: that runs on the flush thread, which Stop waits for.  On Windows
+// Mobile Start fails and notifications are passed straight through
+class AFX_EXT_CLASS CMAPINotifyCoalescer
+{
+public:
+	CMAPINotifyCoalescer();
+	~CMAPINotifyCoalescer();
+
+	enum { DEFAULT_WINDOW=250, DEFAULT_MAX_DELAY=2000 };
+	enum { EVENT_NEWMAIL, EVENT_CREATED, EVENT_DELETED, EVENT_MODIFIED, EVENT_MOVED, EVENT_COPIED, COALESCED_EVENTS };
+
+	struct Pending
+	{
+		LPNOTIFICATION m_pNotification;
+		int m_nEvent;
+		CMAPIEntryID m_entryID;
+		DWORD m_dwFirst;
+		DWORD m_dwLast;
+		POSITION m_pos;
+	};
+
+// Attributes
+protected:
+	CRITICAL_SECTION m_cs;
+	CRITICAL_SECTION m_csDeliver;
+	LPNOTIFCALLBACK m_lpfnCallback;
+	LPVOID m_lpvContext;
+	DWORD m_dwWindow;
+	DWORD m_dwMaxDelay;
+	BOOL m_bStarted;
+	CList<Pending*, Pending*> m_lstPending;
+	CMap<CMAPIEntryID, const CMAPIEntryID&, Pending*, Pending*> m_mapPending[COALESCED_EVENTS];
+	CCoalesceStats m_stats;
+	HANDLE m_hWake;
+	HANDLE m_hStop;
+	HANDLE m_hThread;
+
+// Operations
+public:
+	BOOL Start(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, DWORD dwWindow=DEFAULT_WINDOW, DWORD dwMaxDelay=DEFAULT_MAX_DELAY);
+	void Stop();
+	BOOL IsStarted() { return m_bStarted; }
+	void SetWindow(DWORD dwWindow, DWORD dwMaxDelay=DEFAULT_MAX_DELAY);
+	void Flush();
+
+	void Add(ULONG cNotification, LPNOTIFICATION lpNotifications);
+	void GetStats(CCoalesceStats& stats);
+	void ResetStats();
+
+	static LONG STDAPICALLTYPE OnNotify(LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications);
+	static int GetEvent(ULONG ulEventType);
+
+protected:
+	BOOL AddNotification(NOTIFICATION& notification, DWORD dwNow);
+	Pending* Find(int nEvent, const CMAPIEntryID& entryID);
+	void Remove(Pending* pPending);
+	LPNOTIFICATION Copy(NOTIFICATION& notification);
+	DWORD GetDue(Pending* pPending);
+	DWORD Deliver(BOOL bAll);
+
+#ifndef _WIN32_WCE
+	static unsigned __stdcall FlushThread(void* pParam);
+#endif
+
+private:
+	CMAPINotifyCoalescer(const CMAPINotifyCoalescer&);
+	CMAPINotifyCoalescer& operator=(const CMAPINotifyCoalescer&);
+};
+
+#endif
@@ -0,0 +1,391 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPINotifyQueue.cpp
+// Description: Queued delivery of advise sink notifications on a pool of worker threads
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+#ifndef _WIN32_WCE
+#include <process.h>
+#include <malloc.h>
+#endif
+
+/////////////////////////////////////////////////////////////
+// CNotifyStats
+
+CNotifyStats::CNotifyStats()
+{
+	m_nQueued=0;
+	m_nMaxQueued=0;
+	m_ulPosted=0;
+	m_ulDelivered=0;
+	m_ulDeliveredDirect=0;
+	m_ulDroppedNewest=0;
+	m_ulDroppedOldest=0;
+	m_ulCopyFailed=0;
+	m_ulPoolMisses=0;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPINotifyQueue
+
+CMAPINotifyQueue::CMAPINotifyQueue()
+{
+	m_pSlots=NULL;
+	m_lCapacity=0;
+	m_lEnqueue=0;
+	m_lDequeue=0;
+	m_pArena=NULL;
+#ifndef _WIN32_WCE
+	m_pFree=NULL;
+#endif
+	m_nBlockSize=0;
+	m_nHeaderSize=0;
+	m_lOverflow=OVERFLOW_DROP_OLDEST;
+	m_lStarted=FALSE;
+	m_lPosting=0;
+	m_hItems=NULL;
+	m_hStop=NULL;
+	m_nThreads=0;
+	ResetStats();
+}
+
+CMAPINotifyQueue::~CMAPINotifyQueue()
+{
+	Stop();
+}
+
+// The ring holds nCapacity batches (rounded up to a power of 2) and the pool has a block of nBlockSize bytes
+// for each of them and each worker, batches that don't fit in a block are copied to the heap
+BOOL CMAPINotifyQueue::Start(int nThreads, int nCapacity, int nOverflow, int nBlockSize)
+{
+	Stop();
+
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	nThreads=max(1, min(nThreads, (int)MAX_THREADS));
+	m_lCapacity=2;
+	while(m_lCapacity<nCapacity && m_lCapacity<MAX_CAPACITY) m_lCapacity*=2;
+	m_lOverflow=nOverflow;
+
+	const int nAlign=MEMORY_ALLOCATION_ALIGNMENT;
+	m_nHeaderSize=(sizeof(Entry)+nAlign-1) & ~(nAlign-1);
+	m_nBlockSize=(max(nBlockSize, m_nHeaderSize+(int)sizeof(NOTIFICATION))+nAlign-1) & ~(nAlign-1);
+	int nBlocks=(int)m_lCapacity+nThreads;
+
+	m_pSlots=new Slot[m_lCapacity];
+	m_pFree=(PSLIST_HEADER)_aligned_malloc(sizeof(SLIST_HEADER), nAlign);
+	m_pArena=(BYTE*)_aligned_malloc((size_t)nBlocks*m_nBlockSize, nAlign);
+	m_hItems=CreateSemaphore(NULL, 0, m_lCapacity, NULL);
+	m_hStop=CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!m_pFree || !m_pArena || !m_hItems || !m_hStop)
+	{
+		Stop();
+		return FALSE;
+	}
+
+	int i;
+	for(i=0;i<(int)m_lCapacity;i++)
+	{
+		m_pSlots[i].m_lSequence=i;
+		m_pSlots[i].m_pEntry=NULL;
+	}
+	m_lEnqueue=0;
+	m_lDequeue=0;
+
+	InitializeSListHead(m_pFree);
+	for(i=0;i<nBlocks;i++)
+	{
+		Entry* pEntry=(Entry*)(m_pArena+(size_t)i*m_nBlockSize);
+		InterlockedPushEntrySList(m_pFree, &pEntry->m_link);
+	}
+
+	for(i=0;i<nThreads;i++)
+	{
+		m_hThreads[m_nThreads]=(HANDLE)_beginthreadex(NULL, 0, WorkerThread, this, 0, NULL);
+		if(m_hThreads[m_nThreads]) m_nThreads++;
+	}
+	if(!m_nThreads)
+	{
+		Stop();
+		return FALSE;
+	}
+	ResetStats();
+	InterlockedExchange(&m_lStarted, TRUE);
+	return TRUE;
+#endif
+}
+
+// Posts that saw the queue started are waited for before anything is freed, then the workers deliver what's
+// queued before they exit and what's left is delivered here.  Posts after Stop call the callback directly.
+// Don't call Stop from a callback, it would wait for itself
+void CMAPINotifyQueue::Stop()
+{
+	InterlockedExchange(&m_lStarted, FALSE);
+	while(m_lPosting) SwitchToThread();
+	if(m_hStop) SetEvent(m_hStop);
+	if(m_nThreads) WaitForMultipleObjects(m_nThreads, m_hThreads, TRUE, INFINITE);
+	for(int i=0;i<m_nThreads;i++) CloseHandle(m_hThreads[i]);
+	m_nThreads=0;
+
+	if(m_hItems)
+	{
+		while(WaitForSingleObject(m_hItems, 0)==WAIT_OBJECT_0)
+		{
+			Entry* pEntry=Take();
+			Deliver(pEntry);
+			Free(pEntry);
+		}
+		CloseHandle(m_hItems);
+		m_hItems=NULL;
+	}
+	if(m_hStop)
+	{
+		CloseHandle(m_hStop);
+		m_hStop=NULL;
+	}
+
+	delete [] m_pSlots;
+	m_pSlots=NULL;
+	m_lCapacity=0;
+	m_lEnqueue=0;
+	m_lDequeue=0;
+#ifndef _WIN32_WCE
+	if(m_pArena) _aligned_free(m_pArena);
+	if(m_pFree) _aligned_free(m_pFree);
+	m_pFree=NULL;
+#endif
+	m_pArena=NULL;
+}
+
+// Called by the sink on MAPI's notification thread, returns FALSE if the batch was dropped.  The post is
+// counted in m_lPosting before m_lStarted is read so Stop can't free the ring and the pool under it
+BOOL CMAPINotifyQueue::Post(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	if(!lpfnCallback) return TRUE;
+
+	InterlockedIncrement(&m_lPosting);
+	if(!m_lStarted)
+	{
+		InterlockedDecrement(&m_lPosting);
+		lpfnCallback(lpvContext, cNotification, lpNotifications);
+		return TRUE;
+	}
+	BOOL bResult=Queue(lpfnCallback, lpvContext, cNotification, lpNotifications);
+	InterlockedDecrement(&m_lPosting);
+	return bResult;
+}
+
+BOOL CMAPINotifyQueue::Queue(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	InterlockedIncrement(&m_lPosted);
+	Entry* pEntry=Copy(lpfnCallback, lpvContext, cNotification, lpNotifications);
+	if(!pEntry)
+	{
+		// better late on this thread than lost
+		InterlockedIncrement(&m_lCopyFailed);
+		InterlockedIncrement(&m_lDeliveredDirect);
+		lpfnCallback(lpvContext, cNotification, lpNotifications);
+		InterlockedIncrement(&m_lDelivered);
+		return TRUE;
+	}
+
+	for(int nAttempt=0;;nAttempt++)
+	{
+		if(Push(pEntry))
+		{
+			LONG lQueued=(LONG)GetQueuedCount();
+			LONG lMaxQueued=m_lMaxQueued;
+			while(lQueued>lMaxQueued && InterlockedCompareExchange(&m_lMaxQueued, lQueued, lMaxQueued)!=lMaxQueued) lMaxQueued=m_lMaxQueued;
+			ReleaseSemaphore(m_hItems, 1, NULL);
+			return TRUE;
+		}
+
+		LONG lOverflow=m_lOverflow;
+		if(lOverflow==OVERFLOW_DELIVER)
+		{
+			InterlockedIncrement(&m_lDeliveredDirect);
+			Deliver(pEntry);
+			Free(pEntry);
+			return TRUE;
+		}
+		if(lOverflow!=OVERFLOW_DROP_OLDEST || nAttempt>=OVERFLOW_ATTEMPTS) break;
+
+		// only a batch a worker hasn't claimed can be taken out, otherwise the worker would wait for it
+		if(WaitForSingleObject(m_hItems, 0)==WAIT_OBJECT_0)
+		{
+			Free(Take());
+			InterlockedIncrement(&m_lDroppedOldest);
+		}
+		else SwitchToThread();
+	}
+
+	InterlockedIncrement(&m_lDroppedNewest);
+	Free(pEntry);
+	return FALSE;
+}
+
+// the two positions are read one after the other so under load the count is approximate
+int CMAPINotifyQueue::GetQueuedCount()
+{
+	LONG lDequeue=m_lDequeue;
+	LONG lQueued=(LONG)((ULONG)m_lEnqueue-(ULONG)lDequeue);
+	return (int)max(0, min(lQueued, m_lCapacity));
+}
+
+void CMAPINotifyQueue::GetStats(CNotifyStats& stats)
+{
+	stats.m_nQueued=GetQueuedCount();
+	stats.m_nMaxQueued=(int)m_lMaxQueued;
+	stats.m_ulPosted=(ULONG)m_lPosted;
+	stats.m_ulDelivered=(ULONG)m_lDelivered;
+	stats.m_ulDeliveredDirect=(ULONG)m_lDeliveredDirect;
+	stats.m_ulDroppedNewest=(ULONG)m_lDroppedNewest;
+	stats.m_ulDroppedOldest=(ULONG)m_lDroppedOldest;
+	stats.m_ulCopyFailed=(ULONG)m_lCopyFailed;
+	stats.m_ulPoolMisses=(ULONG)m_lPoolMisses;
+}
+
+// the batches still queued stay counted
+void CMAPINotifyQueue::ResetStats()
+{
+	InterlockedExchange(&m_lMaxQueued, GetQueuedCount());
+	InterlockedExchange(&m_lPosted, 0);
+	InterlockedExchange(&m_lDelivered, 0);
+	InterlockedExchange(&m_lDeliveredDirect, 0);
+	InterlockedExchange(&m_lDroppedNewest, 0);
+	InterlockedExchange(&m_lDroppedOldest, 0);
+	InterlockedExchange(&m_lCopyFailed, 0);
+	InterlockedExchange(&m_lPoolMisses, 0);
+}
+
+// Deep copy of the batch into one block, pointers in the copy point into the same block
+CMAPINotifyQueue::Entry* CMAPINotifyQueue::Copy(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+#ifdef _WIN32_WCE
+	return NULL;
+#else
+	ULONG cb=0;
+	if(FAILED(ScCountNotifications((int)cNotification, lpNotifications, &cb))) return NULL;
+
+	Entry* pEntry=NULL;
+	if(m_nHeaderSize+cb<=(ULONG)m_nBlockSize) pEntry=(Entry*)InterlockedPopEntrySList(m_pFree);
+	if(pEntry) pEntry->m_bPooled=TRUE;
+	else
+	{
+		InterlockedIncrement(&m_lPoolMisses);
+		pEntry=(Entry*)_aligned_malloc(m_nHeaderSize+cb, MEMORY_ALLOCATION_ALIGNMENT);
+		if(!pEntry) return NULL;
+		pEntry->m_bPooled=FALSE;
+	}
+
+	pEntry->m_lpfnCallback=lpfnCallback;
+	pEntry->m_lpvContext=lpvContext;
+	pEntry->m_cNotification=cNotification;
+	pEntry->m_pNotifications=(LPNOTIFICATION)((BYTE*)pEntry+m_nHeaderSize);
+	if(FAILED(ScCopyNotifications((int)cNotification, lpNotifications, pEntry->m_pNotifications, NULL)))
+	{
+		Free(pEntry);
+		return NULL;
+	}
+	return pEntry;
+#endif
+}
+
+void CMAPINotifyQueue::Free(Entry* pEntry)
+{
+#ifndef _WIN32_WCE
+	if(!pEntry) return;
+	if(pEntry->m_bPooled) InterlockedPushEntrySList(m_pFree, &pEntry->m_link);
+	else _aligned_free(pEntry);
+#endif
+}
+
+// Bounded multi-producer multi-consumer ring: each slot's sequence tells whose turn it is, a producer claims
+// the slot when the sequence equals its position and a consumer when it's one past.  FALSE if the ring is full
+BOOL CMAPINotifyQueue::Push(Entry* pEntry)
+{
+	for(;;)
+	{
+		LONG lPos=m_lEnqueue;
+		Slot& slot=m_pSlots[lPos & (m_lCapacity-1)];
+		LONG lDiff=(LONG)((ULONG)slot.m_lSequence-(ULONG)lPos);
+		if(!lDiff)
+		{
+			if(InterlockedCompareExchange(&m_lEnqueue, (LONG)((ULONG)lPos+1), lPos)==lPos)
+			{
+				slot.m_pEntry=pEntry;
+				InterlockedExchange(&slot.m_lSequence, (LONG)((ULONG)lPos+1));
+				return TRUE;
+			}
+		}
+		else if(lDiff<0) return FALSE;
+	}
+}
+
+// NULL if the ring is empty or the producer of the oldest slot hasn't finished writing it
+CMAPINotifyQueue::Entry* CMAPINotifyQueue::Pop()
+{
+	for(;;)
+	{
+		LONG lPos=m_lDequeue;
+		Slot& slot=m_pSlots[lPos & (m_lCapacity-1)];
+		LONG lDiff=(LONG)((ULONG)slot.m_lSequence-((ULONG)lPos+1));
+		if(!lDiff)
+		{
+			if(InterlockedCompareExchange(&m_lDequeue, (LONG)((ULONG)lPos+1), lPos)==lPos)
+			{
+				Entry* pEntry=slot.m_pEntry;
+				InterlockedExchange(&slot.m_lSequence, (LONG)((ULONG)lPos+m_lCapacity));
+				return pEntry;
+			}
+		}
+		else if(lDiff<0) return NULL;
+	}
+}
+
+// Pops after a count was taken from m_hItems, the semaphore is released only after a push so a batch is
+// there, though a producer further back in the ring may still be finishing its slot
+CMAPINotifyQueue::Entry* CMAPINotifyQueue::Take()
+{
+	Entry* pEntry;
+	while((pEntry=Pop())==NULL) SwitchToThread();
+	return pEntry;
+}
+
+void CMAPINotifyQueue::Deliver(Entry* pEntry)
+{
+	pEntry->m_lpfnCallback(pEntry->m_lpvContext, pEntry->m_cNotification, pEntry->m_pNotifications);
+	InterlockedIncrement(&m_lDelivered);
+}
+
+#ifndef _WIN32_WCE
+// Workers check for batches before the stop event so what's queued is delivered before they exit
+unsigned __stdcall CMAPINotifyQueue::WorkerThread(void* pParam)
+{
+	CMAPINotifyQueue* pQueue=(CMAPINotifyQueue*)pParam;
+
+	// callbacks usually go back to MAPI with the entry IDs they're given
+	BOOL bInit=CMAPIEx::Init();
+	HANDLE hEvents[2]={ pQueue->m_hItems, pQueue->m_hStop };
+	while(WaitForMultipleObjects(2, hEvents, FALSE, INFINITE)==WAIT_OBJECT_0)
+	{
+		Entry* pEntry=pQueue->Take();
+		pQueue->Deliver(pEntry);
+		pQueue->Free(pEntry);
+	}
+	if(bInit) CMAPIEx::Term();
+	return 0;
+}
+#endif
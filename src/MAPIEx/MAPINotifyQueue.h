@@ -0,0 +1,143 @@
+#ifndef __MAPINOTIFYQUEUE_H__
+#define __MAPINOTIFYQUEUE_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPINotifyQueue.h
+// Description: Queued delivery of advise sink notifications on a pool of worker threads
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CNotifyStats
+
+// counters since the queue was started or ResetStats
+class AFX_EXT_CLASS CNotifyStats
+{
+public:
+	CNotifyStats();
+
+// Attributes
+public:
+	int m_nQueued;
+	int m_nMaxQueued;
+	ULONG m_ulPosted;
+	ULONG m_ulDelivered;
+	ULONG m_ulDeliveredDirect;
+	ULONG m_ulDroppedNewest;
+	ULONG m_ulDroppedOldest;
+	ULONG m_ulCopyFailed;
+	ULONG m_ulPoolMisses;
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPINotifyQueue
+
+// Takes notifications off MAPI's notification thread so a slow callback can't hold up delivery.  Post copies
+// the batch with ScCopyNotifications into a block from a preallocated pool (the heap when it doesn't fit) and
+// puts it on a bounded lock-free ring, then the workers call the callbacks with the copies.  When the ring is
+// full the overflow policy drops the new batch, drops the oldest one to make room or calls the callback
+// right away like an unqueued sink.  With more than one worker batches can be delivered out of order.
+// Pass the queue to CMAPIEx::Notify, and Unadvise before the queue is stopped or destroyed:
+//
+//		queue.Start(2, 4096, CMAPINotifyQueue::OVERFLOW_DROP_OLDEST);
+//		mapi.Notify(OnNotify, this, fnevNewMail | fnevObjectModified, &queue);
+//
+// Windows Mobile has no ScCopyNotifications, there Start fails and Post calls the callback directly
+class AFX_EXT_CLASS CMAPINotifyQueue
+{
+public:
+	CMAPINotifyQueue();
+	~CMAPINotifyQueue();
+
+	enum { OVERFLOW_DROP_NEWEST, OVERFLOW_DROP_OLDEST, OVERFLOW_DELIVER };
+	enum { DEFAULT_CAPACITY=1024, MAX_CAPACITY=1<<20, DEFAULT_BLOCK_SIZE=1024, MAX_THREADS=16, OVERFLOW_ATTEMPTS=8 };
+
+	// a copied batch, the notifications follow the header in the same block
+	struct Entry
+	{
+#ifndef _WIN32_WCE
+		SLIST_ENTRY m_link;
+#endif
+		LPNOTIFCALLBACK m_lpfnCallback;
+		LPVOID m_lpvContext;
+		ULONG m_cNotification;
+		LPNOTIFICATION m_pNotifications;
+		BOOL m_bPooled;
+	};
+
+	struct Slot
+	{
+		volatile LONG m_lSequence;
+		Entry* m_pEntry;
+	};
+
+// Attributes
+protected:
+	Slot* m_pSlots;
+	LONG m_lCapacity;
+	volatile LONG m_lEnqueue;
+	volatile LONG m_lDequeue;
+	BYTE* m_pArena;
+#ifndef _WIN32_WCE
+	PSLIST_HEADER m_pFree;
+#endif
+	int m_nBlockSize;
+	int m_nHeaderSize;
+	volatile LONG m_lOverflow;
+	volatile LONG m_lStarted;
+	volatile LONG m_lPosting;
+	HANDLE m_hItems;
+	HANDLE m_hStop;
+	HANDLE m_hThreads[MAX_THREADS];
+	int m_nThreads;
+
+	volatile LONG m_lMaxQueued;
+	volatile LONG m_lPosted;
+	volatile LONG m_lDelivered;
+	volatile LONG m_lDeliveredDirect;
+	volatile LONG m_lDroppedNewest;
+	volatile LONG m_lDroppedOldest;
+	volatile LONG m_lCopyFailed;
+	volatile LONG m_lPoolMisses;
+
+// Operations
+public:
+	BOOL Start(int nThreads=1, int nCapacity=DEFAULT_CAPACITY, int nOverflow=OVERFLOW_DROP_OLDEST, int nBlockSize=DEFAULT_BLOCK_SIZE);
+	void Stop();
+	BOOL IsStarted() { return (m_lStarted!=FALSE); }
+	void SetOverflow(int nOverflow) { InterlockedExchange(&m_lOverflow, nOverflow); }
+	int GetOverflow() { return (int)m_lOverflow; }
+	int GetCapacity() { return (int)m_lCapacity; }
+	int GetQueuedCount();
+
+	BOOL Post(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications);
+	void GetStats(CNotifyStats& stats);
+	void ResetStats();
+
+protected:
+	BOOL Queue(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications);
+	Entry* Copy(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications);
+	void Free(Entry* pEntry);
+	BOOL Push(Entry* pEntry);
+	Entry* Pop();
+	Entry* Take();
+	void Deliver(Entry* pEntry);
+
+#ifndef _WIN32_WCE
+	static unsigned __stdcall WorkerThread(void* pParam);
+#endif
+
+private:
+	CMAPINotifyQueue(const CMAPINotifyQueue&);
+	CMAPINotifyQueue& operator=(const CMAPINotifyQueue&);
+};
+
+#endif
@@ -22,8 +22,7 @@ CMAPIObject::CMAPIObject()
 {
 	m_pMAPI=NULL;
 	m_pItem=NULL;
-	m_entryID.cb=0;
-	SetEntryID(NULL);
+	m_hrError=S_OK;
 }
 
 CMAPIObject::~CMAPIObject()
@@ -32,38 +31,12 @@ CMAPIObject::~CMAPIObject()
 
 BOOL CMAPIObject::GetEntryIDString(CString& strEntryID)
 {
-	if(m_entryID.cb) 
-	{
-		strEntryID.Empty();
-		TCHAR szBuffer[3];
-		for(ULONG i=0;i<m_entryID.cb;i++)
-		{
-			_stprintf_s(szBuffer, 3, _T("%02X"), m_entryID.lpb[i]);
-			strEntryID+=szBuffer;
-		}
-		return TRUE;
-	}
-	return FALSE;
+	return m_entryID.ToString(strEntryID);
 }
 
 void CMAPIObject::SetEntryID(SBinary* pEntryID)
 {
-	if(m_entryID.cb) delete [] m_entryID.lpb;
-	m_entryID.lpb=NULL;
-
-	if(pEntryID) 
-	{
-		m_entryID.cb=pEntryID->cb;
-		if(m_entryID.cb) 
-		{
-			m_entryID.lpb=new BYTE[m_entryID.cb];
-			memcpy(m_entryID.lpb, pEntryID->lpb, m_entryID.cb);
-		}
-	} 
-	else 
-	{
-		m_entryID.cb=0;
-	}
+	m_entryID.Set(pEntryID);
 }
 
 BOOL CMAPIObject::Open(CMAPIEx* pMAPI,SBinary entryID)
@@ -71,7 +44,12 @@ BOOL CMAPIObject::Open(CMAPIEx* pMAPI,SBinary entryID)
 	Close();
 	m_pMAPI=pMAPI;
 	ULONG ulObjType;
-	if(m_pMAPI->GetSession()->OpenEntry(entryID.cb, (LPENTRYID)entryID.lpb, NULL, MAPI_BEST_ACCESS, &ulObjType, (LPUNKNOWN*)&m_pItem)!=S_OK) return FALSE;
+	m_hrError=m_pMAPI->GetSession()->OpenEntry(entryID.cb, (LPENTRYID)entryID.lpb, NULL, MAPI_BEST_ACCESS, &ulObjType, (LPUNKNOWN*)&m_pItem);
+	if(m_hrError!=S_OK)
+	{
+		m_pItem=NULL;
+		return FALSE;
+	}
 	SetEntryID(&entryID);
 	return TRUE;
 }
@@ -132,7 +110,8 @@ BOOL CMAPIObject::Create(CMAPIEx* pMAPI, CMAPIFolder* pFolder)
 	if(!pFolder) return FALSE;
 	Close();
 	m_pMAPI=pMAPI;
-	if(pFolder->Folder()->CreateMessage(NULL, 0, (LPMESSAGE*)&m_pItem)==S_OK) 
+	m_hrError=pFolder->Folder()->CreateMessage(NULL, 0, (LPMESSAGE*)&m_pItem);
+	if(m_hrError==S_OK) 
 	{
 		LPSPropValue pProp;
 		if(GetProperty(PR_ENTRYID, pProp)==S_OK) 
@@ -299,6 +278,85 @@ BOOL CMAPIObject::GetOutlookPropertyString(ULONG ulData, ULONG ulProperty, CStri
 	return FALSE;
 }
 
+// reads all of pTags in one GetProps, values are accessed by their index in pTags without being copied
+BOOL CMAPIObject::GetProperties(LPSPropTagArray pTags, CMAPIProperties& props)
+{
+	props.Release();
+	if(!m_pItem || !pTags) return FALSE;
+
+	ULONG ulPropCount=0;
+	LPSPropValue pProps=NULL;
+	HRESULT hr=m_pItem->GetProps(pTags, CMAPIEx::cm_nMAPICode, &ulPropCount, &pProps);
+	if(FAILED(hr)) return FALSE;
+
+	// MAPI_W_ERRORS_RETURNED is fine, missing properties come back as PT_ERROR
+	props.Attach(pProps, ulPropCount);
+	return TRUE;
+}
+
+// resolves all the names in one GetIDsFromNames call, then reads them with one GetProps
+BOOL CMAPIObject::GetNamedProperties(LPCTSTR* szFieldNames, int nCount, CMAPIProperties& props)
+{
+	props.Release();
+	if(!m_pItem || nCount<=0) return FALSE;
+
+	CArray<MAPINAMEID, MAPINAMEID&> arNameIDs;
+	CArray<LPMAPINAMEID, LPMAPINAMEID> arpNameIDs;
+	arNameIDs.SetSize(nCount);
+	arpNameIDs.SetSize(nCount);
+#ifndef UNICODE
+	CArray<WCHAR, WCHAR> arNames;
+	arNames.SetSize(nCount*256);
+#endif
+	for(int i=0;i<nCount;i++)
+	{
+		arNameIDs[i].lpguid=(GUID*)&GUIDPublicStrings;
+		arNameIDs[i].ulKind=MNID_STRING;
+#ifdef UNICODE
+		arNameIDs[i].Kind.lpwstrName=(LPWSTR)szFieldNames[i];
+#else
+		LPWSTR wszFieldName=arNames.GetData()+i*256;
+		MultiByteToWideChar(CP_ACP, 0, szFieldNames[i], -1, wszFieldName, 255);
+		wszFieldName[255]=0;
+		arNameIDs[i].Kind.lpwstrName=wszFieldName;
+#endif
+		arpNameIDs[i]=&arNameIDs[i];
+	}
+
+	LPSPropTagArray lppPropTags;
+	if(FAILED(m_pItem->GetIDsFromNames(nCount, arpNameIDs.GetData(), 0, &lppPropTags))) return FALSE;
+	BOOL bResult=GetProperties(lppPropTags, props);
+	MAPIFreeBuffer(lppPropTags);
+	return bResult;
+}
+
+// gets several custom outlook properties (ie the three EmailAddress fields of a contact) in one round trip
+BOOL CMAPIObject::GetOutlookProperties(ULONG ulData, const ULONG* pulProperties, int nCount, CMAPIProperties& props)
+{
+	props.Release();
+	if(!m_pItem || nCount<=0) return FALSE;
+
+	const GUID guidOutlook={ulData, 0x0000, 0x0000, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+
+	CArray<MAPINAMEID, MAPINAMEID&> arNameIDs;
+	CArray<LPMAPINAMEID, LPMAPINAMEID> arpNameIDs;
+	arNameIDs.SetSize(nCount);
+	arpNameIDs.SetSize(nCount);
+	for(int i=0;i<nCount;i++)
+	{
+		arNameIDs[i].lpguid=(GUID*)&guidOutlook;
+		arNameIDs[i].ulKind=MNID_ID;
+		arNameIDs[i].Kind.lID=pulProperties[i];
+		arpNameIDs[i]=&arNameIDs[i];
+	}
+
+	LPSPropTagArray lppPropTags;
+	if(FAILED(m_pItem->GetIDsFromNames(nCount, arpNameIDs.GetData(), 0, &lppPropTags))) return FALSE;
+	BOOL bResult=GetProperties(lppPropTags, props);
+	MAPIFreeBuffer(lppPropTags);
+	return bResult;
+}
+
 BOOL CMAPIObject::SetPropertyString(ULONG ulProperty, LPCTSTR szProperty, BOOL bStream)
 {
 	if(m_pItem && szProperty) 
@@ -483,7 +541,7 @@ BOOL CMAPIObject::GetAttachmentCID(CString& strAttachmentCID, int nIndex)
 				{
 					if(nIndex < (int)pRows->cRows)
 					{
-						if(!CMAPIEx::GetValidString(pRows->aRow[nIndex].lpProps[PROP_ATTACH_CONTENT_ID])) strAttachmentCID=pRows->aRow[nIndex].lpProps[PROP_ATTACH_CONTENT_ID].Value.LPSZ;
+						if(CMAPIEx::GetValidString(pRows->aRow[nIndex].lpProps[PROP_ATTACH_CONTENT_ID])) strAttachmentCID=pRows->aRow[nIndex].lpProps[PROP_ATTACH_CONTENT_ID].Value.LPSZ;
 					}
 					FreeProws(pRows);
 					MAPIFreeBuffer(pRows);
@@ -530,10 +588,15 @@ BOOL CMAPIObject::GetAttachmentName(CString& strAttachmentName, int nIndex)
 BOOL CMAPIObject::SaveAttachment(LPATTACH pAttachment, LPCTSTR szPath)
 {
 	CFile file;
-	if(!file.Open(szPath, CFile::modeCreate | CFile::modeWrite)) return FALSE;
+	if(!file.Open(szPath, CFile::modeCreate | CFile::modeWrite))
+	{
+		m_hrError=HRESULT_FROM_WIN32(GetLastError());
+		return FALSE;
+	}
 
 	IStream* pStream;
-	if(pAttachment->OpenProperty(PR_ATTACH_DATA_BIN, &IID_IStream,STGM_READ, NULL, (LPUNKNOWN*)&pStream)!=S_OK) 
+	m_hrError=pAttachment->OpenProperty(PR_ATTACH_DATA_BIN, &IID_IStream,STGM_READ, NULL, (LPUNKNOWN*)&pStream);
+	if(m_hrError!=S_OK) 
 	{
 		file.Close();
 		return FALSE;
@@ -557,7 +620,8 @@ BOOL CMAPIObject::SaveAttachment(LPATTACH pAttachment, LPCTSTR szPath)
 BOOL CMAPIObject::SaveAttachment(LPCTSTR szFolder, int nIndex, LPCTSTR szFileName)
 {
 	LPMAPITABLE pAttachTable=NULL;
-	if(Message()->GetAttachmentTable(0, &pAttachTable)!=S_OK) return FALSE;
+	m_hrError=Message()->GetAttachmentTable(0, &pAttachTable);
+	if(m_hrError!=S_OK) return FALSE;
 
 	CString strPath;
 	BOOL bResult=FALSE;
@@ -580,7 +644,8 @@ BOOL CMAPIObject::SaveAttachment(LPCTSTR szFolder, int nIndex, LPCTSTR szFileNam
 				else
 				{
 					LPATTACH pAttachment;
-					if(Message()->OpenAttach(pRows->aRow[0].lpProps[PROP_ATTACH_NUM].Value.bin.cb, NULL, 0, &pAttachment)==S_OK)
+					m_hrError=Message()->OpenAttach(pRows->aRow[0].lpProps[PROP_ATTACH_NUM].Value.bin.cb, NULL, 0, &pAttachment);
+					if(m_hrError==S_OK)
 					{
 						if (szFileName != NULL)
 						{
@@ -612,6 +677,7 @@ BOOL CMAPIObject::SaveAttachment(LPCTSTR szFolder, int nIndex, LPCTSTR szFileNam
 		}
 	}
 	RELEASE(pAttachTable);
+	if(!bResult && m_hrError==S_OK) m_hrError=MAPI_E_NOT_FOUND;
 	return bResult;
 }
 
@@ -783,6 +849,25 @@ BOOL CMAPIObject::GetHTML(CString& strHTML)
 	return GetPropertyString(PR_BODY_HTML, strHTML, TRUE);
 }
 
+// Gets the HTML body converted to plain text (for indexing etc), decoded straight from the PR_HTML byte stream
+BOOL CMAPIObject::GetHTMLText(CString& strText)
+{
+	strText=_T("");
+	if(!m_pItem) return FALSE;
+
+	IStream* pStream;
+	if(Message()->OpenProperty(PR_HTML, &IID_IStream, STGM_READ, 0, (LPUNKNOWN*)&pStream)!=S_OK)
+	{
+		if(Message()->OpenProperty(PR_BODY_HTML_A, &IID_IStream, STGM_READ, 0, (LPUNKNOWN*)&pStream)!=S_OK) return FALSE;
+	}
+
+	// PR_HTML is stored in the message's internet code page, without it the extractor looks for a <meta> charset
+	UINT nCodePage=(UINT)GetPropertyValue(PR_INTERNET_CPID, CP_ACP);
+	BOOL bResult=CMAPIHTMLText::Extract(pStream, strText, nCodePage);
+	RELEASE(pStream);
+	return bResult;
+}
+
 BOOL CMAPIObject::SetHTML(LPCTSTR szHTML)
 {
 	if(szHTML)
@@ -799,16 +884,13 @@ BOOL CMAPIObject::SetHTML(LPCTSTR szHTML)
 		} 
 		else 
 		{
-			// otherwise lets encode it into RTF 
-			TCHAR szCodePage[6]=_T("1252"); // default codepage is ANSI - Latin I
-			GetLocaleInfo(LOCALE_SYSTEM_DEFAULT, LOCALE_IDEFAULTANSICODEPAGE, szCodePage, sizeof(szCodePage));
-
-			CString strRTF;
-			strRTF.Format(_T("{\\rtf1\\ansi\\ansicpg%s\\fromhtml1 {\\*\\htmltag1 "), szCodePage);
-			strRTF+=szHTML;
-			strRTF+=_T(" }}");
-
-			return SetRTF(strRTF);
+			// otherwise lets encode it into RTF, streamed so large bodies are never copied
+			CMAPIRTFStream rtf;
+			if(rtf.Open(Message()) && rtf.WriteHTML(szHTML) && rtf.Close())
+			{
+				SetMessageEditorFormat(EDITOR_FORMAT_RTF);
+				return TRUE;
+			}
 		}
 	}
 	return FALSE;
@@ -887,6 +969,7 @@ BOOL CMAPIObject::GetRTF(CString& strRTF)
 		// Ignore \pntext{..} and \liN and \fi-N. These are RTF junk.
 		// Convert \par and \tab into \r\n and \t
 		// Convert \'XX into the ascii character indicated by the hex number XX
+		// Convert \uN into the UTF-16 unit N and skip the \ucN (default 1) fallback characters after it
 		// Convert \{ and \} into { and }. This is how RTF escapes its curly braces.
 		// When we get \*\mhtmltagN, keep the tag, but ignore the subsequent \*\htmltagN
 		// When we get \*\htmltagN, keep the tag as long as it isn't subsequent to a \*\mhtmltagN
@@ -898,7 +981,10 @@ BOOL CMAPIObject::GetRTF(CString& strRTF)
 			s++;
 		}
 
-		int nTag=-1, nIgnoreTag=-1;
+		int nTag=-1, nIgnoreTag=-1, nSkip=1;
+#ifndef UNICODE
+		WCHAR wchHigh=0;
+#endif
 		while(*s) 
 		{
 			if(*s==(TCHAR)'{') s++;
@@ -959,6 +1045,55 @@ BOOL CMAPIObject::GetRTF(CString& strRTF)
 				while(*s>=(TCHAR)'0' && *s<=(TCHAR)'9') s++; 
 				if(*s==(TCHAR)' ') s++;
 			} 
+			else if(_tcsnccmp(s, _T("\\uc"),3)==0 && _istdigit(s[3])) 
+			{
+				s+=3;
+				nSkip=0;
+				while(*s>=(TCHAR)'0' && *s<=(TCHAR)'9') 
+				{
+					nSkip=nSkip*10+*s-(TCHAR)'0';
+					s++;
+				}
+				if(*s==(TCHAR)' ') s++;
+			} 
+			else if(_tcsnccmp(s, _T("\\u"),2)==0 && (_istdigit(s[2]) || (s[2]==(TCHAR)'-' && _istdigit(s[3])))) 
+			{
+				// signed 16 bit, so characters above 0x7FFF come in negative
+				s+=2;
+				BOOL bNegative=(*s==(TCHAR)'-');
+				if(bNegative) s++;
+				int nValue=0;
+				while(*s>=(TCHAR)'0' && *s<=(TCHAR)'9') 
+				{
+					nValue=nValue*10+*s-(TCHAR)'0';
+					s++;
+				}
+				if(*s==(TCHAR)' ') s++;
+				WCHAR wch=(WCHAR)(bNegative ? -nValue : nValue);
+#ifdef UNICODE
+				strText+=wch;
+#else
+				// a surrogate pair is converted once both halves are in
+				if(wch>=0xD800 && wch<0xDC00) wchHigh=wch;
+				else
+				{
+					WCHAR wsz[2]={ wchHigh, wch };
+					int nUnits=(wchHigh && wch>=0xDC00 && wch<0xE000) ? 2 : 1;
+					char szBytes[8];
+					int nBytes=WideCharToMultiByte(CP_ACP, 0, wsz+2-nUnits, nUnits, szBytes, sizeof(szBytes), NULL, NULL);
+					for(int i=0;i<nBytes;i++) strText+=szBytes[i];
+					wchHigh=0;
+				}
+#endif
+
+				// the fallback is plain characters or \'XX, another control word or a group ends it
+				for(int i=0;i<nSkip && *s && *s!=(TCHAR)'{' && *s!=(TCHAR)'}';i++) 
+				{
+					if(_tcsnccmp(s, _T("\\'"),2)==0) s+=(s[2] && s[3]) ? 4 : 2;
+					else if(*s==(TCHAR)'\\') break;
+					else s++;
+				}
+			} 
 			else if(_tcsnccmp(s, _T("\\'"),2)==0) 
 			{ 
 				TCHAR hi=s[2], lo=s[3];
@@ -990,6 +1125,11 @@ BOOL CMAPIObject::GetRTF(CString& strRTF)
 					s++;
 				}
 			} 
+			else if(_tcsnccmp(s, _T("\\\\"),2)==0) 
+			{ 
+				strText+='\\';
+				s+=2;
+			} 
 			else if(_tcsnccmp(s, _T("\\{"),2)==0) 
 			{ 
 				strText+='{';
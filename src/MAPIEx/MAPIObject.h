@@ -31,13 +31,17 @@ public:
 protected:
 	CMAPIEx* m_pMAPI;
 	IMAPIProp* m_pItem;
-	SBinary m_entryID;
+	CMAPIEntryID m_entryID;
+	HRESULT m_hrError;
 
 // Operations
 public:
 	inline LPMESSAGE Message() { return (LPMESSAGE)m_pItem; }
+	CMAPIEx* GetMAPI() { return m_pMAPI; }
+	HRESULT GetError() { return m_hrError; } // of the last Open, Create, SaveAttachment or Send
 
-	SBinary* GetEntryID() { return &m_entryID; }
+	SBinary* GetEntryID() { return m_entryID.GetBinary(); }
+	const CMAPIEntryID& EntryID() { return m_entryID; }
 	BOOL GetEntryIDString(CString& strEntryID);
 	void SetEntryID(SBinary* pEntryID=NULL);
 	int GetMessageFlags();
@@ -57,6 +61,9 @@ public:
 	BOOL GetNamedProperty(LPCTSTR szFieldName, CString& strField);
 	BOOL GetOutlookProperty(ULONG ulData, ULONG ulProperty, LPSPropValue& pProp);
 	BOOL GetOutlookPropertyString(ULONG ulData, ULONG ulProperty, CString& strProperty);
+	BOOL GetProperties(LPSPropTagArray pTags, CMAPIProperties& props);
+	BOOL GetNamedProperties(LPCTSTR* szFieldNames, int nCount, CMAPIProperties& props);
+	BOOL GetOutlookProperties(ULONG ulData, const ULONG* pulProperties, int nCount, CMAPIProperties& props);
 	virtual BOOL SetPropertyString(ULONG ulProperty, LPCTSTR szProperty, BOOL bStream=FALSE);
 	BOOL SetNamedProperty(LPCTSTR szFieldName, LPCTSTR szField, BOOL bCreate=TRUE);
 	BOOL SetNamedMVProperty(LPCTSTR szFieldName, LPCTSTR* arCategories, int nCount, LPSPropValue &pProp, BOOL bCreate=TRUE);
@@ -77,6 +84,7 @@ public:
 	BOOL GetBody(CString& strBody, BOOL bAutoDetect=TRUE);
 	BOOL SetBody(LPCTSTR szBody);
 	BOOL GetHTML(CString& strHTML);
+	BOOL GetHTMLText(CString& strText);
 	BOOL SetHTML(LPCTSTR szHTML);
 	BOOL GetRTF(CString& strRTF);
 	BOOL SetRTF(LPCTSTR szRTF);
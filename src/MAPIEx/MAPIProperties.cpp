@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIProperties.cpp
+// Description: Owner of a MAPI allocated property array with non-copying accessors
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CMAPIProperties
+
+CMAPIProperties::CMAPIProperties()
+{
+	m_pProps=NULL;
+	m_ulCount=0;
+}
+
+CMAPIProperties::~CMAPIProperties()
+{
+	Release();
+}
+
+// takes ownership of a MAPIAllocateBuffer'd array (ie from GetProps)
+void CMAPIProperties::Attach(LPSPropValue pProps, ULONG ulCount)
+{
+	Release();
+	m_pProps=pProps;
+	m_ulCount=pProps ? ulCount : 0;
+}
+
+// gives up ownership, the caller must MAPIFreeBuffer the result
+LPSPropValue CMAPIProperties::Detach()
+{
+	LPSPropValue pProps=m_pProps;
+	m_pProps=NULL;
+	m_ulCount=0;
+	return pProps;
+}
+
+void CMAPIProperties::Release()
+{
+	if(m_pProps) MAPIFreeBuffer(m_pProps);
+	m_pProps=NULL;
+	m_ulCount=0;
+}
+
+// returns NULL if the property at nIndex is missing (PT_ERROR)
+LPSPropValue CMAPIProperties::GetProp(int nIndex)
+{
+	if(nIndex<0 || (ULONG)nIndex>=m_ulCount) return NULL;
+	if(PROP_TYPE(m_pProps[nIndex].ulPropTag)==PT_ERROR) return NULL;
+	return &m_pProps[nIndex];
+}
+
+// searches by property ID, pass a PT_UNSPECIFIED tag to accept any type
+LPSPropValue CMAPIProperties::FindProp(ULONG ulPropTag)
+{
+	for(ULONG i=0;i<m_ulCount;i++)
+	{
+		if(PROP_ID(m_pProps[i].ulPropTag)!=PROP_ID(ulPropTag)) continue;
+		ULONG ulType=PROP_TYPE(m_pProps[i].ulPropTag);
+		if(ulType==PT_ERROR) return NULL;
+		if(PROP_TYPE(ulPropTag)==PT_UNSPECIFIED || ulType==PROP_TYPE(ulPropTag)) return &m_pProps[i];
+	}
+	return NULL;
+}
+
+LPCTSTR CMAPIProperties::GetString(int nIndex)
+{
+	LPSPropValue pProp=GetProp(nIndex);
+	if(!pProp || PROP_TYPE(pProp->ulPropTag)!=PT_TSTRING) return NULL;
+	return pProp->Value.LPSZ;
+}
+
+// returns the length of the string or -1 if it is missing
+int CMAPIProperties::GetString(int nIndex, LPCTSTR& szValue)
+{
+	szValue=GetString(nIndex);
+	return szValue ? (int)_tcslen(szValue) : -1;
+}
+
+SBinary* CMAPIProperties::GetBinary(int nIndex)
+{
+	LPSPropValue pProp=GetProp(nIndex);
+	if(!pProp || PROP_TYPE(pProp->ulPropTag)!=PT_BINARY) return NULL;
+	return &pProp->Value.bin;
+}
+
+int CMAPIProperties::GetLong(int nIndex, int nDefaultValue)
+{
+	LPSPropValue pProp=GetProp(nIndex);
+	if(!pProp || PROP_TYPE(pProp->ulPropTag)!=PT_LONG) return nDefaultValue;
+	return pProp->Value.l;
+}
+
+BOOL CMAPIProperties::GetBoolean(int nIndex, BOOL bDefaultValue)
+{
+	LPSPropValue pProp=GetProp(nIndex);
+	if(!pProp || PROP_TYPE(pProp->ulPropTag)!=PT_BOOLEAN) return bDefaultValue;
+	return (pProp->Value.b!=0);
+}
+
+// the raw UTC value
+BOOL CMAPIProperties::GetFileTime(int nIndex, FILETIME& ftValue)
+{
+	LPSPropValue pProp=GetProp(nIndex);
+	if(!pProp || PROP_TYPE(pProp->ulPropTag)!=PT_SYSTIME) return FALSE;
+	ftValue=pProp->Value.ft;
+	return TRUE;
+}
+
+// converted to local time the same way CMAPIMessage::GetReceivedTime does
+BOOL CMAPIProperties::GetSystemTime(int nIndex, SYSTEMTIME& tmValue)
+{
+	FILETIME ft, ftLocal;
+	if(!GetFileTime(nIndex, ft)) return FALSE;
+	FileTimeToLocalFileTime(&ft, &ftLocal);
+	return FileTimeToSystemTime(&ftLocal, &tmValue);
+}
@@ -0,0 +1,64 @@
+#ifndef __MAPIPROPERTIES_H__
+#define __MAPIPROPERTIES_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIProperties.h
+// Description: Owner of a MAPI allocated property array with non-copying accessors
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIProperties
+
+// Holds the SPropValue array returned by one GetProps call and frees it with MAPIFreeBuffer when it goes out
+// of scope or is reloaded.  Strings and binaries returned point into that buffer (nothing is copied) and stay
+// valid until then.  Values are looked up by their position in the requested tag array:
+//
+//		enum { PROP_SUBJECT, PROP_SIZE, MESSAGE_COLS };
+//		SizedSPropTagArray(MESSAGE_COLS, Tags)={ MESSAGE_COLS, { PR_SUBJECT, PR_MESSAGE_SIZE } };
+//		CMAPIProperties props;
+//		if(message.GetProperties((LPSPropTagArray)&Tags, props)) szSubject=props.GetString(PROP_SUBJECT);
+class AFX_EXT_CLASS CMAPIProperties
+{
+public:
+	CMAPIProperties();
+	~CMAPIProperties();
+
+// Attributes
+protected:
+	LPSPropValue m_pProps;
+	ULONG m_ulCount;
+
+// Operations
+public:
+	void Attach(LPSPropValue pProps, ULONG ulCount);
+	LPSPropValue Detach();
+	void Release();
+
+	ULONG GetCount() { return m_ulCount; }
+	LPSPropValue GetProps() { return m_pProps; }
+	LPSPropValue GetProp(int nIndex);
+	LPSPropValue FindProp(ULONG ulPropTag);
+
+	LPCTSTR GetString(int nIndex);
+	int GetString(int nIndex, LPCTSTR& szValue);
+	SBinary* GetBinary(int nIndex);
+	int GetLong(int nIndex, int nDefaultValue=0);
+	BOOL GetBoolean(int nIndex, BOOL bDefaultValue=FALSE);
+	BOOL GetFileTime(int nIndex, FILETIME& ftValue);
+	BOOL GetSystemTime(int nIndex, SYSTEMTIME& tmValue);
+
+private:
+	CMAPIProperties(const CMAPIProperties&);
+	CMAPIProperties& operator=(const CMAPIProperties&);
+};
+
+#endif
@@ -0,0 +1,271 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIRTFStream.cpp
+// Description: Streaming writer that encapsulates HTML into compressed RTF (\fromhtml)
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CMAPIRTFStream
+
+CMAPIRTFStream::CMAPIRTFStream()
+{
+	m_pStream=NULL;
+	m_pUncompressed=NULL;
+	m_nCodePage=CP_ACP;
+	m_nState=STATE_TEXT;
+	m_nTagLength=0;
+	m_nDashes=0;
+	m_chQuote=0;
+	m_hr=S_OK;
+	m_nBufferLength=0;
+}
+
+CMAPIRTFStream::~CMAPIRTFStream()
+{
+	Abort();
+}
+
+// opens PR_RTF_COMPRESSED for writing and emits the \fromhtml header
+BOOL CMAPIRTFStream::Open(LPMESSAGE pMessage)
+{
+	Abort();
+#ifdef _WIN32_WCE
+	return FALSE;
+#else
+	if(!pMessage) return FALSE;
+	if(pMessage->OpenProperty(PR_RTF_COMPRESSED, &IID_IStream, STGM_CREATE | STGM_WRITE, MAPI_MODIFY | MAPI_CREATE, (LPUNKNOWN*)&m_pStream)!=S_OK) return FALSE;
+	if(WrapCompressedRTFStream(m_pStream, MAPI_MODIFY, &m_pUncompressed)!=S_OK)
+	{
+		RELEASE(m_pStream);
+		return FALSE;
+	}
+
+	m_nCodePage=GetACP();
+	m_nState=STATE_TEXT;
+	m_nTagLength=0;
+	m_nDashes=0;
+	m_chQuote=0;
+	m_hr=S_OK;
+	m_nBufferLength=0;
+
+	char szHeader[128];
+	sprintf_s(szHeader, sizeof(szHeader), "{\\rtf1\\ansi\\ansicpg%u\\fromhtml1 \\deff0{\\fonttbl{\\f0\\fswiss Arial;}}\r\n", m_nCodePage);
+	Write(szHeader);
+	return (m_hr==S_OK);
+#endif
+}
+
+// feed the HTML in as many pieces as you like, tags may be split across calls
+BOOL CMAPIRTFStream::WriteHTML(LPCTSTR szHTML, int nLength)
+{
+	if(!m_pUncompressed || !szHTML) return FALSE;
+	if(nLength<0) nLength=(int)_tcslen(szHTML);
+
+	for(int i=0;i<nLength && m_hr==S_OK;i++)
+	{
+		TCHAR ch=szHTML[i];
+		if(m_nState==STATE_TEXT)
+		{
+			if(ch==(TCHAR)'<')
+			{
+				BeginTag();
+				Put('<');
+			}
+			else PutEscaped(ch);
+		}
+		else if(m_nState==STATE_TAG)
+		{
+			static const TCHAR szComment[]=_T("<!--");
+
+			PutEscaped(ch);
+			m_nTagLength++;
+
+			// m_nDashes counts how much of "<!--" the tag has matched so far; comments may contain '>'
+			// and quotes and only end at "-->"
+			if(m_nTagLength<=4 && m_nDashes==m_nTagLength-1 && ch==szComment[m_nTagLength-1])
+			{
+				if(++m_nDashes==4)
+				{
+					m_nState=STATE_COMMENT;
+					m_nDashes=0;
+				}
+			}
+			else if(m_chQuote)
+			{
+				if(ch==m_chQuote) m_chQuote=0;
+			}
+			else if(ch==(TCHAR)'"' || ch==(TCHAR)'\'')
+			{
+				m_chQuote=ch;
+			}
+			else if(ch==(TCHAR)'>')
+			{
+				EndTag();
+			}
+		}
+		else
+		{
+			PutEscaped(ch);
+			if(ch==(TCHAR)'-') m_nDashes++;
+			else
+			{
+				if(ch==(TCHAR)'>' && m_nDashes>=2) EndTag();
+				m_nDashes=0;
+			}
+		}
+	}
+	return (m_hr==S_OK);
+}
+
+// closes any open group, writes the trailer and commits both streams
+BOOL CMAPIRTFStream::Close()
+{
+	if(!m_pUncompressed) return FALSE;
+
+	if(m_nState!=STATE_TEXT) EndTag();
+	Write("}\r\n");
+	Flush();
+
+	if(m_hr==S_OK)
+	{
+		m_hr=m_pUncompressed->Commit(STGC_DEFAULT);
+		if(m_hr==S_OK) m_hr=m_pStream->Commit(STGC_DEFAULT);
+	}
+	BOOL bResult=(m_hr==S_OK);
+	Abort();
+	return bResult;
+}
+
+// releases the streams without committing
+void CMAPIRTFStream::Abort()
+{
+	RELEASE(m_pUncompressed);
+	RELEASE(m_pStream);
+	m_nBufferLength=0;
+	m_nState=STATE_TEXT;
+}
+
+void CMAPIRTFStream::BeginTag()
+{
+	char szTag[32];
+	sprintf_s(szTag, sizeof(szTag), "{\\*\\htmltag%d ", HTMLTAG_PARAMETER);
+	Write(szTag);
+	m_nState=STATE_TAG;
+	m_nTagLength=1;
+	m_nDashes=1;
+	m_chQuote=0;
+}
+
+void CMAPIRTFStream::EndTag()
+{
+	Put('}');
+	m_nState=STATE_TEXT;
+	m_nTagLength=0;
+	m_nDashes=0;
+	m_chQuote=0;
+}
+
+void CMAPIRTFStream::Write(LPCSTR szText)
+{
+	while(*szText) Put(*szText++);
+}
+
+void CMAPIRTFStream::Put(char ch)
+{
+	if(m_nBufferLength==BUFFER_SIZE) Flush();
+	m_szBuffer[m_nBufferLength++]=ch;
+}
+
+// escapes RTF specials, line breaks become \par so CMAPIObject::GetRTF restores them as CRLF
+void CMAPIRTFStream::PutEscaped(TCHAR ch)
+{
+	static const char szHex[]="0123456789abcdef";
+
+	switch(ch)
+	{
+	case (TCHAR)'\\':
+	case (TCHAR)'{':
+	case (TCHAR)'}':
+		Put('\\');
+		Put((char)ch);
+		return;
+	case (TCHAR)'\r':
+		return;
+	case (TCHAR)'\n':
+		Write("\\par\r\n");
+		return;
+	case (TCHAR)'\t':
+		Write("\\tab ");
+		return;
+	}
+
+#ifdef UNICODE
+	if((unsigned)ch>=0x80)
+	{
+		char szBytes[4];
+		BOOL bUsedDefault=FALSE;
+		int nBytes=WideCharToMultiByte(m_nCodePage, WC_NO_BEST_FIT_CHARS, &ch, 1, szBytes, sizeof(szBytes), NULL, &bUsedDefault);
+		if(!nBytes || bUsedDefault)
+		{
+			// not in the code page: \uN (signed 16 bit, space delimited) followed by a single byte fallback for older readers,
+			// the best fit character when there is one (\uc1 is the default skip count)
+			char szUnicode[16];
+			sprintf_s(szUnicode, sizeof(szUnicode), "\\u%d ", (int)(short)ch);
+			Write(szUnicode);
+
+			char chFallback='?';
+			if(WideCharToMultiByte(m_nCodePage, 0, &ch, 1, szBytes, sizeof(szBytes), NULL, NULL)==1 && (BYTE)szBytes[0]>=0x20) chFallback=szBytes[0];
+			if((BYTE)chFallback>=0x80 || chFallback=='\\' || chFallback=='{' || chFallback=='}')
+			{
+				Put('\\');
+				Put('\'');
+				Put(szHex[(BYTE)chFallback>>4]);
+				Put(szHex[(BYTE)chFallback&0x0F]);
+			}
+			else Put(chFallback);
+			return;
+		}
+		for(int i=0;i<nBytes;i++)
+		{
+			Put('\\');
+			Put('\'');
+			Put(szHex[(BYTE)szBytes[i]>>4]);
+			Put(szHex[(BYTE)szBytes[i]&0x0F]);
+		}
+		return;
+	}
+#else
+	if((BYTE)ch>=0x80)
+	{
+		Put('\\');
+		Put('\'');
+		Put(szHex[(BYTE)ch>>4]);
+		Put(szHex[(BYTE)ch&0x0F]);
+		return;
+	}
+#endif
+	Put((char)ch);
+}
+
+BOOL CMAPIRTFStream::Flush()
+{
+	if(m_nBufferLength && m_pUncompressed && m_hr==S_OK)
+	{
+		ULONG ulWritten=0;
+		m_hr=m_pUncompressed->Write(m_szBuffer, m_nBufferLength, &ulWritten);
+		if(m_hr==S_OK && ulWritten!=(ULONG)m_nBufferLength) m_hr=STG_E_WRITEFAULT;
+	}
+	m_nBufferLength=0;
+	return (m_hr==S_OK);
+}
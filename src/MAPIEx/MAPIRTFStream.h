@@ -0,0 +1,69 @@
+#ifndef __MAPIRTFSTREAM_H__
+#define __MAPIRTFSTREAM_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIRTFStream.h
+// Description: Streaming writer that encapsulates HTML into compressed RTF (\fromhtml)
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIRTFStream
+
+// Writes HTML into PR_RTF_COMPRESSED for stores without STORE_HTML_OK.  Each HTML tag is wrapped in its
+// own {\*\htmltagN ...} group and text is escaped, so the HTML can be fed in chunks of any size without
+// ever holding the whole body in memory:
+//
+//		CMAPIRTFStream rtf;
+//		if(rtf.Open(message.Message()))
+//		{
+//			while(...) rtf.WriteHTML(szChunk);
+//			rtf.Close();
+//		}
+class AFX_EXT_CLASS CMAPIRTFStream
+{
+public:
+	CMAPIRTFStream();
+	~CMAPIRTFStream();
+
+	enum { BUFFER_SIZE=8192, HTMLTAG_PARAMETER=1 };
+	enum { STATE_TEXT, STATE_TAG, STATE_COMMENT };
+
+// Attributes
+protected:
+	LPSTREAM m_pStream;
+	LPSTREAM m_pUncompressed;
+	UINT m_nCodePage;
+	int m_nState;
+	int m_nTagLength;
+	int m_nDashes;
+	TCHAR m_chQuote;
+	HRESULT m_hr;
+	int m_nBufferLength;
+	char m_szBuffer[BUFFER_SIZE];
+
+// Operations
+public:
+	BOOL Open(LPMESSAGE pMessage);
+	BOOL WriteHTML(LPCTSTR szHTML, int nLength=-1);
+	BOOL Close();
+	void Abort();
+
+protected:
+	void Write(LPCSTR szText);
+	void Put(char ch);
+	void PutEscaped(TCHAR ch);
+	void BeginTag();
+	void EndTag();
+	BOOL Flush();
+};
+
+#endif
@@ -0,0 +1,379 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIRecurrence.cpp
+// Description: Parses the recurrence of an appointment and lists its occurrences
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceException
+
+CRecurrenceException::CRecurrenceException()
+{
+	m_dwStart=m_dwEnd=m_dwOriginalStart=0;
+	m_wOverrideFlags=0;
+	m_nBusyStatus=-1;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPIRecurrence
+
+CMAPIRecurrence::CMAPIRecurrence()
+{
+	m_pPattern=new CRecurrencePattern;
+	m_nCodePage=CP_ACP;
+	Empty();
+}
+
+CMAPIRecurrence::~CMAPIRecurrence()
+{
+	delete m_pPattern;
+}
+
+void CMAPIRecurrence::Empty()
+{
+	m_pPattern->Empty();
+	CopyPattern();
+	CopyTimeZone();
+}
+
+// Reads an AppointmentRecurrencePattern, see CRecurrencePattern::Parse.  The time zone set by SetTimeZone is kept
+BOOL CMAPIRecurrence::Parse(const BYTE* pData, ULONG cb)
+{
+	BOOL bParsed=m_pPattern->Parse(pData, cb);
+	if(!bParsed) m_pPattern->EmptyPattern();
+	CopyPattern();
+	return bParsed;
+}
+
+// pData is a TimeZoneStruct (TZREG), without one the blob's times are treated as UTC
+BOOL CMAPIRecurrence::SetTimeZone(const BYTE* pData, ULONG cb)
+{
+	BOOL bSet=m_pPattern->SetTimeZone(pData, cb);
+	CopyTimeZone();
+	return bSet;
+}
+
+// Sets the time zone from pTZI laid out as a TimeZoneStruct, NULL for UTC
+BOOL CMAPIRecurrence::SetTimeZone(const TIME_ZONE_INFORMATION* pTZI)
+{
+	if(!pTZI)
+	{
+		SetTimeZone(NULL, 0);
+		return TRUE;
+	}
+
+	BYTE data[TIMEZONE_STRUCT_SIZE];
+	memcpy(data, &pTZI->Bias, sizeof(LONG));
+	memcpy(data+4, &pTZI->StandardBias, sizeof(LONG));
+	memcpy(data+8, &pTZI->DaylightBias, sizeof(LONG));
+	memcpy(data+12, &pTZI->StandardDate.wYear, sizeof(WORD));
+	memcpy(data+14, &pTZI->StandardDate, sizeof(SYSTEMTIME));
+	memcpy(data+30, &pTZI->DaylightDate.wYear, sizeof(WORD));
+	memcpy(data+32, &pTZI->DaylightDate, sizeof(SYSTEMTIME));
+	return SetTimeZone(data, TIMEZONE_STRUCT_SIZE);
+}
+
+// Sets the pattern from an iCalendar RRULE, dwStart and dwEnd are the first instance in local minutes of the
+// time zone set first, see CRecurrencePattern::ParseRule
+BOOL CMAPIRecurrence::ParseRule(LPCSTR szRule, DWORD dwStart, DWORD dwEnd)
+{
+	BOOL bParsed=m_pPattern->ParseRule(szRule, dwStart, dwEnd);
+	if(!bParsed) m_pPattern->EmptyPattern();
+	CopyPattern();
+	return bParsed;
+}
+
+// deletes the occurrence originally starting at dwOriginalStart (local minutes)
+void CMAPIRecurrence::DeleteOccurrence(DWORD dwOriginalStart)
+{
+	UpdatePattern();
+	m_pPattern->DeleteOccurrence(dwOriginalStart);
+	CopyPattern();
+}
+
+// the AppointmentRecur blob for the pattern, see CRecurrencePattern::Write
+void CMAPIRecurrence::Write(CByteArray& arData)
+{
+	UpdatePattern();
+	std::vector<uint8_t> arPattern;
+	m_pPattern->Write(arPattern);
+	arData.SetSize((INT_PTR)arPattern.size());
+	if(arPattern.size()) memcpy(arData.GetData(), &arPattern[0], arPattern.size());
+}
+
+// the TimeZoneStruct blob, FALSE if the pattern has no time zone
+BOOL CMAPIRecurrence::WriteTimeZone(CByteArray& arData)
+{
+	UpdatePattern();
+	std::vector<uint8_t> arTimeZone;
+	BOOL bTimeZone=m_pPattern->WriteTimeZone(arTimeZone);
+	arData.SetSize((INT_PTR)arTimeZone.size());
+	if(arTimeZone.size()) memcpy(arData.GetData(), &arTimeZone[0], arTimeZone.size());
+	return bTimeZone;
+}
+
+void CMAPIRecurrence::CopyPattern()
+{
+	const CRecurrencePattern& pattern=*m_pPattern;
+	m_wFrequency=pattern.m_wFrequency;
+	m_wPatternType=pattern.m_wPatternType;
+	m_wCalendarType=pattern.m_wCalendarType;
+	m_dwFirstDateTime=pattern.m_dwFirstDateTime;
+	m_dwPeriod=pattern.m_dwPeriod;
+	m_dwDayMask=pattern.m_dwDayMask;
+	m_dwDayOfMonth=pattern.m_dwDayOfMonth;
+	m_dwEndType=pattern.m_dwEndType;
+	m_dwOccurrenceCount=pattern.m_dwOccurrenceCount;
+	m_dwFirstDOW=pattern.m_dwFirstDOW;
+	m_dwStartDate=pattern.m_dwStartDate;
+	m_dwEndDate=pattern.m_dwEndDate;
+	m_dwStartTimeOffset=pattern.m_dwStartTimeOffset;
+	m_dwEndTimeOffset=pattern.m_dwEndTimeOffset;
+
+	int i, nCount=(int)pattern.m_arDeletedDates.size();
+	m_arDeletedDates.SetSize(nCount);
+	for(i=0;i<nCount;i++) m_arDeletedDates[i]=pattern.m_arDeletedDates[i];
+	nCount=(int)pattern.m_arModifiedDates.size();
+	m_arModifiedDates.SetSize(nCount);
+	for(i=0;i<nCount;i++) m_arModifiedDates[i]=pattern.m_arModifiedDates[i];
+	nCount=(int)pattern.m_arExceptionOrder.size();
+	m_arExceptionOrder.SetSize(nCount);
+	for(i=0;i<nCount;i++) m_arExceptionOrder[i]=pattern.m_arExceptionOrder[i];
+
+	// the UTF-16 strings of the ExtendedException replace the ANSI ones when they were read
+	nCount=(int)pattern.m_arExceptions.size();
+	m_arExceptions.SetSize(nCount);
+	for(i=0;i<nCount;i++)
+	{
+		const CRecurrencePatternException& source=pattern.m_arExceptions[i];
+		CRecurrenceException& exception=m_arExceptions[i];
+		exception.m_dwStart=source.m_dwStart;
+		exception.m_dwEnd=source.m_dwEnd;
+		exception.m_dwOriginalStart=source.m_dwOriginalStart;
+		exception.m_wOverrideFlags=source.m_wOverrideFlags;
+		exception.m_nBusyStatus=source.m_nBusyStatus;
+		if(source.m_bExtended)
+		{
+			exception.m_strSubject=CStringW(source.m_arSubjectW.size() ? (LPCWSTR)&source.m_arSubjectW[0] : L"", (int)source.m_arSubjectW.size());
+			exception.m_strLocation=CStringW(source.m_arLocationW.size() ? (LPCWSTR)&source.m_arLocationW[0] : L"", (int)source.m_arLocationW.size());
+		}
+		else
+		{
+			exception.m_strSubject=ToWide(source.m_strSubject, m_nCodePage);
+			exception.m_strLocation=ToWide(source.m_strLocation, m_nCodePage);
+		}
+	}
+}
+
+void CMAPIRecurrence::CopyTimeZone()
+{
+	const CRecurrencePattern& pattern=*m_pPattern;
+	m_bTimeZone=pattern.m_bTimeZone;
+	m_lBias=pattern.m_lBias;
+	m_lStandardBias=pattern.m_lStandardBias;
+	m_lDaylightBias=pattern.m_lDaylightBias;
+	memcpy(&m_tmStandardDate, &pattern.m_tmStandardDate, sizeof(SYSTEMTIME));
+	memcpy(&m_tmDaylightDate, &pattern.m_tmDaylightDate, sizeof(SYSTEMTIME));
+}
+
+// copies the attributes back into the pattern so edits to them are written and expanded.  Both the ANSI and
+// the UTF-16 exception strings are set so CRecurrencePattern::Write doesn't have to guess the code page
+void CMAPIRecurrence::UpdatePattern()
+{
+	CRecurrencePattern& pattern=*m_pPattern;
+	pattern.m_wFrequency=m_wFrequency;
+	pattern.m_wPatternType=m_wPatternType;
+	pattern.m_wCalendarType=m_wCalendarType;
+	pattern.m_dwFirstDateTime=m_dwFirstDateTime;
+	pattern.m_dwPeriod=m_dwPeriod;
+	pattern.m_dwDayMask=m_dwDayMask;
+	pattern.m_dwDayOfMonth=m_dwDayOfMonth;
+	pattern.m_dwEndType=m_dwEndType;
+	pattern.m_dwOccurrenceCount=m_dwOccurrenceCount;
+	pattern.m_dwFirstDOW=m_dwFirstDOW;
+	pattern.m_dwStartDate=m_dwStartDate;
+	pattern.m_dwEndDate=m_dwEndDate;
+	pattern.m_dwStartTimeOffset=m_dwStartTimeOffset;
+	pattern.m_dwEndTimeOffset=m_dwEndTimeOffset;
+
+	int i, nCount=(int)m_arDeletedDates.GetSize();
+	pattern.m_arDeletedDates.resize(nCount);
+	for(i=0;i<nCount;i++) pattern.m_arDeletedDates[i]=m_arDeletedDates[i];
+	nCount=(int)m_arModifiedDates.GetSize();
+	pattern.m_arModifiedDates.resize(nCount);
+	for(i=0;i<nCount;i++) pattern.m_arModifiedDates[i]=m_arModifiedDates[i];
+	nCount=(int)m_arExceptionOrder.GetSize();
+	pattern.m_arExceptionOrder.resize(nCount);
+	for(i=0;i<nCount;i++) pattern.m_arExceptionOrder[i]=m_arExceptionOrder[i];
+
+	nCount=(int)m_arExceptions.GetSize();
+	pattern.m_arExceptions.resize(nCount);
+	for(i=0;i<nCount;i++)
+	{
+		const CRecurrenceException& source=m_arExceptions[i];
+		CRecurrencePatternException& exception=pattern.m_arExceptions[i];
+		exception.m_dwStart=source.m_dwStart;
+		exception.m_dwEnd=source.m_dwEnd;
+		exception.m_dwOriginalStart=source.m_dwOriginalStart;
+		exception.m_wOverrideFlags=source.m_wOverrideFlags;
+		exception.m_nBusyStatus=source.m_nBusyStatus;
+
+		CStringW strSubject(source.m_strSubject), strLocation(source.m_strLocation);
+		exception.m_strSubject=ToAnsi(strSubject, m_nCodePage);
+		exception.m_strLocation=ToAnsi(strLocation, m_nCodePage);
+		exception.m_arSubjectW.assign((LPCWSTR)strSubject, (LPCWSTR)strSubject+strSubject.GetLength());
+		exception.m_arLocationW.assign((LPCWSTR)strLocation, (LPCWSTR)strLocation+strLocation.GetLength());
+		exception.m_bExtended=true;
+	}
+
+	pattern.m_bTimeZone=(m_bTimeZone!=FALSE);
+	pattern.m_lBias=m_lBias;
+	pattern.m_lStandardBias=m_lStandardBias;
+	pattern.m_lDaylightBias=m_lDaylightBias;
+	memcpy(&pattern.m_tmStandardDate, &m_tmStandardDate, sizeof(SYSTEMTIME));
+	memcpy(&pattern.m_tmDaylightDate, &m_tmDaylightDate, sizeof(SYSTEMTIME));
+}
+
+// the pattern with the attributes copied back, for CRecurrenceIterator
+const CRecurrencePattern& CMAPIRecurrence::GetPattern()
+{
+	UpdatePattern();
+	return *m_pPattern;
+}
+
+CStringW CMAPIRecurrence::ToWide(const std::string& strValue, UINT nCodePage)
+{
+	CStringW strWide;
+	int nLength=(int)strValue.size();
+	if(!nLength) return strWide;
+
+	int nWide=MultiByteToWideChar(nCodePage, 0, strValue.c_str(), nLength, NULL, 0);
+	if(nWide<=0) return CStringW(strValue.c_str(), nLength);
+	MultiByteToWideChar(nCodePage, 0, strValue.c_str(), nLength, strWide.GetBuffer(nWide), nWide);
+	strWide.ReleaseBuffer(nWide);
+	return strWide;
+}
+
+std::string CMAPIRecurrence::ToAnsi(const CStringW& strValue, UINT nCodePage)
+{
+	std::string strAnsi;
+	int nLength=strValue.GetLength();
+	if(!nLength) return strAnsi;
+
+	int nBytes=WideCharToMultiByte(nCodePage, 0, strValue, nLength, NULL, 0, NULL, NULL);
+	if(nBytes<=0) return strAnsi;
+	strAnsi.resize(nBytes);
+	WideCharToMultiByte(nCodePage, 0, strValue, nLength, &strAnsi[0], nBytes, NULL, NULL);
+	return strAnsi;
+}
+
+// the Hijri patterns and non Gregorian calendars aren't expanded
+BOOL CMAPIRecurrence::IsSupported()
+{
+	UpdatePattern();
+	return m_pPattern->IsSupported();
+}
+
+// m_dwEndDate is the date of the last occurrence for both END_AFTER_DATE and END_AFTER_COUNT
+BOOL CMAPIRecurrence::HasEndDate()
+{
+	UpdatePattern();
+	return m_pPattern->HasEndDate();
+}
+
+// local minutes of the switches to daylight and back to standard time in nYear, FALSE without daylight time
+BOOL CMAPIRecurrence::GetTransitions(int nYear, DWORD& dwDaylight, DWORD& dwStandard)
+{
+	UpdatePattern();
+	uint32_t dwDaylightLocal, dwStandardLocal;
+	if(!m_pPattern->GetTransitions(nYear, dwDaylightLocal, dwStandardLocal)) return FALSE;
+	dwDaylight=dwDaylightLocal;
+	dwStandard=dwStandardLocal;
+	return TRUE;
+}
+
+DWORD CMAPIRecurrence::FileTimeToMinutes(const FILETIME& ft, BOOL bRoundUp)
+{
+	return CRecurrencePattern::TicksToMinutes(((ULONGLONG)ft.dwHighDateTime<<32)|ft.dwLowDateTime, bRoundUp!=FALSE);
+}
+
+void CMAPIRecurrence::MinutesToFileTime(DWORD dwMinutes, FILETIME& ft)
+{
+	ULONGLONG ullTime=CRecurrencePattern::MinutesToTicks(dwMinutes);
+	ft.dwLowDateTime=(DWORD)ullTime;
+	ft.dwHighDateTime=(DWORD)(ullTime>>32);
+}
+
+// days since 1601-01-01 of a Gregorian date, nMonth is 1 to 12
+int CMAPIRecurrence::DaysFromDate(int nYear, int nMonth, int nDay)
+{
+	return CRecurrencePattern::DaysFromDate(nYear, nMonth, nDay);
+}
+
+void CMAPIRecurrence::DateFromDays(int nDays, int& nYear, int& nMonth, int& nDay)
+{
+	CRecurrencePattern::DateFromDays(nDays, nYear, nMonth, nDay);
+}
+
+int CMAPIRecurrence::GetDaysInMonth(int nYear, int nMonth)
+{
+	return CRecurrencePattern::GetDaysInMonth(nYear, nMonth);
+}
+
+// tm is a TIME_ZONE_INFORMATION style date, either absolute (wYear set) or the wDay'th (5 is last)
+// wDayOfWeek of wMonth
+DWORD CMAPIRecurrence::GetTransition(int nYear, const SYSTEMTIME& tm)
+{
+	CRecurrenceDate date;
+	memcpy(&date, &tm, sizeof(CRecurrenceDate));
+	return CRecurrencePattern::GetTransition(nYear, date);
+}
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceIterator
+
+CRecurrenceIterator::CRecurrenceIterator()
+{
+	m_pExpander=new CRecurrenceExpander;
+}
+
+CRecurrenceIterator::~CRecurrenceIterator()
+{
+	delete m_pExpander;
+}
+
+// Starts listing the occurrences overlapping ftStart..ftEnd (UTC), returns FALSE if the pattern can't be
+// expanded (see CMAPIRecurrence::IsSupported)
+BOOL CRecurrenceIterator::Begin(CMAPIRecurrence& recurrence, const FILETIME& ftStart, const FILETIME& ftEnd)
+{
+	return m_pExpander->Begin(recurrence.GetPattern(), CMAPIRecurrence::FileTimeToMinutes(ftStart), CMAPIRecurrence::FileTimeToMinutes(ftEnd, TRUE));
+}
+
+BOOL CRecurrenceIterator::Next(CRecurrenceOccurrence& occurrence)
+{
+	CRecurrenceInstance instance;
+	if(!m_pExpander->Next(instance)) return FALSE;
+
+	CMAPIRecurrence::MinutesToFileTime(instance.m_dwStart, occurrence.m_ftStart);
+	CMAPIRecurrence::MinutesToFileTime(instance.m_dwEnd, occurrence.m_ftEnd);
+	CMAPIRecurrence::MinutesToFileTime(instance.m_dwOriginalStart, occurrence.m_ftOriginalStart);
+	occurrence.m_nException=instance.m_nException;
+	return TRUE;
+}
+
+// converts a time in the recurrence's time zone
+DWORD CRecurrenceIterator::LocalToUTC(DWORD dwLocal)
+{
+	return m_pExpander->LocalToUTC(dwLocal);
+}
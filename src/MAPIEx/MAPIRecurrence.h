@@ -0,0 +1,182 @@
+#ifndef __MAPIRECURRENCE_H__
+#define __MAPIRECURRENCE_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIRecurrence.h
+// Description: Parses the recurrence of an appointment and lists its occurrences
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceException
+
+// A modified occurrence (ExceptionInfo), times are minutes since 1601 in the appointment's time zone like the
+// rest of the blob.  The strings and m_nBusyStatus are only set when m_wOverrideFlags says they changed.
+// Copied from the CRecurrencePatternException Parse reads
+class AFX_EXT_CLASS CRecurrenceException
+{
+public:
+	CRecurrenceException();
+
+// Attributes
+public:
+	DWORD m_dwStart;
+	DWORD m_dwEnd;
+	DWORD m_dwOriginalStart;
+	WORD m_wOverrideFlags;
+	CString m_strSubject;
+	CString m_strLocation;
+	int m_nBusyStatus;
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceOccurrence
+
+// One occurrence returned by CRecurrenceIterator, times are UTC.  m_nException is the index of the
+// CRecurrenceException it comes from or -1 for a regular occurrence
+class AFX_EXT_CLASS CRecurrenceOccurrence
+{
+public:
+	FILETIME m_ftStart;
+	FILETIME m_ftEnd;
+	FILETIME m_ftOriginalStart;
+	int m_nException;
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIRecurrence
+
+// The AppointmentRecur blob of a recurring appointment (MS-OXOCAL AppointmentRecurrencePattern) with the
+// time zone it was created in (TimeZoneStruct).  The parsing, writing and expansion is done by
+// CRecurrencePattern and CRecurrenceExpander (RecurrencePattern.h, no MFC or MAPI), the attributes below are
+// copied from it for the rest of MAPIEx and copied back before it is written or expanded, so they can be
+// edited.  The ANSI exception strings are in m_nCodePage.  CMAPIAppointment::GetRecurrence reads both blobs
+// from an appointment, CMAPIAppointmentLoader::Write writes them:
+//
+//		CMAPIRecurrence recurrence;
+//		CRecurrenceIterator it;
+//		if(appointment.GetRecurrence(recurrence) && it.Begin(recurrence, ftStart, ftEnd))
+//		{
+//			while(it.Next(occurrence)) ...
+//		}
+class AFX_EXT_CLASS CMAPIRecurrence
+{
+public:
+	CMAPIRecurrence();
+	~CMAPIRecurrence();
+
+	enum { OUTLOOK_APPOINTMENT_RECUR=0x8216, OUTLOOK_TIMEZONE_STRUCT=0x8233 };
+	enum { FREQUENCY_DAILY=0x200A, FREQUENCY_WEEKLY=0x200B, FREQUENCY_MONTHLY=0x200C, FREQUENCY_YEARLY=0x200D };
+	enum { PATTERN_DAY=0x0, PATTERN_WEEK=0x1, PATTERN_MONTH=0x2, PATTERN_MONTH_NTH=0x3, PATTERN_MONTH_END=0x4,
+		PATTERN_HJ_MONTH=0xA, PATTERN_HJ_MONTH_NTH=0xB, PATTERN_HJ_MONTH_END=0xC
+	};
+	enum { END_AFTER_DATE=0x2021, END_AFTER_COUNT=0x2022, END_NEVER=0x2023, END_DATE_NEVER=0x5AE980DF };
+	enum { ARO_SUBJECT=0x0001, ARO_MEETINGTYPE=0x0002, ARO_REMINDERDELTA=0x0004, ARO_REMINDER=0x0008, ARO_LOCATION=0x0010,
+		ARO_BUSYSTATUS=0x0020, ARO_ATTACHMENT=0x0040, ARO_SUBTYPE=0x0080, ARO_APPTCOLOR=0x0100, ARO_EXCEPTIONAL_BODY=0x0200
+	};
+	enum { MINUTES_PER_DAY=1440, TIMEZONE_STRUCT_SIZE=48 };
+
+// Attributes
+public:
+	WORD m_wFrequency;
+	WORD m_wPatternType;
+	WORD m_wCalendarType;
+	DWORD m_dwFirstDateTime;
+	DWORD m_dwPeriod;
+	DWORD m_dwDayMask;		// PATTERN_WEEK and PATTERN_MONTH_NTH, bit 0 is Sunday
+	DWORD m_dwDayOfMonth;	// PATTERN_MONTH, or the week (1-4, 5 is last) for PATTERN_MONTH_NTH
+	DWORD m_dwEndType;
+	DWORD m_dwOccurrenceCount;
+	DWORD m_dwFirstDOW;
+	DWORD m_dwStartDate;
+	DWORD m_dwEndDate;
+	DWORD m_dwStartTimeOffset;
+	DWORD m_dwEndTimeOffset;
+	CArray<DWORD, DWORD> m_arDeletedDates;
+	CArray<DWORD, DWORD> m_arModifiedDates;
+	CArray<CRecurrenceException, CRecurrenceException&> m_arExceptions;
+	CArray<int, int> m_arExceptionOrder;	// m_arExceptions indexes by new start time
+
+	BOOL m_bTimeZone;
+	LONG m_lBias;
+	LONG m_lStandardBias;
+	LONG m_lDaylightBias;
+	SYSTEMTIME m_tmStandardDate;
+	SYSTEMTIME m_tmDaylightDate;
+
+	UINT m_nCodePage;	// PR_MESSAGE_CODEPAGE of the appointment, CP_ACP by default
+
+// Operations
+public:
+	void Empty();
+	BOOL Parse(const BYTE* pData, ULONG cb);
+	BOOL SetTimeZone(const BYTE* pData, ULONG cb);
+	BOOL SetTimeZone(const TIME_ZONE_INFORMATION* pTZI);
+	BOOL ParseRule(LPCSTR szRule, DWORD dwStart, DWORD dwEnd);
+	void DeleteOccurrence(DWORD dwOriginalStart);
+	void Write(CByteArray& arData);
+	BOOL WriteTimeZone(CByteArray& arData);
+	BOOL IsSupported();
+	BOOL HasEndDate();
+	BOOL GetTransitions(int nYear, DWORD& dwDaylight, DWORD& dwStandard);
+
+	static DWORD FileTimeToMinutes(const FILETIME& ft, BOOL bRoundUp=FALSE);
+	static void MinutesToFileTime(DWORD dwMinutes, FILETIME& ft);
+	static int DaysFromDate(int nYear, int nMonth, int nDay);
+	static void DateFromDays(int nDays, int& nYear, int& nMonth, int& nDay);
+	static int GetDaysInMonth(int nYear, int nMonth);
+	static int GetDayOfWeek(int nDays) { return (nDays+1)%7; } // 1601-01-01 was a Monday
+	static DWORD GetTransition(int nYear, const SYSTEMTIME& tm);
+
+	const CRecurrencePattern& GetPattern();
+
+protected:
+	CRecurrencePattern* m_pPattern;
+
+	void CopyPattern();
+	void CopyTimeZone();
+	void UpdatePattern();
+
+	static CStringW ToWide(const std::string& strValue, UINT nCodePage);
+	static std::string ToAnsi(const CStringW& strValue, UINT nCodePage);
+
+private:
+	CMAPIRecurrence(const CMAPIRecurrence&);
+	CMAPIRecurrence& operator=(const CMAPIRecurrence&);
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceIterator
+
+// Lists the occurrences of a CMAPIRecurrence overlapping a UTC window in start order, one per call to Next.
+// A FILETIME front end to CRecurrenceExpander, see there
+class AFX_EXT_CLASS CRecurrenceIterator
+{
+public:
+	CRecurrenceIterator();
+	~CRecurrenceIterator();
+
+// Attributes
+protected:
+	CRecurrenceExpander* m_pExpander;
+
+// Operations
+public:
+	BOOL Begin(CMAPIRecurrence& recurrence, const FILETIME& ftStart, const FILETIME& ftEnd);
+	BOOL Next(CRecurrenceOccurrence& occurrence);
+	DWORD LocalToUTC(DWORD dwLocal);
+
+private:
+	CRecurrenceIterator(const CRecurrenceIterator&);
+	CRecurrenceIterator& operator=(const CRecurrenceIterator&);
+};
+
+#endif
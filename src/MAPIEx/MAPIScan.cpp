@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIScan.cpp
+// Description: Resumable contents table scan run a batch at a time on a CMAPIExecutor
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CMAPIContentsScan
+
+CMAPIContentsScan::CMAPIContentsScan(const CMAPIEntryID& folderID, int nBatchSize, const ULONG* pulColumns, int nColumns)
+	: m_folderID(folderID)
+{
+	m_nBatchSize=max(1, nBatchSize);
+	m_ulSortField=PR_NULL;
+	m_ulSortParam=TABLE_SORT_ASCEND;
+	m_bUnreadOnly=FALSE;
+	m_nStep=SCAN_OPEN;
+	m_pContents=NULL;
+	m_lRowCount=-1;
+	m_lRowsRead=0;
+	m_lRowsSkipped=0;
+	m_pRowsCallback=NULL;
+	m_pRowsContext=NULL;
+	m_pMessageCallback=NULL;
+	m_pMessageContext=NULL;
+	m_pRows=NULL;
+	m_nRow=-1;
+
+	if(pulColumns && nColumns>0)
+	{
+		for(int i=0;i<nColumns;i++) m_arColumns.Add(pulColumns[i]);
+	}
+	else
+	{
+		m_arColumns.Add(PR_ENTRYID);
+		m_arColumns.Add(PR_MESSAGE_FLAGS);
+	}
+}
+
+CMAPIContentsScan::~CMAPIContentsScan()
+{
+	CloseTable();
+}
+
+void CMAPIContentsScan::SetRowsCallback(LPMAPIROWSCALLBACK pCallback, LPVOID pContext)
+{
+	m_pRowsCallback=pCallback;
+	m_pRowsContext=pContext;
+}
+
+void CMAPIContentsScan::SetMessageCallback(LPMAPIMESSAGECALLBACK pCallback, LPVOID pContext)
+{
+	m_pMessageCallback=pCallback;
+	m_pMessageContext=pContext;
+}
+
+// Opens the table on the first step, then each step reads one batch and continues until the table is
+// exhausted or OnRows ends the scan.  Fails if the table can't be opened or read, a failed read leaves the
+// table where it was so a retry reads the same batch.  When OnRows fails (sets m_hrError) the batch is kept
+// and a retry passes on the rest of it
+BOOL CMAPIContentsScan::Run(CMAPIEx* pMAPI)
+{
+	if(m_nStep==SCAN_OPEN)
+	{
+		if(!OpenTable(pMAPI)) return FALSE;
+		m_nStep=SCAN_READ;
+	}
+	if(m_nStep!=SCAN_READ) return FALSE;
+
+	if(!m_pRows)
+	{
+		CMAPILimiterCall call(m_pLimiter);
+		if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+		HRESULT hr=m_pContents->QueryRows(m_nBatchSize, 0, &m_pRows);
+		if(hr!=S_OK)
+		{
+			m_pRows=NULL;
+			return Fail(call, hr);
+		}
+		m_nRow=-1;
+		InterlockedExchangeAdd(&m_lRowsRead, (LONG)m_pRows->cRows);
+	}
+
+	BOOL bMore=(m_pRows->cRows>0 && OnRows(pMAPI, m_pRows));
+	if(m_hrError!=S_OK) return FALSE;
+	FreeProws(m_pRows);
+	m_pRows=NULL;
+
+	if(bMore)
+	{
+		Continue();
+		return TRUE;
+	}
+	CloseTable();
+	m_nStep=SCAN_DONE;
+	return TRUE;
+}
+
+// the scan is over or was cancelled between steps, the table belongs to the worker's session so it's released there
+void CMAPIContentsScan::ReleaseSession()
+{
+	CloseTable();
+	m_nStep=SCAN_DONE;
+}
+
+// Passes the batch to the rows callback and then each message from m_nRow to the message callback, FALSE ends
+// the scan.  A message that can't be opened for any reason but having been deleted sets m_hrError and stops
+// at its row
+BOOL CMAPIContentsScan::OnRows(CMAPIEx* pMAPI, LPSRowSet pRows)
+{
+	if(m_nRow<0)
+	{
+		if(m_pRowsCallback && !m_pRowsCallback(this, pRows, m_pRowsContext)) return FALSE;
+		m_nRow=0;
+	}
+	if(!m_pMessageCallback) return TRUE;
+
+	for(;m_nRow<(int)pRows->cRows;m_nRow++)
+	{
+		SRow& row=pRows->aRow[m_nRow];
+		for(ULONG j=0;j<row.cValues;j++)
+		{
+			if(row.lpProps[j].ulPropTag!=PR_ENTRYID) continue;
+
+			CMAPIMessage message;
+			{
+				CMAPILimiterCall call(m_pLimiter);
+				if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+				if(!message.Open(pMAPI, row.lpProps[j].Value.bin))
+				{
+					if(message.GetError()!=MAPI_E_NOT_FOUND) return Fail(call, message.GetError());
+					call.End(MAPI_E_NOT_FOUND);
+					InterlockedIncrement(&m_lRowsSkipped);
+					break;
+				}
+			}
+
+			// outside the limiter's slot
+			if(!m_pMessageCallback(this, message, m_pMessageContext))
+			{
+				m_nRow++;
+				return FALSE;
+			}
+			break;
+		}
+	}
+	return TRUE;
+}
+
+// sets up the contents table with the columns, sort and restriction, PR_ENTRYID is added for the message callback
+BOOL CMAPIContentsScan::OpenTable(CMAPIEx* pMAPI)
+{
+	CloseTable();
+
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return Fail(call, MAPI_E_CALL_FAILED);
+
+	CMAPIFolder folder;
+	if(!folder.Open(pMAPI, *m_folderID.GetBinary())) return Fail(call, folder.GetError());
+	HRESULT hr=folder.Folder()->GetContentsTable(CMAPIEx::cm_nMAPICode, &m_pContents);
+	if(hr!=S_OK)
+	{
+		m_pContents=NULL;
+		return Fail(call, hr);
+	}
+
+	int i, nColumns=(int)m_arColumns.GetSize();
+	BOOL bEntryID=FALSE;
+	for(i=0;i<nColumns;i++)
+	{
+		if(m_arColumns[i]==PR_ENTRYID) bEntryID=TRUE;
+	}
+	if(m_pMessageCallback && !bEntryID) m_arColumns.Add(PR_ENTRYID);
+	nColumns=(int)m_arColumns.GetSize();
+
+	BOOL bResult=FALSE;
+	LPSPropTagArray pTags=NULL;
+	if(MAPIAllocateBuffer(CbNewSPropTagArray(nColumns), (LPVOID*)&pTags)==S_OK)
+	{
+		pTags->cValues=nColumns;
+		for(i=0;i<nColumns;i++) pTags->aulPropTag[i]=m_arColumns[i];
+
+		SRestriction res;
+		res.rt=RES_BITMASK;
+		res.res.resBitMask.relBMR=BMR_EQZ;
+		res.res.resBitMask.ulPropTag=PR_MESSAGE_FLAGS;
+		res.res.resBitMask.ulMask=MSGFLAG_READ;
+
+		SizedSSortOrderSet(1, SortColums)={1, 0, 0, {{m_ulSortField, m_ulSortParam}}};
+		ULONG ulCount=0;
+		if((hr=m_pContents->SetColumns(pTags, TBL_BATCH))==S_OK
+			&& (!m_bUnreadOnly || (hr=m_pContents->Restrict(&res, TBL_BATCH))==S_OK)
+			&& (m_ulSortField==PR_NULL || (hr=m_pContents->SortTable((LPSSortOrderSet)&SortColums, TBL_BATCH))==S_OK)
+			&& (hr=m_pContents->GetRowCount(0, &ulCount))==S_OK)
+		{
+			InterlockedExchange(&m_lRowCount, (LONG)ulCount);
+			bResult=TRUE;
+		}
+		MAPIFreeBuffer(pTags);
+	}
+	else hr=MAPI_E_NOT_ENOUGH_MEMORY;
+	if(!bResult)
+	{
+		CloseTable();
+		return Fail(call, hr);
+	}
+	return TRUE;
+}
+
+void CMAPIContentsScan::CloseTable()
+{
+	if(m_pRows)
+	{
+		FreeProws(m_pRows);
+		m_pRows=NULL;
+	}
+	RELEASE(m_pContents);
+}
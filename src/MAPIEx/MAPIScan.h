@@ -0,0 +1,91 @@
+#ifndef __MAPISCAN_H__
+#define __MAPISCAN_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIScan.h
+// Description: Resumable contents table scan run a batch at a time on a CMAPIExecutor
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CMAPIContentsScan;
+
+// both are called on the worker, return FALSE to end the scan early
+typedef BOOL (*LPMAPIROWSCALLBACK)(CMAPIContentsScan* pScan, LPSRowSet pRows, LPVOID pContext);
+typedef BOOL (*LPMAPIMESSAGECALLBACK)(CMAPIContentsScan* pScan, CMAPIMessage& message, LPVOID pContext);
+
+/////////////////////////////////////////////////////////////
+// CMAPIContentsScan
+
+// Walks a folder's contents table as a job that reads one batch per step and then continues, so a few workers
+// can interleave many scans instead of each one holding a thread for the whole folder.  The table stays open
+// between steps on the worker that opened it.  Each batch goes to the rows callback (or OnRows), and with a
+// message callback every row's message is opened in the worker's session and passed on.  A message deleted
+// since the batch was read is skipped and counted, any other error opening one fails the step with the
+// HRESULT in GetError and a retry carries on from that row.  The job's own callback and Wait tell when the
+// scan is over:
+//
+//		CMAPIContentsScan* pScan=new CMAPIContentsScan(folderID);
+//		pScan->SetMessageCallback(OnMessage, this);
+//		executor.Submit(pScan, OnScanDone, this);
+//		pScan->Release();
+class AFX_EXT_CLASS CMAPIContentsScan : public CMAPIJob
+{
+public:
+	CMAPIContentsScan(const CMAPIEntryID& folderID, int nBatchSize=DEFAULT_BATCH_SIZE, const ULONG* pulColumns=NULL, int nColumns=0);
+
+	enum { DEFAULT_BATCH_SIZE=50 };
+	enum { SCAN_OPEN, SCAN_READ, SCAN_DONE };
+
+// Attributes
+public:
+	CMAPIEntryID m_folderID;
+	int m_nBatchSize;
+	CArray<ULONG, ULONG> m_arColumns;
+	ULONG m_ulSortField;
+	ULONG m_ulSortParam;
+	BOOL m_bUnreadOnly;
+
+protected:
+	int m_nStep;
+	LPMAPITABLE m_pContents;
+	LONG m_lRowCount;
+	LONG m_lRowsRead;
+	LONG m_lRowsSkipped;
+	LPMAPIROWSCALLBACK m_pRowsCallback;
+	LPVOID m_pRowsContext;
+	LPMAPIMESSAGECALLBACK m_pMessageCallback;
+	LPVOID m_pMessageContext;
+
+	// the batch being passed on and its next row, -1 before the rows callback
+	LPSRowSet m_pRows;
+	int m_nRow;
+
+// Operations
+public:
+	void SetRowsCallback(LPMAPIROWSCALLBACK pCallback, LPVOID pContext);
+	void SetMessageCallback(LPMAPIMESSAGECALLBACK pCallback, LPVOID pContext);
+
+	int GetStep() { return m_nStep; }
+	int GetRowCount() { return (int)m_lRowCount; }
+	int GetRowsRead() { return (int)m_lRowsRead; }
+	int GetRowsSkipped() { return (int)m_lRowsSkipped; }
+
+protected:
+	virtual ~CMAPIContentsScan();
+	virtual BOOL Run(CMAPIEx* pMAPI);
+	virtual void ReleaseSession();
+	virtual BOOL OnRows(CMAPIEx* pMAPI, LPSRowSet pRows);
+
+	BOOL OpenTable(CMAPIEx* pMAPI);
+	void CloseTable();
+};
+
+#endif
@@ -0,0 +1,332 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPISessionPool.cpp
+// Description: Pool of logged on MAPI sessions shared by worker threads
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+/////////////////////////////////////////////////////////////
+// CSessionPoolStats
+
+CSessionPoolStats::CSessionPoolStats()
+{
+	m_nSessions=0;
+	m_nLeased=0;
+	m_ulAcquires=0;
+	m_ulWaits=0;
+	m_ulTimeouts=0;
+	m_ulAffinityHits=0;
+	m_ulHealthChecks=0;
+	m_ulRecycles=0;
+	m_ulLogonFailures=0;
+	m_ullWaitTime=0;
+	m_dwMaxWaitTime=0;
+	m_ullLeasedTime=0;
+	m_ullElapsedTime=0;
+	m_nUtilization=0;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPISessionLease
+
+CMAPISessionLease::CMAPISessionLease(CMAPISessionPool& pool, DWORD dwTimeout) : m_pool(pool)
+{
+	m_bBroken=FALSE;
+	m_pMAPI=m_pool.Acquire(dwTimeout);
+}
+
+CMAPISessionLease::~CMAPISessionLease()
+{
+	Release();
+}
+
+// the pool's limiter or NULL, hold a CMAPILimiterCall on it around each call made with the session
+CMAPILimiter* CMAPISessionLease::GetLimiter()
+{
+	return m_pool.GetLimiter();
+}
+
+// gives the session back early
+void CMAPISessionLease::Release()
+{
+	if(m_pMAPI) m_pool.Release(m_pMAPI, m_bBroken);
+	m_pMAPI=NULL;
+	m_bBroken=FALSE;
+}
+
+/////////////////////////////////////////////////////////////
+// CMAPISessionPool
+
+CMAPISessionPool::CMAPISessionPool()
+{
+	InitializeCriticalSection(&m_cs);
+	m_bProfile=FALSE;
+	m_bStore=FALSE;
+	m_bInitAsService=FALSE;
+	m_dwCheckInterval=DEFAULT_CHECK_INTERVAL;
+	m_hAvailable=NULL;
+	m_pLimiter=NULL;
+	m_dwStatsStart=GetTickCount();
+}
+
+CMAPISessionPool::~CMAPISessionPool()
+{
+	Close();
+	DeleteCriticalSection(&m_cs);
+}
+
+// Logs nSessions on to szProfileName (NULL for the default) and opens szStore (NULL for the default store) in
+// each.  Sessions that fail are retried when they're next handed out; FALSE if none could log on
+BOOL CMAPISessionPool::Open(LPCTSTR szProfileName, int nSessions, LPCTSTR szStore, BOOL bInitAsService)
+{
+	Close();
+	nSessions=max(1, min(nSessions, (int)MAX_SESSIONS));
+
+	// the stats start here so the logons that fail below are counted
+	ResetStats();
+	EnterCriticalSection(&m_cs);
+	m_bProfile=(szProfileName!=NULL);
+	m_strProfile=szProfileName ? szProfileName : _T("");
+	m_bStore=(szStore!=NULL);
+	m_strStore=szStore ? szStore : _T("");
+	m_bInitAsService=bInitAsService;
+
+	int nLoggedOn=0;
+	m_arSessions.SetSize(nSessions);
+	for(int i=0;i<nSessions;i++)
+	{
+		Session& session=m_arSessions[i];
+		memset(&session, 0, sizeof(Session));
+		if(Logon(session)) nLoggedOn++;
+		else m_stats.m_ulLogonFailures++;
+		session.m_dwReleaseTime=GetTickCount();
+	}
+	LeaveCriticalSection(&m_cs);
+
+	if(!nLoggedOn)
+	{
+		Close();
+		return FALSE;
+	}
+	m_hAvailable=CreateSemaphore(NULL, nSessions, nSessions, NULL);
+	return (m_hAvailable!=NULL);
+}
+
+// logs every session off, all leases must have been released
+void CMAPISessionPool::Close()
+{
+	EnterCriticalSection(&m_cs);
+	for(int i=0;i<m_arSessions.GetSize();i++)
+	{
+		CMAPIEx* pMAPI=m_arSessions[i].m_pMAPI;
+		if(pMAPI)
+		{
+			pMAPI->Logout();
+			delete pMAPI;
+		}
+	}
+	m_arSessions.RemoveAll();
+	if(m_hAvailable)
+	{
+		CloseHandle(m_hAvailable);
+		m_hAvailable=NULL;
+	}
+	LeaveCriticalSection(&m_cs);
+}
+
+// Waits up to dwTimeout for a free session and returns it, or NULL on timeout or if a dead session couldn't
+// be logged on again.  Probing and logging on happen outside the lock so other threads aren't held up
+CMAPIEx* CMAPISessionPool::Acquire(DWORD dwTimeout)
+{
+	if(!m_hAvailable) return NULL;
+
+	DWORD dwStart=GetTickCount();
+	BOOL bWaited=FALSE;
+	DWORD dwWait=WaitForSingleObject(m_hAvailable, 0);
+	if(dwWait==WAIT_TIMEOUT && dwTimeout)
+	{
+		bWaited=TRUE;
+		dwWait=WaitForSingleObject(m_hAvailable, dwTimeout);
+	}
+	DWORD dwWaitTime=GetTickCount()-dwStart;
+
+	EnterCriticalSection(&m_cs);
+	if(bWaited) m_stats.m_ulWaits++;
+	if(dwWait!=WAIT_OBJECT_0)
+	{
+		m_stats.m_ulTimeouts++;
+		LeaveCriticalSection(&m_cs);
+		return NULL;
+	}
+
+	// timeouts would pull the average towards dwTimeout, only waits that got a session count
+	m_stats.m_ulAcquires++;
+	m_stats.m_ullWaitTime+=dwWaitTime;
+	m_stats.m_dwMaxWaitTime=max(m_stats.m_dwMaxWaitTime, dwWaitTime);
+	DWORD dwThreadID=GetCurrentThreadId();
+	int nSession=FindSession(dwThreadID);
+	Session& session=m_arSessions[nSession];
+	session.m_bLeased=TRUE;
+	BOOL bBroken=session.m_bBroken;
+	BOOL bCheck=(!bBroken && GetTickCount()-session.m_dwCheckTime>=m_dwCheckInterval);
+	LeaveCriticalSection(&m_cs);
+
+	// the session is ours now and m_arSessions doesn't change size until Close
+	if(bCheck && !IsHealthy(session.m_pMAPI)) bBroken=TRUE;
+	BOOL bLoggedOn=(!bBroken || Logon(session));
+
+	EnterCriticalSection(&m_cs);
+	if(bCheck) m_stats.m_ulHealthChecks++;
+	if(bBroken) m_stats.m_ulRecycles++;
+	CMAPIEx* pMAPI=NULL;
+	if(bLoggedOn)
+	{
+		if(bCheck) session.m_dwCheckTime=GetTickCount();
+		session.m_dwThreadID=dwThreadID;
+		session.m_dwLeaseTime=GetTickCount();
+		pMAPI=session.m_pMAPI;
+	}
+	else
+	{
+		m_stats.m_ulLogonFailures++;
+		session.m_bLeased=FALSE;
+		session.m_dwReleaseTime=GetTickCount();
+	}
+	LeaveCriticalSection(&m_cs);
+
+	if(!pMAPI) ReleaseSemaphore(m_hAvailable, 1, NULL);
+	return pMAPI;
+}
+
+// gives pMAPI back, with bBroken it's logged on again before it's handed out next
+void CMAPISessionPool::Release(CMAPIEx* pMAPI, BOOL bBroken)
+{
+	if(!pMAPI) return;
+
+	BOOL bReleased=FALSE;
+	EnterCriticalSection(&m_cs);
+	for(int i=0;i<m_arSessions.GetSize();i++)
+	{
+		Session& session=m_arSessions[i];
+		if(session.m_pMAPI!=pMAPI || !session.m_bLeased) continue;
+
+		DWORD dwNow=GetTickCount();
+		m_stats.m_ullLeasedTime+=dwNow-session.m_dwLeaseTime;
+		session.m_dwReleaseTime=dwNow;
+		session.m_bLeased=FALSE;
+		if(bBroken) session.m_bBroken=TRUE;
+		bReleased=TRUE;
+		break;
+	}
+	LeaveCriticalSection(&m_cs);
+
+	if(bReleased) ReleaseSemaphore(m_hAvailable, 1, NULL);
+}
+
+void CMAPISessionPool::GetStats(CSessionPoolStats& stats)
+{
+	EnterCriticalSection(&m_cs);
+	stats=m_stats;
+	DWORD dwNow=GetTickCount();
+	stats.m_nSessions=(int)m_arSessions.GetSize();
+	for(int i=0;i<m_arSessions.GetSize();i++)
+	{
+		Session& session=m_arSessions[i];
+		if(!session.m_bLeased) continue;
+		stats.m_nLeased++;
+		stats.m_ullLeasedTime+=dwNow-session.m_dwLeaseTime;
+	}
+	stats.m_ullElapsedTime=dwNow-m_dwStatsStart;
+
+	ULONGLONG ullSessionTime=stats.m_ullElapsedTime*stats.m_nSessions;
+	stats.m_nUtilization=ullSessionTime ? (int)min(stats.m_ullLeasedTime*100/ullSessionTime, (ULONGLONG)100) : 0;
+	LeaveCriticalSection(&m_cs);
+}
+
+// leases held now only count from here on
+void CMAPISessionPool::ResetStats()
+{
+	EnterCriticalSection(&m_cs);
+	m_stats=CSessionPoolStats();
+	m_dwStatsStart=GetTickCount();
+	for(int i=0;i<m_arSessions.GetSize();i++)
+	{
+		if(m_arSessions[i].m_bLeased) m_arSessions[i].m_dwLeaseTime=m_dwStatsStart;
+	}
+	LeaveCriticalSection(&m_cs);
+}
+
+// The free session dwThreadID used last, otherwise the healthy one idle the longest, otherwise a broken one.
+// The semaphore guarantees one is free
+int CMAPISessionPool::FindSession(DWORD dwThreadID)
+{
+	DWORD dwNow=GetTickCount();
+	int nBest=-1, nBroken=-1;
+	DWORD dwBestIdle=0;
+	for(int i=0;i<m_arSessions.GetSize();i++)
+	{
+		Session& session=m_arSessions[i];
+		if(session.m_bLeased) continue;
+		if(session.m_bBroken)
+		{
+			if(nBroken<0) nBroken=i;
+			continue;
+		}
+		if(session.m_dwThreadID==dwThreadID)
+		{
+			m_stats.m_ulAffinityHits++;
+			return i;
+		}
+
+		DWORD dwIdle=dwNow-session.m_dwReleaseTime;
+		if(nBest<0 || dwIdle>dwBestIdle)
+		{
+			nBest=i;
+			dwBestIdle=dwIdle;
+		}
+	}
+	return (nBest>=0) ? nBest : nBroken;
+}
+
+// logs session on (again), its CMAPIEx is created the first time
+BOOL CMAPISessionPool::Logon(Session& session)
+{
+	if(!session.m_pMAPI) session.m_pMAPI=new CMAPIEx;
+	CMAPIEx* pMAPI=session.m_pMAPI;
+	pMAPI->Logout();
+
+	BOOL bResult=(pMAPI->Login(m_bProfile ? (LPCTSTR)m_strProfile : NULL, m_bInitAsService) && pMAPI->OpenMessageStore(m_bStore ? (LPCTSTR)m_strStore : NULL));
+	if(!bResult) pMAPI->Logout();
+	session.m_bBroken=!bResult;
+	session.m_dwCheckTime=GetTickCount();
+	return bResult;
+}
+
+// A cheap round trip to the store, fails once the session or the connection behind it is gone.  Properties
+// like PR_OBJECT_TYPE are answered from the store object without asking the server, the receive folder isn't
+BOOL CMAPISessionPool::IsHealthy(CMAPIEx* pMAPI)
+{
+	LPMDB pMsgStore=pMAPI ? pMAPI->GetMessageStore() : NULL;
+	if(!pMsgStore) return FALSE;
+
+	// a limiter that can't hand out slots isn't the session's fault
+	CMAPILimiterCall call(m_pLimiter);
+	if(!call.IsValid()) return TRUE;
+
+	ULONG cbEntryID=0;
+	LPENTRYID pEntryID=NULL;
+	HRESULT hr=pMsgStore->GetReceiveFolder(NULL, 0, &cbEntryID, &pEntryID, NULL);
+	call.End(hr);
+	if(pEntryID) MAPIFreeBuffer(pEntryID);
+	return (hr==S_OK);
+}
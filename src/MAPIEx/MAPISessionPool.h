@@ -0,0 +1,163 @@
+#ifndef __MAPISESSIONPOOL_H__
+#define __MAPISESSIONPOOL_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPISessionPool.h
+// Description: Pool of logged on MAPI sessions shared by worker threads
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class CMAPISessionPool;
+class CMAPILimiter;
+
+/////////////////////////////////////////////////////////////
+// CSessionPoolStats
+
+// Counters since Open or ResetStats, times in milliseconds.  The wait times are of the Acquires that got a
+// session.  Utilization is the share of the session time that was leased, in percent
+class AFX_EXT_CLASS CSessionPoolStats
+{
+public:
+	CSessionPoolStats();
+
+// Attributes
+public:
+	int m_nSessions;
+	int m_nLeased;
+	ULONG m_ulAcquires;
+	ULONG m_ulWaits;
+	ULONG m_ulTimeouts;
+	ULONG m_ulAffinityHits;
+	ULONG m_ulHealthChecks;
+	ULONG m_ulRecycles;
+	ULONG m_ulLogonFailures;
+	ULONGLONG m_ullWaitTime;
+	DWORD m_dwMaxWaitTime;
+	ULONGLONG m_ullLeasedTime;
+	ULONGLONG m_ullElapsedTime;
+	int m_nUtilization;
+
+// Operations
+public:
+	DWORD GetAverageWaitTime() { return m_ulAcquires ? (DWORD)(m_ullWaitTime/m_ulAcquires) : 0; }
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPISessionLease
+
+// Holds a session from the pool for the lifetime of the lease and gives it back when it goes out of scope.
+// Call SetBroken when a MAPI call failed in a way that means the session is dead, it's logged on again before
+// it's handed out next
+class AFX_EXT_CLASS CMAPISessionLease
+{
+public:
+	CMAPISessionLease(CMAPISessionPool& pool, DWORD dwTimeout=INFINITE);
+	~CMAPISessionLease();
+
+// Attributes
+protected:
+	CMAPISessionPool& m_pool;
+	CMAPIEx* m_pMAPI;
+	BOOL m_bBroken;
+
+// Operations
+public:
+	BOOL IsValid() { return (m_pMAPI!=NULL); }
+	CMAPIEx* GetMAPI() { return m_pMAPI; }
+	CMAPIEx* operator->() { return m_pMAPI; }
+	operator CMAPIEx*() { return m_pMAPI; }
+	void SetBroken() { m_bBroken=TRUE; }
+	CMAPILimiter* GetLimiter();
+	void Release();
+
+private:
+	CMAPISessionLease(const CMAPISessionLease&);
+	CMAPISessionLease& operator=(const CMAPISessionLease&);
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPISessionPool
+
+// Keeps nSessions CMAPIEx logged on to one profile with their message store open, so a request costs a lease
+// instead of a MAPILogonEx.  A thread gets back the session it used last when it's free (MAPI caches per
+// session), otherwise the one idle the longest.  Sessions idle past the check interval are probed with a
+// GetReceiveFolder on their store before being handed out and logged on again if that fails.  With
+// SetLimiter the probes hold a slot of the limiter, and leases hand it out for callers to do the same.
+//
+// Every thread that leases a session must have called CMAPIEx::Init, and all leases must be released before
+// Close:
+//
+//		CMAPISessionPool pool;
+//		pool.Open(NULL, 8);
+//		...
+//		CMAPISessionLease mapi(pool, 5000); // on a worker thread
+//		if(mapi.IsValid() && mapi->OpenInbox()) ...
+class AFX_EXT_CLASS CMAPISessionPool
+{
+public:
+	CMAPISessionPool();
+	~CMAPISessionPool();
+
+	enum { MAX_SESSIONS=64, DEFAULT_CHECK_INTERVAL=60000 };
+
+	struct Session
+	{
+		CMAPIEx* m_pMAPI;
+		DWORD m_dwThreadID;
+		DWORD m_dwLeaseTime;
+		DWORD m_dwReleaseTime;
+		DWORD m_dwCheckTime;
+		BOOL m_bLeased;
+		BOOL m_bBroken;
+	};
+
+// Attributes
+protected:
+	CArray<Session, Session&> m_arSessions;
+	CString m_strProfile;
+	CString m_strStore;
+	BOOL m_bProfile;
+	BOOL m_bStore;
+	BOOL m_bInitAsService;
+	DWORD m_dwCheckInterval;
+	HANDLE m_hAvailable;
+	CMAPILimiter* m_pLimiter;
+	CSessionPoolStats m_stats;
+	DWORD m_dwStatsStart;
+	CRITICAL_SECTION m_cs;
+
+// Operations
+public:
+	BOOL Open(LPCTSTR szProfileName, int nSessions, LPCTSTR szStore=NULL, BOOL bInitAsService=FALSE);
+	void Close();
+	BOOL IsOpen() { return (m_hAvailable!=NULL); }
+	int GetSessionCount() { return (int)m_arSessions.GetSize(); }
+	void SetCheckInterval(DWORD dwCheckInterval) { m_dwCheckInterval=dwCheckInterval; }
+	void SetLimiter(CMAPILimiter* pLimiter) { m_pLimiter=pLimiter; }
+	CMAPILimiter* GetLimiter() { return m_pLimiter; }
+
+	CMAPIEx* Acquire(DWORD dwTimeout=INFINITE);
+	void Release(CMAPIEx* pMAPI, BOOL bBroken=FALSE);
+
+	void GetStats(CSessionPoolStats& stats);
+	void ResetStats();
+
+protected:
+	int FindSession(DWORD dwThreadID);
+	BOOL Logon(Session& session);
+	BOOL IsHealthy(CMAPIEx* pMAPI);
+
+private:
+	CMAPISessionPool(const CMAPISessionPool&);
+	CMAPISessionPool& operator=(const CMAPISessionPool&);
+};
+
+#endif
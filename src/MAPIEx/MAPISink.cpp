@@ -13,15 +13,17 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "MAPIExPCH.h"
+#include "MAPIEx.h"
 #include "MAPISink.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // CMAPISink
 
-CMAPISink::CMAPISink(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext)
+CMAPISink::CMAPISink(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, CMAPINotifyQueue* pQueue)
 {
 	m_lpfnCallback=lpfnCallback;
 	m_lpvContext=lpvContext;
+	m_pQueue=pQueue;
 	m_nRef=0;
 }
 
@@ -50,7 +52,8 @@ ULONG CMAPISink::Release()
 
 ULONG CMAPISink::OnNotify(ULONG cNotification, LPNOTIFICATION lpNotifications)
 {
-	if(m_lpfnCallback) m_lpfnCallback(m_lpvContext, cNotification, lpNotifications);
+	if(m_pQueue) m_pQueue->Post(m_lpfnCallback, m_lpvContext, cNotification, lpNotifications);
+	else if(m_lpfnCallback) m_lpfnCallback(m_lpvContext, cNotification, lpNotifications);
 	return 0;
 }
 
@@ -19,15 +19,18 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // CMAPISink
 
+// Calls the callback on MAPI's notification thread, or with a started CMAPINotifyQueue posts a copy of the
+// notifications for one of the queue's workers
 class CMAPISink : public IMAPIAdviseSink
 {
 public:
-	CMAPISink(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext);
+	CMAPISink(LPNOTIFCALLBACK lpfnCallback, LPVOID lpvContext, CMAPINotifyQueue* pQueue=NULL);
 
 // Attributes
 protected:
 	LPNOTIFCALLBACK m_lpfnCallback;  
 	LPVOID m_lpvContext;  
+	CMAPINotifyQueue* m_pQueue;
 	LONG m_nRef;  
 
 // IUnknown
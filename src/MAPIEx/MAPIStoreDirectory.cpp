@@ -0,0 +1,355 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIStoreDirectory.cpp
+// Description: Cached copy of a session's message stores table and the stores opened from it
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+#include "MAPISink.h"
+
+/////////////////////////////////////////////////////////////
+// CMAPIStoreDirectory
+
+CMAPIStoreDirectory::CMAPIStoreDirectory()
+{
+	m_pSession=NULL;
+	m_pTable=NULL;
+	m_ulConnection=0;
+	m_lStale=FALSE;
+	m_nDefault=-1;
+}
+
+CMAPIStoreDirectory::~CMAPIStoreDirectory()
+{
+	Close();
+}
+
+// Reads pSession's stores table and starts listening to it, the session is held until Close
+BOOL CMAPIStoreDirectory::Load(IMAPISession* pSession)
+{
+	Close();
+	if(!pSession) return FALSE;
+
+	if(pSession->GetMsgStoresTable(0, &m_pTable)!=S_OK)
+	{
+		m_pTable=NULL;
+		return FALSE;
+	}
+
+	SizedSPropTagArray(STORE_COLS, Columns)={STORE_COLS,{PR_DISPLAY_NAME, PR_ENTRYID, PR_DEFAULT_STORE}};
+	if(m_pTable->SetColumns((LPSPropTagArray)&Columns, 0)!=S_OK)
+	{
+		RELEASE(m_pTable);
+		return FALSE;
+	}
+
+	m_pSession=pSession;
+	m_pSession->AddRef();
+
+	// advise first so a change made while reading isn't missed
+	Advise();
+	if(!ReadTable())
+	{
+		Close();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// releases the stores opened through the directory, callers keep the references OpenStore gave them
+void CMAPIStoreDirectory::Close()
+{
+	if(m_ulConnection && m_pTable) m_pTable->Unadvise(m_ulConnection);
+	m_ulConnection=0;
+	RELEASE(m_pTable);
+
+	ReleaseStores(m_arStores);
+	m_arStores.RemoveAll();
+	m_mapNames.RemoveAll();
+	m_mapIDs.RemoveAll();
+	m_nDefault=-1;
+	m_lStale=FALSE;
+	RELEASE(m_pSession);
+}
+
+// Store indexes are only good until the next Find, which may reload the table
+int CMAPIStoreDirectory::GetCount()
+{
+	return (int)m_arStores.GetSize();
+}
+
+LPCTSTR CMAPIStoreDirectory::GetName(int nStore)
+{
+	return (nStore>=0 && nStore<GetCount()) ? (LPCTSTR)m_arStores[nStore].m_strName : NULL;
+}
+
+const CMAPIEntryID* CMAPIStoreDirectory::GetEntryID(int nStore)
+{
+	return (nStore>=0 && nStore<GetCount()) ? &m_arStores[nStore].m_entryID : NULL;
+}
+
+BOOL CMAPIStoreDirectory::IsDefault(int nStore)
+{
+	return (nStore>=0 && nStore<GetCount()) ? m_arStores[nStore].m_bDefault : FALSE;
+}
+
+int CMAPIStoreDirectory::FindDefault()
+{
+	Refresh();
+	return m_nDefault;
+}
+
+// An exact name match, otherwise the first store whose name contains szName like OpenMessageStore always did
+int CMAPIStoreDirectory::FindName(LPCTSTR szName)
+{
+	if(!szName) return -1;
+	Refresh();
+
+	int nStore;
+	if(m_mapNames.Lookup(szName, nStore)) return nStore;
+	for(nStore=0;nStore<GetCount();nStore++)
+	{
+		if(m_arStores[nStore].m_strName.Find(szName)!=-1) return nStore;
+	}
+	return -1;
+}
+
+// An entry ID can have other forms than the one in the stores table (a long term ID from a message's
+// PR_STORE_ENTRYID for instance), on a hash miss the provider compares it and the form is remembered
+int CMAPIStoreDirectory::FindEntryID(const CMAPIEntryID& entryID)
+{
+	Refresh();
+
+	int nStore;
+	if(m_mapIDs.Lookup(entryID, nStore)) return nStore;
+	if(!m_pSession || entryID.IsEmpty()) return -1;
+
+	for(nStore=0;nStore<GetCount();nStore++)
+	{
+		CMAPIEntryID& storeID=m_arStores[nStore].m_entryID;
+		ULONG ulResult=FALSE;
+		if(m_pSession->CompareEntryIDs(entryID.GetSize(), entryID.GetEntryID(), storeID.GetSize(), storeID.GetEntryID(), 0, &ulResult)==S_OK && ulResult)
+		{
+			m_mapIDs.SetAt(entryID, nStore);
+			return nStore;
+		}
+	}
+	return -1;
+}
+
+// Opens the store the first time it's asked for and returns it with a reference the caller releases
+LPMDB CMAPIStoreDirectory::OpenStore(int nStore)
+{
+	if(!m_pSession || nStore<0 || nStore>=GetCount()) return NULL;
+
+	Store& store=m_arStores[nStore];
+	if(!store.m_pMsgStore)
+	{
+		CMAPIEntryID& entryID=store.m_entryID;
+		if(m_pSession->OpenMsgStore(NULL, entryID.GetSize(), entryID.GetEntryID(), NULL, MDB_NO_DIALOG | MAPI_BEST_ACCESS, &store.m_pMsgStore)!=S_OK)
+		{
+			store.m_pMsgStore=NULL;
+			return NULL;
+		}
+	}
+	store.m_pMsgStore->AddRef();
+	return store.m_pMsgStore;
+}
+
+// The entry ID of one of the FOLDER_ special folders in the store, NULL if the store doesn't have it
+const CMAPIEntryID* CMAPIStoreDirectory::GetFolderID(int nStore, int nFolder)
+{
+	if(nStore<0 || nStore>=GetCount() || nFolder<0 || nFolder>=SPECIAL_FOLDERS) return NULL;
+
+	if(!m_arStores[nStore].m_bFolderIDs) LoadFolderIDs(nStore);
+	const CMAPIEntryID& folderID=m_arStores[nStore].m_folderIDs[nFolder];
+	return folderID.IsEmpty() ? NULL : &folderID;
+}
+
+// for folders found some other way, like Junk E-mail by name on stores without PR_ADDITIONAL_REN_ENTRYIDS
+void CMAPIStoreDirectory::SetFolderID(int nStore, int nFolder, const CMAPIEntryID& folderID)
+{
+	if(nStore<0 || nStore>=GetCount() || nFolder<0 || nFolder>=SPECIAL_FOLDERS) return;
+	m_arStores[nStore].m_folderIDs[nFolder]=folderID;
+}
+
+// maps the store and Inbox properties that point to special folders to their FOLDER_ index, -1 for others
+int CMAPIStoreDirectory::GetSpecialFolder(ULONG ulFolderID)
+{
+	switch(ulFolderID)
+	{
+	case PR_IPM_SUBTREE_ENTRYID: return FOLDER_ROOT;
+	case PR_IPM_OUTBOX_ENTRYID: return FOLDER_OUTBOX;
+	case PR_IPM_SENTMAIL_ENTRYID: return FOLDER_SENT;
+	case PR_IPM_WASTEBASKET_ENTRYID: return FOLDER_DELETED;
+	case PR_IPM_APPOINTMENT_ENTRYID: return FOLDER_CALENDAR;
+	case PR_IPM_CONTACT_ENTRYID: return FOLDER_CONTACTS;
+	case PR_IPM_JOURNAL_ENTRYID: return FOLDER_JOURNAL;
+	case PR_IPM_NOTE_ENTRYID: return FOLDER_NOTES;
+	case PR_IPM_TASK_ENTRYID: return FOLDER_TASKS;
+	case PR_IPM_DRAFTS_ENTRYID: return FOLDER_DRAFTS;
+	}
+	return -1;
+}
+
+// stores table notifications arrive on MAPI's thread, they only mark the copy stale
+LONG STDAPICALLTYPE CMAPIStoreDirectory::OnNotify(LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	CMAPIStoreDirectory* pDirectory=(CMAPIStoreDirectory*)lpvContext;
+	if(pDirectory && cNotification) pDirectory->Invalidate();
+	return 0;
+}
+
+// reloads if a notification came in since the last read, failing reads are tried again next time
+BOOL CMAPIStoreDirectory::Refresh()
+{
+	if(!m_pSession) return FALSE;
+	if(!InterlockedExchange(&m_lStale, FALSE)) return TRUE;
+	if(ReadTable()) return TRUE;
+	Invalidate();
+	return FALSE;
+}
+
+// Reads every row in one pass and rebuilds the lookups, stores still in the table keep their open IMsgStore
+BOOL CMAPIStoreDirectory::ReadTable()
+{
+	if(!m_pTable || m_pTable->SeekRow(BOOKMARK_BEGINNING, 0, NULL)!=S_OK) return FALSE;
+
+	ULONG ulCount=0;
+	if(m_pTable->GetRowCount(0, &ulCount)!=S_OK) return FALSE;
+
+	CArray<Store, Store&> arStores;
+	LPSRowSet pRows=NULL;
+	while(m_pTable->QueryRows(max(ulCount, (ULONG)1), 0, &pRows)==S_OK)
+	{
+		ULONG cRows=pRows->cRows;
+		for(ULONG i=0;i<cRows;i++)
+		{
+			LPSPropValue pProps=pRows->aRow[i].lpProps;
+			if(PROP_TYPE(pProps[PROP_ENTRYID].ulPropTag)!=PT_BINARY) continue;
+
+			Store store;
+			store.m_strName=CMAPIEx::GetValidString(pProps[PROP_DISPLAY_NAME]);
+			store.m_entryID.Set(&pProps[PROP_ENTRYID].Value.bin);
+			store.m_bDefault=(PROP_TYPE(pProps[PROP_DEFAULT_STORE].ulPropTag)==PT_BOOLEAN && pProps[PROP_DEFAULT_STORE].Value.b);
+			store.m_pMsgStore=NULL;
+			store.m_bFolderIDs=FALSE;
+			arStores.Add(store);
+		}
+		FreeProws(pRows);
+		if(!cRows) break;
+	}
+
+	int i, j, nStore;
+	for(i=0;i<arStores.GetSize();i++)
+	{
+		if(!m_mapIDs.Lookup(arStores[i].m_entryID, nStore)) continue;
+
+		Store& store=m_arStores[nStore];
+		arStores[i].m_pMsgStore=store.m_pMsgStore;
+		store.m_pMsgStore=NULL;
+		arStores[i].m_bFolderIDs=store.m_bFolderIDs;
+		for(j=0;j<SPECIAL_FOLDERS;j++) arStores[i].m_folderIDs[j]=store.m_folderIDs[j];
+	}
+	ReleaseStores(m_arStores);
+
+	m_arStores.Copy(arStores);
+	m_mapNames.RemoveAll();
+	m_mapIDs.RemoveAll();
+	m_mapNames.InitHashTable(max(17, GetCount()*2+1));
+	m_mapIDs.InitHashTable(max(17, GetCount()*2+1));
+	m_nDefault=-1;
+	for(i=0;i<GetCount();i++)
+	{
+		Store& store=m_arStores[i];
+		if(!m_mapNames.Lookup(store.m_strName, nStore)) m_mapNames.SetAt(store.m_strName, i);
+		m_mapIDs.SetAt(store.m_entryID, i);
+		if(store.m_bDefault && m_nDefault<0) m_nDefault=i;
+	}
+	return TRUE;
+}
+
+// without notifications (some providers don't support them on this table) call Invalidate after changes
+void CMAPIStoreDirectory::Advise()
+{
+	CMAPISink* pAdviseSink=new CMAPISink(OnNotify, this);
+	if(m_pTable->Advise(fnevTableModified, pAdviseSink, &m_ulConnection)!=S_OK)
+	{
+		delete pAdviseSink;
+		m_ulConnection=0;
+	}
+}
+
+// One GetProps on the store, the receive folder and one GetProps on the Inbox for the folders it points to,
+// Junk E-mail is the fifth entry of the Inbox's PR_ADDITIONAL_REN_ENTRYIDS.  Folders that aren't found stay
+// empty and the lookup isn't repeated until the store drops out of the table
+void CMAPIStoreDirectory::LoadFolderIDs(int nStore)
+{
+	LPMDB pMsgStore=OpenStore(nStore);
+	if(!pMsgStore) return;
+
+	Store& store=m_arStores[nStore];
+	store.m_bFolderIDs=TRUE;
+	int i;
+	for(i=0;i<SPECIAL_FOLDERS;i++) store.m_folderIDs[i].Empty();
+
+	static const int nStoreFolders[]={ FOLDER_ROOT, FOLDER_OUTBOX, FOLDER_SENT, FOLDER_DELETED };
+	SizedSPropTagArray(4, StoreTags)={4,{PR_IPM_SUBTREE_ENTRYID, PR_IPM_OUTBOX_ENTRYID, PR_IPM_SENTMAIL_ENTRYID, PR_IPM_WASTEBASKET_ENTRYID}};
+	ULONG cValues=0;
+	LPSPropValue pProps=NULL;
+	if(SUCCEEDED(pMsgStore->GetProps((LPSPropTagArray)&StoreTags, CMAPIEx::cm_nMAPICode, &cValues, &pProps)))
+	{
+		for(i=0;i<(int)cValues;i++)
+		{
+			if(PROP_TYPE(pProps[i].ulPropTag)==PT_BINARY) store.m_folderIDs[nStoreFolders[i]].Set(&pProps[i].Value.bin);
+		}
+		MAPIFreeBuffer(pProps);
+	}
+
+	ULONG cbEntryID=0;
+	LPENTRYID pEntryID=NULL;
+	if(pMsgStore->GetReceiveFolder(NULL, 0, &cbEntryID, &pEntryID, NULL)==S_OK)
+	{
+		store.m_folderIDs[FOLDER_INBOX].Set(cbEntryID, (const BYTE*)pEntryID);
+		MAPIFreeBuffer(pEntryID);
+	}
+
+	DWORD dwObjType;
+	LPMAPIFOLDER pInbox=NULL;
+	CMAPIEntryID& inboxID=store.m_folderIDs[FOLDER_INBOX];
+	if(!inboxID.IsEmpty() && pMsgStore->OpenEntry(inboxID.GetSize(), inboxID.GetEntryID(), NULL, MAPI_BEST_ACCESS, &dwObjType, (LPUNKNOWN*)&pInbox)==S_OK)
+	{
+		static const int nInboxFolders[]={ FOLDER_CALENDAR, FOLDER_CONTACTS, FOLDER_JOURNAL, FOLDER_NOTES, FOLDER_TASKS, FOLDER_DRAFTS };
+		SizedSPropTagArray(7, InboxTags)={7,{PR_IPM_APPOINTMENT_ENTRYID, PR_IPM_CONTACT_ENTRYID, PR_IPM_JOURNAL_ENTRYID, PR_IPM_NOTE_ENTRYID,
+			PR_IPM_TASK_ENTRYID, PR_IPM_DRAFTS_ENTRYID, PR_ADDITIONAL_REN_ENTRYIDS}};
+		if(SUCCEEDED(pInbox->GetProps((LPSPropTagArray)&InboxTags, CMAPIEx::cm_nMAPICode, &cValues, &pProps)))
+		{
+			for(i=0;i<(int)cValues && i<6;i++)
+			{
+				if(PROP_TYPE(pProps[i].ulPropTag)==PT_BINARY) store.m_folderIDs[nInboxFolders[i]].Set(&pProps[i].Value.bin);
+			}
+			if(cValues==7 && PROP_TYPE(pProps[6].ulPropTag)==PT_MV_BINARY && pProps[6].Value.MVbin.cValues>ADDITIONAL_REN_JUNK)
+			{
+				SBinary& junkID=pProps[6].Value.MVbin.lpbin[ADDITIONAL_REN_JUNK];
+				if(junkID.cb) store.m_folderIDs[FOLDER_JUNK].Set(&junkID);
+			}
+			MAPIFreeBuffer(pProps);
+		}
+		RELEASE(pInbox);
+	}
+	pMsgStore->Release();
+}
+
+void CMAPIStoreDirectory::ReleaseStores(CArray<Store, Store&>& arStores)
+{
+	for(int i=0;i<arStores.GetSize();i++) RELEASE(arStores[i].m_pMsgStore);
+}
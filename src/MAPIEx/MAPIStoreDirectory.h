@@ -0,0 +1,94 @@
+#ifndef __MAPISTOREDIRECTORY_H__
+#define __MAPISTOREDIRECTORY_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIStoreDirectory.h
+// Description: Cached copy of a session's message stores table and the stores opened from it
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIStoreDirectory
+
+// Reads the stores table of a session in one pass and answers lookups by name, default flag and entry ID from
+// hash tables.  Stores are opened once and the IMsgStore kept for the next caller.  The directory listens to
+// the stores table and reloads on the next lookup after a store is added, removed or changed, keeping the
+// stores that are still there open.  Every CMAPIEx has one, OpenMessageStore goes through it.  The entry IDs
+// of each store's special folders (Inbox, Calendar, Junk E-mail...) are read together the first time one is
+// asked for, so opening any of them afterwards is a single OpenEntry
+class AFX_EXT_CLASS CMAPIStoreDirectory
+{
+public:
+	CMAPIStoreDirectory();
+	~CMAPIStoreDirectory();
+
+	enum { PROP_DISPLAY_NAME, PROP_ENTRYID, PROP_DEFAULT_STORE, STORE_COLS };
+	enum { FOLDER_ROOT, FOLDER_INBOX, FOLDER_OUTBOX, FOLDER_SENT, FOLDER_DELETED, FOLDER_CALENDAR, FOLDER_CONTACTS, FOLDER_JOURNAL,
+		FOLDER_NOTES, FOLDER_TASKS, FOLDER_DRAFTS, FOLDER_JUNK, SPECIAL_FOLDERS };
+	enum { ADDITIONAL_REN_JUNK=4 };
+
+	struct Store
+	{
+		CString m_strName;
+		CMAPIEntryID m_entryID;
+		BOOL m_bDefault;
+		LPMDB m_pMsgStore;
+		BOOL m_bFolderIDs;
+		CMAPIEntryID m_folderIDs[SPECIAL_FOLDERS];
+	};
+
+// Attributes
+protected:
+	IMAPISession* m_pSession;
+	LPMAPITABLE m_pTable;
+	ULONG_PTR m_ulConnection;
+	LONG m_lStale;
+	CArray<Store, Store&> m_arStores;
+	CMap<CString, LPCTSTR, int, int> m_mapNames;
+	CMap<CMAPIEntryID, const CMAPIEntryID&, int, int> m_mapIDs;
+	int m_nDefault;
+
+// Operations
+public:
+	BOOL Load(IMAPISession* pSession);
+	void Close();
+	void Invalidate() { InterlockedExchange(&m_lStale, TRUE); }
+	BOOL IsLoaded() { return (m_pSession!=NULL); }
+
+	int GetCount();
+	LPCTSTR GetName(int nStore);
+	const CMAPIEntryID* GetEntryID(int nStore);
+	BOOL IsDefault(int nStore);
+
+	int FindDefault();
+	int FindName(LPCTSTR szName);
+	int FindEntryID(const CMAPIEntryID& entryID);
+	LPMDB OpenStore(int nStore);
+
+	const CMAPIEntryID* GetFolderID(int nStore, int nFolder);
+	void SetFolderID(int nStore, int nFolder, const CMAPIEntryID& folderID);
+	static int GetSpecialFolder(ULONG ulFolderID);
+
+	static LONG STDAPICALLTYPE OnNotify(LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications);
+
+protected:
+	BOOL Refresh();
+	BOOL ReadTable();
+	void Advise();
+	void LoadFolderIDs(int nStore);
+	void ReleaseStores(CArray<Store, Store&>& arStores);
+
+private:
+	CMAPIStoreDirectory(const CMAPIStoreDirectory&);
+	CMAPIStoreDirectory& operator=(const CMAPIStoreDirectory&);
+};
+
+#endif
@@ -0,0 +1,492 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIVCard.cpp
+// Description: Streaming vCard 3.0/4.0 reader and writer for contacts
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MAPIExPCH.h"
+#include "MAPIEx.h"
+
+// TEL types for each phone number in CContactRecord (ContactPhoneNumberTags order), the ones vCard has no
+// name for get x- names so they survive a round trip
+const LPCSTR VCardPhoneTypes[CContactRecord::MAX_PHONE_NUMBERS]={
+	"voice", "work,voice", "home,voice", "x-callback", "work,voice", "cell,voice", "x-radio", "car", "voice",
+	"pager", "fax", "work,fax", "home,fax", "x-telex", "isdn", "x-assistant", "home,voice", "textphone", "work,x-company-main"
+};
+
+#define PHONE_PRIMARY 0
+#define PHONE_OTHER 8
+
+// ADR types in CContactAddress::AddressType order, other addresses have no type
+const LPCSTR VCardAddressTypes[CContactAddress::MAX_ADDRESS_TYPES]={ "home", "work", NULL };
+
+struct VCardType
+{
+	LPCSTR m_szName;
+	int m_nType;
+};
+
+const VCardType VCardTypes[]={
+	{ "voice", CMAPIVCard::TYPE_VOICE }, { "home", CMAPIVCard::TYPE_HOME }, { "work", CMAPIVCard::TYPE_WORK },
+	{ "cell", CMAPIVCard::TYPE_CELL }, { "fax", CMAPIVCard::TYPE_FAX }, { "pager", CMAPIVCard::TYPE_PAGER },
+	{ "car", CMAPIVCard::TYPE_CAR }, { "isdn", CMAPIVCard::TYPE_ISDN }, { "pref", CMAPIVCard::TYPE_PREF },
+	{ "textphone", CMAPIVCard::TYPE_TEXTPHONE }, { "x-callback", CMAPIVCard::TYPE_CALLBACK },
+	{ "x-radio", CMAPIVCard::TYPE_RADIO }, { "x-telex", CMAPIVCard::TYPE_TELEX },
+	{ "x-assistant", CMAPIVCard::TYPE_ASSISTANT }, { "x-company-main", CMAPIVCard::TYPE_COMPANY_MAIN },
+	{ NULL, 0 }
+};
+
+/////////////////////////////////////////////////////////////
+// CMAPIVCard
+
+CMAPIVCard::CMAPIVCard()
+{
+	m_nVersion=VCARD_30;
+}
+
+// opens szPath for reading, or creates it for writing vCards of nVersion
+BOOL CMAPIVCard::Open(LPCTSTR szPath, BOOL bWrite, int nVersion)
+{
+	m_nVersion=(nVersion==VCARD_40) ? VCARD_40 : VCARD_30;
+	return CMAPIContentFile::Open(szPath, bWrite);
+}
+
+BOOL CMAPIVCard::Write(CContactRecord& record)
+{
+	if(!m_bOpen || !m_bWrite) return FALSE;
+
+	PutASCII("BEGIN:VCARD");
+	EndLine();
+	PutASCII((m_nVersion==VCARD_40) ? "VERSION:4.0" : "VERSION:3.0");
+	EndLine();
+
+	// FN is required, N is required by 3.0
+	LPCTSTR szName=record.m_strDisplayName.GetLength() ? record.m_strDisplayName : record.m_strFileAs;
+	BeginProperty("FN", NULL);
+	PutValue(szName);
+	EndLine();
+
+	LPCTSTR szNames[]={ record.m_strSurname, record.m_strGivenName, record.m_strMiddleName, record.m_strDisplayNamePrefix, record.m_strGeneration };
+	if(m_nVersion==VCARD_30 && !*szNames[0] && !*szNames[1] && !*szNames[2] && !*szNames[3] && !*szNames[4])
+	{
+		PutASCII("N:;;;;");
+		EndLine();
+	}
+	else WriteStructured("N", szNames, 5);
+
+	WriteText("NICKNAME", record.m_strNickName);
+	LPCTSTR szOrg[]={ record.m_strCompany, record.m_strDepartment };
+	WriteStructured("ORG", szOrg, record.m_strDepartment.GetLength() ? 2 : 1);
+	WriteText("TITLE", record.m_strTitle);
+	WriteText("ROLE", record.m_strProfession);
+
+	int i;
+	BOOL bPref=TRUE;
+	for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+	{
+		if(record.m_strEmail[i].IsEmpty()) continue;
+		if(m_nVersion==VCARD_40) WriteText("EMAIL", record.m_strEmail[i], bPref ? "PREF=1" : NULL);
+		else WriteText("EMAIL", record.m_strEmail[i], bPref ? "TYPE=internet,pref" : "TYPE=internet");
+		bPref=FALSE;
+	}
+
+	char szParams[64];
+	for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+	{
+		if(record.m_strPhoneNumbers[i].IsEmpty()) continue;
+		if(m_nVersion==VCARD_40) sprintf_s(szParams, sizeof(szParams), "VALUE=text;TYPE=%s%s", VCardPhoneTypes[i], (i==PHONE_PRIMARY) ? ";PREF=1" : "");
+		else sprintf_s(szParams, sizeof(szParams), "TYPE=%s%s", VCardPhoneTypes[i], (i==PHONE_PRIMARY) ? ",pref" : "");
+		WriteText("TEL", record.m_strPhoneNumbers[i], szParams);
+	}
+
+	for(i=0;i<CContactAddress::MAX_ADDRESS_TYPES;i++)
+	{
+		// post office box; extended address; street; locality; region; postal code; country
+		LPCTSTR szAddress[]={ _T(""), _T(""), record.m_strStreet[i], record.m_strCity[i], record.m_strStateOrProvince[i], record.m_strPostalCode[i], record.m_strCountry[i] };
+		if(VCardAddressTypes[i]) sprintf_s(szParams, sizeof(szParams), "TYPE=%s", VCardAddressTypes[i]);
+		WriteStructured("ADR", szAddress, 7, VCardAddressTypes[i] ? szParams : NULL);
+	}
+
+	WriteText("URL", record.m_strHomePage, "TYPE=home");
+	WriteText("URL", record.m_strBusinessHomePage, "TYPE=work");
+	WriteText("IMPP", record.m_strIMAddress);
+	if(record.m_bBirthday) WriteDate("BDAY", record.m_tmBirthday);
+	if(record.m_bAnniversary) WriteDate((m_nVersion==VCARD_40) ? "ANNIVERSARY" : "X-ANNIVERSARY", record.m_tmAnniversary);
+	WriteText("X-MS-ASSISTANT", record.m_strAssistantName);
+	WriteText("X-MS-MANAGER", record.m_strManagerName);
+	WriteText("X-MS-SPOUSE", record.m_strSpouseName);
+	WriteList("CATEGORIES", record.m_strCategories);
+
+	// vCard 4.0 dropped CLASS
+	if(m_nVersion==VCARD_30 && record.m_nSensitivity>0)
+	{
+		PutASCII((record.m_nSensitivity==SENSITIVITY_COMPANY_CONFIDENTIAL) ? "CLASS:CONFIDENTIAL" : "CLASS:PRIVATE");
+		EndLine();
+	}
+
+	if(record.m_ftLastModified.dwLowDateTime || record.m_ftLastModified.dwHighDateTime)
+	{
+		SYSTEMTIME tm;
+		if(FileTimeToSystemTime(&record.m_ftLastModified, &tm)) WriteDate("REV", tm, TRUE);
+	}
+
+	PutASCII("END:VCARD");
+	EndLine();
+	return !m_bError;
+}
+
+// reads the next vCard in the file into record, returns FALSE at the end of the file
+BOOL CMAPIVCard::Read(CContactRecord& record)
+{
+	record.Empty();
+	if(!m_bOpen || m_bWrite) return FALSE;
+
+	CStringA strLine;
+	BOOL bCard=FALSE;
+	while(ReadLine(strLine))
+	{
+		LPSTR szLine=strLine.GetBuffer();
+		if(!bCard) bCard=!_stricmp(szLine, "BEGIN:VCARD");
+		else if(!_stricmp(szLine, "END:VCARD")) return TRUE;
+		else ReadProperty(szLine, record);
+		strLine.ReleaseBuffer();
+	}
+	return FALSE;
+}
+
+// writes every contact in folder using its contents table, returns the number written or -1 on error
+int CMAPIVCard::Export(CMAPIFolder& folder, CMAPIContactLoader& loader)
+{
+	if(!m_bOpen || !m_bWrite || !folder.GetContactContents(loader)) return -1;
+
+	CContactRecord record;
+	int nCount=0;
+	while(folder.GetNextContact(record))
+	{
+		if(!Write(record)) return -1;
+		nCount++;
+	}
+	return Flush() ? nCount : -1;
+}
+
+// Creates a contact in pFolder (the contacts folder if NULL) for every vCard left in the file with a single
+// SetProps each, the SaveChanges are deferred and done in batches (see Defer).  Init loader with bCreate on
+// the target store first, otherwise it is initialized from the first contact created.  Returns the number of
+// contacts imported, or -1 if the file or folder couldn't be used.  MAPI can't undo a save, so the import
+// stops at the first contact that can't be created, written or saved and the ones before it stay in the
+// folder: pnFailed gets the number of vCards that weren't imported (that one and the rest of the file)
+int CMAPIVCard::Import(CMAPIEx* pMAPI, CMAPIFolder* pFolder, CMAPIContactLoader& loader, int* pnFailed)
+{
+	if(pnFailed) *pnFailed=0;
+	if(!m_bOpen || m_bWrite || !pMAPI) return -1;
+	if(!pFolder) pFolder=pMAPI->GetFolder();
+	if(!pFolder) pFolder=pMAPI->OpenContacts();
+	if(!pFolder) return -1;
+
+	CContactRecord record;
+	CMAPIContact contact;
+	int nCount=0, nFailed=0;
+	BOOL bFailed=FALSE;
+	while(Read(record))
+	{
+		if(bFailed)
+		{
+			nFailed++;
+			continue;
+		}
+
+		if(!contact.Create(pMAPI, pFolder, FALSE) || (!loader.IsInitialized() && !loader.Init(contact.Contact(), TRUE)) || !loader.Write(contact, record, TRUE))
+		{
+			contact.Close();
+			nFailed++;
+			bFailed=TRUE;
+		}
+		else if(!Defer(contact, nCount, nFailed)) bFailed=TRUE;
+	}
+	SaveDeferred(nCount, nFailed);
+
+	if(pnFailed) *pnFailed=nFailed;
+	return nCount;
+}
+
+void CMAPIVCard::WriteText(LPCSTR szName, LPCTSTR szValue, LPCSTR szParams)
+{
+	if(!szValue || !*szValue) return;
+	BeginProperty(szName, szParams);
+	PutValue(szValue);
+	EndLine();
+}
+
+// components are separated by ';', nothing is written if they are all empty
+void CMAPIVCard::WriteStructured(LPCSTR szName, LPCTSTR* szValues, int nCount, LPCSTR szParams)
+{
+	int i;
+	for(i=0;i<nCount;i++)
+	{
+		if(szValues[i] && *szValues[i]) break;
+	}
+	if(i==nCount) return;
+
+	BeginProperty(szName, szParams);
+	for(i=0;i<nCount;i++)
+	{
+		if(i) Put(";", 1);
+		if(szValues[i]) PutValue(szValues[i]);
+	}
+	EndLine();
+}
+
+// szValues is ';' separated like CMAPIContact::GetCategories, written as a ',' separated list
+void CMAPIVCard::WriteList(LPCSTR szName, LPCTSTR szValues)
+{
+	if(!szValues) return;
+
+	BOOL bFirst=TRUE;
+	LPCTSTR szValue=szValues;
+	for(int i=0;;i++)
+	{
+		if(szValues[i] && szValues[i]!=(TCHAR)';') continue;
+
+		int nLength=(int)(szValues+i-szValue);
+		if(nLength)
+		{
+			if(bFirst) BeginProperty(szName, NULL);
+			else Put(",", 1);
+			PutValue(szValue, nLength);
+			bFirst=FALSE;
+		}
+		if(!szValues[i]) break;
+		szValue=szValues+i+1;
+	}
+	if(!bFirst) EndLine();
+}
+
+// dates only unless bTime, which writes tm as UTC
+void CMAPIVCard::WriteDate(LPCSTR szName, SYSTEMTIME& tm, BOOL bTime)
+{
+	char szDate[32];
+	if(m_nVersion==VCARD_40)
+	{
+		if(bTime) sprintf_s(szDate, sizeof(szDate), "%04d%02d%02dT%02d%02d%02dZ", tm.wYear, tm.wMonth, tm.wDay, tm.wHour, tm.wMinute, tm.wSecond);
+		else sprintf_s(szDate, sizeof(szDate), "%04d%02d%02d", tm.wYear, tm.wMonth, tm.wDay);
+	}
+	else
+	{
+		if(bTime) sprintf_s(szDate, sizeof(szDate), "%04d-%02d-%02dT%02d:%02d:%02dZ", tm.wYear, tm.wMonth, tm.wDay, tm.wHour, tm.wMinute, tm.wSecond);
+		else sprintf_s(szDate, sizeof(szDate), "%04d-%02d-%02d", tm.wYear, tm.wMonth, tm.wDay);
+	}
+	BeginProperty(szName, NULL);
+	PutASCII(szDate);
+	EndLine();
+}
+
+// szLine is "[group.]NAME[;params]:value" and is modified in place
+void CMAPIVCard::ReadProperty(LPSTR szLine, CContactRecord& record)
+{
+	LPSTR szParams, szValue;
+	LPSTR szName=SplitLine(szLine, szParams, szValue);
+	if(!szName) return;
+
+	LPSTR szComponents[MAX_COMPONENTS];
+	int i;
+	if(!_stricmp(szName, "FN"))
+	{
+		Decode(szValue, record.m_strDisplayName);
+	}
+	else if(!_stricmp(szName, "N"))
+	{
+		Split(szValue, szComponents, 5, ';');
+		Decode(szComponents[0], record.m_strSurname);
+		Decode(szComponents[1], record.m_strGivenName);
+		Decode(szComponents[2], record.m_strMiddleName);
+		Decode(szComponents[3], record.m_strDisplayNamePrefix);
+		Decode(szComponents[4], record.m_strGeneration);
+	}
+	else if(!_stricmp(szName, "NICKNAME"))
+	{
+		Split(szValue, szComponents, 2, ',');
+		Decode(szComponents[0], record.m_strNickName);
+	}
+	else if(!_stricmp(szName, "ORG"))
+	{
+		Split(szValue, szComponents, 3, ';');
+		Decode(szComponents[0], record.m_strCompany);
+		Decode(szComponents[1], record.m_strDepartment);
+	}
+	else if(!_stricmp(szName, "TITLE"))
+	{
+		Decode(szValue, record.m_strTitle);
+	}
+	else if(!_stricmp(szName, "ROLE"))
+	{
+		Decode(szValue, record.m_strProfession);
+	}
+	else if(!_stricmp(szName, "EMAIL"))
+	{
+		for(i=0;i<CContactRecord::MAX_EMAILS;i++)
+		{
+			if(record.m_strEmail[i].IsEmpty())
+			{
+				Decode(szValue, record.m_strEmail[i]);
+				break;
+			}
+		}
+	}
+	else if(!_stricmp(szName, "TEL"))
+	{
+		// the phone number whose types match exactly, then ignoring pref, then other.  VOICE is the default
+		int nTypes=ParseTypes(szParams)&~TYPE_VOICE;
+		int nPhone=-1;
+		for(int nPass=0;nPass<2 && nPhone<0;nPass++)
+		{
+			int nMask=nPass ? ~TYPE_PREF : ~0;
+			for(i=0;i<CContactRecord::MAX_PHONE_NUMBERS;i++)
+			{
+				int nPhoneTypes=ParseTypes(VCardPhoneTypes[i])&~TYPE_VOICE;
+				if(i==PHONE_PRIMARY) nPhoneTypes|=TYPE_PREF;
+				if((nPhoneTypes&nMask)==(nTypes&nMask) && record.m_strPhoneNumbers[i].IsEmpty())
+				{
+					nPhone=i;
+					break;
+				}
+			}
+		}
+		if(nPhone<0 && record.m_strPhoneNumbers[PHONE_OTHER].IsEmpty()) nPhone=PHONE_OTHER;
+		if(nPhone>=0) Decode(szValue, record.m_strPhoneNumbers[nPhone]);
+	}
+	else if(!_stricmp(szName, "ADR"))
+	{
+		int nTypes=ParseTypes(szParams);
+		int nAddress=(nTypes&TYPE_HOME) ? CContactAddress::HOME : (nTypes&TYPE_WORK) ? CContactAddress::BUSINESS : CContactAddress::OTHER;
+		if(record.m_strStreet[nAddress].GetLength() || record.m_strCity[nAddress].GetLength() || record.m_strPostalCode[nAddress].GetLength()) return;
+
+		Split(szValue, szComponents, 7, ';');
+		Decode(szComponents[2], record.m_strStreet[nAddress]);
+		Decode(szComponents[3], record.m_strCity[nAddress]);
+		Decode(szComponents[4], record.m_strStateOrProvince[nAddress]);
+		Decode(szComponents[5], record.m_strPostalCode[nAddress]);
+		Decode(szComponents[6], record.m_strCountry[nAddress]);
+	}
+	else if(!_stricmp(szName, "URL"))
+	{
+		BOOL bWork=(ParseTypes(szParams)&TYPE_WORK) || record.m_strHomePage.GetLength();
+		if(bWork && record.m_strBusinessHomePage.IsEmpty()) Decode(szValue, record.m_strBusinessHomePage);
+		else if(!bWork) Decode(szValue, record.m_strHomePage);
+	}
+	else if(!_stricmp(szName, "IMPP") || !_stricmp(szName, "X-MS-IMADDRESS"))
+	{
+		if(record.m_strIMAddress.IsEmpty()) Decode(szValue, record.m_strIMAddress);
+	}
+	else if(!_stricmp(szName, "BDAY"))
+	{
+		record.m_bBirthday=ParseDate(szValue, record.m_tmBirthday);
+	}
+	else if(!_stricmp(szName, "ANNIVERSARY") || !_stricmp(szName, "X-ANNIVERSARY") || !_stricmp(szName, "X-MS-ANNIVERSARY"))
+	{
+		record.m_bAnniversary=ParseDate(szValue, record.m_tmAnniversary);
+	}
+	else if(!_stricmp(szName, "X-MS-ASSISTANT") || !_stricmp(szName, "X-ASSISTANT"))
+	{
+		Decode(szValue, record.m_strAssistantName);
+	}
+	else if(!_stricmp(szName, "X-MS-MANAGER") || !_stricmp(szName, "X-MANAGER"))
+	{
+		Decode(szValue, record.m_strManagerName);
+	}
+	else if(!_stricmp(szName, "X-MS-SPOUSE") || !_stricmp(szName, "X-SPOUSE"))
+	{
+		Decode(szValue, record.m_strSpouseName);
+	}
+	else if(!_stricmp(szName, "CATEGORIES"))
+	{
+		CString strCategory;
+		while(szValue)
+		{
+			int nCount=Split(szValue, szComponents, 2, ',');
+			Decode(szComponents[0], strCategory);
+			if(strCategory.GetLength())
+			{
+				if(record.m_strCategories.GetLength()) record.m_strCategories+=(TCHAR)';';
+				record.m_strCategories+=strCategory;
+			}
+			szValue=(nCount>1) ? szComponents[1] : NULL;
+		}
+	}
+	else if(!_stricmp(szName, "CLASS"))
+	{
+		if(!_stricmp(szValue, "PUBLIC")) record.m_nSensitivity=SENSITIVITY_NONE;
+		else if(!_stricmp(szValue, "PRIVATE")) record.m_nSensitivity=SENSITIVITY_PRIVATE;
+		else if(!_stricmp(szValue, "CONFIDENTIAL")) record.m_nSensitivity=SENSITIVITY_COMPANY_CONFIDENTIAL;
+	}
+}
+
+// TYPE=a,b;PREF=1 (3.0/4.0) or bare a;b (2.1) into TYPE_ flags
+int CMAPIVCard::ParseTypes(LPCSTR szParams)
+{
+	int nTypes=0;
+	while(szParams && *szParams)
+	{
+		// one parameter up to the next ';'
+		LPCSTR szEnd=strchr(szParams, ';');
+		int nLength=szEnd ? (int)(szEnd-szParams) : (int)strlen(szParams);
+		LPCSTR szEquals=(LPCSTR)memchr(szParams, '=', nLength);
+		if(szEquals && (szEquals-szParams)==4 && !_strnicmp(szParams, "PREF", 4))
+		{
+			nTypes|=TYPE_PREF;
+		}
+		else if(!szEquals || ((szEquals-szParams)==4 && !_strnicmp(szParams, "TYPE", 4)))
+		{
+			LPCSTR szType=szEquals ? szEquals+1 : szParams;
+			LPCSTR szParamEnd=szParams+nLength;
+			while(szType<szParamEnd)
+			{
+				if(*szType=='"' || *szType==',')
+				{
+					szType++;
+					continue;
+				}
+				int nType=0;
+				while(szType+nType<szParamEnd && szType[nType]!=',' && szType[nType]!='"') nType++;
+				for(int i=0;VCardTypes[i].m_szName;i++)
+				{
+					if((int)strlen(VCardTypes[i].m_szName)==nType && !_strnicmp(szType, VCardTypes[i].m_szName, nType))
+					{
+						nTypes|=VCardTypes[i].m_nType;
+						break;
+					}
+				}
+				szType+=nType;
+			}
+		}
+		szParams=szEnd ? szEnd+1 : NULL;
+	}
+	return nTypes;
+}
+
+// yyyy-mm-dd or yyyymmdd, any time part is ignored.  Dates without a year (--mmdd) aren't supported
+BOOL CMAPIVCard::ParseDate(LPCSTR szValue, SYSTEMTIME& tm)
+{
+	int nDigits[8];
+	int nCount=0;
+	for(;*szValue && *szValue!='T' && *szValue!='t';szValue++)
+	{
+		if(*szValue=='-') continue;
+		if(*szValue<'0' || *szValue>'9' || nCount==8) return FALSE;
+		nDigits[nCount++]=*szValue-'0';
+	}
+	if(nCount!=8) return FALSE;
+
+	memset(&tm, 0, sizeof(SYSTEMTIME));
+	tm.wYear=(WORD)(nDigits[0]*1000+nDigits[1]*100+nDigits[2]*10+nDigits[3]);
+	tm.wMonth=(WORD)(nDigits[4]*10+nDigits[5]);
+	tm.wDay=(WORD)(nDigits[6]*10+nDigits[7]);
+	return (tm.wYear && tm.wMonth>=1 && tm.wMonth<=12 && tm.wDay>=1 && tm.wDay<=31);
+}
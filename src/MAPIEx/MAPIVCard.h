@@ -0,0 +1,72 @@
+#ifndef __MAPIVCARD_H__
+#define __MAPIVCARD_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: MAPIVCard.h
+// Description: Streaming vCard 3.0/4.0 reader and writer for contacts
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/////////////////////////////////////////////////////////////
+// CMAPIVCard
+
+// Reads or writes a .vcf file holding any number of contacts, one CContactRecord at a time through the fixed
+// buffer of CMAPIContentFile, so memory use doesn't grow with the size of the folder or file:
+//
+//		CMAPIVCard vcard;
+//		if(vcard.Open(szPath, TRUE)) vcard.Export(folder, loader);
+//
+//		CMAPIContactLoader loader;
+//		int nFailed;
+//		if(vcard.Open(szPath) && loader.Init(folder.Folder(), TRUE)) vcard.Import(pMAPI, &folder, loader, &nFailed);
+class AFX_EXT_CLASS CMAPIVCard : public CMAPIContentFile
+{
+public:
+	CMAPIVCard();
+
+	enum { VCARD_30=3, VCARD_40=4 };
+	enum { MAX_COMPONENTS=8 };
+
+	// TEL and ADR TYPE parameters we understand
+	enum { TYPE_VOICE=0x0001, TYPE_HOME=0x0002, TYPE_WORK=0x0004, TYPE_CELL=0x0008, TYPE_FAX=0x0010, TYPE_PAGER=0x0020,
+		TYPE_CAR=0x0040, TYPE_ISDN=0x0080, TYPE_PREF=0x0100, TYPE_TEXTPHONE=0x0200, TYPE_CALLBACK=0x0400, TYPE_RADIO=0x0800,
+		TYPE_TELEX=0x1000, TYPE_ASSISTANT=0x2000, TYPE_COMPANY_MAIN=0x4000
+	};
+
+// Attributes
+protected:
+	int m_nVersion;
+
+// Operations
+public:
+	BOOL Open(LPCTSTR szPath, BOOL bWrite=FALSE, int nVersion=VCARD_30);
+
+	BOOL Write(CContactRecord& record);
+	BOOL Read(CContactRecord& record);
+	int Export(CMAPIFolder& folder, CMAPIContactLoader& loader);
+	int Import(CMAPIEx* pMAPI, CMAPIFolder* pFolder, CMAPIContactLoader& loader, int* pnFailed=NULL);
+
+protected:
+	void WriteText(LPCSTR szName, LPCTSTR szValue, LPCSTR szParams=NULL);
+	void WriteStructured(LPCSTR szName, LPCTSTR* szValues, int nCount, LPCSTR szParams=NULL);
+	void WriteList(LPCSTR szName, LPCTSTR szValues);
+	void WriteDate(LPCSTR szName, SYSTEMTIME& tm, BOOL bTime=FALSE);
+
+	void ReadProperty(LPSTR szLine, CContactRecord& record);
+	static int ParseTypes(LPCSTR szParams);
+	static BOOL ParseDate(LPCSTR szValue, SYSTEMTIME& tm);
+
+private:
+	CMAPIVCard(const CMAPIVCard&);
+	CMAPIVCard& operator=(const CMAPIVCard&);
+};
+
+#endif
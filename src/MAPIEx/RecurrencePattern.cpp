@@ -0,0 +1,1066 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: RecurrencePattern.cpp
+// Description: Parses recurrence blobs and expands their occurrences without MFC or MAPI
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// not built with the precompiled header, nothing from Windows may be used here
+#include "RecurrencePattern.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#define RECUR_READER_VERSION 0x3004
+#define RECUR_READER_VERSION2 0x3006
+#define RECUR_WRITER_VERSION2_HIGHLIGHT 0x3009
+
+// RRULE day names, Sunday first like CRecurrenceDate::wDayOfWeek and the day masks
+const char* RecurRuleDays[]={ "SU", "MO", "TU", "WE", "TH", "FR", "SA" };
+
+// the largest INTERVAL Outlook offers
+const int RecurMaxInterval=999;
+
+// FILETIME ticks per minute
+const uint64_t RecurTicksPerMinute=600000000;
+
+// days from 1601-01-01 to 1970-01-01, DaysFromDate and DateFromDays count from 1970 internally
+const int RecurDays1601To1970=134774;
+
+// sorts m_arExceptionOrder by the new start times
+class CRecurrenceExceptionLess
+{
+public:
+	CRecurrenceExceptionLess(const std::vector<CRecurrencePatternException>& arExceptions) : m_arExceptions(arExceptions) { }
+	bool operator()(int n1, int n2) const { return m_arExceptions[n1].m_dwStart<m_arExceptions[n2].m_dwStart; }
+
+protected:
+	const std::vector<CRecurrencePatternException>& m_arExceptions;
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrencePatternException
+
+CRecurrencePatternException::CRecurrencePatternException()
+{
+	m_dwStart=m_dwEnd=m_dwOriginalStart=0;
+	m_wOverrideFlags=0;
+	m_bExtended=false;
+	m_nBusyStatus=-1;
+}
+
+/////////////////////////////////////////////////////////////
+// CRecurrencePattern
+
+CRecurrencePattern::CRecurrencePattern()
+{
+	Empty();
+}
+
+void CRecurrencePattern::Empty()
+{
+	EmptyPattern();
+	m_bTimeZone=false;
+	m_lBias=m_lStandardBias=m_lDaylightBias=0;
+	memset(&m_tmStandardDate, 0, sizeof(CRecurrenceDate));
+	memset(&m_tmDaylightDate, 0, sizeof(CRecurrenceDate));
+}
+
+void CRecurrencePattern::EmptyPattern()
+{
+	m_wFrequency=m_wPatternType=m_wCalendarType=0;
+	m_dwFirstDateTime=m_dwPeriod=m_dwDayMask=m_dwDayOfMonth=0;
+	m_dwEndType=END_NEVER;
+	m_dwOccurrenceCount=m_dwFirstDOW=0;
+	m_dwStartDate=0;
+	m_dwEndDate=END_DATE_NEVER;
+	m_dwStartTimeOffset=m_dwEndTimeOffset=0;
+	m_arDeletedDates.clear();
+	m_arModifiedDates.clear();
+	m_arExceptions.clear();
+	m_arExceptionOrder.clear();
+}
+
+// Reads an AppointmentRecurrencePattern, every read is bounds checked so a truncated or corrupt blob fails
+// instead of reading past cb.  The time zone set by SetTimeZone is kept
+bool CRecurrencePattern::Parse(const uint8_t* pData, uint32_t cb)
+{
+	EmptyPattern();
+	if(!pData) return false;
+	const uint8_t* pEnd=pData+cb;
+
+	uint16_t wReaderVersion, wWriterVersion;
+	uint32_t dwSlidingFlag, dwValue;
+	if(!ReadWord(pData, pEnd, wReaderVersion) || !ReadWord(pData, pEnd, wWriterVersion)) return false;
+	if(wReaderVersion!=RECUR_READER_VERSION || wWriterVersion!=RECUR_READER_VERSION) return false;
+	if(!ReadWord(pData, pEnd, m_wFrequency) || !ReadWord(pData, pEnd, m_wPatternType) || !ReadWord(pData, pEnd, m_wCalendarType)) return false;
+	if(!ReadDWord(pData, pEnd, m_dwFirstDateTime) || !ReadDWord(pData, pEnd, m_dwPeriod) || !ReadDWord(pData, pEnd, dwSlidingFlag)) return false;
+
+	switch(m_wPatternType)
+	{
+	case PATTERN_DAY:
+		break;
+	case PATTERN_WEEK:
+		if(!ReadDWord(pData, pEnd, m_dwDayMask)) return false;
+		break;
+	case PATTERN_MONTH:
+	case PATTERN_MONTH_END:
+	case PATTERN_HJ_MONTH:
+	case PATTERN_HJ_MONTH_END:
+		if(!ReadDWord(pData, pEnd, m_dwDayOfMonth)) return false;
+		break;
+	case PATTERN_MONTH_NTH:
+	case PATTERN_HJ_MONTH_NTH:
+		if(!ReadDWord(pData, pEnd, m_dwDayMask) || !ReadDWord(pData, pEnd, m_dwDayOfMonth)) return false;
+		break;
+	default:
+		return false;
+	}
+
+	if(!ReadDWord(pData, pEnd, m_dwEndType) || !ReadDWord(pData, pEnd, m_dwOccurrenceCount) || !ReadDWord(pData, pEnd, m_dwFirstDOW)) return false;
+	if(!ReadDates(pData, pEnd, m_arDeletedDates) || !ReadDates(pData, pEnd, m_arModifiedDates)) return false;
+	if(!ReadDWord(pData, pEnd, m_dwStartDate) || !ReadDWord(pData, pEnd, m_dwEndDate)) return false;
+
+	// the appointment specific part, ReaderVersion2 and WriterVersion2 first
+	uint32_t dwWriterVersion2;
+	uint16_t wExceptionCount;
+	if(!ReadDWord(pData, pEnd, dwValue) || !ReadDWord(pData, pEnd, dwWriterVersion2)) return false;
+	if(!ReadDWord(pData, pEnd, m_dwStartTimeOffset) || !ReadDWord(pData, pEnd, m_dwEndTimeOffset)) return false;
+	if(!ReadWord(pData, pEnd, wExceptionCount)) return false;
+
+	// an ExceptionInfo is at least 14 bytes, don't let a corrupt count allocate more than the blob could hold
+	if(wExceptionCount>(pEnd-pData)/14) return false;
+	m_arExceptions.resize(wExceptionCount);
+	int i;
+	for(i=0;i<wExceptionCount;i++)
+	{
+		CRecurrencePatternException& exception=m_arExceptions[i];
+		if(!ReadDWord(pData, pEnd, exception.m_dwStart) || !ReadDWord(pData, pEnd, exception.m_dwEnd)) return false;
+		if(!ReadDWord(pData, pEnd, exception.m_dwOriginalStart) || !ReadWord(pData, pEnd, exception.m_wOverrideFlags)) return false;
+
+		// the fields present follow the order of the ARO flags
+		uint16_t wFlags=exception.m_wOverrideFlags;
+		if((wFlags&ARO_SUBJECT) && !ReadString(pData, pEnd, exception.m_strSubject)) return false;
+		if((wFlags&ARO_MEETINGTYPE) && !ReadDWord(pData, pEnd, dwValue)) return false;
+		if((wFlags&ARO_REMINDERDELTA) && !ReadDWord(pData, pEnd, dwValue)) return false;
+		if((wFlags&ARO_REMINDER) && !ReadDWord(pData, pEnd, dwValue)) return false;
+		if((wFlags&ARO_LOCATION) && !ReadString(pData, pEnd, exception.m_strLocation)) return false;
+		if(wFlags&ARO_BUSYSTATUS)
+		{
+			if(!ReadDWord(pData, pEnd, dwValue)) return false;
+			exception.m_nBusyStatus=(int)dwValue;
+		}
+		if((wFlags&ARO_ATTACHMENT) && !ReadDWord(pData, pEnd, dwValue)) return false;
+		if((wFlags&ARO_SUBTYPE) && !ReadDWord(pData, pEnd, dwValue)) return false;
+		if((wFlags&ARO_APPTCOLOR) && !ReadDWord(pData, pEnd, dwValue)) return false;
+	}
+
+	// the ExtendedExceptions hold the subject and location as UTF-16, the ANSI ones above are all there is if
+	// they're missing since some writers leave them out
+	bool bExtended=(ReadDWord(pData, pEnd, dwValue) && Skip(pData, pEnd, dwValue));
+	for(i=0;i<wExceptionCount && bExtended;i++)
+	{
+		CRecurrencePatternException& exception=m_arExceptions[i];
+		if(dwWriterVersion2>=RECUR_WRITER_VERSION2_HIGHLIGHT)
+		{
+			bExtended=(ReadDWord(pData, pEnd, dwValue) && Skip(pData, pEnd, dwValue));
+		}
+		bExtended=bExtended && ReadDWord(pData, pEnd, dwValue) && Skip(pData, pEnd, dwValue);
+		if(bExtended && (exception.m_wOverrideFlags&(ARO_SUBJECT|ARO_LOCATION)))
+		{
+			std::vector<uint16_t> arSubject, arLocation;
+			bExtended=Skip(pData, pEnd, 3*sizeof(uint32_t));
+			if(bExtended && (exception.m_wOverrideFlags&ARO_SUBJECT)) bExtended=ReadStringW(pData, pEnd, arSubject);
+			if(bExtended && (exception.m_wOverrideFlags&ARO_LOCATION)) bExtended=ReadStringW(pData, pEnd, arLocation);
+			bExtended=bExtended && ReadDWord(pData, pEnd, dwValue) && Skip(pData, pEnd, dwValue);
+			if(bExtended)
+			{
+				exception.m_arSubjectW.swap(arSubject);
+				exception.m_arLocationW.swap(arLocation);
+				exception.m_bExtended=true;
+			}
+		}
+	}
+
+	// the expander walks both in order
+	std::sort(m_arDeletedDates.begin(), m_arDeletedDates.end());
+	m_arExceptionOrder.resize(wExceptionCount);
+	for(i=0;i<wExceptionCount;i++) m_arExceptionOrder[i]=i;
+	std::sort(m_arExceptionOrder.begin(), m_arExceptionOrder.end(), CRecurrenceExceptionLess(m_arExceptions));
+	return true;
+}
+
+// pData is a TimeZoneStruct (TZREG), without one the blob's times are treated as UTC
+bool CRecurrencePattern::SetTimeZone(const uint8_t* pData, uint32_t cb)
+{
+	m_bTimeZone=false;
+	if(!pData || cb<TIMEZONE_STRUCT_SIZE) return false;
+
+	const uint8_t* pEnd=pData+cb;
+	uint32_t dwValue;
+	uint16_t wYear;
+	ReadDWord(pData, pEnd, dwValue);
+	m_lBias=(int32_t)dwValue;
+	ReadDWord(pData, pEnd, dwValue);
+	m_lStandardBias=(int32_t)dwValue;
+	ReadDWord(pData, pEnd, dwValue);
+	m_lDaylightBias=(int32_t)dwValue;
+
+	CRecurrenceDate* pDates[2]={ &m_tmStandardDate, &m_tmDaylightDate };
+	for(int i=0;i<2;i++)
+	{
+		CRecurrenceDate& tm=*pDates[i];
+		ReadWord(pData, pEnd, wYear);
+		ReadWord(pData, pEnd, tm.wYear);
+		ReadWord(pData, pEnd, tm.wMonth);
+		ReadWord(pData, pEnd, tm.wDayOfWeek);
+		ReadWord(pData, pEnd, tm.wDay);
+		ReadWord(pData, pEnd, tm.wHour);
+		ReadWord(pData, pEnd, tm.wMinute);
+		ReadWord(pData, pEnd, tm.wSecond);
+		ReadWord(pData, pEnd, tm.wMilliseconds);
+	}
+	m_bTimeZone=true;
+	return true;
+}
+
+// Sets the pattern from an iCalendar RRULE (RFC 5545) whose first instance runs from dwStart to dwEnd, local
+// minutes in the time zone set by SetTimeZone.  Only rules Outlook can store are accepted: DAILY, WEEKLY,
+// MONTHLY or YEARLY with INTERVAL, COUNT or UNTIL, WKST, BYDAY, BYMONTHDAY and BYSETPOS for a single day of
+// the month, and BYMONTH for the month of the start.  The start date is moved to the first occurrence when
+// dwStart doesn't match the rule
+bool CRecurrencePattern::ParseRule(const char* szRule, uint32_t dwStart, uint32_t dwEnd)
+{
+	EmptyPattern();
+	if(!szRule || dwEnd<dwStart || dwStart>=END_DATE_NEVER) return false;
+
+	std::string strRule(szRule);
+	size_t i;
+	for(i=0;i<strRule.size();i++) strRule[i]=(char)toupper((unsigned char)strRule[i]);
+
+	std::string strFrequency, strUntil;
+	int nInterval=1, nCount=0, nMonth=0;
+	std::vector<int> arDays, arOrdinals, arMonthDays, arSetPos, arFirstDOW, arNone;
+	size_t nPos=0;
+	while(nPos<strRule.size())
+	{
+		size_t nEnd=strRule.find(';', nPos);
+		if(nEnd==std::string::npos) nEnd=strRule.size();
+		std::string strPart=strRule.substr(nPos, nEnd-nPos);
+		nPos=nEnd+1;
+		if(strPart.empty()) continue;
+
+		size_t nEquals=strPart.find('=');
+		if(nEquals==std::string::npos) return false;
+		std::string strName=strPart.substr(0, nEquals);
+		const char* szValue=strPart.c_str()+nEquals+1;
+		if(strName=="FREQ") strFrequency=szValue;
+		else if(strName=="INTERVAL") nInterval=atoi(szValue);
+		else if(strName=="COUNT") nCount=atoi(szValue);
+		else if(strName=="UNTIL") strUntil=szValue;
+		else if(strName=="BYMONTH") nMonth=strchr(szValue, ',') ? -1 : atoi(szValue);
+		else if(strName=="WKST")
+		{
+			if(!ParseRuleList(szValue, arNone, &arFirstDOW) || arFirstDOW.size()!=1) return false;
+		}
+		else if(strName=="BYDAY")
+		{
+			if(!ParseRuleList(szValue, arOrdinals, &arDays)) return false;
+		}
+		else if(strName=="BYMONTHDAY")
+		{
+			if(!ParseRuleList(szValue, arMonthDays, NULL)) return false;
+		}
+		else if(strName=="BYSETPOS")
+		{
+			if(!ParseRuleList(szValue, arSetPos, NULL)) return false;
+		}
+		else return false;
+	}
+	if(nInterval<1 || nInterval>RecurMaxInterval || nCount<0 || (nCount && !strUntil.empty())) return false;
+
+	int nStartDays=(int)(dwStart/MINUTES_PER_DAY), nYear, nStartMonth, nDay;
+	DateFromDays(nStartDays, nYear, nStartMonth, nDay);
+	m_dwStartDate=(uint32_t)nStartDays*MINUTES_PER_DAY;
+	m_dwStartTimeOffset=dwStart-m_dwStartDate;
+	m_dwEndTimeOffset=m_dwStartTimeOffset+(dwEnd-dwStart);
+	m_dwPeriod=(uint32_t)nInterval;
+	m_dwFirstDOW=arFirstDOW.size() ? (uint32_t)arFirstDOW[0] : 1;
+
+	bool bOrdinals=false;
+	for(i=0;i<arDays.size();i++)
+	{
+		m_dwDayMask|=1<<arDays[i];
+		if(arOrdinals[i]) bOrdinals=true;
+	}
+
+	if(strFrequency=="DAILY" || strFrequency=="WEEKLY")
+	{
+		bool bDaily=(strFrequency=="DAILY");
+		if(nMonth || arMonthDays.size() || arSetPos.size() || bOrdinals) return false;
+		if(bDaily && arDays.empty())
+		{
+			m_wFrequency=FREQUENCY_DAILY;
+			m_wPatternType=PATTERN_DAY;
+			m_dwPeriod*=MINUTES_PER_DAY;
+		}
+		else
+		{
+			// FREQ=DAILY;BYDAY=MO,TU,WE,TH,FR is Outlook's every weekday, a weekly pattern with a daily frequency
+			if(bDaily && nInterval!=1) return false;
+			m_wFrequency=bDaily ? FREQUENCY_DAILY : FREQUENCY_WEEKLY;
+			m_wPatternType=PATTERN_WEEK;
+			if(!m_dwDayMask) m_dwDayMask=1<<GetDayOfWeek(nStartDays);
+		}
+	}
+	else if(strFrequency=="MONTHLY" || strFrequency=="YEARLY")
+	{
+		// yearly patterns are monthly ones every 12 months, in the month of the start
+		bool bYearly=(strFrequency=="YEARLY");
+		if(nMonth && (!bYearly || nMonth!=nStartMonth)) return false;
+		m_wFrequency=bYearly ? FREQUENCY_YEARLY : FREQUENCY_MONTHLY;
+		if(bYearly) m_dwPeriod*=12;
+
+		if(arDays.size())
+		{
+			// the Nth of one day (BYDAY=2TU or -1FR) or of several (BYDAY=MO,TU,WE,TH,FR;BYSETPOS=-1), 5 is the last
+			int nWeek;
+			if(arMonthDays.size()) return false;
+			if(arSetPos.empty() && arDays.size()==1) nWeek=arOrdinals[0];
+			else if(arSetPos.size()==1 && !bOrdinals) nWeek=arSetPos[0];
+			else return false;
+			if(nWeek<-1 || nWeek>4 || !nWeek) return false;
+			m_wPatternType=PATTERN_MONTH_NTH;
+			m_dwDayOfMonth=(nWeek<0) ? 5 : (uint32_t)nWeek;
+		}
+		else if(arMonthDays.size()==1 && arSetPos.empty())
+		{
+			// Outlook moves the 29th to 31st to the last day of shorter months where RFC 5545 skips them
+			if(arMonthDays[0]==-1)
+			{
+				m_wPatternType=PATTERN_MONTH_END;
+				m_dwDayOfMonth=31;
+			}
+			else if(arMonthDays[0]>=1 && arMonthDays[0]<=31)
+			{
+				m_wPatternType=PATTERN_MONTH;
+				m_dwDayOfMonth=(uint32_t)arMonthDays[0];
+			}
+			else return false;
+		}
+		else if(arMonthDays.size())
+		{
+			// BYMONTHDAY=28,29,30;BYSETPOS=-1 is the 30th or the last day of shorter months, the way
+			// CMAPIICalendar writes those patterns
+			if(arSetPos.size()!=1 || arSetPos[0]!=-1 || std::find(arMonthDays.begin(), arMonthDays.end(), 28)==arMonthDays.end()) return false;
+			for(i=0;i<arMonthDays.size();i++)
+			{
+				if(arMonthDays[i]<28 || arMonthDays[i]>31) return false;
+				m_dwDayOfMonth=std::max(m_dwDayOfMonth, (uint32_t)arMonthDays[i]);
+			}
+			m_wPatternType=PATTERN_MONTH;
+		}
+		else if(arSetPos.size()) return false;
+		else
+		{
+			m_wPatternType=PATTERN_MONTH;
+			m_dwDayOfMonth=(uint32_t)nDay;
+		}
+	}
+	else return false;
+
+	return SetRuleEnd(nCount, strUntil.c_str());
+}
+
+// adds the date of the occurrence originally starting at dwOriginalStart (local minutes) to the deleted dates
+void CRecurrencePattern::DeleteOccurrence(uint32_t dwOriginalStart)
+{
+	uint32_t dwDate=dwOriginalStart-dwOriginalStart%MINUTES_PER_DAY;
+	std::vector<uint32_t>::iterator it=std::lower_bound(m_arDeletedDates.begin(), m_arDeletedDates.end(), dwDate);
+	if(it==m_arDeletedDates.end() || *it!=dwDate) m_arDeletedDates.insert(it, dwDate);
+}
+
+// Writes the pattern as an AppointmentRecurrencePattern (WriterVersion2 0x3009) that Parse reads back.  Of
+// the exception fields only the ones Parse keeps are written: the subject, location and busy status
+void CRecurrencePattern::Write(std::vector<uint8_t>& arData) const
+{
+	arData.clear();
+	PutWord(arData, RECUR_READER_VERSION);
+	PutWord(arData, RECUR_READER_VERSION);
+	PutWord(arData, m_wFrequency);
+	PutWord(arData, m_wPatternType);
+	PutWord(arData, m_wCalendarType);
+	PutDWord(arData, m_dwFirstDateTime);
+	PutDWord(arData, m_dwPeriod);
+	PutDWord(arData, 0);
+
+	switch(m_wPatternType)
+	{
+	case PATTERN_DAY:
+		break;
+	case PATTERN_WEEK:
+		PutDWord(arData, m_dwDayMask);
+		break;
+	case PATTERN_MONTH_NTH:
+	case PATTERN_HJ_MONTH_NTH:
+		PutDWord(arData, m_dwDayMask);
+		PutDWord(arData, m_dwDayOfMonth);
+		break;
+	default:
+		PutDWord(arData, m_dwDayOfMonth);
+		break;
+	}
+
+	PutDWord(arData, m_dwEndType);
+	PutDWord(arData, m_dwOccurrenceCount);
+	PutDWord(arData, m_dwFirstDOW);
+	PutDates(arData, m_arDeletedDates);
+	PutDates(arData, m_arModifiedDates);
+	PutDWord(arData, m_dwStartDate);
+	PutDWord(arData, m_dwEndDate);
+
+	PutDWord(arData, RECUR_READER_VERSION2);
+	PutDWord(arData, RECUR_WRITER_VERSION2_HIGHLIGHT);
+	PutDWord(arData, m_dwStartTimeOffset);
+	PutDWord(arData, m_dwEndTimeOffset);
+	PutWord(arData, (uint16_t)m_arExceptions.size());
+
+	const uint16_t wWritten=ARO_SUBJECT|ARO_LOCATION|ARO_BUSYSTATUS;
+	size_t i;
+	for(i=0;i<m_arExceptions.size();i++)
+	{
+		const CRecurrencePatternException& exception=m_arExceptions[i];
+		uint16_t wFlags=exception.m_wOverrideFlags&wWritten;
+		PutDWord(arData, exception.m_dwStart);
+		PutDWord(arData, exception.m_dwEnd);
+		PutDWord(arData, exception.m_dwOriginalStart);
+		PutWord(arData, wFlags);
+		if(wFlags&ARO_SUBJECT) PutString(arData, exception.m_strSubject);
+		if(wFlags&ARO_LOCATION) PutString(arData, exception.m_strLocation);
+		if(wFlags&ARO_BUSYSTATUS) PutDWord(arData, (uint32_t)exception.m_nBusyStatus);
+	}
+	PutDWord(arData, 0);
+
+	// the ExtendedExceptions, with an empty ChangeHighlight.  Without the UTF-16 strings only ASCII can be
+	// widened since the code page of the ANSI ones isn't known here, other bytes become '?'.  CMAPIRecurrence
+	// always sets both with the message's code page
+	for(i=0;i<m_arExceptions.size();i++)
+	{
+		const CRecurrencePatternException& exception=m_arExceptions[i];
+		uint16_t wFlags=exception.m_wOverrideFlags&wWritten;
+		PutDWord(arData, sizeof(uint32_t));
+		PutDWord(arData, 0);
+		PutDWord(arData, 0);
+		if(!(wFlags&(ARO_SUBJECT|ARO_LOCATION))) continue;
+
+		PutDWord(arData, exception.m_dwStart);
+		PutDWord(arData, exception.m_dwEnd);
+		PutDWord(arData, exception.m_dwOriginalStart);
+		const std::string* pStrings[2]={ &exception.m_strSubject, &exception.m_strLocation };
+		const std::vector<uint16_t>* pStringsW[2]={ &exception.m_arSubjectW, &exception.m_arLocationW };
+		const uint16_t wStringFlags[2]={ ARO_SUBJECT, ARO_LOCATION };
+		for(int j=0;j<2;j++)
+		{
+			if(!(wFlags&wStringFlags[j])) continue;
+			if(exception.m_bExtended)
+			{
+				PutStringW(arData, *pStringsW[j]);
+				continue;
+			}
+			std::vector<uint16_t> arValue(pStrings[j]->begin(), pStrings[j]->end());
+			for(size_t k=0;k<arValue.size();k++) if(arValue[k]&0xFF80) arValue[k]='?';
+			PutStringW(arData, arValue);
+		}
+		PutDWord(arData, 0);
+	}
+	PutDWord(arData, 0);
+}
+
+// the TimeZoneStruct SetTimeZone reads, false if the pattern has no time zone
+bool CRecurrencePattern::WriteTimeZone(std::vector<uint8_t>& arData) const
+{
+	arData.clear();
+	if(!m_bTimeZone) return false;
+
+	PutDWord(arData, (uint32_t)m_lBias);
+	PutDWord(arData, (uint32_t)m_lStandardBias);
+	PutDWord(arData, (uint32_t)m_lDaylightBias);
+	PutWord(arData, m_tmStandardDate.wYear);
+	PutDate(arData, m_tmStandardDate);
+	PutWord(arData, m_tmDaylightDate.wYear);
+	PutDate(arData, m_tmDaylightDate);
+	return true;
+}
+
+// FirstDateTime as Outlook computes it from the start date: the start of the first day, week or month of the
+// period holding the start counted from 1601-01-01
+uint32_t CRecurrencePattern::GetFirstDateTime() const
+{
+	uint32_t dwPeriod=m_dwPeriod ? m_dwPeriod : 1;
+	int nStartDays=(int)(m_dwStartDate/MINUTES_PER_DAY), nYear, nMonth, nDay;
+	switch(m_wPatternType)
+	{
+	case PATTERN_DAY:
+		return m_dwStartDate%dwPeriod;
+	case PATTERN_WEEK:
+		nDay=(GetDayOfWeek(nStartDays)-(int)(m_dwFirstDOW%7)+7)%7;
+		return ((uint32_t)(nStartDays-nDay)*MINUTES_PER_DAY)%(dwPeriod*7*MINUTES_PER_DAY);
+	}
+
+	DateFromDays(nStartDays, nYear, nMonth, nDay);
+	int nMonths=((nYear-1601)*12+nMonth-1)%(int)dwPeriod;
+	return (uint32_t)DaysFromDate(1601+nMonths/12, nMonths%12+1, 1)*MINUTES_PER_DAY;
+}
+
+// the Hijri patterns and non Gregorian calendars aren't expanded
+bool CRecurrencePattern::IsSupported() const
+{
+	switch(m_wPatternType)
+	{
+	case PATTERN_DAY:
+	case PATTERN_WEEK:
+		return true;
+	case PATTERN_MONTH:
+	case PATTERN_MONTH_NTH:
+	case PATTERN_MONTH_END:
+		return (m_wCalendarType==0 || m_wCalendarType==CALENDAR_GREGORIAN || m_wCalendarType==CALENDAR_GREGORIAN_US ||
+			(m_wCalendarType>=CALENDAR_GREGORIAN_ME_FRENCH && m_wCalendarType<=CALENDAR_GREGORIAN_XLIT_FRENCH));
+	}
+	return false;
+}
+
+// m_dwEndDate is the date of the last occurrence for both END_AFTER_DATE and END_AFTER_COUNT
+bool CRecurrencePattern::HasEndDate() const
+{
+	if(m_dwEndType!=END_AFTER_DATE && m_dwEndType!=END_AFTER_COUNT) return false;
+	return (m_dwEndDate!=END_DATE_NEVER && m_dwEndDate!=NO_DATE && m_dwEndDate>=m_dwStartDate);
+}
+
+// local minutes of the switches to daylight and back to standard time in nYear, false without daylight time
+bool CRecurrencePattern::GetTransitions(int nYear, uint32_t& dwDaylight, uint32_t& dwStandard) const
+{
+	if(!m_bTimeZone || !m_tmStandardDate.wMonth || !m_tmDaylightDate.wMonth) return false;
+	dwDaylight=GetTransition(nYear, m_tmDaylightDate);
+	dwStandard=GetTransition(nYear, m_tmStandardDate);
+	return true;
+}
+
+// ullTicks is a FILETIME as a 64 bit count
+uint32_t CRecurrencePattern::TicksToMinutes(uint64_t ullTicks, bool bRoundUp)
+{
+	if(bRoundUp) ullTicks+=RecurTicksPerMinute-1;
+	ullTicks/=RecurTicksPerMinute;
+	return (ullTicks>=NO_DATE) ? NO_DATE-1 : (uint32_t)ullTicks;
+}
+
+uint64_t CRecurrencePattern::MinutesToTicks(uint32_t dwMinutes)
+{
+	return dwMinutes*RecurTicksPerMinute;
+}
+
+// days since 1601-01-01 of a Gregorian date, nMonth is 1 to 12
+int CRecurrencePattern::DaysFromDate(int nYear, int nMonth, int nDay)
+{
+	nYear-=(nMonth<=2);
+	int nEra=(nYear>=0 ? nYear : nYear-399)/400;
+	int nYearOfEra=nYear-nEra*400;
+	int nDayOfYear=(153*(nMonth>2 ? nMonth-3 : nMonth+9)+2)/5+nDay-1;
+	int nDayOfEra=nYearOfEra*365+nYearOfEra/4-nYearOfEra/100+nDayOfYear;
+	return nEra*146097+nDayOfEra-719468+RecurDays1601To1970;
+}
+
+void CRecurrencePattern::DateFromDays(int nDays, int& nYear, int& nMonth, int& nDay)
+{
+	nDays+=719468-RecurDays1601To1970;
+	int nEra=(nDays>=0 ? nDays : nDays-146096)/146097;
+	int nDayOfEra=nDays-nEra*146097;
+	int nYearOfEra=(nDayOfEra-nDayOfEra/1460+nDayOfEra/36524-nDayOfEra/146096)/365;
+	int nDayOfYear=nDayOfEra-(365*nYearOfEra+nYearOfEra/4-nYearOfEra/100);
+	int nMonthIndex=(5*nDayOfYear+2)/153;
+	nDay=nDayOfYear-(153*nMonthIndex+2)/5+1;
+	nMonth=(nMonthIndex<10) ? nMonthIndex+3 : nMonthIndex-9;
+	nYear=nYearOfEra+nEra*400+(nMonth<=2);
+}
+
+int CRecurrencePattern::GetDaysInMonth(int nYear, int nMonth)
+{
+	static const int DaysInMonth[12]={ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if(nMonth==2 && ((nYear%4==0 && nYear%100!=0) || nYear%400==0)) return 29;
+	return DaysInMonth[(nMonth-1)%12];
+}
+
+// tm is either absolute (wYear set) or the wDay'th (5 is last) wDayOfWeek of wMonth
+uint32_t CRecurrencePattern::GetTransition(int nYear, const CRecurrenceDate& tm)
+{
+	int nDays;
+	if(tm.wYear)
+	{
+		nDays=DaysFromDate(nYear, tm.wMonth, tm.wDay);
+	}
+	else
+	{
+		int nFirst=DaysFromDate(nYear, tm.wMonth, 1);
+		int nDay=1+(tm.wDayOfWeek-GetDayOfWeek(nFirst)+7)%7+(tm.wDay-1)*7;
+		int nDaysInMonth=GetDaysInMonth(nYear, tm.wMonth);
+		while(nDay>nDaysInMonth) nDay-=7;
+		nDays=nFirst+nDay-1;
+	}
+	return (uint32_t)nDays*MINUTES_PER_DAY+tm.wHour*60+tm.wMinute;
+}
+
+bool CRecurrencePattern::ReadWord(const uint8_t*& pData, const uint8_t* pEnd, uint16_t& wValue)
+{
+	if(pEnd-pData<2) return false;
+	wValue=(uint16_t)(pData[0]|(pData[1]<<8));
+	pData+=2;
+	return true;
+}
+
+bool CRecurrencePattern::ReadDWord(const uint8_t*& pData, const uint8_t* pEnd, uint32_t& dwValue)
+{
+	if(pEnd-pData<4) return false;
+	dwValue=(uint32_t)pData[0]|((uint32_t)pData[1]<<8)|((uint32_t)pData[2]<<16)|((uint32_t)pData[3]<<24);
+	pData+=4;
+	return true;
+}
+
+// a count followed by that many dates
+bool CRecurrencePattern::ReadDates(const uint8_t*& pData, const uint8_t* pEnd, std::vector<uint32_t>& arDates)
+{
+	uint32_t dwCount;
+	if(!ReadDWord(pData, pEnd, dwCount) || dwCount>(uint32_t)(pEnd-pData)/4) return false;
+	arDates.resize(dwCount);
+	for(uint32_t i=0;i<dwCount;i++) ReadDWord(pData, pEnd, arDates[i]);
+	return true;
+}
+
+// ExceptionInfo strings are two lengths then ANSI characters
+bool CRecurrencePattern::ReadString(const uint8_t*& pData, const uint8_t* pEnd, std::string& strValue)
+{
+	uint16_t wLength;
+	if(!ReadWord(pData, pEnd, wLength) || !ReadWord(pData, pEnd, wLength) || pEnd-pData<wLength) return false;
+	strValue.assign((const char*)pData, wLength);
+	pData+=wLength;
+	return true;
+}
+
+// ExtendedException strings are a length then UTF-16 characters
+bool CRecurrencePattern::ReadStringW(const uint8_t*& pData, const uint8_t* pEnd, std::vector<uint16_t>& arValue)
+{
+	uint16_t wLength;
+	if(!ReadWord(pData, pEnd, wLength) || pEnd-pData<wLength*2) return false;
+	arValue.resize(wLength);
+	for(int i=0;i<wLength;i++) arValue[i]=(uint16_t)(pData[i*2]|(pData[i*2+1]<<8));
+	pData+=wLength*2;
+	return true;
+}
+
+bool CRecurrencePattern::Skip(const uint8_t*& pData, const uint8_t* pEnd, uint32_t cb)
+{
+	if((uint32_t)(pEnd-pData)<cb) return false;
+	pData+=cb;
+	return true;
+}
+
+void CRecurrencePattern::PutWord(std::vector<uint8_t>& arData, uint16_t wValue)
+{
+	arData.push_back((uint8_t)wValue);
+	arData.push_back((uint8_t)(wValue>>8));
+}
+
+void CRecurrencePattern::PutDWord(std::vector<uint8_t>& arData, uint32_t dwValue)
+{
+	PutWord(arData, (uint16_t)dwValue);
+	PutWord(arData, (uint16_t)(dwValue>>16));
+}
+
+void CRecurrencePattern::PutDates(std::vector<uint8_t>& arData, const std::vector<uint32_t>& arDates)
+{
+	PutDWord(arData, (uint32_t)arDates.size());
+	for(size_t i=0;i<arDates.size();i++) PutDWord(arData, arDates[i]);
+}
+
+void CRecurrencePattern::PutDate(std::vector<uint8_t>& arData, const CRecurrenceDate& tm)
+{
+	PutWord(arData, tm.wYear);
+	PutWord(arData, tm.wMonth);
+	PutWord(arData, tm.wDayOfWeek);
+	PutWord(arData, tm.wDay);
+	PutWord(arData, tm.wHour);
+	PutWord(arData, tm.wMinute);
+	PutWord(arData, tm.wSecond);
+	PutWord(arData, tm.wMilliseconds);
+}
+
+// see ReadString, the first length counts a terminator that isn't written
+void CRecurrencePattern::PutString(std::vector<uint8_t>& arData, const std::string& strValue)
+{
+	uint16_t wLength=(uint16_t)std::min(strValue.size(), (size_t)0xFFFE);
+	PutWord(arData, (uint16_t)(wLength+1));
+	PutWord(arData, wLength);
+	arData.insert(arData.end(), strValue.begin(), strValue.begin()+wLength);
+}
+
+void CRecurrencePattern::PutStringW(std::vector<uint8_t>& arData, const std::vector<uint16_t>& arValue)
+{
+	uint16_t wLength=(uint16_t)std::min(arValue.size(), (size_t)0xFFFF);
+	PutWord(arData, wLength);
+	for(int i=0;i<wLength;i++) PutWord(arData, arValue[i]);
+}
+
+// A comma separated BYMONTHDAY or BYSETPOS list of non zero numbers, or with parDays a BYDAY list of day names
+// each after an optional number (0 when missing)
+bool CRecurrencePattern::ParseRuleList(const char* szValue, std::vector<int>& arValues, std::vector<int>* parDays)
+{
+	for(;;)
+	{
+		int nSign=1, nValue=0;
+		bool bDigits=false;
+		if(*szValue=='+' || *szValue=='-') nSign=(*szValue++=='-') ? -1 : 1;
+		while(*szValue>='0' && *szValue<='9' && nValue<1000)
+		{
+			nValue=nValue*10+*szValue++-'0';
+			bDigits=true;
+		}
+
+		if(parDays)
+		{
+			int nDay=0;
+			while(nDay<7 && strncmp(szValue, RecurRuleDays[nDay], 2)) nDay++;
+			if(nDay==7) return false;
+			parDays->push_back(nDay);
+			szValue+=2;
+		}
+		else if(!bDigits || !nValue) return false;
+		arValues.push_back(nSign*nValue);
+
+		if(!*szValue) return true;
+		if(*szValue++!=',') return false;
+	}
+}
+
+// UNTIL is a date (yyyymmdd), a local time (yyyymmddThhmmss) or a UTC time ending in Z, the seconds are dropped
+bool CRecurrencePattern::ParseRuleDate(const char* szValue, uint32_t& dwMinutes, bool& bDate, bool& bUTC)
+{
+	int nDigits[14], nCount=0;
+	bUTC=false;
+	for(;*szValue;szValue++)
+	{
+		if(*szValue>='0' && *szValue<='9' && nCount<14) nDigits[nCount++]=*szValue-'0';
+		else if(*szValue=='T' && nCount==8) continue;
+		else if(*szValue=='Z' && nCount==14 && !szValue[1]) bUTC=true;
+		else return false;
+	}
+	if(nCount!=8 && nCount!=14) return false;
+
+	int nYear=nDigits[0]*1000+nDigits[1]*100+nDigits[2]*10+nDigits[3];
+	int nMonth=nDigits[4]*10+nDigits[5], nDay=nDigits[6]*10+nDigits[7];
+	if(nYear<1601 || nMonth<1 || nMonth>12 || nDay<1 || nDay>GetDaysInMonth(nYear, nMonth)) return false;
+
+	bDate=(nCount==8);
+	uint64_t ullMinutes=(uint64_t)DaysFromDate(nYear, nMonth, nDay)*MINUTES_PER_DAY;
+	if(!bDate) ullMinutes+=(nDigits[8]*10+nDigits[9])*60+nDigits[10]*10+nDigits[11];
+	dwMinutes=(ullMinutes>=NO_DATE) ? NO_DATE-1 : (uint32_t)ullMinutes;
+	return true;
+}
+
+// Sets the start date to the first occurrence and, for COUNT or UNTIL, the end date to the last one by
+// expanding the pattern in local time.  A series still running at END_DATE_NEVER, the last date Outlook
+// stores, doesn't end
+bool CRecurrencePattern::SetRuleEnd(int nCount, const char* szUntil)
+{
+	uint32_t dwUntil=NO_DATE;
+	bool bDate=false, bUTC=false;
+	if(*szUntil)
+	{
+		if(!ParseRuleDate(szUntil, dwUntil, bDate, bUTC)) return false;
+		if(bDate && dwUntil<NO_DATE-MINUTES_PER_DAY) dwUntil+=MINUTES_PER_DAY-1;
+	}
+
+	// local is expanded without the time zone so its times are local, zone only converts UNTIL
+	CRecurrencePattern local(*this);
+	local.m_bTimeZone=false;
+	CRecurrenceExpander expander, zone;
+	CRecurrenceInstance instance;
+	if(!expander.Begin(local, 0, NO_DATE-1)) return false;
+	zone.Begin(*this, 0, 0);
+
+	uint32_t dwFirst=NO_DATE, dwLast=NO_DATE;
+	int nOccurrences=0;
+	bool bEnd=false;
+	while(expander.Next(instance) && instance.m_dwStart<END_DATE_NEVER)
+	{
+		if(dwUntil!=NO_DATE && (bUTC ? zone.LocalToUTC(instance.m_dwStart) : instance.m_dwStart)>dwUntil)
+		{
+			bEnd=true;
+			break;
+		}
+		dwLast=instance.m_dwStart-instance.m_dwStart%MINUTES_PER_DAY;
+		if(dwFirst==NO_DATE) dwFirst=dwLast;
+		nOccurrences++;
+		if(nCount && nOccurrences==nCount)
+		{
+			bEnd=true;
+			break;
+		}
+		if(!nCount && dwUntil==NO_DATE) break;
+	}
+	if(dwFirst==NO_DATE) return false;
+
+	m_dwStartDate=dwFirst;
+	m_dwFirstDateTime=GetFirstDateTime();
+	if(bEnd)
+	{
+		m_dwEndType=nCount ? END_AFTER_COUNT : END_AFTER_DATE;
+		m_dwOccurrenceCount=(uint32_t)nOccurrences;
+		m_dwEndDate=dwLast;
+	}
+	else
+	{
+		m_dwEndType=END_NEVER;
+		m_dwOccurrenceCount=DEFAULT_OCCURRENCE_COUNT;
+		m_dwEndDate=END_DATE_NEVER;
+	}
+	return true;
+}
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceExpander
+
+CRecurrenceExpander::CRecurrenceExpander()
+{
+	m_pPattern=NULL;
+}
+
+// Starts listing the occurrences overlapping dwWindowStart..dwWindowEnd (UTC minutes), returns false if the
+// pattern can't be expanded (see CRecurrencePattern::IsSupported)
+bool CRecurrenceExpander::Begin(const CRecurrencePattern& pattern, uint32_t dwWindowStart, uint32_t dwWindowEnd)
+{
+	m_pPattern=NULL;
+	if(!pattern.IsSupported()) return false;
+
+	m_pPattern=&pattern;
+	m_dwWindowStart=dwWindowStart;
+	m_dwWindowEnd=dwWindowEnd;
+	m_nPeriod=m_nDay=m_nDeleted=m_nNextException=0;
+	m_bRegular=m_bException=false;
+	m_bRegularDone=m_bExceptionDone=false;
+	m_dwYearStart=m_dwYearEnd=0;
+
+	// no time zone is more than a day from UTC, so a regular occurrence starting (local time) 2 days after the
+	// window can't overlap it and neither can any after it
+	const uint32_t dwSlack=2*CRecurrencePattern::MINUTES_PER_DAY;
+	const uint32_t dwNoDate=CRecurrencePattern::NO_DATE;
+	m_dwLocalStop=(m_dwWindowEnd<dwNoDate-dwSlack) ? m_dwWindowEnd+dwSlack : dwNoDate-1;
+	m_dwEndDate=pattern.HasEndDate() ? pattern.m_dwEndDate : dwNoDate-1;
+	m_nRemaining=(pattern.m_dwEndType==CRecurrencePattern::END_AFTER_COUNT && !pattern.HasEndDate()) ? (int)pattern.m_dwOccurrenceCount : -1;
+
+	int nStartDays=pattern.m_dwStartDate/CRecurrencePattern::MINUTES_PER_DAY, nYear, nMonth, nDay;
+	int nWeekDay=(CRecurrencePattern::GetDayOfWeek(nStartDays)-(int)(pattern.m_dwFirstDOW%7)+7)%7;
+	m_dwFirstWeek=(uint32_t)(nStartDays-nWeekDay)*CRecurrencePattern::MINUTES_PER_DAY;
+	CRecurrencePattern::DateFromDays(nStartDays, nYear, nMonth, nDay);
+	m_nFirstMonth=nYear*12+nMonth-1;
+
+	// step straight to the period holding the window (less the slack and the length of an occurrence), unless
+	// the series ends after a count without an end date and has to be counted from the start
+	uint32_t dwDuration=(pattern.m_dwEndTimeOffset>pattern.m_dwStartTimeOffset) ? pattern.m_dwEndTimeOffset-pattern.m_dwStartTimeOffset : 0;
+	if(m_nRemaining<0 && m_dwWindowStart>pattern.m_dwStartDate+dwDuration+dwSlack)
+	{
+		uint32_t dwTarget=m_dwWindowStart-dwDuration-dwSlack;
+		uint32_t dwPeriod=pattern.m_dwPeriod ? pattern.m_dwPeriod : 1;
+		switch(pattern.m_wPatternType)
+		{
+		case CRecurrencePattern::PATTERN_DAY:
+			m_nPeriod=(int)((dwTarget-pattern.m_dwStartDate)/std::max(dwPeriod, (uint32_t)CRecurrencePattern::MINUTES_PER_DAY));
+			break;
+		case CRecurrencePattern::PATTERN_WEEK:
+			m_nPeriod=(int)((dwTarget-m_dwFirstWeek)/(dwPeriod*7*CRecurrencePattern::MINUTES_PER_DAY));
+			break;
+		default:
+			CRecurrencePattern::DateFromDays(dwTarget/CRecurrencePattern::MINUTES_PER_DAY, nYear, nMonth, nDay);
+			m_nPeriod=std::max((int)((nYear*12+nMonth-1-m_nFirstMonth)/(int)dwPeriod)-1, 0);
+			break;
+		}
+	}
+	return true;
+}
+
+bool CRecurrenceExpander::Next(CRecurrenceInstance& instance)
+{
+	if(!m_pPattern) return false;
+
+	// the next regular occurrence and the next exception are merged by start time
+	if(!m_bRegular && !m_bRegularDone)
+	{
+		m_bRegular=NextRegular(m_regular);
+		m_bRegularDone=!m_bRegular;
+	}
+	if(!m_bException && !m_bExceptionDone)
+	{
+		m_bException=NextException(m_exception);
+		m_bExceptionDone=!m_bException;
+	}
+	if(!m_bRegular && !m_bException) return false;
+
+	if(m_bRegular && (!m_bException || m_regular.m_dwStart<=m_exception.m_dwStart))
+	{
+		instance=m_regular;
+		m_bRegular=false;
+	}
+	else
+	{
+		instance=m_exception;
+		m_bException=false;
+	}
+	return true;
+}
+
+// converts a time in the pattern's time zone, the daylight transitions are only worked out once a year
+uint32_t CRecurrenceExpander::LocalToUTC(uint32_t dwLocal)
+{
+	if(!m_pPattern || !m_pPattern->m_bTimeZone) return dwLocal;
+
+	if(dwLocal<m_dwYearStart || dwLocal>=m_dwYearEnd)
+	{
+		int nYear, nMonth, nDay;
+		CRecurrencePattern::DateFromDays(dwLocal/CRecurrencePattern::MINUTES_PER_DAY, nYear, nMonth, nDay);
+		m_dwYearStart=(uint32_t)CRecurrencePattern::DaysFromDate(nYear, 1, 1)*CRecurrencePattern::MINUTES_PER_DAY;
+		m_dwYearEnd=(uint32_t)CRecurrencePattern::DaysFromDate(nYear+1, 1, 1)*CRecurrencePattern::MINUTES_PER_DAY;
+		m_bDaylight=m_pPattern->GetTransitions(nYear, m_dwDaylight, m_dwStandard);
+	}
+
+	int32_t lBias=m_pPattern->m_lBias+m_pPattern->m_lStandardBias;
+	if(m_bDaylight)
+	{
+		// the southern hemisphere switches to daylight time late in the year
+		bool bDaylight;
+		if(m_dwDaylight<m_dwStandard) bDaylight=(dwLocal>=m_dwDaylight && dwLocal<m_dwStandard);
+		else bDaylight=(dwLocal>=m_dwDaylight || dwLocal<m_dwStandard);
+		if(bDaylight) lBias=m_pPattern->m_lBias+m_pPattern->m_lDaylightBias;
+	}
+	return dwLocal+(uint32_t)lBias;
+}
+
+// local midnight of the next date of the pattern, NO_DATE when there isn't one
+uint32_t CRecurrenceExpander::NextDate()
+{
+	const CRecurrencePattern& pattern=*m_pPattern;
+	uint32_t dwPeriod=pattern.m_dwPeriod ? pattern.m_dwPeriod : 1;
+	uint32_t dwMask=pattern.m_dwDayMask&0x7F;
+
+	switch(pattern.m_wPatternType)
+	{
+	case CRecurrencePattern::PATTERN_DAY:
+		dwPeriod=std::max(dwPeriod, (uint32_t)CRecurrencePattern::MINUTES_PER_DAY);
+		return pattern.m_dwStartDate+(uint32_t)(m_nPeriod++)*dwPeriod;
+
+	case CRecurrencePattern::PATTERN_WEEK:
+		if(!dwMask) return CRecurrencePattern::NO_DATE;
+		for(;;)
+		{
+			if(m_nDay>=7)
+			{
+				m_nDay=0;
+				m_nPeriod++;
+			}
+			int nDay=m_nDay++;
+			if(!(dwMask&(1<<((pattern.m_dwFirstDOW+nDay)%7)))) continue;
+
+			uint32_t dwDate=m_dwFirstWeek+((uint32_t)m_nPeriod*dwPeriod*7+nDay)*CRecurrencePattern::MINUTES_PER_DAY;
+			if(dwDate>=pattern.m_dwStartDate) return dwDate;
+		}
+
+	default:
+		if(pattern.m_wPatternType==CRecurrencePattern::PATTERN_MONTH_NTH && !dwMask) return CRecurrencePattern::NO_DATE;
+		for(;;)
+		{
+			int nMonths=m_nFirstMonth+(m_nPeriod++)*(int)dwPeriod;
+			int nYear=nMonths/12, nMonth=nMonths%12+1;
+			int nDaysInMonth=CRecurrencePattern::GetDaysInMonth(nYear, nMonth);
+			int nFirst=CRecurrencePattern::DaysFromDate(nYear, nMonth, 1), nDay=nDaysInMonth;
+
+			if(pattern.m_wPatternType==CRecurrencePattern::PATTERN_MONTH)
+			{
+				// the 31st is the last day of shorter months
+				nDay=std::min(std::max((int)pattern.m_dwDayOfMonth, 1), nDaysInMonth);
+			}
+			else if(pattern.m_wPatternType==CRecurrencePattern::PATTERN_MONTH_NTH)
+			{
+				// the Nth day matching the mask (ie the 2nd weekday), 5 is the last one
+				int nFirstDOW=CRecurrencePattern::GetDayOfWeek(nFirst);
+				if(pattern.m_dwDayOfMonth>=5)
+				{
+					while(nDay>1 && !(dwMask&(1<<((nFirstDOW+nDay-1)%7)))) nDay--;
+				}
+				else
+				{
+					int nCount=0;
+					for(nDay=1;nDay<nDaysInMonth;nDay++)
+					{
+						if((dwMask&(1<<((nFirstDOW+nDay-1)%7))) && ++nCount==std::max((int)pattern.m_dwDayOfMonth, 1)) break;
+					}
+				}
+			}
+
+			uint32_t dwDate=(uint32_t)(nFirst+nDay-1)*CRecurrencePattern::MINUTES_PER_DAY;
+			if(dwDate>=pattern.m_dwStartDate) return dwDate;
+		}
+	}
+}
+
+bool CRecurrenceExpander::NextRegular(CRecurrenceInstance& instance)
+{
+	const CRecurrencePattern& pattern=*m_pPattern;
+	int nDeleted=(int)pattern.m_arDeletedDates.size();
+	for(;;)
+	{
+		uint32_t dwDate=NextDate();
+		if(dwDate==CRecurrencePattern::NO_DATE || dwDate>m_dwEndDate || m_nRemaining==0) return false;
+		if(m_nRemaining>0) m_nRemaining--;
+
+		uint32_t dwStart=dwDate+pattern.m_dwStartTimeOffset;
+		if(dwStart>m_dwLocalStop) return false;
+
+		// deleted and modified occurrences are both in the deleted dates, modified ones come from the exceptions
+		while(m_nDeleted<nDeleted && pattern.m_arDeletedDates[m_nDeleted]<dwDate) m_nDeleted++;
+		if(m_nDeleted<nDeleted && pattern.m_arDeletedDates[m_nDeleted]==dwDate) continue;
+
+		uint32_t dwUTCStart=LocalToUTC(dwStart), dwUTCEnd=LocalToUTC(dwDate+pattern.m_dwEndTimeOffset);
+		if(dwUTCStart<m_dwWindowEnd && dwUTCEnd>m_dwWindowStart)
+		{
+			instance.m_dwStart=dwUTCStart;
+			instance.m_dwEnd=dwUTCEnd;
+			instance.m_dwOriginalStart=dwUTCStart;
+			instance.m_nException=-1;
+			return true;
+		}
+	}
+}
+
+bool CRecurrenceExpander::NextException(CRecurrenceInstance& instance)
+{
+	const CRecurrencePattern& pattern=*m_pPattern;
+	while(m_nNextException<(int)pattern.m_arExceptionOrder.size())
+	{
+		int nException=pattern.m_arExceptionOrder[m_nNextException++];
+		const CRecurrencePatternException& exception=pattern.m_arExceptions[nException];
+		uint32_t dwUTCStart=LocalToUTC(exception.m_dwStart), dwUTCEnd=LocalToUTC(exception.m_dwEnd);
+		if(dwUTCStart<m_dwWindowEnd && dwUTCEnd>m_dwWindowStart)
+		{
+			instance.m_dwStart=dwUTCStart;
+			instance.m_dwEnd=dwUTCEnd;
+			instance.m_dwOriginalStart=LocalToUTC(exception.m_dwOriginalStart);
+			instance.m_nException=nException;
+			return true;
+		}
+	}
+	return false;
+}
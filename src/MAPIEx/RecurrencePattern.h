@@ -0,0 +1,218 @@
+#ifndef __RECURRENCEPATTERN_H__
+#define __RECURRENCEPATTERN_H__
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: RecurrencePattern.h
+// Description: Parses recurrence blobs and expands their occurrences without MFC or MAPI
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+// Usage: see the CodeProject article at http://www.codeproject.com/internet/CMapiEx.asp
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Only the standard library is used here so the parser, the writer and the expander can be built and tested
+// on any platform (see src/TestRecurrence), CMAPIRecurrence and CRecurrenceIterator wrap them for the rest of
+// MAPIEx
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceDate
+
+// A TIME_ZONE_INFORMATION style date, laid out like a SYSTEMTIME
+struct CRecurrenceDate
+{
+	uint16_t wYear;
+	uint16_t wMonth;
+	uint16_t wDayOfWeek;
+	uint16_t wDay;
+	uint16_t wHour;
+	uint16_t wMinute;
+	uint16_t wSecond;
+	uint16_t wMilliseconds;
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrencePatternException
+
+// An ExceptionInfo with its ExtendedException, times are minutes since 1601 in the appointment's time zone.
+// m_strSubject and m_strLocation are the ANSI strings, m_bExtended is set when the UTF-16 ones were read too
+class CRecurrencePatternException
+{
+public:
+	CRecurrencePatternException();
+
+// Attributes
+public:
+	uint32_t m_dwStart;
+	uint32_t m_dwEnd;
+	uint32_t m_dwOriginalStart;
+	uint16_t m_wOverrideFlags;
+	std::string m_strSubject;
+	std::string m_strLocation;
+	bool m_bExtended;
+	std::vector<uint16_t> m_arSubjectW;
+	std::vector<uint16_t> m_arLocationW;
+	int m_nBusyStatus;
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrencePattern
+
+// An AppointmentRecurrencePattern (MS-OXOCAL) and the TimeZoneStruct it was created in
+class CRecurrencePattern
+{
+public:
+	CRecurrencePattern();
+
+	enum { FREQUENCY_DAILY=0x200A, FREQUENCY_WEEKLY=0x200B, FREQUENCY_MONTHLY=0x200C, FREQUENCY_YEARLY=0x200D };
+	enum { PATTERN_DAY=0x0, PATTERN_WEEK=0x1, PATTERN_MONTH=0x2, PATTERN_MONTH_NTH=0x3, PATTERN_MONTH_END=0x4,
+		PATTERN_HJ_MONTH=0xA, PATTERN_HJ_MONTH_NTH=0xB, PATTERN_HJ_MONTH_END=0xC
+	};
+	enum { END_AFTER_DATE=0x2021, END_AFTER_COUNT=0x2022, END_NEVER=0x2023, END_DATE_NEVER=0x5AE980DF };
+	enum { ARO_SUBJECT=0x0001, ARO_MEETINGTYPE=0x0002, ARO_REMINDERDELTA=0x0004, ARO_REMINDER=0x0008, ARO_LOCATION=0x0010,
+		ARO_BUSYSTATUS=0x0020, ARO_ATTACHMENT=0x0040, ARO_SUBTYPE=0x0080, ARO_APPTCOLOR=0x0100, ARO_EXCEPTIONAL_BODY=0x0200
+	};
+	enum { CALENDAR_GREGORIAN=1, CALENDAR_GREGORIAN_US=2, CALENDAR_GREGORIAN_ME_FRENCH=9, CALENDAR_GREGORIAN_XLIT_FRENCH=12 };
+	enum { MINUTES_PER_DAY=1440, TIMEZONE_STRUCT_SIZE=48 };
+	enum { NO_DATE=0xFFFFFFFF, DEFAULT_OCCURRENCE_COUNT=10 };
+
+// Attributes
+public:
+	uint16_t m_wFrequency;
+	uint16_t m_wPatternType;
+	uint16_t m_wCalendarType;
+	uint32_t m_dwFirstDateTime;
+	uint32_t m_dwPeriod;
+	uint32_t m_dwDayMask;
+	uint32_t m_dwDayOfMonth;
+	uint32_t m_dwEndType;
+	uint32_t m_dwOccurrenceCount;
+	uint32_t m_dwFirstDOW;
+	uint32_t m_dwStartDate;
+	uint32_t m_dwEndDate;
+	uint32_t m_dwStartTimeOffset;
+	uint32_t m_dwEndTimeOffset;
+	std::vector<uint32_t> m_arDeletedDates;
+	std::vector<uint32_t> m_arModifiedDates;
+	std::vector<CRecurrencePatternException> m_arExceptions;
+	std::vector<int> m_arExceptionOrder;
+
+	bool m_bTimeZone;
+	int32_t m_lBias;
+	int32_t m_lStandardBias;
+	int32_t m_lDaylightBias;
+	CRecurrenceDate m_tmStandardDate;
+	CRecurrenceDate m_tmDaylightDate;
+
+// Operations
+public:
+	void Empty();
+	void EmptyPattern();
+	bool Parse(const uint8_t* pData, uint32_t cb);
+	bool SetTimeZone(const uint8_t* pData, uint32_t cb);
+	bool ParseRule(const char* szRule, uint32_t dwStart, uint32_t dwEnd);
+	void DeleteOccurrence(uint32_t dwOriginalStart);
+	void Write(std::vector<uint8_t>& arData) const;
+	bool WriteTimeZone(std::vector<uint8_t>& arData) const;
+	uint32_t GetFirstDateTime() const;
+	bool IsSupported() const;
+	bool HasEndDate() const;
+	bool GetTransitions(int nYear, uint32_t& dwDaylight, uint32_t& dwStandard) const;
+
+	static uint32_t TicksToMinutes(uint64_t ullTicks, bool bRoundUp=false);
+	static uint64_t MinutesToTicks(uint32_t dwMinutes);
+	static int DaysFromDate(int nYear, int nMonth, int nDay);
+	static void DateFromDays(int nDays, int& nYear, int& nMonth, int& nDay);
+	static int GetDaysInMonth(int nYear, int nMonth);
+	static int GetDayOfWeek(int nDays) { return (nDays+1)%7; } // 1601-01-01 was a Monday
+	static uint32_t GetTransition(int nYear, const CRecurrenceDate& tm);
+
+protected:
+	static bool ReadWord(const uint8_t*& pData, const uint8_t* pEnd, uint16_t& wValue);
+	static bool ReadDWord(const uint8_t*& pData, const uint8_t* pEnd, uint32_t& dwValue);
+	static bool ReadDates(const uint8_t*& pData, const uint8_t* pEnd, std::vector<uint32_t>& arDates);
+	static bool ReadString(const uint8_t*& pData, const uint8_t* pEnd, std::string& strValue);
+	static bool ReadStringW(const uint8_t*& pData, const uint8_t* pEnd, std::vector<uint16_t>& arValue);
+	static bool Skip(const uint8_t*& pData, const uint8_t* pEnd, uint32_t cb);
+	static void PutWord(std::vector<uint8_t>& arData, uint16_t wValue);
+	static void PutDWord(std::vector<uint8_t>& arData, uint32_t dwValue);
+	static void PutDates(std::vector<uint8_t>& arData, const std::vector<uint32_t>& arDates);
+	static void PutDate(std::vector<uint8_t>& arData, const CRecurrenceDate& tm);
+	static void PutString(std::vector<uint8_t>& arData, const std::string& strValue);
+	static void PutStringW(std::vector<uint8_t>& arData, const std::vector<uint16_t>& arValue);
+	static bool ParseRuleList(const char* szValue, std::vector<int>& arValues, std::vector<int>* parDays);
+	static bool ParseRuleDate(const char* szValue, uint32_t& dwMinutes, bool& bDate, bool& bUTC);
+	bool SetRuleEnd(int nCount, const char* szUntil);
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceInstance
+
+// One occurrence from CRecurrenceExpander, times are UTC minutes since 1601.  m_nException is the index of
+// the CRecurrencePatternException it comes from or -1 for a regular occurrence
+struct CRecurrenceInstance
+{
+	uint32_t m_dwStart;
+	uint32_t m_dwEnd;
+	uint32_t m_dwOriginalStart;
+	int m_nException;
+};
+
+/////////////////////////////////////////////////////////////
+// CRecurrenceExpander
+
+// Lists the occurrences of a CRecurrencePattern overlapping a UTC window in start order, one per call to Next.
+// Nothing is allocated and the pattern is stepped straight to the window, so a window years after the start
+// of a daily series costs the same as one at its start
+class CRecurrenceExpander
+{
+public:
+	CRecurrenceExpander();
+
+// Attributes
+protected:
+	const CRecurrencePattern* m_pPattern;
+	uint32_t m_dwWindowStart;
+	uint32_t m_dwWindowEnd;
+	uint32_t m_dwLocalStop;
+	uint32_t m_dwEndDate;
+	uint32_t m_dwFirstWeek;
+	int m_nFirstMonth;
+	int m_nPeriod;
+	int m_nDay;
+	int m_nRemaining;
+	int m_nDeleted;
+	int m_nNextException;
+	bool m_bRegular;
+	bool m_bRegularDone;
+	bool m_bException;
+	bool m_bExceptionDone;
+	CRecurrenceInstance m_regular;
+	CRecurrenceInstance m_exception;
+	uint32_t m_dwYearStart;
+	uint32_t m_dwYearEnd;
+	uint32_t m_dwDaylight;
+	uint32_t m_dwStandard;
+	bool m_bDaylight;
+
+// Operations
+public:
+	bool Begin(const CRecurrencePattern& pattern, uint32_t dwWindowStart, uint32_t dwWindowEnd);
+	bool Next(CRecurrenceInstance& instance);
+	uint32_t LocalToUTC(uint32_t dwLocal);
+
+protected:
+	uint32_t NextDate();
+	bool NextRegular(CRecurrenceInstance& instance);
+	bool NextException(CRecurrenceInstance& instance);
+};
+
+#endif
@@ -0,0 +1,333 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: TestCalendarIndex.cpp
+// Description: Tests the CCalendarIntervals tree behind CMAPICalendarIndex, builds anywhere (see Makefile)
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../MAPIEx/CalendarIntervals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+int g_nFailed=0;
+
+#define CHECK(x) if(!(x)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); g_nFailed++; }
+
+// 2010-01-01 in FILETIME ticks, the intervals below are laid out in the year after it
+const uint64_t BaseTicks=129067776000000000ULL;
+const uint64_t TicksPerMinute=600000000ULL;
+const int MinutesPerYear=365*1440;
+
+// the same sequence on every platform, unlike rand()
+uint32_t g_dwSeed=12345;
+
+uint32_t Random(uint32_t dwRange)
+{
+	g_dwSeed=g_dwSeed*1103515245+12345;
+	return ((g_dwSeed>>8)%dwRange);
+}
+
+uint64_t Ticks(int nMinutes)
+{
+	return BaseTicks+(uint64_t)nMinutes*TicksPerMinute;
+}
+
+// adds nItems items with 1 to 3 intervals each, some of them zero length and some free
+void AddRandom(CCalendarIntervals& intervals, int nItems, int nMaxMinutes)
+{
+	for(int i=0;i<nItems;i++)
+	{
+		int nItem=intervals.AddItem();
+		int nIntervals=1+Random(3);
+		for(int j=0;j<nIntervals;j++)
+		{
+			int nStart=Random(MinutesPerYear);
+			int nLength=Random(10) ? 15*(int)Random(nMaxMinutes/15+1) : 0;
+			intervals.AddInterval(nItem, Ticks(nStart), Ticks(nStart+nLength), Random(5));
+		}
+	}
+}
+
+// the intervals matching ullStart..ullEnd found by looking at every one, written from the CMAPICalendarIndex
+// rules rather than with CCalendarIntervals::Matches
+void BruteForce(const CCalendarIntervals& intervals, uint64_t ullStart, uint64_t ullEnd, bool bIgnoreFree, int nIgnoreItem, std::vector<int>& arMatches)
+{
+	arMatches.clear();
+	if(ullEnd<=ullStart) ullEnd=ullStart+1;
+	for(int i=0;i<(int)intervals.m_arIntervals.size();i++)
+	{
+		const CCalendarInterval& interval=intervals.m_arIntervals[i];
+		if(intervals.m_arItemDeleted[interval.m_nItem] || interval.m_nItem==nIgnoreItem) continue;
+		if(bIgnoreFree && interval.m_nBusyStatus==CCalendarIntervals::BUSY_FREE) continue;
+		uint64_t ullIntervalEnd=(interval.m_ullEnd==interval.m_ullStart) ? interval.m_ullStart+1 : interval.m_ullEnd;
+		if(interval.m_ullStart<ullEnd && ullIntervalEnd>ullStart) arMatches.push_back(i);
+	}
+}
+
+// Find against BruteForce for nQueries random ranges and points, the tree part of each result must be in
+// start order.  nLine is the caller's line for the failure messages
+void Compare(const CCalendarIntervals& intervals, int nQueries, int nLine)
+{
+	int nMismatches=0, nUnordered=0, nMatches=0;
+	std::vector<int> arFound, arExpected;
+	for(int i=0;i<nQueries;i++)
+	{
+		int nStart=Random(MinutesPerYear);
+		int nLength=(i%4==0) ? 0 : Random(3*1440);
+		bool bIgnoreFree=(i%2!=0);
+		int nIgnoreItem=(i%3==0) ? (int)Random((uint32_t)intervals.GetItemCount()) : -1;
+
+		intervals.Find(Ticks(nStart), Ticks(nStart+nLength), arFound, 0, bIgnoreFree, nIgnoreItem);
+		BruteForce(intervals, Ticks(nStart), Ticks(nStart+nLength), bIgnoreFree, nIgnoreItem, arExpected);
+		for(size_t j=1;j<arFound.size();j++)
+		{
+			if(arFound[j]<intervals.m_nIndexed && arFound[j-1]>=arFound[j]) nUnordered++;
+		}
+		std::sort(arFound.begin(), arFound.end());
+		if(arFound!=arExpected) nMismatches++;
+		nMatches+=(int)arExpected.size();
+
+		// stopping at the first match, the way HasConflict asks
+		intervals.Find(Ticks(nStart), Ticks(nStart+nLength), arFound, 1, bIgnoreFree, nIgnoreItem);
+		if(arFound.size()!=std::min(arExpected.size(), (size_t)1) || (arFound.size() && !std::binary_search(arExpected.begin(), arExpected.end(), arFound[0]))) nMismatches++;
+	}
+	if(nMismatches || nUnordered)
+	{
+		printf("%s(%d): %d of %d queries differ from the brute force, %d out of order\n", __FILE__, nLine, nMismatches, nQueries, nUnordered);
+		g_nFailed++;
+	}
+	CHECK(nMatches>0);
+}
+
+// m_arMaxEnd[middle of nLow..nHigh] must be the largest end in nLow..nHigh, zero length intervals end a tick
+// after they start
+uint64_t CheckMaxEnd(const CCalendarIntervals& intervals, int nLow, int nHigh, int& nWrong)
+{
+	if(nLow>=nHigh) return 0;
+	int nMid=(nLow+nHigh)/2;
+	uint64_t ullMax=0;
+	for(int i=nLow;i<nHigh;i++) ullMax=std::max(ullMax, CCalendarIntervals::GetEnd(intervals.m_arIntervals[i]));
+	if(intervals.m_arMaxEnd[nMid]!=ullMax) nWrong++;
+	CheckMaxEnd(intervals, nLow, nMid, nWrong);
+	CheckMaxEnd(intervals, nMid+1, nHigh, nWrong);
+	return ullMax;
+}
+
+void TreeTest()
+{
+	CCalendarIntervals intervals;
+	std::vector<int> arFound;
+	CHECK(intervals.Find(Ticks(0), Ticks(60), arFound)==0);
+
+	AddRandom(intervals, 2000, 240);
+	intervals.Build();
+	CHECK(intervals.m_nIndexed==(int)intervals.m_arIntervals.size() && intervals.m_arMaxEnd.size()==intervals.m_arIntervals.size());
+
+	bool bSorted=true;
+	for(size_t i=1;i<intervals.m_arIntervals.size();i++)
+	{
+		if(CCalendarIntervals::CompareIntervals(&intervals.m_arIntervals[i-1], &intervals.m_arIntervals[i])>0) bSorted=false;
+	}
+	CHECK(bSorted);
+
+	// every subtree end, including the single interval and empty cases
+	int nWrong=0;
+	CheckMaxEnd(intervals, 0, intervals.m_nIndexed, nWrong);
+	CHECK(nWrong==0);
+	Compare(intervals, 2000, __LINE__);
+
+	CCalendarIntervals single;
+	single.AddInterval(single.AddItem(), Ticks(60), Ticks(60), 2);
+	single.Build();
+	CHECK(single.m_arMaxEnd.size()==1 && single.m_arMaxEnd[0]==Ticks(60)+1);
+	CHECK(single.Find(Ticks(60), Ticks(60), arFound)==1);
+	CHECK(single.Find(Ticks(59), Ticks(60), arFound)==0);
+	CHECK(single.Find(Ticks(0), Ticks(120), arFound, 0, false, 0)==0);
+}
+
+// changes after Build go to the delta and tombstones until Compact renumbers the items
+void DeltaTest()
+{
+	CCalendarIntervals intervals;
+	AddRandom(intervals, 2000, 240);
+	intervals.Build();
+	int nItems=intervals.GetItemCount();
+	CHECK(!intervals.IsDeltaFull());
+
+	AddRandom(intervals, 200, 240);
+	std::vector<bool> arRemoved(intervals.GetItemCount(), false);
+	int nRemoved=0;
+	for(int i=0;i<150;i++)
+	{
+		int nItem=(int)Random((uint32_t)intervals.GetItemCount());
+		if(intervals.RemoveItem(nItem))
+		{
+			arRemoved[nItem]=true;
+			nRemoved++;
+		}
+		else CHECK(arRemoved[nItem]);
+	}
+	CHECK(intervals.m_nIndexed<(int)intervals.m_arIntervals.size() && intervals.m_nDeleted>0);
+	CHECK(intervals.IsDeltaFull());
+	Compare(intervals, 2000, __LINE__);
+
+	std::vector<int> arNewItems;
+	uint64_t ullFirstStart=0;
+	int nFirstItem=-1;
+	for(size_t i=0;i<intervals.m_arIntervals.size() && nFirstItem<0;i++)
+	{
+		if(arRemoved[intervals.m_arIntervals[i].m_nItem]) continue;
+		nFirstItem=intervals.m_arIntervals[i].m_nItem;
+		ullFirstStart=intervals.m_arIntervals[i].m_ullStart;
+	}
+	intervals.Compact(arNewItems);
+	CHECK((int)arNewItems.size()==nItems+200 && intervals.GetItemCount()==nItems+200-nRemoved);
+	bool bRenumbered=true;
+	for(int i=0, nNext=0;i<(int)arNewItems.size();i++)
+	{
+		if(arNewItems[i]!=(arRemoved[i] ? -1 : nNext)) bRenumbered=false;
+		if(!arRemoved[i]) nNext++;
+	}
+	CHECK(bRenumbered);
+	CHECK(intervals.m_nDeleted==0 && intervals.m_nIndexed==0);
+	CHECK(nFirstItem>=0 && intervals.m_arIntervals[0].m_ullStart==ullFirstStart && intervals.m_arIntervals[0].m_nItem==arNewItems[nFirstItem]);
+
+	// unbuilt, everything is the delta
+	Compare(intervals, 500, __LINE__);
+	intervals.Build();
+	CHECK(!intervals.IsDeltaFull());
+	int nWrong=0;
+	CheckMaxEnd(intervals, 0, intervals.m_nIndexed, nWrong);
+	CHECK(nWrong==0);
+	Compare(intervals, 2000, __LINE__);
+
+	// Build compacts by itself too
+	intervals.RemoveItem(0);
+	intervals.Build();
+	CHECK(intervals.m_nDeleted==0 && intervals.GetItemCount()==nItems+200-nRemoved-1);
+	Compare(intervals, 500, __LINE__);
+}
+
+// Write and Read, the way CMAPICalendarIndex::Save and Load use them after the entry IDs
+void SaveTest()
+{
+	CCalendarIntervals intervals;
+	AddRandom(intervals, 1000, 240);
+	intervals.RemoveItem(3);
+	intervals.Build();
+
+	std::vector<uint8_t> arData(4, 0xAB);
+	intervals.Write(arData);
+	CHECK(arData.size()==4+4+intervals.m_arIntervals.size()*CCalendarIntervals::INTERVAL_SIZE);
+	uint32_t dwCount=arData[4]|(arData[5]<<8)|(arData[6]<<16)|((uint32_t)arData[7]<<24);
+	CHECK(dwCount==intervals.m_arIntervals.size());
+
+	CCalendarIntervals copy;
+	int i;
+	for(i=0;i<intervals.GetItemCount();i++) copy.AddItem();
+	const uint8_t* pData=&arData[4];
+	CHECK(copy.Read(pData, &arData[0]+arData.size()));
+	CHECK(pData==&arData[0]+arData.size());
+	CHECK(copy.m_arIntervals.size()==intervals.m_arIntervals.size() && copy.m_nIndexed==(int)copy.m_arIntervals.size());
+	bool bSame=(copy.m_arItemIntervals==intervals.m_arItemIntervals && copy.m_arMaxEnd==intervals.m_arMaxEnd);
+	for(i=0;bSame && i<(int)copy.m_arIntervals.size();i++)
+	{
+		const CCalendarInterval& interval=intervals.m_arIntervals[i];
+		const CCalendarInterval& read=copy.m_arIntervals[i];
+		bSame=(read.m_ullStart==interval.m_ullStart && read.m_ullEnd==interval.m_ullEnd && read.m_nItem==interval.m_nItem && read.m_nBusyStatus==interval.m_nBusyStatus);
+	}
+	CHECK(bSame);
+
+	std::vector<int> arFound, arCopyFound;
+	int nDifferent=0;
+	for(i=0;i<500;i++)
+	{
+		int nStart=Random(MinutesPerYear);
+		intervals.Find(Ticks(nStart), Ticks(nStart+120), arFound);
+		copy.Find(Ticks(nStart), Ticks(nStart+120), arCopyFound);
+		if(arFound!=arCopyFound) nDifferent++;
+	}
+	CHECK(nDifferent==0);
+	Compare(copy, 500, __LINE__);
+
+	// cut short, with bytes after it, an unknown item and an end before its start all fail and leave nothing
+	pData=&arData[4];
+	CHECK(!copy.Read(pData, &arData[0]+arData.size()-1) && copy.m_arIntervals.empty());
+	std::vector<uint8_t> arLonger(arData);
+	arLonger.push_back(0);
+	pData=&arLonger[4];
+	CHECK(!copy.Read(pData, &arLonger[0]+arLonger.size()));
+
+	std::vector<uint8_t> arBad(arData);
+	memset(&arBad[8+16], 0xFF, 4);
+	pData=&arBad[4];
+	CHECK(!copy.Read(pData, &arBad[0]+arBad.size()) && copy.m_arIntervals.empty());
+
+	CCalendarIntervals fewer;
+	fewer.AddItem();
+	pData=&arData[4];
+	CHECK(!fewer.Read(pData, &arData[0]+arData.size()) && fewer.m_arItemIntervals[0]==0);
+
+	arBad=arData;
+	memset(&arBad[8+8], 0, 8);
+	arBad[8+8]=1;
+	pData=&arBad[4];
+	CHECK(!copy.Read(pData, &arBad[0]+arBad.size()));
+
+	// an empty index round trips too
+	CCalendarIntervals empty, emptyCopy;
+	arData.clear();
+	empty.Write(arData);
+	pData=&arData[0];
+	CHECK(arData.size()==4 && emptyCopy.Read(pData, &arData[0]+arData.size()) && emptyCopy.m_arIntervals.empty());
+}
+
+// a busy calendar's worth of appointments, a conflict check must stay well under a millisecond
+void QueryTimeTest()
+{
+	const int ITEMS=100000, QUERIES=100000;
+	CCalendarIntervals intervals;
+	for(int i=0;i<ITEMS;i++)
+	{
+		int nStart=Random(MinutesPerYear);
+		intervals.AddInterval(intervals.AddItem(), Ticks(nStart), Ticks(nStart+30+Random(4)*30), 1+Random(4));
+	}
+	clock_t start=clock();
+	intervals.Build();
+	double dBuild=(double)(clock()-start)/CLOCKS_PER_SEC;
+
+	std::vector<int> arFound;
+	int nConflicts=0, nFound=0;
+	start=clock();
+	for(int i=0;i<QUERIES;i++)
+	{
+		int nStart=Random(MinutesPerYear);
+		nConflicts+=intervals.Find(Ticks(nStart), Ticks(nStart+60), arFound, 1, true);
+		nFound+=intervals.Find(Ticks(nStart), Ticks(nStart+60), arFound);
+	}
+	double dElapsed=(double)(clock()-start)/CLOCKS_PER_SEC;
+	double dPerQuery=dElapsed*1000000/(2*QUERIES);
+
+	CHECK(nConflicts>0 && nFound>=nConflicts);
+	CHECK(dPerQuery<1000);
+	printf("Queries: %d items built in %.3f s, %d queries in %.3f s (%.2f us per query, %d found)\n", ITEMS, dBuild, 2*QUERIES, dElapsed, dPerQuery, nFound);
+}
+
+int main()
+{
+	TreeTest();
+	DeltaTest();
+	SaveTest();
+	QueryTimeTest();
+	printf("%s: %d failed\n", g_nFailed ? "FAILED" : "PASSED", g_nFailed);
+	return g_nFailed ? 1 : 0;
+}
@@ -451,6 +451,963 @@ void AppointmentTest(CMAPIEx& mapi)
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HTML to text extraction doesn't need a session, this runs a small corpus through CMAPIHTMLText:
+//		-each sample is fed in chunks of every size from 1 to 16 bytes and must match a single Write
+//		-multibyte characters are split across writes and across the internal buffer
+//		-then a 1MB UTF-8 body is extracted repeatedly to time it
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct HTMLTextSample
+{
+	const char* m_szHTML;
+	UINT m_nCodePage;
+	const WCHAR* m_szText;
+};
+
+const HTMLTextSample HTMLTextSamples[]={
+	{ "<p>caf\xE9 &amp; cr&egrave;me</p>", 1252, L"caf\x00E9 & cr\x00E8me\r\n" },
+	{ "<meta charset=\"utf-8\"><p>Gr\xC3\xBC\xC3\x9F" "e \xE2\x82\xAC</p>", CP_ACP, L"Gr\x00FC\x00DF" L"e \x20AC\r\n" },
+	{ "<meta http-equiv=Content-Type content='text/html; charset=windows-1251'>\xCC\xE8\xF0", CP_ACP, L"\x041C\x0438\x0440" },
+	{ "<style>p{}</style><script>if(a>b) a=b;</script>x&#x1F600;y &#8364; &bogus;", CP_UTF8, L"x\xD83D\xDE00y \x20AC &bogus;" },
+	{ "<p>\x82\xA0\x82\xA2</p>", 932, L"\x3042\x3044\r\n" },
+};
+
+void HTMLTextTest()
+{
+	int nFailed=0;
+	for(int i=0;i<sizeof(HTMLTextSamples)/sizeof(HTMLTextSample);i++)
+	{
+		const HTMLTextSample& sample=HTMLTextSamples[i];
+		int nLength=(int)strlen(sample.m_szHTML);
+		for(int nChunk=1;nChunk<=16;nChunk++)
+		{
+			CString strText;
+			CMAPIHTMLText extractor;
+			extractor.Begin(strText, sample.m_nCodePage);
+			for(int j=0;j<nLength;j+=nChunk) extractor.Write(sample.m_szHTML+j, min(nChunk, nLength-j));
+			extractor.End();
+			if(strText!=CString(sample.m_szText))
+			{
+				PRINTF(_T("HTML sample %d failed with %d byte writes: '%s'\n"), i, nChunk, strText);
+				nFailed++;
+				break;
+			}
+		}
+	}
+
+	// about 1MB of UTF-8 text with markup and entities, the 3 byte euro sign lands on every buffer offset
+	CStringA strHTML("<html><head><meta charset=utf-8><style>td{color:red}</style></head><body>");
+	while(strHTML.GetLength()<1024*1024) strHTML+="<p class=x>Gr\xC3\xBC\xC3\x9F" "e &amp; 10\xE2\x82\xAC <b>f\xC3\xBCr</b> alle</p>\r\n";
+	strHTML+="</body></html>";
+
+	const int ITERATIONS=20;
+	DWORD dwStart=GetTickCount();
+	for(int i=0;i<ITERATIONS;i++)
+	{
+		CString strText;
+		CMAPIHTMLText extractor;
+		extractor.Begin(strText);
+		extractor.Write(strHTML, strHTML.GetLength());
+		extractor.End();
+	}
+	DWORD dwElapsed=max(GetTickCount()-dwStart, (DWORD)1);
+	PRINTF(_T("HTML text: %d samples failed, %d MB in %u ms (%u MB/s)\n"), nFailed, ITERATIONS, dwElapsed, ITERATIONS*1000/dwElapsed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// GetValidString and GetValidMVString check the property type instead of probing the string, this checks a
+// PT_ERROR value (where the error code sits in place of the pointer) and out of range indexes come back NULL,
+// then times both against the IsBadStringPtr probe they replaced over a row of typical contents columns
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// what GetValidString did before, kept here to compare against
+LPCTSTR ProbeString(LPCTSTR s)
+{
+	if(s && !::IsBadStringPtr(s, (UINT_PTR)-1)) return s;
+	return NULL;
+}
+
+void ValidStringTest()
+{
+	LPTSTR szValues[]={ _T("Subject"), _T("Display To"), _T("someone@nospam.com") };
+	SPropValue props[5];
+	props[0].ulPropTag=PR_SUBJECT;
+	props[0].Value.LPSZ=szValues[0];
+	props[1].ulPropTag=PR_DISPLAY_TO;
+	props[1].Value.LPSZ=szValues[1];
+	props[2].ulPropTag=PROP_TAG(PT_ERROR, PROP_ID(PR_SENDER_EMAIL_ADDRESS));
+	props[2].Value.err=MAPI_E_NOT_FOUND;
+	props[3].ulPropTag=PR_MESSAGE_FLAGS;
+	props[3].Value.l=MSGFLAG_READ;
+	props[4].ulPropTag=PROP_TAG(PT_MV_TSTRING, 0x8000);
+	props[4].Value.MVSZ.cValues=3;
+	props[4].Value.MVSZ.LPPSZ=szValues;
+
+	int nFailed=0;
+	if(CMAPIEx::GetValidString(props[0])!=szValues[0]) nFailed++;
+	if(CMAPIEx::GetValidString(props[2])!=NULL) nFailed++;
+	if(CMAPIEx::GetValidString(props[3])!=NULL) nFailed++;
+	if(CMAPIEx::GetValidString(props[4])!=NULL) nFailed++;
+	if(CMAPIEx::GetValidMVString(props[4], 2)!=szValues[2]) nFailed++;
+	if(CMAPIEx::GetValidMVString(props[4], 3)!=NULL) nFailed++;
+	if(CMAPIEx::GetValidMVString(props[4], -1)!=NULL) nFailed++;
+	if(CMAPIEx::GetValidMVString(props[0], 0)!=NULL) nFailed++;
+
+	const int ITERATIONS=1000000;
+	int i, j, nValid=0;
+	DWORD dwStart=GetTickCount();
+	for(i=0;i<ITERATIONS;i++)
+	{
+		for(j=0;j<2;j++) if(ProbeString(props[j].Value.LPSZ)) nValid++;
+		for(j=0;j<3;j++) if(ProbeString(props[4].Value.MVSZ.LPPSZ[j])) nValid++;
+	}
+	DWORD dwProbe=GetTickCount()-dwStart;
+
+	dwStart=GetTickCount();
+	for(i=0;i<ITERATIONS;i++)
+	{
+		for(j=0;j<4;j++) if(CMAPIEx::GetValidString(props[j])) nValid++;
+		for(j=0;j<3;j++) if(CMAPIEx::GetValidMVString(props[4], j)) nValid++;
+	}
+	DWORD dwType=GetTickCount()-dwStart;
+	PRINTF(_T("Valid strings: %d checks failed, %d rows in %u ms probing, %u ms by type (%d)\n"), nFailed, ITERATIONS, dwProbe, dwType, nValid);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HTML encoded into RTF (what SetHTML does when the store can't take HTML) must come back from GetRTF as the
+// same HTML.  Characters outside the ANSI code page are written as \uN with a one byte fallback, this checks
+// they decode to themselves (CJK, an emoji's surrogate pair, a Latin-1 letter) and not to '?' or the control
+// words.  The draft is never saved.  In a MultiByte build the samples are what's left after conversion to
+// the ANSI code page, build for Unicode to cover \uN fully
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const WCHAR* RTFSamples[]={
+	L"<html><body><p>\x6F22\x5B57 \x304B\x306A</p></body></html>",
+	L"<html><body title=\"\xD83D\xDE00\">smile \xD83D\xDE00 &amp; caf\x00E9 {x}</body></html>",
+	L"<html><body>\x0416\x0438\x0437\x043D\x044C \x20AC\x2014\x00A0</body></html>",
+};
+
+void RTFTest(CMAPIEx& mapi)
+{
+	if(!mapi.OpenDrafts()) return;
+
+	int nFailed=0;
+	for(int i=0;i<sizeof(RTFSamples)/sizeof(const WCHAR*);i++)
+	{
+		CString strHTML(RTFSamples[i]), strResult;
+		CMAPIMessage message;
+		CMAPIRTFStream rtf;
+		if(!message.Create(&mapi) || !rtf.Open(message.Message()) || !rtf.WriteHTML(strHTML) || !rtf.Close() || !message.GetRTF(strResult))
+		{
+			PRINTF(_T("RTF sample %d couldn't be written\n"), i);
+			nFailed++;
+		}
+		else if(strResult!=strHTML)
+		{
+			PRINTF(_T("RTF sample %d failed: '%s'\n"), i, strResult);
+			nFailed++;
+		}
+	}
+	PRINTF(_T("RTF round trip: %d samples failed\n"), nFailed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CMAPIEntryID doesn't need a session either, this checks the value type on its own:
+//		-the hash is 64 bit FNV-1a (checked against its published test vectors)
+//		-IDs of every size from 0 to 200 bytes (inline and on the heap) go to hex and back unchanged
+//		-lower case hex decodes, odd lengths and non hex digits are refused and leave the ID empty
+//		-copies, self assignment and CMap lookups, then the interning table numbers IDs once each
+//		-then 100000 message sized IDs are converted to hex and back to time the codec
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void EntryIDTest()
+{
+	int i, nFailed=0;
+	if(CMAPIEntryID::Hash(0, NULL)!=0xCBF29CE484222325ULL) nFailed++;
+	if(CMAPIEntryID::Hash(1, (const BYTE*)"a")!=0xAF63DC4C8601EC8CULL) nFailed++;
+	if(CMAPIEntryID::Hash(6, (const BYTE*)"foobar")!=0x85944171F73967E8ULL) nFailed++;
+
+	BYTE data[200];
+	for(i=0;i<sizeof(data);i++) data[i]=(BYTE)(i*37+11);
+	for(ULONG cb=0;cb<=sizeof(data);cb++)
+	{
+		CMAPIEntryID entryID(cb, data), decoded;
+		CString strHex;
+		if(entryID.GetSize()!=cb || entryID.GetHash()!=CMAPIEntryID::Hash(cb, data)) nFailed++;
+		if(entryID.ToString(strHex)!=(cb>0)) nFailed++;
+		if(!cb) continue;
+
+		CString strUpper(strHex);
+		strUpper.MakeUpper();
+		if(strHex.GetLength()!=(int)cb*2 || strHex!=strUpper) nFailed++;
+		if(!decoded.FromString(strHex) || decoded!=entryID || decoded.GetHash()!=entryID.GetHash()) nFailed++;
+		if(!decoded.FromString(strHex.MakeLower()) || decoded!=entryID || memcmp(decoded.GetData(), data, cb)) nFailed++;
+	}
+
+	CMAPIEntryID entryID;
+	if(entryID.FromString(_T("0A0")) || !entryID.IsEmpty()) nFailed++;
+	if(entryID.FromString(_T("0A0G")) || !entryID.IsEmpty()) nFailed++;
+	if(entryID.FromString(_T("")) || entryID.FromString(NULL)) nFailed++;
+	BYTE buffer[4];
+	if(CMAPIEntryID::FromString(_T("0a1B2c"), buffer, sizeof(buffer))!=3 || buffer[0]!=0x0A || buffer[1]!=0x1B || buffer[2]!=0x2C) nFailed++;
+
+	// short and long copies, and Set from the ID's own data
+	CMAPIEntryID shortID(16, data), longID(sizeof(data), data);
+	entryID=longID;
+	entryID=entryID;
+	if(entryID!=longID) nFailed++;
+	entryID=shortID;
+	if(entryID!=shortID || entryID==longID) nFailed++;
+	entryID.Set(8, entryID.GetData()+4);
+	if(entryID!=CMAPIEntryID(8, data+4)) nFailed++;
+	longID.Set(100, longID.GetData()+50);
+	if(longID!=CMAPIEntryID(100, data+50)) nFailed++;
+
+	CMap<CMAPIEntryID, const CMAPIEntryID&, int, int> map;
+	CMAPIEntryIDTable table;
+	for(i=0;i<100;i++)
+	{
+		map[CMAPIEntryID(i+1, data)]=i;
+		if(table.Intern(CMAPIEntryID(i+1, data))!=i || table.Intern(CMAPIEntryID(i+1, data))!=i) nFailed++;
+	}
+	for(i=0;i<100;i++)
+	{
+		int nValue;
+		if(!map.Lookup(CMAPIEntryID(i+1, data), nValue) || nValue!=i) nFailed++;
+		if(table.Find(CMAPIEntryID(i+1, data))!=i || *table.GetAt(i)!=CMAPIEntryID(i+1, data)) nFailed++;
+	}
+	if(table.GetCount()!=100 || table.Find(CMAPIEntryID(101, data))!=-1 || table.Intern(CMAPIEntryID())!=-1) nFailed++;
+
+	// 70 bytes, about the size of a message entry ID from a PST or an Exchange mailbox
+	const int ITERATIONS=100000;
+	CString strHex;
+	DWORD dwStart=GetTickCount();
+	for(i=0;i<ITERATIONS;i++)
+	{
+		data[0]=(BYTE)i;
+		CMAPIEntryID::ToString(70, data, strHex);
+		if(!entryID.FromString(strHex)) nFailed++;
+	}
+	DWORD dwElapsed=GetTickCount()-dwStart;
+	PRINTF(_T("Entry IDs: %d checks failed, %d hex round trips in %u ms\n"), nFailed, ITERATIONS, dwElapsed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CMAPIEntryID::CompareLocal answers what it can without the session, this builds IDs by hand and checks:
+//		-identical IDs and IDs that differ only in their flags are equal, an empty ID equals nothing
+//		-long term IDs from the session's stores are different if anything else differs, short term IDs and
+//		 IDs from unknown providers are left to the session
+//		-Exchange address book IDs compare their DNs ignoring case
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// flags, provider UID, then szRest (with its NULL)
+CMAPIEntryID MakeEntryID(BYTE nFlags, const MAPIUID& uid, const char* szRest)
+{
+	BYTE data[256]={ 0 };
+	data[0]=nFlags;
+	memcpy(data+4, &uid, sizeof(MAPIUID));
+	int nLength=(int)strlen(szRest)+1;
+	memcpy(data+4+sizeof(MAPIUID), szRest, nLength);
+	return CMAPIEntryID(4+sizeof(MAPIUID)+nLength, data);
+}
+
+void CompareEntryIDTest()
+{
+	MAPIUID storeUIDs[2], otherUID;
+	for(int i=0;i<sizeof(MAPIUID);i++)
+	{
+		storeUIDs[0].ab[i]=(BYTE)i;
+		storeUIDs[1].ab[i]=(BYTE)(i+100);
+		otherUID.ab[i]=(BYTE)(i+200);
+	}
+	const MAPIUID exchangeAB={ 0xDC, 0xA7, 0x40, 0xC8, 0xC0, 0x42, 0x10, 0x1A, 0xB4, 0xB9, 0x08, 0x00, 0x2B, 0x2F, 0xE1, 0x82 };
+
+	int nFailed=0;
+	CMAPIEntryID message=MakeEntryID(0, storeUIDs[0], "message 1");
+	if(message.CompareLocal(MakeEntryID(0, storeUIDs[0], "message 1"))!=CMAPIEntryID::ENTRYID_EQUAL) nFailed++;
+	if(message.CompareLocal(CMAPIEntryID())!=CMAPIEntryID::ENTRYID_DIFFERENT) nFailed++;
+	if(CMAPIEntryID().CompareLocal(CMAPIEntryID())!=CMAPIEntryID::ENTRYID_DIFFERENT) nFailed++;
+
+	// MAPI_NOTRECIP and the like are in the other flag bytes
+	BYTE data[256]={ 0 };
+	memcpy(data, message.GetData(), message.GetSize());
+	data[1]=0x10;
+	CMAPIEntryID flagged(message.GetSize(), data);
+	if(message.CompareLocal(flagged)!=CMAPIEntryID::ENTRYID_EQUAL) nFailed++;
+
+	CMAPIEntryID message2=MakeEntryID(0, storeUIDs[0], "message 2");
+	if(message.CompareLocal(message2, storeUIDs, 2)!=CMAPIEntryID::ENTRYID_DIFFERENT) nFailed++;
+	if(message.CompareLocal(message2)!=CMAPIEntryID::ENTRYID_UNKNOWN) nFailed++;
+	if(message.CompareLocal(MakeEntryID(0, storeUIDs[1], "message 1"), storeUIDs, 2)!=CMAPIEntryID::ENTRYID_DIFFERENT) nFailed++;
+	if(message.CompareLocal(MakeEntryID(0, otherUID, "message 1"), storeUIDs, 2)!=CMAPIEntryID::ENTRYID_UNKNOWN) nFailed++;
+	if(MakeEntryID(0x80, storeUIDs[0], "message 1").CompareLocal(message2, storeUIDs, 2)!=CMAPIEntryID::ENTRYID_UNKNOWN) nFailed++;
+	if(MakeEntryID(0, otherUID, "message 1").CompareLocal(MakeEntryID(0, otherUID, "message 2"), storeUIDs, 2)!=CMAPIEntryID::ENTRYID_UNKNOWN) nFailed++;
+	if(CMAPIEntryID(8, message.GetData()).CompareLocal(CMAPIEntryID(9, message.GetData()))!=CMAPIEntryID::ENTRYID_UNKNOWN) nFailed++;
+
+	// version and type (8 bytes) come before the DN, which may be followed by padding
+	CMAPIEntryID user=MakeEntryID(0, exchangeAB, "\x01\x01\x01\x01\x01\x01\x01\x01/o=Org/ou=Site/cn=Recipients/cn=bob");
+	CMAPIEntryID userUpper=MakeEntryID(0, exchangeAB, "\x01\x01\x01\x01\x01\x01\x01\x01/O=ORG/OU=SITE/CN=RECIPIENTS/CN=BOB");
+	memset(data, 0, sizeof(data));
+	memcpy(data, userUpper.GetData(), userUpper.GetSize());
+	CMAPIEntryID padded(userUpper.GetSize()+3, data);
+	CMAPIEntryID other=MakeEntryID(0, exchangeAB, "\x01\x01\x01\x01\x01\x01\x01\x01/o=Org/ou=Site/cn=Recipients/cn=bobby");
+	if(user.CompareLocal(userUpper)!=CMAPIEntryID::ENTRYID_EQUAL) nFailed++;
+	if(user.CompareLocal(padded)!=CMAPIEntryID::ENTRYID_EQUAL) nFailed++;
+	if(user.CompareLocal(other)!=CMAPIEntryID::ENTRYID_DIFFERENT) nFailed++;
+
+	int nResult=CMAPIEntryID::CompareLocal(message.GetSize(), message.GetData(), flagged.GetSize(), flagged.GetData());
+	if(nResult!=CMAPIEntryID::ENTRYID_EQUAL || !CMAPIEntryID::IsFromStore(message.GetSize(), message.GetData(), storeUIDs, 2)) nFailed++;
+	PRINTF(_T("Compare entry IDs: %d checks failed\n"), nFailed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// The contact dedup keys come from NormalizeEmail and NormalizePhone, this checks them without a session:
+//		-addresses lose their blanks, SMTP: or mailto: prefix, case and +tag, anything but SMTP is refused
+//		-numbers written with or without the + and country code, with a 00 or trunk 0 prefix or with an
+//		 extension give the same digits, numbers shorter than MIN_PHONE_DIGITS are refused
+//		-a number that already starts with the country code is only recognized as such past 10 digits, which
+//		 is the North American plan and so only right for country code 1
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct NormalizeSample
+{
+	LPCTSTR m_szValue;
+	LPCTSTR m_szCountryCode;
+	LPCTSTR m_szKey;
+};
+
+const NormalizeSample EmailSamples[]={
+	{ _T(" SMTP:John.Doe+news@Example.COM "), NULL, _T("john.doe@example.com") },
+	{ _T("mailto:Jane@Example.com"), NULL, _T("jane@example.com") },
+	{ _T("+tag@example.com"), NULL, _T("+tag@example.com") },
+	{ _T("john.doe"), NULL, NULL },
+	{ _T("@example.com"), NULL, NULL },
+	{ _T("john.doe@"), NULL, NULL },
+	{ _T("/o=Org/ou=Site/cn=Recipients/cn=jdoe"), NULL, NULL },
+};
+
+const NormalizeSample PhoneSamples[]={
+	{ _T("+1 (555) 123-4567 x89"), _T("1"), _T("15551234567") },
+	{ _T("1-555-123-4567"), _T("1"), _T("15551234567") },
+	{ _T("555.123.4567"), _T("1"), _T("15551234567") },
+	{ _T("555 123 4567;ext=12"), _T("1"), _T("15551234567") },
+	{ _T("1555123456"), _T("1"), _T("11555123456") },
+	{ _T("555-1234"), _T("1"), _T("15551234") },
+	{ _T("+44 20 7946 0958"), _T("1"), _T("442079460958") },
+	{ _T("0044 20 7946 0958"), _T("1"), _T("442079460958") },
+	{ _T("020 7946 0958"), _T("44"), _T("442079460958") },
+	{ _T("44 20 7946 0958"), _T("44"), _T("442079460958") },
+	{ _T("030 123456"), _T("49"), _T("4930123456") },
+	{ _T("12345"), _T("1"), NULL },
+	{ _T("ext 5551234567"), _T("1"), NULL },
+};
+
+void NormalizeTest()
+{
+	int i, nFailed=0;
+	CString strKey;
+	for(i=0;i<sizeof(EmailSamples)/sizeof(NormalizeSample);i++)
+	{
+		const NormalizeSample& sample=EmailSamples[i];
+		BOOL bValid=CMAPIContactDedup::NormalizeEmail(sample.m_szValue, strKey);
+		if(bValid!=(sample.m_szKey!=NULL) || strKey!=(sample.m_szKey ? sample.m_szKey : _T("")))
+		{
+			PRINTF(_T("Email sample %d failed: '%s'\n"), i, strKey);
+			nFailed++;
+		}
+	}
+
+	CMAPIContactDedup dedup;
+	for(i=0;i<sizeof(PhoneSamples)/sizeof(NormalizeSample);i++)
+	{
+		const NormalizeSample& sample=PhoneSamples[i];
+		dedup.SetCountryCode(sample.m_szCountryCode);
+		BOOL bValid=dedup.NormalizePhone(sample.m_szValue, strKey);
+		if(bValid!=(sample.m_szKey!=NULL) || strKey!=(sample.m_szKey ? sample.m_szKey : _T("")))
+		{
+			PRINTF(_T("Phone sample %d failed: '%s'\n"), i, strKey);
+			nFailed++;
+		}
+	}
+	if(dedup.NormalizePhone(NULL, strKey)) nFailed++;
+	PRINTF(_T("Normalize: %d samples failed\n"), nFailed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CMAPIFreeBusy's bitmaps can be filled by hand with AddBusy, this checks them against a slot at a time
+// reference without a session:
+//		-random appointments, some starting before or ending after the window, mark exactly the slots they
+//		 overlap, one ending on a slot boundary doesn't mark the next slot and bits past the last slot stay 0
+//		-FindFirstFree agrees with a linear scan for every start slot and length and for every calendar subset
+//		-then a year of 15 minute slots over 50 calendars is searched repeatedly to time it
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void AddBusyMinutes(CMAPIFreeBusy& freebusy, int nCalendar, DWORD dwStart, DWORD dwEnd)
+{
+	FILETIME ftStart, ftEnd;
+	CMAPIRecurrence::MinutesToFileTime(dwStart, ftStart);
+	CMAPIRecurrence::MinutesToFileTime(dwEnd, ftEnd);
+	freebusy.AddBusy(nCalendar, ftStart, ftEnd);
+}
+
+void FreeBusyTest()
+{
+	const int CALENDARS=3, SLOTS=200, SLOT_MINUTES=15;
+	const DWORD dwWindow=CMAPIRecurrence::MINUTES_PER_DAY*150000;
+	FILETIME ftWindow;
+	CMAPIRecurrence::MinutesToFileTime(dwWindow, ftWindow);
+
+	int i, j, nFailed=0;
+	CMAPIFreeBusy freebusy;
+	for(i=0;i<CALENDARS;i++) freebusy.AddCalendar(CMAPIEntryID());
+	if(!freebusy.SetWindow(ftWindow, SLOTS, SLOT_MINUTES)) nFailed++;
+
+	BOOL bBusy[CALENDARS][SLOTS]={ 0 };
+	srand(1);
+	for(i=0;i<60;i++)
+	{
+		int nCalendar=i%CALENDARS;
+		int nStart=rand()%(SLOTS*SLOT_MINUTES+200)-100;
+		int nEnd=nStart+rand()%(i<50 ? 60 : 300);
+		AddBusyMinutes(freebusy, nCalendar, dwWindow+nStart, dwWindow+nEnd);
+		for(j=0;j<SLOTS;j++)
+		{
+			if(nStart<(j+1)*SLOT_MINUTES && nEnd>j*SLOT_MINUTES && nEnd>nStart) bBusy[nCalendar][j]=TRUE;
+		}
+	}
+	for(i=0;i<CALENDARS;i++)
+	{
+		for(j=0;j<SLOTS;j++) if(freebusy.IsBusy(i, j)!=bBusy[i][j]) nFailed++;
+		if(freebusy.GetBits(i)[SLOTS/32]>>(SLOTS%32)) nFailed++;
+	}
+
+	// an hour on a slot boundary is exactly 4 slots, a minute in the middle of one is that slot
+	CMAPIFreeBusy boundary;
+	boundary.AddCalendar(CMAPIEntryID());
+	boundary.SetWindow(ftWindow, 96);
+	AddBusyMinutes(boundary, 0, dwWindow+60, dwWindow+120);
+	AddBusyMinutes(boundary, 0, dwWindow+157, dwWindow+158);
+	for(j=0;j<96;j++) if(boundary.IsBusy(0, j)!=((j>=4 && j<8) || j==10)) nFailed++;
+	if(boundary.FindFirstFree(NULL, 0, 4)!=0 || boundary.FindFirstFree(NULL, 0, 5, 1)!=11 || boundary.FindFirstFree(NULL, 0, 2, 8)!=8) nFailed++;
+	if(boundary.FindFirstFree(NULL, 0, 97)!=-1 || boundary.FindFirstFree(NULL, 0, 1, 96)!=-1) nFailed++;
+
+	// every subset of the calendars, every start and every length up to 40 slots
+	int nCalendars[CALENDARS];
+	for(int nMask=0;nMask<(1<<CALENDARS);nMask++)
+	{
+		int nCount=0;
+		for(i=0;i<CALENDARS;i++) if(nMask & (1<<i)) nCalendars[nCount++]=i;
+		for(int nLength=1;nLength<=40;nLength++)
+		{
+			for(int nFrom=0;nFrom<SLOTS;nFrom++)
+			{
+				int nExpected=-1;
+				for(i=nFrom;i+nLength<=SLOTS && nExpected<0;i++)
+				{
+					for(j=i;j<i+nLength;j++)
+					{
+						int k=0;
+						while(k<nCount && !bBusy[nCalendars[k]][j]) k++;
+						if(k<nCount) break;
+					}
+					if(j==i+nLength) nExpected=i;
+				}
+				if(freebusy.FindFirstFree(nCalendars, nCount, nLength, nFrom)!=nExpected) nFailed++;
+			}
+		}
+	}
+
+	// a year of slots, each calendar busy 9 to 5 on one weekday, searched for 8 free hours from 9 on each day
+	CMAPIFreeBusy year;
+	for(i=0;i<50;i++) year.AddCalendar(CMAPIEntryID());
+	year.SetWindow(ftWindow, 365*96);
+	for(i=0;i<50;i++)
+	{
+		for(int nDay=i%5;nDay<365;nDay+=7) AddBusyMinutes(year, i, dwWindow+nDay*1440+9*60, dwWindow+nDay*1440+17*60);
+	}
+
+	const int ITERATIONS=1000;
+	int nSlot=0;
+	DWORD dwStart=GetTickCount();
+	for(i=0;i<ITERATIONS;i++) nSlot=year.FindFirstFree(NULL, 0, 8*4, (i%7)*96+9*4);
+	DWORD dwElapsed=GetTickCount()-dwStart;
+	if(nSlot<0 || !year.IsBusy(0, 9*4) || year.IsBusy(0, 5*96+9*4)) nFailed++;
+	PRINTF(_T("Free busy: %d checks failed, %d searches in %u ms\n"), nFailed, ITERATIONS, dwElapsed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// The iCalendar RRULE and DURATION handling doesn't need a file or a session, this checks:
+//		-each RRULE parsed into a pattern is written back by FormatRule as itself, or in the form Export
+//		 writes for rules with more than one spelling (FREQ=DAILY on weekdays, BYDAY=2TU, a missing INTERVAL)
+//		-UNTIL comes back as a UTC time or, for all day events, a date
+//		-rules Outlook can't hold are refused
+//		-ParseDuration reads signed week, day and time durations and refuses malformed ones
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct RuleSample
+{
+	LPCSTR m_szRule;
+	int m_nYear, m_nMonth, m_nDay, m_nHour;
+	BOOL m_bDate;
+	LPCSTR m_szFormatted;
+};
+
+const RuleSample RuleSamples[]={
+	{ "FREQ=DAILY;INTERVAL=2;COUNT=10", 2011, 1, 3, 9, FALSE, NULL },
+	{ "FREQ=DAILY;BYDAY=MO,TU,WE,TH,FR", 2011, 1, 3, 9, FALSE, "FREQ=WEEKLY;INTERVAL=1;WKST=MO;BYDAY=MO,TU,WE,TH,FR" },
+	{ "FREQ=WEEKLY;INTERVAL=2;WKST=SU;BYDAY=SU,WE;COUNT=6", 2011, 1, 5, 9, FALSE, NULL },
+	{ "FREQ=MONTHLY;INTERVAL=1;BYMONTHDAY=15", 2011, 1, 15, 9, FALSE, NULL },
+	{ "FREQ=MONTHLY;INTERVAL=3;BYDAY=TU;BYSETPOS=2", 2011, 1, 11, 9, FALSE, NULL },
+	{ "FREQ=MONTHLY;BYDAY=2TU", 2011, 1, 11, 9, FALSE, "FREQ=MONTHLY;INTERVAL=1;BYDAY=TU;BYSETPOS=2" },
+	{ "FREQ=MONTHLY;INTERVAL=1;BYMONTHDAY=-1", 2011, 1, 31, 9, FALSE, NULL },
+	{ "FREQ=MONTHLY;INTERVAL=1;BYMONTHDAY=28,29,30;BYSETPOS=-1", 2011, 1, 30, 9, FALSE, NULL },
+	{ "FREQ=YEARLY;INTERVAL=1;BYMONTH=3;BYDAY=SU;BYSETPOS=-1", 2011, 3, 27, 1, FALSE, NULL },
+	{ "FREQ=YEARLY;BYMONTH=7;BYMONTHDAY=4", 2011, 7, 4, 0, TRUE, "FREQ=YEARLY;INTERVAL=1;BYMONTH=7;BYMONTHDAY=4" },
+	{ "FREQ=DAILY;INTERVAL=1;UNTIL=20110131T090000Z", 2011, 1, 3, 9, FALSE, NULL },
+	{ "FREQ=DAILY;UNTIL=20110131", 2011, 1, 3, 0, TRUE, "FREQ=DAILY;INTERVAL=1;UNTIL=20110131" },
+};
+
+const LPCSTR BadRules[]={ "FREQ=HOURLY", "FREQ=DAILY;COUNT=2;UNTIL=20110131", "FREQ=WEEKLY;BYMONTHDAY=3", "FREQ=MONTHLY;BYDAY=1MO,2TU", "FREQ=DAILY;INTERVAL=0", "FREQ" };
+
+struct DurationSample
+{
+	LPCSTR m_szDuration;
+	BOOL m_bValid;
+	LONGLONG m_llSeconds;
+};
+
+const DurationSample DurationSamples[]={
+	{ "PT1H", TRUE, 3600 },
+	{ "-PT15M", TRUE, -900 },
+	{ "+P2D", TRUE, 172800 },
+	{ "P1W", TRUE, 604800 },
+	{ "P1DT2H3M4S", TRUE, 93784 },
+	{ "pt30m", TRUE, 1800 },
+	{ "1H", FALSE, 0 },
+	{ "PT5", FALSE, 0 },
+	{ "PTH", FALSE, 0 },
+	{ "P1X", FALSE, 0 },
+	{ "", FALSE, 0 },
+};
+
+void ICalendarTest()
+{
+	int i, nFailed=0;
+	for(i=0;i<sizeof(RuleSamples)/sizeof(RuleSample);i++)
+	{
+		const RuleSample& sample=RuleSamples[i];
+		DWORD dwStart=(DWORD)CMAPIRecurrence::DaysFromDate(sample.m_nYear, sample.m_nMonth, sample.m_nDay)*CMAPIRecurrence::MINUTES_PER_DAY+sample.m_nHour*60;
+		CMAPIRecurrence recurrence;
+		CStringA strRule;
+		if(recurrence.ParseRule(sample.m_szRule, dwStart, dwStart+60) && recurrence.IsSupported())
+		{
+			CMAPIICalendar::FormatRule(recurrence, FALSE, sample.m_bDate, strRule);
+		}
+		if(strRule!=(sample.m_szFormatted ? sample.m_szFormatted : sample.m_szRule))
+		{
+			printf("RRULE sample %d failed: '%s'\n", i, (LPCSTR)strRule);
+			nFailed++;
+		}
+	}
+	for(i=0;i<sizeof(BadRules)/sizeof(LPCSTR);i++)
+	{
+		CMAPIRecurrence recurrence;
+		DWORD dwStart=(DWORD)CMAPIRecurrence::DaysFromDate(2011, 1, 3)*CMAPIRecurrence::MINUTES_PER_DAY;
+		if(recurrence.ParseRule(BadRules[i], dwStart, dwStart+60)) nFailed++;
+	}
+
+	for(i=0;i<sizeof(DurationSamples)/sizeof(DurationSample);i++)
+	{
+		const DurationSample& sample=DurationSamples[i];
+		LONGLONG llSeconds;
+		BOOL bValid=CMAPIICalendar::ParseDuration(sample.m_szDuration, llSeconds);
+		if(bValid!=sample.m_bValid || (bValid && llSeconds!=sample.m_llSeconds))
+		{
+			printf("Duration sample %d failed: %I64d\n", i, llSeconds);
+			nFailed++;
+		}
+	}
+	PRINTF(_T("iCalendar rules: %d samples failed\n"), nFailed);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CMAPITimeZone and CMAPIDateFormat stand in for the Windows calls, so they're checked against them:
+//		-UTC times every 20 minutes over three years and random ones from 1980 to 2100 convert like
+//		 SystemTimeToTzSpecificLocalTime does in the local zone, a northern and a southern daylight zone and
+//		 one without daylight time
+//		-date pictures format like GetDateFormat and time pictures like GetTimeFormat, in English and in
+//		 Russian (which has genitive month names), and a buffer one character short gives 0 and an empty string
+//		-then a million conversions and formats are timed against the Windows calls
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// bias, standard and daylight rules (month, week, day of the week, hour)
+TIME_ZONE_INFORMATION MakeTimeZone(LONG lBias, WORD wStandardMonth, WORD wStandardWeek, WORD wStandardHour, WORD wDaylightMonth, WORD wDaylightWeek, WORD wDaylightHour)
+{
+	TIME_ZONE_INFORMATION tzi;
+	memset(&tzi, 0, sizeof(tzi));
+	tzi.Bias=lBias;
+	tzi.StandardDate.wMonth=wStandardMonth;
+	tzi.StandardDate.wDay=wStandardWeek;
+	tzi.StandardDate.wHour=wStandardHour;
+	tzi.DaylightDate.wMonth=wDaylightMonth;
+	tzi.DaylightDate.wDay=wDaylightWeek;
+	tzi.DaylightDate.wHour=wDaylightHour;
+	tzi.DaylightBias=wDaylightMonth ? -60 : 0;
+	return tzi;
+}
+
+const LPCTSTR DatePictures[]={ _T("dd/MM/yyyy"), _T("d MMM yy"), _T("dddd, MMMM d, yyyy"), _T("ddd d MMMM"), _T("'Week of' M/d/y"), _T("MMMM yyyy ''q''") };
+const LPCTSTR TimePictures[]={ _T("hh:mm:ss tt"), _T("H:m:s"), _T("HH'h'mm"), _T("h t") };
+
+void DateTimeTest()
+{
+	TIME_ZONE_INFORMATION timeZones[4];
+	GetTimeZoneInformation(&timeZones[0]);
+	timeZones[1]=MakeTimeZone(300, 11, 1, 2, 3, 2, 2);		// US Eastern
+	timeZones[2]=MakeTimeZone(-600, 4, 1, 3, 10, 1, 2);		// Sydney
+	timeZones[3]=MakeTimeZone(-330, 0, 0, 0, 0, 0, 0);		// India
+
+	SYSTEMTIME tmStart={ 2010, 1, 0, 1 };
+	FILETIME ftStart;
+	SystemTimeToFileTime(&tmStart, &ftStart);
+	ULONGLONG ullStart=CMAPITimeZone::GetTicks(ftStart);
+	const ULONGLONG ullMinute=600000000;
+
+	int i, j, nFailed=0;
+	for(i=0;i<sizeof(timeZones)/sizeof(TIME_ZONE_INFORMATION);i++)
+	{
+		CMAPITimeZone timeZone;
+		timeZone.SetTimeZone(timeZones[i]);
+		srand(i);
+		for(j=0;j<3*365*72+10000;j++)
+		{
+			// every 20 minutes from 2010, then random minutes from 1980
+			ULONGLONG ullUTC=ullStart+(ULONGLONG)j*20*ullMinute;
+			if(j>=3*365*72) ullUTC=(ULONGLONG)(((rand()<<15)|rand())%(120*525960)+379*525960)*ullMinute;
+
+			FILETIME ftUTC;
+			SYSTEMTIME tmUTC, tmExpected, tmLocal;
+			CMAPITimeZone::SetTicks(ullUTC, ftUTC);
+			FileTimeToSystemTime(&ftUTC, &tmUTC);
+			SystemTimeToTzSpecificLocalTime(&timeZones[i], &tmUTC, &tmExpected);
+			if(!timeZone.ToLocal(ftUTC, tmLocal) || memcmp(&tmLocal, &tmExpected, sizeof(SYSTEMTIME)))
+			{
+				if(nFailed<10) PRINTF(_T("Time zone %d failed at %04d-%02d-%02d %02d:%02d UTC\n"), i, tmUTC.wYear, tmUTC.wMonth, tmUTC.wDay, tmUTC.wHour, tmUTC.wMinute);
+				nFailed++;
+			}
+		}
+	}
+
+	FILETIME ftDates[2]={ ftStart, { 0, 0 } };
+	SYSTEMTIME tmDates[2];
+	CMAPITimeZone timeZone;
+	if(timeZone.ToLocal(ftDates, tmDates, 2)!=1 || tmDates[1].wYear) nFailed++;
+
+	LCID lcids[]={ MAKELCID(MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US), SORT_DEFAULT), MAKELCID(MAKELANGID(LANG_RUSSIAN, SUBLANG_DEFAULT), SORT_DEFAULT) };
+	TCHAR szDate[128], szExpected[128];
+	for(int nLCID=0;nLCID<2;nLCID++)
+	{
+		for(int nPicture=0;nPicture<sizeof(DatePictures)/sizeof(LPCTSTR)+sizeof(TimePictures)/sizeof(LPCTSTR);nPicture++)
+		{
+			BOOL bDate=(nPicture<sizeof(DatePictures)/sizeof(LPCTSTR));
+			LPCTSTR szPicture=bDate ? DatePictures[nPicture] : TimePictures[nPicture-sizeof(DatePictures)/sizeof(LPCTSTR)];
+			CMAPIDateFormat format(szPicture, lcids[nLCID]);
+
+			// a day and a time from every month of 2009, including midnight and noon
+			for(j=0;j<365;j+=7)
+			{
+				SYSTEMTIME tm;
+				CMAPITimeZone::TicksToSystemTime(CMAPITimeZone::GetTicks(ftStart)-(ULONGLONG)(365-j)*1440*ullMinute+(ULONGLONG)(j%48)*30*ullMinute, tm);
+				if(bDate) GetDateFormat(lcids[nLCID], 0, &tm, szPicture, szExpected, 128);
+				else GetTimeFormat(lcids[nLCID], 0, &tm, szPicture, szExpected, 128);
+				int nLength=format.Format(tm, szDate, 128);
+				if(_tcscmp(szDate, szExpected) || nLength!=(int)_tcslen(szExpected))
+				{
+					PRINTF(_T("Date picture '%s' failed: '%s' instead of '%s'\n"), szPicture, szDate, szExpected);
+					nFailed++;
+					break;
+				}
+				if(format.Format(tm, szDate, nLength) || *szDate) nFailed++;
+			}
+		}
+	}
+
+	// the local zone, a million dates spread over 2010
+	const int ITERATIONS=1000000;
+	CMAPIDateFormat format(_T("MM/dd/yyyy hh:mm tt"));
+	FILETIME ftUTC;
+	SYSTEMTIME tmUTC, tmLocal;
+	DWORD dwStart=GetTickCount();
+	for(i=0;i<ITERATIONS;i++)
+	{
+		CMAPITimeZone::SetTicks(ullStart+(ULONGLONG)i*31*ullMinute/60, ftUTC);
+		FileTimeToSystemTime(&ftUTC, &tmUTC);
+		SystemTimeToTzSpecificLocalTime(NULL, &tmUTC, &tmLocal);
+		GetDateFormat(LOCALE_SYSTEM_DEFAULT, 0, &tmLocal, _T("MM/dd/yyyy"), szExpected, 128);
+		GetTimeFormat(LOCALE_SYSTEM_DEFAULT, 0, &tmLocal, _T("hh:mm tt"), szExpected, 128);
+	}
+	DWORD dwWindows=GetTickCount()-dwStart;
+
+	dwStart=GetTickCount();
+	for(i=0;i<ITERATIONS;i++)
+	{
+		CMAPITimeZone::SetTicks(ullStart+(ULONGLONG)i*31*ullMinute/60, ftUTC);
+		format.Format(timeZone, ftUTC, szDate, 128);
+	}
+	DWORD dwCached=GetTickCount()-dwStart;
+	PRINTF(_T("Date and time: %d checks failed, %d dates in %u ms with the Windows calls, %u ms cached\n"), nFailed, ITERATIONS, dwWindows, dwCached);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CMAPINotifyCoalescer is fed made up notifications through Add, no store is needed (only MAPI's allocator):
+//		-a modify is folded into a pending create, a delete drops a pending modify, a create and a delete
+//		 cancel out and a burst of modifies is delivered once, table notifications are kept in order
+//		-an item modified more often than the window is still delivered within dwMaxDelay of its first event,
+//		 a quiet one a window after it
+//		-Stop delivers what's pending and later notifications are passed straight through
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// what the callback saw, the first byte of each entry ID (0 without one) and when it came
+struct CoalesceRecorder
+{
+	CRITICAL_SECTION m_cs;
+	CArray<ULONG, ULONG> m_arEvents;
+	CArray<BYTE, BYTE> m_arIDs;
+	CArray<DWORD, DWORD> m_arTimes;
+	int m_nBatches;
+};
+
+LONG STDAPICALLTYPE CoalesceCallback(LPVOID lpvContext, ULONG cNotification, LPNOTIFICATION lpNotifications)
+{
+	CoalesceRecorder* pRecorder=(CoalesceRecorder*)lpvContext;
+	EnterCriticalSection(&pRecorder->m_cs);
+	for(ULONG i=0;i<cNotification;i++)
+	{
+		NOTIFICATION& notification=lpNotifications[i];
+		BOOL bObject=(notification.ulEventType!=fnevTableModified && notification.info.obj.cbEntryID);
+		pRecorder->m_arEvents.Add(notification.ulEventType);
+		pRecorder->m_arIDs.Add(bObject ? *(BYTE*)notification.info.obj.lpEntryID : (BYTE)0);
+		pRecorder->m_arTimes.Add(GetTickCount());
+	}
+	pRecorder->m_nBatches++;
+	LeaveCriticalSection(&pRecorder->m_cs);
+	return 0;
+}
+
+// an object notification for the entry ID starting with nID, or a table reload with no ID
+void AddTestNotification(CMAPINotifyCoalescer& coalescer, ULONG ulEventType, BYTE nID)
+{
+	BYTE entryID[24]={ nID };
+	NOTIFICATION notification;
+	memset(&notification, 0, sizeof(notification));
+	notification.ulEventType=ulEventType;
+	if(ulEventType==fnevTableModified)
+	{
+		notification.info.tab.ulTableEvent=TABLE_RELOAD;
+		notification.info.tab.propIndex.ulPropTag=PR_NULL;
+		notification.info.tab.propPrior.ulPropTag=PR_NULL;
+	}
+	else
+	{
+		notification.info.obj.cbEntryID=sizeof(entryID);
+		notification.info.obj.lpEntryID=(LPENTRYID)entryID;
+		notification.info.obj.ulObjType=MAPI_MESSAGE;
+	}
+	coalescer.Add(1, &notification);
+}
+
+void CoalesceTest()
+{
+	CoalesceRecorder recorder;
+	InitializeCriticalSection(&recorder.m_cs);
+	recorder.m_nBatches=0;
+
+	int i, nFailed=0;
+	CMAPINotifyCoalescer coalescer;
+	if(!coalescer.Start(CoalesceCallback, &recorder, 10000, 10000)) nFailed++;
+	AddTestNotification(coalescer, fnevObjectCreated, 'A');
+	AddTestNotification(coalescer, fnevObjectModified, 'A');
+	AddTestNotification(coalescer, fnevObjectCreated, 'B');
+	AddTestNotification(coalescer, fnevObjectModified, 'C');
+	AddTestNotification(coalescer, fnevTableModified, 0);
+	AddTestNotification(coalescer, fnevObjectDeleted, 'B');
+	AddTestNotification(coalescer, fnevObjectDeleted, 'C');
+	AddTestNotification(coalescer, fnevObjectModified, 'D');
+	AddTestNotification(coalescer, fnevObjectModified, 'D');
+	AddTestNotification(coalescer, fnevTableModified, 0);
+	AddTestNotification(coalescer, fnevObjectModified, 'A');
+
+	CCoalesceStats stats;
+	coalescer.GetStats(stats);
+	if(stats.m_nPending!=5 || recorder.m_nBatches) nFailed++;
+	coalescer.Flush();
+
+	// in the order each item first came in, B never shows up
+	ULONG ulEvents[]={ fnevObjectCreated, fnevTableModified, fnevObjectDeleted, fnevObjectModified, fnevTableModified };
+	BYTE nIDs[]={ 'A', 0, 'C', 'D', 0 };
+	if(recorder.m_nBatches!=1 || recorder.m_arEvents.GetSize()!=5) nFailed++;
+	for(i=0;i<recorder.m_arEvents.GetSize() && i<5;i++)
+	{
+		if(recorder.m_arEvents[i]!=ulEvents[i] || recorder.m_arIDs[i]!=nIDs[i]) nFailed++;
+	}
+	coalescer.GetStats(stats);
+	if(stats.m_ulReceived!=11 || stats.m_ulDelivered!=5 || stats.m_ulMerged!=4 || stats.m_ulCancelled!=2 || stats.m_nPending) nFailed++;
+
+	// E is modified every 20ms for a second against a 100ms window, F once.  E must come out every 300ms or so
+	const DWORD WINDOW=100, MAX_DELAY=300, SLACK=100;
+	recorder.m_arEvents.RemoveAll();
+	recorder.m_arIDs.RemoveAll();
+	recorder.m_arTimes.RemoveAll();
+	coalescer.SetWindow(WINDOW, MAX_DELAY);
+	DWORD dwStart=GetTickCount(), dwLast=dwStart;
+	AddTestNotification(coalescer, fnevObjectModified, 'F');
+	while(GetTickCount()-dwStart<1000)
+	{
+		AddTestNotification(coalescer, fnevObjectModified, 'E');
+		dwLast=GetTickCount();
+		Sleep(20);
+	}
+	Sleep(WINDOW+SLACK);
+
+	EnterCriticalSection(&recorder.m_cs);
+	int nE=0;
+	DWORD dwPrevious=dwStart;
+	for(i=0;i<recorder.m_arEvents.GetSize();i++)
+	{
+		DWORD dwTime=recorder.m_arTimes[i];
+		if(recorder.m_arIDs[i]=='F')
+		{
+			if(dwTime-dwStart<WINDOW || dwTime-dwStart>WINDOW+SLACK) nFailed++;
+			continue;
+		}
+		nE++;
+		if(dwTime-dwPrevious>MAX_DELAY+SLACK) nFailed++;
+		dwPrevious=dwTime;
+	}
+	LeaveCriticalSection(&recorder.m_cs);
+	coalescer.GetStats(stats);
+	if(nE<3 || dwPrevious-dwLast>WINDOW+SLACK || stats.m_nPending) nFailed++;
+
+	int nBatches=recorder.m_nBatches;
+	AddTestNotification(coalescer, fnevObjectModified, 'G');
+	coalescer.Stop();
+	if(recorder.m_nBatches!=nBatches+1 || recorder.m_arIDs[recorder.m_arIDs.GetSize()-1]!='G') nFailed++;
+	AddTestNotification(coalescer, fnevObjectModified, 'H');
+	if(recorder.m_nBatches!=nBatches+2 || recorder.m_arIDs[recorder.m_arIDs.GetSize()-1]!='H') nFailed++;
+
+	DeleteCriticalSection(&recorder.m_cs);
+	PRINTF(_T("Coalesce: %d checks failed, E delivered %d times\n"), nFailed, nE);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// CMAPILimiter only needs results fed to it, this checks the AIMD steps without a server:
+//		-calls returning quickly while every slot is in use raise the limit by one per limit's worth, up to the max
+//		-a throttled call drops it by 30%, once per round trip and never below the min
+//		-an average latency past the target drops it too, a MAPI_E_NOT_FOUND doesn't count towards the latency
+//		-ShouldRetry's delays stay under the doubling ceiling and it stops after the last retry
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// fills the free slots and then returns one with hr, so the call counts as made at the limit
+void LimiterCall(CMAPILimiter& limiter, DWORD dwLatency, HRESULT hr)
+{
+	while(limiter.GetInFlight()<limiter.GetLimit()) limiter.Acquire(0);
+	limiter.Release(dwLatency, hr);
+}
+
+void LimiterTest()
+{
+	int i, nFailed=0;
+	CMAPILimiter limiter(8, 4, 2);
+	for(i=0;i<4;i++) LimiterCall(limiter, 5, S_OK);
+	if(limiter.GetLimit()!=5) nFailed++;
+	for(i=0;i<5;i++) LimiterCall(limiter, 5, S_OK);
+	if(limiter.GetLimit()!=6) nFailed++;
+	for(i=0;i<100;i++) LimiterCall(limiter, 5, S_OK);
+	if(limiter.GetLimit()!=8) nFailed++;
+	while(limiter.GetInFlight()) limiter.Release(5, S_OK);
+
+	// 8 -> 5 -> 3 -> 2, the second throttled call in the same round trip is ignored
+	int nLimits[]={ 5, 3, 2, 2 };
+	for(i=0;i<sizeof(nLimits)/sizeof(int);i++)
+	{
+		Sleep(CMAPILimiter::MIN_LATENCY_TARGET+10);
+		LimiterCall(limiter, 5, MAPI_E_BUSY);
+		LimiterCall(limiter, 5, HRESULT_FROM_WIN32(RPC_S_SERVER_TOO_BUSY));
+		if(limiter.GetLimit()!=nLimits[i]) nFailed++;
+	}
+
+	CLimiterStats stats;
+	limiter.GetStats(stats);
+	DWORD dwAverageLatency=stats.m_dwAverageLatency;
+	LimiterCall(limiter, 5000, MAPI_E_NOT_FOUND);
+	limiter.GetStats(stats);
+	if(stats.m_dwAverageLatency!=dwAverageLatency || limiter.GetLimit()!=2) nFailed++;
+	if(stats.m_ulIncreases!=4 || stats.m_ulDecreases!=3 || stats.m_ulThrottled!=8) nFailed++;
+	while(limiter.GetInFlight()) limiter.Release(5, S_OK);
+
+	// the average moves an eighth of the way, so one 500ms call takes it from 5ms past a 50ms target
+	CMAPILimiter slow(8, 8);
+	slow.SetLatencyTarget(50);
+	LimiterCall(slow, 5, S_OK);
+	Sleep(CMAPILimiter::MIN_LATENCY_TARGET*5);
+	LimiterCall(slow, 500, S_OK);
+	slow.GetStats(stats);
+	if(slow.GetLimit()!=5 || stats.m_ulSlow!=1) nFailed++;
+	while(slow.GetInFlight()) slow.Release(5, S_OK);
+
+	// full jitter: anywhere from 0 to the ceiling, so over 1000 tries both halves come up
+	DWORD dwDelay;
+	for(int nAttempt=0;nAttempt<CMAPILimiter::DEFAULT_MAX_RETRIES;nAttempt++)
+	{
+		DWORD dwCeiling=min((DWORD)CMAPILimiter::DEFAULT_BASE_BACKOFF<<nAttempt, (DWORD)CMAPILimiter::DEFAULT_MAX_BACKOFF);
+		DWORD dwMin=MAXDWORD, dwMax=0;
+		for(i=0;i<1000;i++)
+		{
+			if(!limiter.ShouldRetry(MAPI_E_TIMEOUT, nAttempt, dwDelay) || dwDelay>dwCeiling) nFailed++;
+			dwMin=min(dwMin, dwDelay);
+			dwMax=max(dwMax, dwDelay);
+		}
+		if(dwMin>dwCeiling/2 || dwMax<dwCeiling/2) nFailed++;
+	}
+	if(limiter.ShouldRetry(MAPI_E_TIMEOUT, CMAPILimiter::DEFAULT_MAX_RETRIES, dwDelay) || dwDelay) nFailed++;
+	if(limiter.ShouldRetry(S_OK, 0, dwDelay) || limiter.ShouldRetry(MAPI_E_NOT_FOUND, 0, dwDelay)) nFailed++;
+
+	limiter.SetBackoff(20, 100, 1000);
+	for(i=0;i<1000;i++)
+	{
+		if(!limiter.ShouldRetry(MAPI_E_BUSY, 19, dwDelay) || dwDelay>1000) nFailed++;
+	}
+	limiter.SetBackoff(0, 100, 1000);
+	if(limiter.ShouldRetry(MAPI_E_BUSY, 0, dwDelay)) nFailed++;
+
+	limiter.GetStats(stats);
+	if(stats.m_ulRetries!=CMAPILimiter::DEFAULT_MAX_RETRIES*1000+1000) nFailed++;
+	PRINTF(_T("Limiter: %d checks failed\n"), nFailed);
+}
+
 // this example works on unread messages, so send yourself a message and don't open it before trying this test
 // If you have "autopreview" set turn it off to run this sample, you may want to run step by step as well.
 void main(int argc, char* argv[])
@@ -480,6 +1437,17 @@ void main(int argc, char* argv[])
 // 	CreateContactTest(mapi);
 // 	ContactSubFolderTest(mapi);
 // 	AppointmentTest(mapi);
+//	HTMLTextTest();
+//	ValidStringTest();
+//	RTFTest(mapi);
+//	EntryIDTest();
+//	CompareEntryIDTest();
+//	NormalizeTest();
+//	FreeBusyTest();
+//	ICalendarTest();
+//	DateTimeTest();
+//	CoalesceTest();
+//	LimiterTest();
 
 	mapi.Logout();
 	CMAPIEx::Term();
@@ -0,0 +1,400 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: TestRecurrence.cpp
+// Description: Tests CRecurrencePattern and CRecurrenceExpander on recurrence blobs, builds anywhere (see Makefile)
+//
+// Copyright (C) 2005-2010, Noel Dillabough
+//
+// This source code is free to use and modify provided this notice remains intact and that any enhancements
+// or bug fixes are posted to the CodeProject page hosting this class for the community to benefit.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../MAPIEx/RecurrencePattern.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+int g_nFailed=0;
+
+#define CHECK(x) if(!(x)) { printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #x); g_nFailed++; }
+
+// The blobs below are laid out the way Outlook writes PidLidAppointmentRecur (WriterVersion2 0x3009) and
+// PidLidTimeZoneStruct.  Eastern is UTC-5 with daylight time from the 2nd Sunday of March to the 1st Sunday
+// of November, Sydney is UTC+10 with daylight time from the 1st Sunday of October to the 1st Sunday of April.
+//
+// WeeklyRecur: Mon, Wed and Fri 09:00-10:00 from 2010-03-01, no end
+// DailyRecur: 08:00-08:30 for 10 days from 2010-06-01 (UTC), the 3rd deleted, the 5th moved to 15:00-16:00
+// with a new subject, location and busy status (ANSI and UTF-16), the 7th moved to 2010-06-08 07:00-07:30
+// MonthlyRecur: the last Friday of the month 18:00-19:00 from 2010-01-01 to 2010-12-31
+
+static const unsigned char EasternTimeZone[]=
+{
+	0x2C, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC4, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+	0x0B, 0x00, 0x00, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const unsigned char SydneyTimeZone[]=
+{
+	0xA8, 0xFD, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xC4, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+	0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const unsigned char WeeklyRecur[]=
+{
+	0x04, 0x30, 0x04, 0x30, 0x0B, 0x20, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2A, 0x00, 0x00, 0x00, 0x23, 0x20, 0x00, 0x00, 0x0A, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0xA8,
+	0xD3, 0x0C, 0xDF, 0x80, 0xE9, 0x5A, 0x06, 0x30, 0x00, 0x00, 0x09, 0x30, 0x00, 0x00, 0x1C, 0x02,
+	0x00, 0x00, 0x58, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const unsigned char DailyRecur[]=
+{
+	0x04, 0x30, 0x04, 0x30, 0x0A, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xA0, 0x05,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x20, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0xA0, 0xB9, 0xD5, 0x0C, 0xE0, 0xC4, 0xD5, 0x0C, 0x20, 0xD0,
+	0xD5, 0x0C, 0x02, 0x00, 0x00, 0x00, 0xE0, 0xC4, 0xD5, 0x0C, 0x20, 0xD0, 0xD5, 0x0C, 0x60, 0xAE,
+	0xD5, 0x0C, 0x00, 0xE1, 0xD5, 0x0C, 0x06, 0x30, 0x00, 0x00, 0x09, 0x30, 0x00, 0x00, 0xE0, 0x01,
+	0x00, 0x00, 0xFE, 0x01, 0x00, 0x00, 0x02, 0x00, 0x64, 0xC8, 0xD5, 0x0C, 0xA0, 0xC8, 0xD5, 0x0C,
+	0xC0, 0xC6, 0xD5, 0x0C, 0x31, 0x00, 0x06, 0x00, 0x05, 0x00, 0x4D, 0x6F, 0x76, 0x65, 0x64, 0x07,
+	0x00, 0x06, 0x00, 0x52, 0x6F, 0x6F, 0x6D, 0x20, 0x32, 0x01, 0x00, 0x00, 0x00, 0x64, 0xD7, 0xD5,
+	0x0C, 0x82, 0xD7, 0xD5, 0x0C, 0x00, 0xD2, 0xD5, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0xC8, 0xD5, 0x0C, 0xA0,
+	0xC8, 0xD5, 0x0C, 0xC0, 0xC6, 0xD5, 0x0C, 0x0D, 0x00, 0x56, 0x00, 0x65, 0x00, 0x72, 0x00, 0x73,
+	0x00, 0x63, 0x00, 0x68, 0x00, 0x6F, 0x00, 0x62, 0x00, 0x65, 0x00, 0x6E, 0x00, 0x20, 0x00, 0xFC,
+	0x00, 0xAC, 0x20, 0x06, 0x00, 0x52, 0x00, 0x61, 0x00, 0x75, 0x00, 0x6D, 0x00, 0x20, 0x00, 0x32,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const unsigned char MonthlyRecur[]=
+{
+	0x04, 0x30, 0x04, 0x30, 0x0C, 0x20, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x21, 0x20,
+	0x00, 0x00, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x5D, 0xD2, 0x0C, 0x80, 0x5C, 0xDA, 0x0C, 0x06, 0x30, 0x00, 0x00, 0x09, 0x30,
+	0x00, 0x00, 0x38, 0x04, 0x00, 0x00, 0x74, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00,
+};
+
+// the bytes of DailyRecur before the optional ExtendedExceptions, shorter blobs must fail to parse
+const uint32_t DailyRecurRequired=139;
+
+// UTC minutes since 1601
+uint32_t Minutes(int nYear, int nMonth, int nDay, int nHour=0, int nMinute=0)
+{
+	return (uint32_t)CRecurrencePattern::DaysFromDate(nYear, nMonth, nDay)*CRecurrencePattern::MINUTES_PER_DAY+nHour*60+nMinute;
+}
+
+// expands pattern over the window and compares with arExpected (start, end, exception index), nExpected rows
+void Expect(const CRecurrencePattern& pattern, uint32_t dwWindowStart, uint32_t dwWindowEnd, const uint32_t (*arExpected)[3], int nExpected, int nLine)
+{
+	CRecurrenceExpander expander;
+	CRecurrenceInstance instance;
+	int nCount=0;
+	if(!expander.Begin(pattern, dwWindowStart, dwWindowEnd))
+	{
+		printf("line %d: Begin failed\n", nLine);
+		g_nFailed++;
+		return;
+	}
+	while(expander.Next(instance))
+	{
+		if(nCount<nExpected && (instance.m_dwStart!=arExpected[nCount][0] || instance.m_dwEnd!=arExpected[nCount][1] || instance.m_nException!=(int)arExpected[nCount][2]))
+		{
+			printf("line %d: occurrence %d is %u-%u (%d), expected %u-%u (%d)\n", nLine, nCount, instance.m_dwStart, instance.m_dwEnd,
+				instance.m_nException, arExpected[nCount][0], arExpected[nCount][1], (int)arExpected[nCount][2]);
+			g_nFailed++;
+		}
+		nCount++;
+	}
+	if(nCount!=nExpected)
+	{
+		printf("line %d: %d occurrences, expected %d\n", nLine, nCount, nExpected);
+		g_nFailed++;
+	}
+}
+
+#define EXPECT(pattern, start, end, expected) Expect(pattern, start, end, expected, sizeof(expected)/sizeof(expected[0]), __LINE__)
+
+const uint32_t NoException=(uint32_t)-1;
+
+// the switch to daylight time on 2010-03-14 moves 09:00 from 14:00 to 13:00 UTC, the switch back on
+// 2030-11-03 is reached without expanding the 20 years in between
+void WeeklyTest()
+{
+	CRecurrencePattern pattern;
+	CHECK(pattern.SetTimeZone(EasternTimeZone, sizeof(EasternTimeZone)));
+	CHECK(pattern.Parse(WeeklyRecur, sizeof(WeeklyRecur)));
+	CHECK(pattern.m_wPatternType==CRecurrencePattern::PATTERN_WEEK && pattern.m_dwDayMask==0x2A);
+	CHECK(!pattern.HasEndDate());
+
+	const uint32_t March[][3]=
+	{
+		{ Minutes(2010, 3, 8, 14), Minutes(2010, 3, 8, 15), NoException },
+		{ Minutes(2010, 3, 10, 14), Minutes(2010, 3, 10, 15), NoException },
+		{ Minutes(2010, 3, 12, 14), Minutes(2010, 3, 12, 15), NoException },
+		{ Minutes(2010, 3, 15, 13), Minutes(2010, 3, 15, 14), NoException },
+		{ Minutes(2010, 3, 17, 13), Minutes(2010, 3, 17, 14), NoException },
+		{ Minutes(2010, 3, 19, 13), Minutes(2010, 3, 19, 14), NoException },
+	};
+	EXPECT(pattern, Minutes(2010, 3, 8), Minutes(2010, 3, 20), March);
+
+	// an occurrence already under way at the start of the window is listed
+	EXPECT(pattern, Minutes(2010, 3, 8, 14, 30), Minutes(2010, 3, 20), March);
+
+	const uint32_t November[][3]=
+	{
+		{ Minutes(2030, 11, 1, 13), Minutes(2030, 11, 1, 14), NoException },
+		{ Minutes(2030, 11, 4, 14), Minutes(2030, 11, 4, 15), NoException },
+		{ Minutes(2030, 11, 6, 14), Minutes(2030, 11, 6, 15), NoException },
+	};
+	EXPECT(pattern, Minutes(2030, 11, 1), Minutes(2030, 11, 8), November);
+
+	// without the time zone the blob's times are UTC
+	pattern.m_bTimeZone=false;
+	const uint32_t Local[][3]=
+	{
+		{ Minutes(2010, 3, 15, 9), Minutes(2010, 3, 15, 10), NoException },
+	};
+	EXPECT(pattern, Minutes(2010, 3, 15), Minutes(2010, 3, 16), Local);
+}
+
+// deleted and moved occurrences, the moved ones come back from the exceptions in start order
+void DailyTest()
+{
+	CRecurrencePattern pattern;
+	CHECK(pattern.Parse(DailyRecur, sizeof(DailyRecur)));
+	CHECK(pattern.m_arDeletedDates.size()==3 && pattern.m_arModifiedDates.size()==2);
+	CHECK(pattern.m_arExceptions.size()==2 && pattern.HasEndDate());
+	if(pattern.m_arExceptions.size()!=2) return;
+
+	const CRecurrencePatternException& moved=pattern.m_arExceptions[0];
+	const uint16_t SubjectW[]={ 'V', 'e', 'r', 's', 'c', 'h', 'o', 'b', 'e', 'n', ' ', 0xFC, 0x20AC };
+	CHECK(moved.m_strSubject=="Moved" && moved.m_strLocation=="Room 2" && moved.m_nBusyStatus==1);
+	CHECK(moved.m_bExtended && moved.m_arSubjectW.size()==13 && !memcmp(&moved.m_arSubjectW[0], SubjectW, sizeof(SubjectW)));
+	CHECK(moved.m_arLocationW.size()==6);
+	CHECK(pattern.m_arExceptions[1].m_nBusyStatus==-1 && !pattern.m_arExceptions[1].m_bExtended);
+
+	const uint32_t June[][3]=
+	{
+		{ Minutes(2010, 6, 1, 8), Minutes(2010, 6, 1, 8, 30), NoException },
+		{ Minutes(2010, 6, 2, 8), Minutes(2010, 6, 2, 8, 30), NoException },
+		{ Minutes(2010, 6, 4, 8), Minutes(2010, 6, 4, 8, 30), NoException },
+		{ Minutes(2010, 6, 5, 15), Minutes(2010, 6, 5, 16), 0 },
+		{ Minutes(2010, 6, 6, 8), Minutes(2010, 6, 6, 8, 30), NoException },
+		{ Minutes(2010, 6, 8, 7), Minutes(2010, 6, 8, 7, 30), 1 },
+		{ Minutes(2010, 6, 8, 8), Minutes(2010, 6, 8, 8, 30), NoException },
+		{ Minutes(2010, 6, 9, 8), Minutes(2010, 6, 9, 8, 30), NoException },
+		{ Minutes(2010, 6, 10, 8), Minutes(2010, 6, 10, 8, 30), NoException },
+	};
+	EXPECT(pattern, Minutes(2010, 1, 1), Minutes(2011, 1, 1), June);
+	Expect(pattern, Minutes(2010, 6, 8, 7, 15), Minutes(2010, 6, 8, 8, 15), June+5, 2, __LINE__);
+
+	// counted from the start when there's no end date, deleted dates count
+	pattern.m_dwEndDate=CRecurrencePattern::END_DATE_NEVER;
+	EXPECT(pattern, Minutes(2010, 1, 1), Minutes(2011, 1, 1), June);
+
+	// every truncation either fails or drops the ExtendedExceptions, never reads past the end
+	for(uint32_t cb=0;cb<sizeof(DailyRecur);cb++)
+	{
+		uint8_t* pData=new uint8_t[cb+1];
+		memcpy(pData, DailyRecur, cb);
+		bool bParsed=pattern.Parse(pData, cb);
+		delete [] pData;
+		if(bParsed!=(cb>=DailyRecurRequired))
+		{
+			printf("DailyRecur truncated to %u bytes %s\n", cb, bParsed ? "parsed" : "failed");
+			g_nFailed++;
+		}
+	}
+}
+
+// the last Friday of each month in the southern hemisphere, daylight time ends in April and starts in October
+void MonthlyTest()
+{
+	CRecurrencePattern pattern;
+	CHECK(pattern.SetTimeZone(SydneyTimeZone, sizeof(SydneyTimeZone)));
+	CHECK(pattern.Parse(MonthlyRecur, sizeof(MonthlyRecur)));
+
+	const uint32_t Year[][3]=
+	{
+		{ Minutes(2010, 1, 29, 7), Minutes(2010, 1, 29, 8), NoException },
+		{ Minutes(2010, 2, 26, 7), Minutes(2010, 2, 26, 8), NoException },
+		{ Minutes(2010, 3, 26, 7), Minutes(2010, 3, 26, 8), NoException },
+		{ Minutes(2010, 4, 30, 8), Minutes(2010, 4, 30, 9), NoException },
+		{ Minutes(2010, 5, 28, 8), Minutes(2010, 5, 28, 9), NoException },
+		{ Minutes(2010, 6, 25, 8), Minutes(2010, 6, 25, 9), NoException },
+		{ Minutes(2010, 7, 30, 8), Minutes(2010, 7, 30, 9), NoException },
+		{ Minutes(2010, 8, 27, 8), Minutes(2010, 8, 27, 9), NoException },
+		{ Minutes(2010, 9, 24, 8), Minutes(2010, 9, 24, 9), NoException },
+		{ Minutes(2010, 10, 29, 7), Minutes(2010, 10, 29, 8), NoException },
+		{ Minutes(2010, 11, 26, 7), Minutes(2010, 11, 26, 8), NoException },
+		{ Minutes(2010, 12, 31, 7), Minutes(2010, 12, 31, 8), NoException },
+	};
+	EXPECT(pattern, Minutes(2009, 1, 1), Minutes(2020, 1, 1), Year);
+
+	uint32_t dwDaylight, dwStandard;
+	CHECK(pattern.GetTransitions(2010, dwDaylight, dwStandard));
+	CHECK(dwDaylight==Minutes(2010, 10, 3, 2) && dwStandard==Minutes(2010, 4, 4, 3));
+}
+
+// Write gives back the blobs Parse read, and what ParseRule builds survives a Write and Parse
+void WriteTest()
+{
+	const unsigned char* pBlobs[]={ WeeklyRecur, DailyRecur, MonthlyRecur };
+	const uint32_t cbBlobs[]={ sizeof(WeeklyRecur), sizeof(DailyRecur), sizeof(MonthlyRecur) };
+	CRecurrencePattern pattern, copy;
+	std::vector<uint8_t> arData;
+	for(int i=0;i<3;i++)
+	{
+		CHECK(pattern.Parse(pBlobs[i], cbBlobs[i]));
+		pattern.Write(arData);
+		CHECK(arData.size()==cbBlobs[i] && !memcmp(&arData[0], pBlobs[i], cbBlobs[i]));
+	}
+
+	CHECK(!pattern.WriteTimeZone(arData) && arData.empty());
+	CHECK(pattern.SetTimeZone(EasternTimeZone, sizeof(EasternTimeZone)));
+	CHECK(pattern.WriteTimeZone(arData));
+	CHECK(arData.size()==sizeof(EasternTimeZone) && !memcmp(&arData[0], EasternTimeZone, sizeof(EasternTimeZone)));
+
+	// exceptions without the UTF-16 strings get them from the ANSI ones, only ASCII is widened
+	CHECK(pattern.Parse(DailyRecur, sizeof(DailyRecur)));
+	pattern.m_arExceptions[0].m_bExtended=false;
+	pattern.m_arExceptions[0].m_strLocation="Room \xE9";
+	pattern.Write(arData);
+	CHECK(copy.Parse(&arData[0], (uint32_t)arData.size()) && copy.m_arExceptions.size()==2);
+	if(copy.m_arExceptions.size()==2)
+	{
+		const CRecurrencePatternException& moved=copy.m_arExceptions[0];
+		CHECK(moved.m_bExtended && moved.m_arSubjectW.size()==5 && moved.m_arSubjectW[0]=='M' && moved.m_strLocation=="Room \xE9");
+		CHECK(moved.m_arLocationW.size()==6 && moved.m_arLocationW[4]==' ' && moved.m_arLocationW[5]=='?');
+	}
+
+	CHECK(pattern.ParseRule("FREQ=MONTHLY;BYDAY=-1FR;UNTIL=20101231T235959Z", Minutes(2010, 1, 1, 18), Minutes(2010, 1, 1, 19)));
+	pattern.DeleteOccurrence(Minutes(2010, 3, 26, 18));
+	pattern.Write(arData);
+	CHECK(copy.Parse(&arData[0], (uint32_t)arData.size()));
+	CHECK(copy.m_wPatternType==pattern.m_wPatternType && copy.m_dwDayMask==pattern.m_dwDayMask && copy.m_dwDayOfMonth==pattern.m_dwDayOfMonth);
+	CHECK(copy.m_dwStartDate==pattern.m_dwStartDate && copy.m_dwEndDate==pattern.m_dwEndDate && copy.m_dwFirstDateTime==pattern.m_dwFirstDateTime);
+	CHECK(copy.m_arDeletedDates.size()==1 && copy.m_arDeletedDates[0]==Minutes(2010, 3, 26));
+}
+
+// RRULEs as Outlook stores them, the first occurrence and the end are worked out from DTSTART
+void RuleTest()
+{
+	CRecurrencePattern pattern;
+	CHECK(pattern.SetTimeZone(EasternTimeZone, sizeof(EasternTimeZone)));
+	CHECK(pattern.ParseRule("FREQ=WEEKLY;WKST=SU;BYDAY=MO,WE,FR", Minutes(2010, 3, 1, 9), Minutes(2010, 3, 1, 10)));
+	CHECK(pattern.m_wFrequency==CRecurrencePattern::FREQUENCY_WEEKLY && pattern.m_wPatternType==CRecurrencePattern::PATTERN_WEEK);
+	CHECK(pattern.m_dwDayMask==0x2A && pattern.m_dwPeriod==1 && pattern.m_dwFirstDOW==0 && pattern.m_dwEndType==CRecurrencePattern::END_NEVER);
+	CHECK(pattern.m_dwStartTimeOffset==540 && pattern.m_dwEndTimeOffset==600 && !pattern.HasEndDate());
+
+	const uint32_t March[][3]=
+	{
+		{ Minutes(2010, 3, 12, 14), Minutes(2010, 3, 12, 15), NoException },
+		{ Minutes(2010, 3, 15, 13), Minutes(2010, 3, 15, 14), NoException },
+	};
+	EXPECT(pattern, Minutes(2010, 3, 11), Minutes(2010, 3, 16), March);
+
+	// UNTIL in UTC is compared with the UTC start, 2010-12-31 18:00 in Sydney is 07:00 UTC
+	CHECK(pattern.SetTimeZone(SydneyTimeZone, sizeof(SydneyTimeZone)));
+	CHECK(pattern.ParseRule("FREQ=MONTHLY;BYDAY=-1FR;UNTIL=20101231T070000Z", Minutes(2010, 1, 29, 18), Minutes(2010, 1, 29, 19)));
+	CHECK(pattern.m_wPatternType==CRecurrencePattern::PATTERN_MONTH_NTH && pattern.m_dwDayMask==0x20 && pattern.m_dwDayOfMonth==5);
+	CHECK(pattern.m_dwEndType==CRecurrencePattern::END_AFTER_DATE && pattern.m_dwOccurrenceCount==12);
+	CHECK(pattern.m_dwEndDate==Minutes(2010, 12, 31) && pattern.m_dwFirstDateTime==0);
+	CHECK(pattern.ParseRule("FREQ=MONTHLY;BYDAY=-1FR;UNTIL=20101231T065959Z", Minutes(2010, 1, 29, 18), Minutes(2010, 1, 29, 19)));
+	CHECK(pattern.m_dwOccurrenceCount==11 && pattern.m_dwEndDate==Minutes(2010, 11, 26));
+
+	// a DTSTART that doesn't match moves to the first occurrence, every other week counts from its week
+	pattern.m_bTimeZone=false;
+	CHECK(pattern.ParseRule("FREQ=WEEKLY;INTERVAL=2;BYDAY=MO;COUNT=3", Minutes(2010, 3, 3, 9), Minutes(2010, 3, 3, 10)));
+	CHECK(pattern.m_dwStartDate==Minutes(2010, 3, 15) && pattern.m_dwEndDate==Minutes(2010, 4, 12));
+	CHECK(pattern.m_dwEndType==CRecurrencePattern::END_AFTER_COUNT && pattern.m_dwOccurrenceCount==3);
+
+	// deleted dates still count towards COUNT
+	CHECK(pattern.ParseRule("FREQ=DAILY;COUNT=10", Minutes(2010, 6, 1, 8), Minutes(2010, 6, 1, 8, 30)));
+	CHECK(pattern.m_wPatternType==CRecurrencePattern::PATTERN_DAY && pattern.m_dwPeriod==CRecurrencePattern::MINUTES_PER_DAY);
+	CHECK(pattern.m_dwEndDate==Minutes(2010, 6, 10) && pattern.m_dwFirstDateTime==0);
+	pattern.DeleteOccurrence(Minutes(2010, 6, 3, 8));
+	pattern.DeleteOccurrence(Minutes(2010, 6, 3, 8));
+	CHECK(pattern.m_arDeletedDates.size()==1);
+	CRecurrenceExpander expander;
+	CRecurrenceInstance instance;
+	int nCount=0;
+	expander.Begin(pattern, Minutes(2010, 1, 1), Minutes(2011, 1, 1));
+	while(expander.Next(instance)) nCount++;
+	CHECK(nCount==9);
+
+	// Outlook's every weekday, the 30th or last day of the month and a yearly pattern in March
+	CHECK(pattern.ParseRule("FREQ=DAILY;BYDAY=MO,TU,WE,TH,FR", Minutes(2010, 3, 1, 9), Minutes(2010, 3, 1, 10)));
+	CHECK(pattern.m_wFrequency==CRecurrencePattern::FREQUENCY_DAILY && pattern.m_wPatternType==CRecurrencePattern::PATTERN_WEEK && pattern.m_dwDayMask==0x3E);
+	CHECK(pattern.ParseRule("FREQ=MONTHLY;BYMONTHDAY=28,29,30;BYSETPOS=-1", Minutes(2010, 1, 30, 9), Minutes(2010, 1, 30, 10)));
+	CHECK(pattern.m_wPatternType==CRecurrencePattern::PATTERN_MONTH && pattern.m_dwDayOfMonth==30);
+	CHECK(pattern.ParseRule("freq=yearly;bymonth=3;count=2", Minutes(2010, 3, 9, 9), Minutes(2010, 3, 9, 10)));
+	CHECK(pattern.m_wFrequency==CRecurrencePattern::FREQUENCY_YEARLY && pattern.m_dwPeriod==12 && pattern.m_dwDayOfMonth==9);
+	CHECK(pattern.m_dwEndDate==Minutes(2011, 3, 9) && pattern.m_dwFirstDateTime==Minutes(1601, 3, 1));
+
+	// rules Outlook can't store
+	const char* szUnsupported[]=
+	{
+		"FREQ=HOURLY", "FREQ=WEEKLY;BYHOUR=9", "FREQ=MONTHLY;BYDAY=MO", "FREQ=MONTHLY;BYDAY=1MO,3MO", "FREQ=MONTHLY;BYDAY=5MO",
+		"FREQ=YEARLY;BYMONTH=1,2", "FREQ=YEARLY;BYMONTH=4", "FREQ=DAILY;INTERVAL=2;BYDAY=MO", "FREQ=DAILY;COUNT=2;UNTIL=20100101",
+		"FREQ=MONTHLY;BYMONTHDAY=30,31;BYSETPOS=-1", "FREQ=DAILY;UNTIL=20090101", "FREQ=WEEKLY;BYDAY=XX", "FREQ=DAILY;INTERVAL=0",
+	};
+	for(int i=0;i<(int)(sizeof(szUnsupported)/sizeof(szUnsupported[0]));i++)
+	{
+		if(pattern.ParseRule(szUnsupported[i], Minutes(2010, 3, 9, 9), Minutes(2010, 3, 9, 10)))
+		{
+			printf("ParseRule accepted %s\n", szUnsupported[i]);
+			g_nFailed++;
+		}
+	}
+}
+
+// a week at a time over 30 years of the weekly series, the way free/busy and the calendar index use it
+void ThroughputTest()
+{
+	CRecurrencePattern pattern;
+	pattern.SetTimeZone(EasternTimeZone, sizeof(EasternTimeZone));
+	pattern.Parse(WeeklyRecur, sizeof(WeeklyRecur));
+
+	const int WEEKS=30*52, ITERATIONS=50;
+	const uint32_t dwWeek=7*CRecurrencePattern::MINUTES_PER_DAY;
+	uint32_t dwFirst=Minutes(2010, 3, 1);
+	int nOccurrences=0;
+	clock_t start=clock();
+	for(int i=0;i<ITERATIONS;i++)
+	{
+		for(int nWeek=0;nWeek<WEEKS;nWeek++)
+		{
+			CRecurrenceExpander expander;
+			CRecurrenceInstance instance;
+			expander.Begin(pattern, dwFirst+nWeek*dwWeek, dwFirst+(nWeek+1)*dwWeek);
+			while(expander.Next(instance)) nOccurrences++;
+		}
+	}
+	double dElapsed=(double)(clock()-start)/CLOCKS_PER_SEC;
+	if(dElapsed<0.001) dElapsed=0.001;
+
+	// 3 a week, plus the ones just before a window that end inside it (none here)
+	CHECK(nOccurrences==ITERATIONS*WEEKS*3);
+	printf("Throughput: %d windows, %d occurrences in %.3f s (%.0f windows/s)\n", ITERATIONS*WEEKS, nOccurrences, dElapsed, ITERATIONS*WEEKS/dElapsed);
+}
+
+int main()
+{
+	WeeklyTest();
+	DailyTest();
+	MonthlyTest();
+	WriteTest();
+	RuleTest();
+	ThroughputTest();
+	printf("%s: %d failed\n", g_nFailed ? "FAILED" : "PASSED", g_nFailed);
+	return g_nFailed ? 1 : 0;
+}